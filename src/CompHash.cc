@@ -10,9 +10,12 @@
 #include "Reporter.h"
 #include "Func.h"
 
+#include <cstring>
 #include <vector>
 #include <map>
 
+#include "3rdparty/doctest.h"
+
 CompositeHash::CompositeHash(IntrusivePtr<TypeList> composite_type)
 	: type(std::move(composite_type))
 	{
@@ -47,25 +50,58 @@ CompositeHash::CompositeHash(IntrusivePtr<TypeList> composite_type)
 		// via the singleton later.
 		singleton_tag = (*type->Types())[0]->InternalType();
 		size = 0;
-		key = nullptr;
 		}
 
 	else
 		{
 		size = ComputeKeySize(nullptr, true, true);
 
-		if ( size > 0 )
-			// Fixed size.  Make sure what we get is fully aligned.
-			key = reinterpret_cast<char*>
-				(new double[size/sizeof(double) + 1]);
-		else
-			key = nullptr;
+		if ( size > 0 && ! is_complex_type )
+			ComputeLayout();
 		}
 	}
 
-CompositeHash::~CompositeHash()
+void CompositeHash::ComputeLayout()
 	{
-	delete [] key;
+	int offset = 0;
+
+	for ( const auto& t : *type->Types() )
+		{
+		unsigned int align;
+		int width;
+
+		switch ( t->InternalType() ) {
+		case TYPE_INTERNAL_INT:
+		case TYPE_INTERNAL_UNSIGNED:
+			align = width = sizeof(bro_int_t);
+			break;
+
+		case TYPE_INTERNAL_DOUBLE:
+			align = width = sizeof(double);
+			break;
+
+		case TYPE_INTERNAL_ADDR:
+			align = sizeof(uint32_t);
+			width = 4 * sizeof(uint32_t);
+			break;
+
+		case TYPE_INTERNAL_SUBNET:
+			align = sizeof(uint32_t);
+			width = 5 * sizeof(uint32_t);
+			break;
+
+		default:
+			layout.clear();
+			return;
+		}
+
+		offset = SizeAlign(offset, align) - align;
+		layout.push_back({t->InternalType(), offset});
+		offset += width;
+		}
+
+	if ( offset != size )
+		reporter->InternalError("key layout mismatch in CompositeHash::ComputeLayout");
 	}
 
 // Computes the piece of the hash for Val*, returning the new kp.
@@ -334,12 +370,23 @@ char* CompositeHash::SingleValHash(bool type_check, char* kp0,
 
 
 HashKey* CompositeHash::ComputeHash(const Val* v, bool type_check) const
+	{
+	HashKey* k = new HashKey();
+
+	if ( ComputeHash(v, type_check, k) )
+		return k;
+
+	delete k;
+	return nullptr;
+	}
+
+bool CompositeHash::ComputeHash(const Val* v, bool type_check, HashKey* k) const
 	{
 	if ( ! v )
 		reporter->InternalError("null value given to CompositeHash::ComputeHash");
 
 	if ( is_singleton )
-		return ComputeSingletonHash(v, type_check);
+		return ComputeSingletonHash(v, type_check, k);
 
 	if ( is_complex_type && v->Type()->Tag() != TYPE_LIST )
 		{
@@ -351,74 +398,173 @@ HashKey* CompositeHash::ComputeHash(const Val* v, bool type_check) const
 		Val* ncv = (Val*) v;
 		ncv->Ref();
 		lv.Append(ncv);
-	        HashKey* hk = ComputeHash(&lv, type_check);
-		return hk;
+		return ComputeHash(&lv, type_check, k);
 		}
 
-	char* k = key;
+	if ( ! layout.empty() )
+		return ComputeLayoutHash(v, type_check, k);
 
-	if ( ! k )
+	int sz = size;
+
+	if ( ! sz )
 		{
-		int sz = ComputeKeySize(v, type_check, false);
+		sz = ComputeKeySize(v, type_check, false);
 		if ( sz == 0 )
-			return nullptr;
+			return false;
 
-		k = reinterpret_cast<char*>(new double[sz/sizeof(double) + 1]);
 		type_check = false;	// no need to type-check again.
 		}
 
 	const type_list* tl = type->Types();
 
 	if ( type_check && v->Type()->Tag() != TYPE_LIST )
-		return nullptr;
+		return false;
 
 	const val_list* vl = v->AsListVal()->Vals();
 	if ( type_check && vl->length() != tl->length() )
-		return nullptr;
+		return false;
+
+	char* kp0 = static_cast<char*>(k->Reserve(sz));
+	char* kp = kp0;
 
-	char* kp = k;
 	loop_over_list(*tl, i)
 		{
 		kp = SingleValHash(type_check, kp, (*tl)[i], (*vl)[i], false);
 		if ( ! kp )
-			return nullptr;
+			return false;
+		}
+
+	k->Seal(kp - kp0);
+	return true;
+	}
+
+bool CompositeHash::ComputeLayoutHash(const Val* v, bool type_check, HashKey* k) const
+	{
+	if ( type_check && v->Type()->Tag() != TYPE_LIST )
+		return false;
+
+	const val_list* vl = v->AsListVal()->Vals();
+	if ( type_check && vl->length() != int(layout.size()) )
+		return false;
+
+	char* kp = static_cast<char*>(k->Reserve(size));
+
+	// Zero the alignment padding.
+	memset(kp, 0, size);
+
+	for ( size_t i = 0; i < layout.size(); ++i )
+		{
+		const Val* vi = (*vl)[i];
+		const KeyField& f = layout[i];
+
+		if ( type_check && vi->Type()->InternalType() != f.tag )
+			return false;
+
+		switch ( f.tag ) {
+		case TYPE_INTERNAL_INT:
+			{
+			bro_int_t i = vi->ForceAsInt();
+			memcpy(kp + f.offset, &i, sizeof(i));
+			}
+			break;
+
+		case TYPE_INTERNAL_UNSIGNED:
+			{
+			bro_uint_t u = vi->ForceAsUInt();
+			memcpy(kp + f.offset, &u, sizeof(u));
+			}
+			break;
+
+		case TYPE_INTERNAL_DOUBLE:
+			{
+			double d = vi->InternalDouble();
+			memcpy(kp + f.offset, &d, sizeof(d));
+			}
+			break;
+
+		case TYPE_INTERNAL_ADDR:
+			vi->AsAddr().CopyIPv6(reinterpret_cast<uint32_t*>(kp + f.offset));
+			break;
+
+		case TYPE_INTERNAL_SUBNET:
+			{
+			uint32_t* sp = reinterpret_cast<uint32_t*>(kp + f.offset);
+			vi->AsSubNet().Prefix().CopyIPv6(sp);
+			sp[4] = vi->AsSubNet().Length();
+			}
+			break;
+
+		default:
+			reporter->InternalError("bad layout type in CompositeHash::ComputeLayoutHash");
+		}
 		}
 
-	return new HashKey((k == key), (void*) k, kp - k);
+	k->Seal(size);
+	return true;
 	}
 
-HashKey* CompositeHash::ComputeSingletonHash(const Val* v, bool type_check) const
+bool CompositeHash::ComputeSingletonHash(const Val* v, bool type_check, HashKey* k) const
 	{
 	if ( v->Type()->Tag() == TYPE_LIST )
 		{
 		const val_list* vl = v->AsListVal()->Vals();
 		if ( type_check && vl->length() != 1 )
-			return nullptr;
+			return false;
 
 		v = (*vl)[0];
 		}
 
 	if ( type_check && v->Type()->InternalType() != singleton_tag )
-		return nullptr;
+		return false;
 
+	// The keys come out the same as the ones of the corresponding
+	// HashKey constructors, or of IPAddr/IPPrefix::GetHashKey().
 	switch ( singleton_tag ) {
 	case TYPE_INTERNAL_INT:
 	case TYPE_INTERNAL_UNSIGNED:
-		return new HashKey(v->ForceAsInt());
+		{
+		bro_int_t i = v->ForceAsInt();
+		memcpy(k->Reserve(sizeof(i)), &i, sizeof(i));
+		k->Seal(sizeof(i));
+		return true;
+		}
 
 	case TYPE_INTERNAL_ADDR:
-		return v->AsAddr().GetHashKey();
+		v->AsAddr().CopyIPv6(static_cast<uint32_t*>(k->Reserve(4 * sizeof(uint32_t))));
+		k->Seal(4 * sizeof(uint32_t));
+		return true;
 
 	case TYPE_INTERNAL_SUBNET:
-		return v->AsSubNet().GetHashKey();
+		{
+		struct {
+			in6_addr ip;
+			uint32_t len;
+		} key;
+
+		v->AsSubNet().Prefix().CopyIPv6(&key.ip);
+		key.len = v->AsSubNet().Length();
+		memcpy(k->Reserve(sizeof(key)), &key, sizeof(key));
+		k->Seal(sizeof(key));
+		return true;
+		}
 
 	case TYPE_INTERNAL_DOUBLE:
-		return new HashKey(v->InternalDouble());
+		{
+		double d = v->InternalDouble();
+		memcpy(k->Reserve(sizeof(d)), &d, sizeof(d));
+		k->Seal(sizeof(d));
+		return true;
+		}
 
 	case TYPE_INTERNAL_VOID:
 	case TYPE_INTERNAL_OTHER:
 		if ( v->Type()->Tag() == TYPE_FUNC )
-			return new HashKey(v->AsFunc()->GetUniqueFuncID());
+			{
+			uint32_t id = v->AsFunc()->GetUniqueFuncID();
+			memcpy(k->Reserve(sizeof(id)), &id, sizeof(id));
+			k->Seal(sizeof(id));
+			return true;
+			}
 
 		if ( v->Type()->Tag() == TYPE_PATTERN )
 			{
@@ -427,24 +573,26 @@ HashKey* CompositeHash::ComputeSingletonHash(const Val* v, bool type_check) cons
 				v->AsPattern()->AnywherePatternText()
 			};
 			int n = strlen(texts[0]) + strlen(texts[1]) + 2; // 2 for null
-			char* key = new char[n];
+			char* key = static_cast<char*>(k->Reserve(n));
 			std::memcpy(key, texts[0], strlen(texts[0]) + 1);
 			std::memcpy(key + strlen(texts[0]) + 1, texts[1], strlen(texts[1]) + 1);
-			return new HashKey(false, key, n);
+			k->Seal(n);
+			return true;
 			}
 
 		reporter->InternalError("bad index type in CompositeHash::ComputeSingletonHash");
-		return nullptr;
+		return false;
 
 	case TYPE_INTERNAL_STRING:
-		return new HashKey(v->AsString());
+		k->Borrow(v->AsString()->Bytes(), v->AsString()->Len());
+		return true;
 
 	case TYPE_INTERNAL_ERROR:
-		return nullptr;
+		return false;
 
 	default:
 		reporter->InternalError("bad internal type in CompositeHash::ComputeSingletonHash");
-		return nullptr;
+		return false;
 	}
 	}
 
@@ -1060,3 +1208,44 @@ const char* CompositeHash::RecoverOneVal(const HashKey* k, const char* kp0,
 
 	return kp1;
 	}
+
+TEST_CASE("composite hash layout")
+	{
+	if ( ! val_mgr )
+		val_mgr = new ValManager();
+
+	auto tl = make_intrusive<TypeList>();
+	tl->Append(base_type(TYPE_ADDR));
+	tl->Append(base_type(TYPE_PORT));
+	tl->Append(base_type(TYPE_SUBNET));
+	tl->Append(base_type(TYPE_INT));
+	CompositeHash ch(tl);
+
+	ListVal lv(TYPE_ANY);
+	lv.Append(new AddrVal("10.0.0.1"));
+	lv.Append(val_mgr->Port(80, TRANSPORT_TCP)->Ref());
+	lv.Append(new SubNetVal("192.168.0.0", 16));
+	lv.Append(val_mgr->Int(-3).release());
+
+	HashKey k;
+	REQUIRE(ch.ComputeHash(&lv, true, &k));
+	CHECK(k.Size() <= HashKey::INLINE_KEY_SIZE);
+
+	HashKey* hk = ch.ComputeHash(&lv, true);
+	REQUIRE(hk);
+	CHECK(hk->Hash() == k.Hash());
+	CHECK(hk->Size() == k.Size());
+	CHECK(memcmp(hk->Key(), k.Key(), k.Size()) == 0);
+	delete hk;
+
+	auto rv = ch.RecoverVals(&k);
+	CHECK(rv->Index(0)->AsAddr() == IPAddr("10.0.0.1"));
+	CHECK(rv->Index(1)->AsPortVal()->Port() == 80);
+	CHECK(rv->Index(2)->AsSubNet() == IPPrefix(IPAddr("192.168.0.0"), 16));
+	CHECK(rv->Index(3)->AsInt() == -3);
+
+	ListVal bad(TYPE_ANY);
+	bad.Append(val_mgr->Count(1).release());
+	CHECK_FALSE(ch.ComputeHash(&bad, true, &k));
+	}
+
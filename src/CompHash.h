@@ -5,25 +5,47 @@
 #include "Type.h"
 #include "IntrusivePtr.h"
 
+#include <vector>
+
 class ListVal;
 class HashKey;
 
 class CompositeHash {
 public:
 	explicit CompositeHash(IntrusivePtr<TypeList> composite_type);
-	~CompositeHash();
 
 	// Compute the hash corresponding to the given index val,
 	// or 0 if it fails to typecheck.
 	HashKey* ComputeHash(const Val* v, bool type_check) const;
 
+	// Same, but computes the hash into the given key, which keeps small
+	// keys in its own storage and so avoids allocating them.  Returns
+	// false if the value fails to typecheck.
+	bool ComputeHash(const Val* v, bool type_check, HashKey* k) const;
+
 	// Given a hash key, recover the values used to create it.
 	IntrusivePtr<ListVal> RecoverVals(const HashKey* k) const;
 
-	unsigned int MemoryAllocation() const { return padded_sizeof(*this) + pad_size(size); }
+	unsigned int MemoryAllocation() const
+		{ return padded_sizeof(*this) + pad_size(layout.capacity() * sizeof(KeyField)); }
 
 protected:
-	HashKey* ComputeSingletonHash(const Val* v, bool type_check) const;
+	// Where a value of a fixed-size, non-record index type goes in the
+	// key.  The offsets are those SingleValHash() aligns the values to.
+	struct KeyField {
+		InternalTypeTag tag;
+		int offset;
+	};
+
+	bool ComputeSingletonHash(const Val* v, bool type_check, HashKey* k) const;
+
+	// Computes the key for an index type that has a layout, writing
+	// the values straight to their offsets.
+	bool ComputeLayoutHash(const Val* v, bool type_check, HashKey* k) const;
+
+	// Fills in the layout if all of the index types are fixed-size and
+	// atomic.
+	void ComputeLayout();
 
 	// Computes the piece of the hash for Val*, returning the new kp.
 	// Used as a helper for ComputeHash in the non-singleton case.
@@ -80,8 +102,8 @@ protected:
 			      bool calc_static_size) const;
 
 	IntrusivePtr<TypeList> type;
-	char* key;	// space for composite key
-	int size;
+	int size;	// of the key, if fixed
+	std::vector<KeyField> layout;
 	bool is_singleton;	// if just one type in index
 
 	// If one type, but not normal "singleton", e.g. record.
@@ -7,6 +7,12 @@
 #include "Desc.h"
 #include "Hash.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
 unsigned int DFA_State::transition_counter = 0;
 
 DFA_State::DFA_State(int arg_state_num, const EquivClass* ec,
@@ -355,6 +361,21 @@ DFA_State* DFA_State_Cache::Insert(DFA_State* state, DigestStr digest)
 	return state;
 	}
 
+std::vector<DFA_State*> DFA_State_Cache::States() const
+	{
+	std::vector<DFA_State*> result;
+	result.reserve(states.size());
+
+	for ( const auto& state : states )
+		result.push_back(state.second);
+
+	std::sort(result.begin(), result.end(),
+	          [](const DFA_State* a, const DFA_State* b)
+	          	{ return a->StateNum() < b->StateNum(); });
+
+	return result;
+	}
+
 void DFA_State_Cache::GetStats(Stats* s)
 	{
 	s->dfa_states = 0;
@@ -469,3 +490,193 @@ int DFA_Machine::Rep(int sym)
 
 	return -1;
 	}
+
+std::vector<NFA_State*> DFA_Machine::NumberedNFAStates() const
+	{
+	std::vector<NFA_State*> result;
+	std::unordered_set<NFA_State*> seen;
+	std::vector<NFA_State*> stack;
+
+	stack.push_back(nfa->FirstState());
+	seen.insert(nfa->FirstState());
+
+	while ( ! stack.empty() )
+		{
+		NFA_State* n = stack.back();
+		stack.pop_back();
+		result.push_back(n);
+
+		// Push in reverse to visit the transitions in order.
+		NFA_state_list* x = n->Transitions();
+
+		for ( int i = x->length() - 1; i >= 0; --i )
+			if ( seen.insert((*x)[i]).second )
+				stack.push_back((*x)[i]);
+		}
+
+	return result;
+	}
+
+// The saved form of a machine is a sequence of 32-bit integers in host
+// byte order: the number of NFA states, equivalence classes and DFA
+// states, followed for each DFA state by the number of its NFA states, the
+// NFA states' positions in NumberedNFAStates(), and the number of the
+// target of the transition on each equivalence class.
+static const int32_t SAVED_JAM = -1;
+static const int32_t SAVED_UNCOMPUTED = -2;
+
+static void append_int(std::string* buf, int32_t i)
+	{
+	buf->append(reinterpret_cast<const char*>(&i), sizeof(i));
+	}
+
+void DFA_Machine::Save(std::string* buf) const
+	{
+	auto nfa_states = NumberedNFAStates();
+	std::unordered_map<const NFA_State*, int32_t> nfa_idx;
+
+	for ( size_t i = 0; i < nfa_states.size(); ++i )
+		nfa_idx[nfa_states[i]] = i;
+
+	auto dfa_states = dfa_state_cache->States();
+	std::unordered_map<const DFA_State*, int32_t> dfa_idx;
+
+	for ( size_t i = 0; i < dfa_states.size(); ++i )
+		dfa_idx[dfa_states[i]] = i;
+
+	append_int(buf, nfa_states.size());
+	append_int(buf, ec->NumClasses());
+	append_int(buf, dfa_states.size());
+
+	for ( const auto d : dfa_states )
+		{
+		append_int(buf, d->nfa_states->length());
+
+		for ( const auto n : *d->nfa_states )
+			append_int(buf, nfa_idx[n]);
+
+		for ( int sym = 0; sym < d->num_sym; ++sym )
+			{
+			DFA_State* next = d->xtions[sym];
+
+			if ( next == DFA_UNCOMPUTED_STATE_PTR )
+				append_int(buf, SAVED_UNCOMPUTED);
+			else if ( ! next )
+				append_int(buf, SAVED_JAM);
+			else
+				append_int(buf, dfa_idx[next]);
+			}
+		}
+	}
+
+bool DFA_Machine::Restore(const u_char* data, size_t len)
+	{
+	if ( ! start_state || len % sizeof(int32_t) != 0 )
+		return false;
+
+	std::vector<int32_t> ints(len / sizeof(int32_t));
+	memcpy(ints.data(), data, len);
+
+	auto nfa_states = NumberedNFAStates();
+	int32_t num_classes = ec->NumClasses();
+
+	if ( ints.size() < 3 || ints[0] != int32_t(nfa_states.size()) ||
+	     ints[1] != num_classes || ints[2] < 1 )
+		return false;
+
+	int32_t num_dfa_states = ints[2];
+
+	// Validate everything before making any change.
+	std::vector<size_t> offsets;
+	size_t pos = 3;
+
+	for ( int32_t i = 0; i < num_dfa_states; ++i )
+		{
+		offsets.push_back(pos);
+
+		if ( pos >= ints.size() || ints[pos] < 1 ||
+		     size_t(ints[pos]) > ints.size() - pos - 1 )
+			return false;
+
+		int32_t n = ints[pos++];
+
+		for ( int32_t j = 0; j < n; ++j, ++pos )
+			if ( ints[pos] < 0 || ints[pos] >= int32_t(nfa_states.size()) )
+				return false;
+
+		if ( size_t(num_classes) > ints.size() - pos )
+			return false;
+
+		for ( int32_t sym = 0; sym < num_classes; ++sym, ++pos )
+			if ( ints[pos] < SAVED_UNCOMPUTED || ints[pos] >= num_dfa_states )
+				return false;
+		}
+
+	if ( pos != ints.size() )
+		return false;
+
+	// States computed already get found by their NFA states.
+	std::vector<DFA_State*> dfa_states;
+
+	for ( auto off : offsets )
+		{
+		NFA_state_list* state_set = new NFA_state_list;
+
+		for ( int32_t j = 0; j < ints[off]; ++j )
+			state_set->push_back(nfa_states[ints[off + 1 + j]]);
+
+		std::sort(state_set->begin(), state_set->end(), NFA_state_cmp_neg);
+
+		DFA_State* d;
+		if ( ! StateSetToDFA_State(state_set, d, ec) )
+			delete state_set;
+
+		dfa_states.push_back(d);
+		}
+
+	for ( int32_t i = 0; i < num_dfa_states; ++i )
+		{
+		DFA_State* d = dfa_states[i];
+		const int32_t* xtions = &ints[offsets[i] + 1 + ints[offsets[i]]];
+
+		for ( int32_t sym = 0; sym < num_classes; ++sym )
+			{
+			if ( d->xtions[sym] != DFA_UNCOMPUTED_STATE_PTR ||
+			     xtions[sym] == SAVED_UNCOMPUTED )
+				continue;
+
+			d->AddXtion(sym, xtions[sym] == SAVED_JAM ? nullptr : dfa_states[xtions[sym]]);
+			}
+		}
+
+	return true;
+	}
+
+void DFA_Machine::Expand(int max_states)
+	{
+	if ( ! start_state )
+		return;
+
+	std::vector<DFA_State*> queue;
+	std::unordered_set<DFA_State*> seen;
+
+	queue.push_back(start_state);
+	seen.insert(start_state);
+
+	for ( size_t i = 0; i < queue.size(); ++i )
+		{
+		DFA_State* d = queue[i];
+
+		for ( int sym = 0; sym < d->num_sym; ++sym )
+			{
+			if ( d->xtions[sym] == DFA_UNCOMPUTED_STATE_PTR &&
+			     NumStates() >= max_states )
+				return;
+
+			DFA_State* next = d->Xtion(sym, this);
+
+			if ( next && seen.insert(next).second )
+				queue.push_back(next);
+			}
+		}
+	}
@@ -8,6 +8,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include <assert.h>
 #include <sys/types.h> // for u_char
@@ -56,6 +57,7 @@ public:
 
 protected:
 	friend class DFA_State_Cache;
+	friend class DFA_Machine;	// for Save() and Restore()
 
 	DFA_State* ComputeXtion(int sym, DFA_Machine* machine);
 	void AppendIfNew(int sym, int_list* sym_list);
@@ -88,6 +90,9 @@ public:
 
 	int NumEntries() const	{ return states.size(); }
 
+	// Returns all states, ordered by their numbers.
+	std::vector<DFA_State*> States() const;
+
 	struct Stats {
 		// Sum of all NFA states
 		unsigned int nfa_states;
@@ -127,6 +132,20 @@ public:
 
 	unsigned int MemoryAllocation() const;
 
+	// Appends the states computed so far to buf, in a format that
+	// Restore() can read back into a machine built from the same
+	// NFA.
+	void Save(std::string* buf) const;
+
+	// Adds the states and transitions saved by Save() to the ones
+	// computed so far. Returns false if the data doesn't fit this
+	// machine, in which case nothing gets changed.
+	bool Restore(const u_char* data, size_t len);
+
+	// Computes transitions breadth-first from the start state until
+	// the machine has max_states states or is complete.
+	void Expand(int max_states);
+
 protected:
 	friend class DFA_State;	// for DFA_State::ComputeXtion
 	friend class DFA_State_Cache;
@@ -138,6 +157,10 @@ protected:
 				const EquivClass* ec);
 	const EquivClass* EC() const	{ return ec; }
 
+	// Returns the NFA's states in an order that only depends on the
+	// NFA's structure, for referring to them in saved states.
+	std::vector<NFA_State*> NumberedNFAStates() const;
+
 	EquivClass* ec;	// equivalence classes corresponding to NFAs
 	DFA_State* start_state;
 	DFA_State_Cache* dfa_state_cache;
@@ -0,0 +1,316 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "DFACache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+#include "3rdparty/doctest.h"
+
+#include "DFA.h"
+#include "RE.h"
+#include "Reporter.h"
+#include "util.h"
+
+// The cache file starts with a header, followed by one entry per DFA,
+// each consisting of the matcher's cache key, the length of the DFA's
+// saved form, and the saved form itself.
+static const char CACHE_MAGIC[8] = { 'Z', 'E', 'E', 'K', 'D', 'F', 'A', '\n' };
+static const uint32_t CACHE_VERSION = 1;
+
+// Tells apart files written on hosts with a different byte order.
+static const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+
+struct CacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+};
+
+static const size_t KEY_SIZE = 16;
+
+namespace {
+
+struct DFACache {
+	std::set<Specific_RE_Matcher*> matchers;
+
+	std::string file;
+	bool initialized = false;
+
+	const u_char* mapped = nullptr;
+	size_t mapped_len = 0;
+
+	// The saved DFAs in the mapped file, by cache key.
+	std::unordered_map<std::string, std::pair<const u_char*, size_t>> entries;
+
+	void Map();
+	void Restore(Specific_RE_Matcher* m);
+};
+
+}
+
+// Allocated on first use, as matchers get compiled during static
+// initialization, and never freed, as some get destroyed at exit.
+static DFACache* cache()
+	{
+	static DFACache* c = new DFACache;
+	return c;
+	}
+
+void DFACache::Map()
+	{
+	int fd = open(file.c_str(), O_RDONLY);
+
+	if ( fd < 0 )
+		{
+		// The first run creates the file.
+		if ( errno != ENOENT )
+			reporter->Error("cannot open DFA cache %s: %s", file.c_str(), strerror(errno));
+
+		return;
+		}
+
+	struct stat st;
+
+	if ( fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(CacheHeader) )
+		{
+		reporter->Warning("ignoring invalid DFA cache %s", file.c_str());
+		close(fd);
+		return;
+		}
+
+	void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if ( p == MAP_FAILED )
+		{
+		reporter->Error("cannot map DFA cache %s: %s", file.c_str(), strerror(errno));
+		return;
+		}
+
+	mapped = static_cast<const u_char*>(p);
+	mapped_len = st.st_size;
+
+	CacheHeader hdr;
+	memcpy(&hdr, mapped, sizeof(hdr));
+
+	if ( memcmp(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+	     hdr.version != CACHE_VERSION || hdr.byte_order != CACHE_BYTE_ORDER )
+		{
+		reporter->Warning("ignoring DFA cache %s written by a different version or host",
+		                  file.c_str());
+		return;
+		}
+
+	size_t pos = sizeof(hdr);
+
+	while ( pos < mapped_len )
+		{
+		uint32_t len;
+
+		if ( mapped_len - pos < KEY_SIZE + sizeof(len) )
+			break;
+
+		std::string key(reinterpret_cast<const char*>(mapped + pos), KEY_SIZE);
+		memcpy(&len, mapped + pos + KEY_SIZE, sizeof(len));
+		pos += KEY_SIZE + sizeof(len);
+
+		if ( len > mapped_len - pos )
+			break;
+
+		entries[key] = {mapped + pos, len};
+		pos += len;
+		}
+
+	if ( pos != mapped_len )
+		reporter->Warning("DFA cache %s is truncated", file.c_str());
+	}
+
+void DFACache::Restore(Specific_RE_Matcher* m)
+	{
+	auto it = entries.find(m->CacheKey());
+
+	if ( it == entries.end() )
+		return;
+
+	// A mismatch would mean a collision of cache keys, or a change in
+	// how patterns get compiled without a version bump.
+	if ( ! m->DFA()->Restore(it->second.first, it->second.second) )
+		reporter->Warning("ignoring mismatching DFA in cache %s for /%s/",
+		                  file.c_str(), m->PatternText());
+	}
+
+void zeek::detail::register_dfa(Specific_RE_Matcher* m)
+	{
+	auto c = cache();
+	c->matchers.insert(m);
+
+	if ( c->mapped )
+		c->Restore(m);
+	}
+
+void zeek::detail::unregister_dfa(Specific_RE_Matcher* m)
+	{
+	cache()->matchers.erase(m);
+	}
+
+void zeek::detail::init_dfa_cache(const std::string& file, int expand_states)
+	{
+	auto c = cache();
+
+	if ( c->initialized )
+		return;
+
+	c->initialized = true;
+
+	if ( ! file.empty() )
+		{
+		c->file = file;
+
+		// We may have changed directories by the time of saving.
+		char cwd[PATH_MAX];
+
+		if ( file[0] != '/' && getcwd(cwd, sizeof(cwd)) )
+			c->file = std::string(cwd) + "/" + file;
+
+		c->Map();
+
+		if ( c->mapped )
+			for ( auto m : c->matchers )
+				c->Restore(m);
+		}
+
+	// Only the matchers existing at startup get expanded, as later ones
+	// may be compiled for a single use.
+	if ( expand_states > 0 )
+		for ( auto m : c->matchers )
+			m->DFA()->Expand(expand_states);
+	}
+
+void zeek::detail::save_dfa_cache()
+	{
+	auto c = cache();
+
+	if ( c->file.empty() )
+		return;
+
+	// Several matchers may share patterns; keep the largest DFA.
+	std::map<std::string, DFA_Machine*> dfas;
+
+	for ( auto m : c->matchers )
+		{
+		auto& dfa = dfas[m->CacheKey()];
+
+		if ( ! dfa || m->DFA()->NumStates() > dfa->NumStates() )
+			dfa = m->DFA();
+		}
+
+	// Other processes may be reading the old file, so replace it as a
+	// whole.
+	std::string tmp = fmt("%s.%d.tmp", c->file.c_str(), getpid());
+	FILE* f = fopen(tmp.c_str(), "w");
+
+	if ( ! f )
+		{
+		reporter->Error("cannot write DFA cache %s: %s", tmp.c_str(), strerror(errno));
+		return;
+		}
+
+	CacheHeader hdr;
+	memcpy(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	hdr.version = CACHE_VERSION;
+	hdr.byte_order = CACHE_BYTE_ORDER;
+	fwrite(&hdr, sizeof(hdr), 1, f);
+
+	std::string buf;
+
+	for ( const auto& d : dfas )
+		{
+		buf.clear();
+		d.second->Save(&buf);
+
+		uint32_t len = buf.size();
+		fwrite(d.first.data(), KEY_SIZE, 1, f);
+		fwrite(&len, sizeof(len), 1, f);
+		fwrite(buf.data(), buf.size(), 1, f);
+		}
+
+	if ( ferror(f) | fclose(f) )
+		{
+		reporter->Error("cannot write DFA cache %s: %s", tmp.c_str(), strerror(errno));
+		unlink(tmp.c_str());
+		return;
+		}
+
+	if ( rename(tmp.c_str(), c->file.c_str()) < 0 )
+		{
+		reporter->Error("cannot replace DFA cache %s: %s", c->file.c_str(), strerror(errno));
+		unlink(tmp.c_str());
+		}
+	}
+
+TEST_CASE("DFA save and restore")
+	{
+	const char* pat = "(foo|ba[rz])+x*$";
+
+	Specific_RE_Matcher computed(MATCH_ANYWHERE);
+	computed.AddPat(pat);
+	REQUIRE(computed.Compile());
+
+	CHECK(computed.Match("xxbarbazx"));
+	CHECK_FALSE(computed.Match("xxbarbay"));
+
+	std::string buf;
+	computed.DFA()->Save(&buf);
+
+	Specific_RE_Matcher restored(MATCH_ANYWHERE);
+	restored.AddPat(pat);
+	REQUIRE(restored.Compile());
+	CHECK(restored.CacheKey() == computed.CacheKey());
+
+	int fresh_states = restored.DFA()->NumStates();
+	CHECK(fresh_states < computed.DFA()->NumStates());
+	CHECK(restored.DFA()->Restore(reinterpret_cast<const u_char*>(buf.data()), buf.size()));
+	CHECK(restored.DFA()->NumStates() == computed.DFA()->NumStates());
+
+	// Matching what got matched before doesn't need any new states.
+	CHECK(restored.Match("xxbarbazx"));
+	CHECK_FALSE(restored.Match("xxbarbay"));
+	CHECK(restored.DFA()->NumStates() == computed.DFA()->NumStates());
+
+	// Restoring again finds all states present.
+	CHECK(restored.DFA()->Restore(reinterpret_cast<const u_char*>(buf.data()), buf.size()));
+	CHECK(restored.DFA()->NumStates() == computed.DFA()->NumStates());
+
+	Specific_RE_Matcher other(MATCH_ANYWHERE);
+	other.AddPat("fo+");
+	REQUIRE(other.Compile());
+	CHECK(other.CacheKey() != computed.CacheKey());
+	CHECK_FALSE(other.DFA()->Restore(reinterpret_cast<const u_char*>(buf.data()), buf.size()));
+
+	Specific_RE_Matcher expanded(MATCH_ANYWHERE);
+	expanded.AddPat(pat);
+	REQUIRE(expanded.Compile());
+	CHECK_FALSE(expanded.DFA()->Restore(reinterpret_cast<const u_char*>(buf.data()), buf.size() - 4));
+	CHECK(expanded.DFA()->NumStates() == fresh_states);
+
+	expanded.DFA()->Expand(3);
+	CHECK(expanded.DFA()->NumStates() == 3);
+	expanded.DFA()->Expand(1000);
+	CHECK(expanded.DFA()->NumStates() >= computed.DFA()->NumStates());
+	CHECK(expanded.Match("xxbarbazx"));
+	}
@@ -0,0 +1,41 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <string>
+
+class Specific_RE_Matcher;
+
+namespace zeek { namespace detail {
+
+/**
+ * Registers a compiled matcher with the DFA cache, which restores the DFA
+ * states that a previous run computed for the same patterns if a cache has
+ * been loaded, and saves the states at termination.
+ */
+void register_dfa(Specific_RE_Matcher* m);
+
+/**
+ * Removes a matcher from the DFA cache before it gets destroyed.
+ */
+void unregister_dfa(Specific_RE_Matcher* m);
+
+/**
+ * Restores the DFAs of all matchers registered so far, and of all that
+ * get registered later, from a cache file, if that exists. Then expands
+ * the DFAs of the matchers registered so far.
+ *
+ * @param file The cache file, or empty to not use one.
+ *
+ * @param expand_states If positive, the number of states to compute for
+ * each DFA ahead of time.
+ */
+void init_dfa_cache(const std::string& file, int expand_states);
+
+/**
+ * Writes the DFA states computed so far to the cache file passed to
+ * init_dfa_cache(), if any.
+ */
+void save_dfa_cache();
+
+}} // namespace zeek::detail
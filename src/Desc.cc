@@ -4,14 +4,20 @@
 #include "Desc.h"
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 #include <math.h>
 
+#include <random>
+#include <vector>
+
 #include "File.h"
 #include "Reporter.h"
 #include "ConvertUTF.h"
 
+#include "3rdparty/doctest.h"
+
 #define DEFAULT_SIZE 128
 #define SLOP 10
 
@@ -264,6 +270,66 @@ size_t ODesc::StartsWithEscapeSequence(const char* start, const char* end)
 	return 0;
 	}
 
+// The first bytes of the escape sequences, for skipping the bytes that
+// can't start one. More than this many means looking at every byte.
+static const int MAX_ESCAPE_STARTS = 4;
+
+// True if a byte goes out as is, without looking any closer: printable
+// ASCII, other than a backslash or the start of an escape sequence.
+static inline bool is_plain(unsigned char c, const unsigned char* starts, int num_starts)
+	{
+	if ( c < 0x20 || c > 0x7e || c == '\\' )
+		return false;
+
+	for ( int k = 0; k < num_starts; ++k )
+		if ( c == starts[k] )
+			return false;
+
+	return true;
+	}
+
+// Returns the position of the first byte at or after i that isn't plain,
+// or n if there's none. This checks eight bytes at a time, using the
+// usual bit tricks for finding bytes in a word, as most log content is
+// plain.
+static size_t skip_plain(const char* bytes, size_t i, size_t n,
+                         const unsigned char* starts, int num_starts)
+	{
+	const uint64_t ones = 0x0101010101010101ULL;
+	const uint64_t highs = 0x8080808080808080ULL;
+
+	while ( i + 8 <= n )
+		{
+		uint64_t w;
+		memcpy(&w, bytes + i, sizeof(w));
+
+		// Any byte below 0x20, or at 0x7f and above? The latter
+		// may flag a 0x7e as well, which the loop below sorts out.
+		uint64_t special = ((w - ones * 0x20) & ~w) | ((w + ones) | w);
+
+		// Any backslash or escape sequence start? A byte is zero
+		// after the xor only where it matched.
+		uint64_t x = w ^ (ones * '\\');
+		special |= (x - ones) & ~x;
+
+		for ( int k = 0; k < num_starts; ++k )
+			{
+			x = w ^ (ones * starts[k]);
+			special |= (x - ones) & ~x;
+			}
+
+		if ( special & highs )
+			break;
+
+		i += 8;
+		}
+
+	while ( i < n && is_plain(bytes[i], starts, num_starts) )
+		++i;
+
+	return i;
+	}
+
 std::pair<const char*, size_t> ODesc::FirstEscapeLoc(const char* bytes, size_t n)
 	{
 	typedef std::pair<const char*, size_t> escape_pos;
@@ -271,8 +337,35 @@ std::pair<const char*, size_t> ODesc::FirstEscapeLoc(const char* bytes, size_t n
 	if ( IsBinary() )
 		return escape_pos(0, 0);
 
+	unsigned char starts[MAX_ESCAPE_STARTS];
+	int num_starts = 0;
+	bool skip = true;
+
+	for ( const auto& esc : escape_sequences )
+		{
+		// An empty sequence never matches anything.
+		if ( esc.empty() )
+			continue;
+
+		if ( num_starts == MAX_ESCAPE_STARTS )
+			{
+			skip = false;
+			break;
+			}
+
+		starts[num_starts++] = esc[0];
+		}
+
 	for ( size_t i = 0; i < n; ++i )
 		{
+		if ( skip )
+			{
+			i = skip_plain(bytes, i, n, starts, num_starts);
+
+			if ( i == n )
+				break;
+			}
+
 		auto printable = isprint(bytes[i]);
 
 		if ( ! printable && ! utf8 )
@@ -423,3 +516,73 @@ bool ODesc::FindType(const BroType* type)
 
 	return false;
 	}
+
+// Escapes like AddBytes() does without UTF-8, one byte at a time.
+static std::string escape_bytewise(const std::string& s, const std::vector<std::string>& seqs)
+	{
+	ODesc d;
+	size_t i = 0;
+
+	while ( i < s.size() )
+		{
+		size_t len = 0;
+
+		if ( ! isprint(s[i]) || s[i] == '\\' )
+			len = 1;
+
+		for ( const auto& seq : seqs )
+			if ( ! len && s.compare(i, seq.size(), seq) == 0 )
+				len = seq.size();
+
+		if ( len )
+			get_escaped_string(&d, s.data() + i, len, true);
+		else
+			d.AddRaw(s.data() + i, 1);
+
+		i += len ? len : 1;
+		}
+
+	return std::string(d.Description(), d.Len());
+	}
+
+TEST_CASE("desc escaping")
+	{
+	ODesc d;
+	d.EnableEscaping();
+	d.AddEscapeSequence("\t");
+	d.Add("a long line\twith a tab and a \\ backslash\x01");
+	CHECK(strcmp(d.Description(), "a long line\\x09with a tab and a \\\\ backslash\\x01") == 0);
+
+	// The plain bytes around the ones to escape may be skipped in
+	// chunks, which mustn't make a difference.
+	std::vector<std::vector<std::string>> seq_sets = {
+		{},
+		{ "\t", "," },
+		{ "||", "~" },
+		{ "\t", ",", "|", ";", ":" },
+	};
+
+	const char alphabet[] = "abcdefgh ~,|;:\t\\\x7e\x7f\x80\xff";
+	std::mt19937 rng(42);
+
+	for ( const auto& seqs : seq_sets )
+		{
+		for ( int n = 0; n < 500; ++n )
+			{
+			std::string s;
+			size_t len = rng() % 40;
+
+			for ( size_t i = 0; i < len; ++i )
+				s += alphabet[rng() % (sizeof(alphabet) - 1)];
+
+			ODesc e;
+			e.EnableEscaping();
+
+			for ( const auto& seq : seqs )
+				e.AddEscapeSequence(seq);
+
+			e.AddN(s.data(), s.size());
+			CHECK(std::string(e.Description(), e.Len()) == escape_bytewise(s, seqs));
+			}
+		}
+	}
@@ -2911,8 +2911,8 @@ void FieldExpr::Delete(Frame* f)
 
 IntrusivePtr<Val> FieldExpr::Fold(Val* v) const
 	{
-	if ( Val* result = v->AsRecordVal()->Lookup(field) )
-		return {NewRef{}, result};
+	if ( auto result = v->AsRecordVal()->GetField(field) )
+		return result;
 
 	// Check for &default.
 	const Attr* def_attr = td ? td->FindAttr(ATTR_DEFAULT) : nullptr;
@@ -2973,7 +2973,7 @@ HasFieldExpr::~HasFieldExpr()
 IntrusivePtr<Val> HasFieldExpr::Fold(Val* v) const
 	{
 	auto rv = v->AsRecordVal();
-	return val_mgr->Bool(rv->Lookup(field));
+	return val_mgr->Bool(rv->HasField(field));
 	}
 
 void HasFieldExpr::ExprDescribe(ODesc* d) const
@@ -0,0 +1,223 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "FlowShards.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+
+#include <utility>
+#include <vector>
+
+#include "3rdparty/doctest.h"
+
+#include "Reporter.h"
+#include "setsignal.h"
+#include "util.h"
+
+int zeek::num_flow_shards = 0;
+int zeek::flow_shard = 0;
+
+static std::vector<pid_t> shard_pids;
+
+static RETSIGTYPE forward_signal(int signo)
+	{
+	for ( auto pid : shard_pids )
+		if ( pid > 0 )
+			kill(pid, signo);
+
+	return RETSIGVAL;
+	}
+
+void zeek::fork_flow_shards(int n)
+	{
+	shard_pids.assign(n, 0);
+
+	for ( int i = 0; i < n; ++i )
+		{
+		auto pid = fork();
+
+		if ( pid < 0 )
+			{
+			fprintf(stderr, "failed to fork flow shard %d: %s\n", i, strerror(errno));
+			forward_signal(SIGTERM);
+			break;
+			}
+
+		if ( pid == 0 )
+			{
+			shard_pids.clear();
+			num_flow_shards = n;
+			flow_shard = i;
+			return;
+			}
+
+		shard_pids[i] = pid;
+		}
+
+	// The parent only supervises from here on.
+	setsignal(SIGINT, forward_signal);
+	setsignal(SIGTERM, forward_signal);
+	setsignal(SIGHUP, SIG_IGN);
+
+	int rc = 0;
+
+	for ( int i = 0; i < n; ++i )
+		{
+		if ( shard_pids[i] <= 0 )
+			{
+			rc = 1;
+			continue;
+			}
+
+		int status;
+		pid_t res;
+
+		while ( (res = waitpid(shard_pids[i], &status, 0)) < 0 && errno == EINTR )
+			;
+
+		if ( res < 0 )
+			{
+			fprintf(stderr, "failed to wait for flow shard %d: %s\n", i, strerror(errno));
+			rc = 1;
+			}
+
+		else if ( WIFEXITED(status) )
+			{
+			if ( WEXITSTATUS(status) != 0 )
+				rc = WEXITSTATUS(status);
+			}
+
+		else
+			{
+			if ( WIFSIGNALED(status) )
+				fprintf(stderr, "flow shard %d terminated by signal %d\n",
+				        i, WTERMSIG(status));
+
+			rc = 1;
+			}
+
+		shard_pids[i] = 0;
+		}
+
+	exit(rc);
+	}
+
+void zeek::enter_flow_shard_dir(std::optional<std::string>* pcap_file)
+	{
+	if ( ! num_flow_shards )
+		return;
+
+	if ( pcap_file && *pcap_file && (*pcap_file)->size() && (**pcap_file)[0] != '/' )
+		{
+		char cwd[PATH_MAX];
+
+		if ( ! getcwd(cwd, sizeof(cwd)) )
+			reporter->FatalError("cannot determine working directory: %s", strerror(errno));
+
+		*pcap_file = std::string(cwd) + "/" + **pcap_file;
+		}
+
+	std::string dir = fmt("shard-%d", flow_shard);
+
+	if ( ! ensure_dir(dir.c_str()) )
+		reporter->FatalError("cannot create flow shard directory %s", dir.c_str());
+
+	if ( chdir(dir.c_str()) < 0 )
+		reporter->FatalError("cannot change into flow shard directory %s: %s",
+		                     dir.c_str(), strerror(errno));
+	}
+
+// Hashes the two addresses in a canonical order, so that both directions of
+// a flow get the same result.
+static uint32_t hash_address_pair(const u_char* a, const u_char* b, size_t len)
+	{
+	if ( memcmp(a, b, len) > 0 )
+		std::swap(a, b);
+
+	// FNV-1a, which doesn't depend on the process's hash seeds.
+	uint32_t h = 2166136261u;
+
+	for ( size_t i = 0; i < len; ++i )
+		h = (h ^ a[i]) * 16777619u;
+
+	for ( size_t i = 0; i < len; ++i )
+		h = (h ^ b[i]) * 16777619u;
+
+	return h;
+	}
+
+uint32_t zeek::flow_shard_hash(Layer3Proto l3_proto, const u_char* data, uint32_t len)
+	{
+	if ( l3_proto == L3_IPV4 )
+		{
+		if ( len < sizeof(struct ip) )
+			return 0;
+
+		const struct ip* ip = (const struct ip*) data;
+		return hash_address_pair((const u_char*) &ip->ip_src,
+		                         (const u_char*) &ip->ip_dst, 4);
+		}
+
+	if ( l3_proto == L3_IPV6 )
+		{
+		if ( len < sizeof(struct ip6_hdr) )
+			return 0;
+
+		const struct ip6_hdr* ip6 = (const struct ip6_hdr*) data;
+		return hash_address_pair((const u_char*) &ip6->ip6_src,
+		                         (const u_char*) &ip6->ip6_dst, 16);
+		}
+
+	return 0;
+	}
+
+TEST_CASE("flow shard hash")
+	{
+	u_char a[20] = { 0x45, 0, 0, 20, 0, 0, 0, 0, 64, 6, 0, 0,
+	                 10, 0, 0, 1, 192, 168, 1, 7 };
+	u_char b[20];
+	memcpy(b, a, sizeof(b));
+	memcpy(b + 12, a + 16, 4);
+	memcpy(b + 16, a + 12, 4);
+
+	auto h = zeek::flow_shard_hash(L3_IPV4, a, sizeof(a));
+	CHECK(h != 0);
+	CHECK(h == zeek::flow_shard_hash(L3_IPV4, b, sizeof(b)));
+
+	// Fragments map like the rest of the flow.
+	b[6] = 0x20;
+	CHECK(h == zeek::flow_shard_hash(L3_IPV4, b, sizeof(b)));
+
+	b[19] = 8;
+	CHECK(h != zeek::flow_shard_hash(L3_IPV4, b, sizeof(b)));
+
+	CHECK(zeek::flow_shard_hash(L3_IPV4, a, 10) == 0);
+	CHECK(zeek::flow_shard_hash(L3_ARP, a, sizeof(a)) == 0);
+
+	u_char c[40];
+	u_char d[40];
+	memset(c, 0, sizeof(c));
+	c[0] = 0x60;
+	c[6] = IPPROTO_UDP;
+	c[8] = 0x20;
+	c[23] = 1;
+	c[24] = 0xfe;
+	c[39] = 2;
+	memcpy(d, c, 8);
+	memcpy(d + 8, c + 24, 16);
+	memcpy(d + 24, c + 8, 16);
+
+	h = zeek::flow_shard_hash(L3_IPV6, c, sizeof(c));
+	CHECK(h != 0);
+	CHECK(h == zeek::flow_shard_hash(L3_IPV6, d, sizeof(d)));
+	}
@@ -0,0 +1,87 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Splitting packet processing across several processes by flow.
+
+#pragma once
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include <optional>
+#include <string>
+
+#include "iosource/Packet.h"
+
+namespace zeek {
+
+/**
+ * The number of flow shards that the current invocation is split into, or
+ * zero if it isn't sharded.
+ */
+extern int num_flow_shards;
+
+/**
+ * The index of the flow shard that this process handles, valid only if
+ * num_flow_shards is non-zero.
+ */
+extern int flow_shard;
+
+/**
+ * Splits the process into the given number of flow shards. Each shard is a
+ * child process that continues initialization, reads the same packet input
+ * and processes only the packets that map to it by flow_shard_hash(). The
+ * children inherit everything set up so far, in particular the parsed
+ * scripts, and share the memory holding it with the parent until written to.
+ *
+ * Only returns in the children; the parent waits for all of them, forwards
+ * SIGINT and SIGTERM, and then exits with a non-zero status if any of the
+ * shards failed.
+ *
+ * Must be called before any threads get started.
+ */
+void fork_flow_shards(int n);
+
+/**
+ * Changes a shard's working directory into its own "shard-<index>"
+ * subdirectory, creating it if needed, so that the logs and other output of
+ * the shards don't clash. Does nothing if not sharded.
+ *
+ * @param pcap_file The trace file to read from, if any. A relative path gets
+ * adjusted so that it still refers to the same file.
+ */
+void enter_flow_shard_dir(std::optional<std::string>* pcap_file);
+
+/**
+ * Computes a hash of a packet's flow that is the same in both directions.
+ * The hash covers just the IP addresses, so that all fragments of a packet,
+ * and all tunneled flows between a pair of endpoints, end up in the same
+ * shard.
+ *
+ * @param l3_proto The network layer protocol.
+ *
+ * @param data The start of the network layer header.
+ *
+ * @param len The number of bytes available at \a data.
+ *
+ * @return The hash, or zero for packets that aren't IP.
+ */
+uint32_t flow_shard_hash(Layer3Proto l3_proto, const u_char* data, uint32_t len);
+
+/**
+ * Returns true if a packet belongs to this process's flow shard. That's
+ * always the case if not sharded.
+ */
+inline bool in_flow_shard(const Packet* pkt)
+	{
+	if ( ! num_flow_shards )
+		return true;
+
+	if ( pkt->hdr_size > pkt->cap_len )
+		return flow_shard == 0;
+
+	auto h = flow_shard_hash(pkt->l3_proto, pkt->data + pkt->hdr_size,
+	                         pkt->cap_len - pkt->hdr_size);
+	return int(h % num_flow_shards) == flow_shard;
+	}
+
+} // namespace zeek
@@ -0,0 +1,348 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "FlowTable.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "3rdparty/doctest.h"
+
+#include "util.h"
+
+void FlowTable::Table::Allocate(size_t cap)
+	{
+	capacity = cap;
+	used = deleted = 0;
+	ctrl = new uint8_t[cap];
+	slots = new Entry[cap];
+	memset(ctrl, CTRL_EMPTY, cap);
+	}
+
+void FlowTable::Table::Release()
+	{
+	delete [] ctrl;
+	delete [] slots;
+	ctrl = nullptr;
+	slots = nullptr;
+	capacity = used = deleted = 0;
+	}
+
+ptrdiff_t FlowTable::Table::Find(const ConnIDKey& key, hash_t h) const
+	{
+	if ( capacity == 0 )
+		return -1;
+
+	size_t mask = capacity - 1;
+	uint8_t tag = Tag(h);
+
+	for ( size_t i = h & mask; ; i = (i + 1) & mask )
+		{
+		uint8_t c = ctrl[i];
+
+		if ( c == CTRL_EMPTY )
+			return -1;
+
+		if ( c == tag && slots[i].key == key )
+			return i;
+		}
+	}
+
+void FlowTable::Table::Place(const ConnIDKey& key, hash_t h, Connection* conn)
+	{
+	size_t mask = capacity - 1;
+	size_t i = h & mask;
+
+	while ( ctrl[i] < CTRL_EMPTY )
+		i = (i + 1) & mask;
+
+	if ( ctrl[i] == CTRL_DELETED )
+		--deleted;
+
+	ctrl[i] = Tag(h);
+	slots[i].key = key;
+	slots[i].conn = conn;
+	++used;
+	}
+
+FlowTable::FlowTable(size_t initial_capacity)
+	{
+	if ( initial_capacity > 0 )
+		{
+		size_t cap = MIN_CAPACITY;
+
+		// Leave room so that the requested number of entries fits
+		// below the load limit.
+		while ( cap * 3 < initial_capacity * 4 )
+			cap <<= 1;
+
+		cur.Allocate(cap);
+		}
+	}
+
+FlowTable::~FlowTable()
+	{
+	cur.Release();
+	old.Release();
+	}
+
+Connection* FlowTable::Lookup(const ConnIDKey& key, hash_t h) const
+	{
+	ptrdiff_t i = cur.Find(key, h);
+
+	if ( i >= 0 )
+		return cur.slots[i].conn;
+
+	if ( old.capacity )
+		{
+		i = old.Find(key, h);
+
+		if ( i >= 0 )
+			return old.slots[i].conn;
+		}
+
+	return nullptr;
+	}
+
+void FlowTable::Prefetch(hash_t h) const
+	{
+	if ( cur.capacity == 0 )
+		return;
+
+	size_t i = h & (cur.capacity - 1);
+	__builtin_prefetch(&cur.ctrl[i]);
+	__builtin_prefetch(&cur.slots[i]);
+	}
+
+Connection* FlowTable::Insert(const ConnIDKey& key, Connection* conn)
+	{
+	hash_t h = HashKey(key);
+	Connection* prev = nullptr;
+
+	ptrdiff_t i = cur.Find(key, h);
+
+	if ( i >= 0 )
+		{
+		prev = cur.slots[i].conn;
+		cur.slots[i].conn = conn;
+		return prev;
+		}
+
+	if ( old.capacity )
+		{
+		// New entries only ever go into the current table, so
+		// pull an existing one out of the old table first.
+		i = old.Find(key, h);
+
+		if ( i >= 0 )
+			{
+			prev = old.slots[i].conn;
+			old.Erase(i);
+			--num_entries;
+			}
+
+		MigrateSome(MIGRATE_STEP);
+		}
+
+	if ( cur.NeedsGrowth() )
+		StartResize();
+
+	cur.Place(key, h, conn);
+	++num_entries;
+
+	return prev;
+	}
+
+Connection* FlowTable::Remove(const ConnIDKey& key)
+	{
+	hash_t h = HashKey(key);
+	Connection* prev = nullptr;
+
+	ptrdiff_t i = cur.Find(key, h);
+
+	if ( i >= 0 )
+		{
+		prev = cur.slots[i].conn;
+		cur.Erase(i);
+		--num_entries;
+		}
+
+	else if ( old.capacity )
+		{
+		i = old.Find(key, h);
+
+		if ( i >= 0 )
+			{
+			prev = old.slots[i].conn;
+			old.Erase(i);
+			--num_entries;
+			}
+		}
+
+	if ( old.capacity )
+		MigrateSome(MIGRATE_STEP);
+
+	return prev;
+	}
+
+void FlowTable::Clear()
+	{
+	cur.Release();
+	old.Release();
+	migrate_pos = 0;
+	num_entries = 0;
+	}
+
+void FlowTable::StartResize()
+	{
+	// A previous migration must be complete before starting another
+	// one.  This only happens if a table is flooded with tombstones.
+	if ( old.capacity )
+		MigrateSome(old.capacity);
+
+	size_t live = cur.used;
+	size_t cap = std::max(cur.capacity, MIN_CAPACITY);
+
+	// Grow if live entries take up more than half the slots; otherwise
+	// the table is mostly tombstones and rebuilding it at the same size
+	// reclaims them.
+	if ( (live + 1) * 2 > cap )
+		cap <<= 1;
+
+	if ( cur.capacity == 0 )
+		{
+		cur.Allocate(cap);
+		return;
+		}
+
+	old = cur;
+	cur = Table();
+	cur.Allocate(cap);
+	migrate_pos = 0;
+	}
+
+void FlowTable::MigrateSome(size_t n)
+	{
+	size_t end = std::min(old.capacity, migrate_pos + n);
+
+	for ( ; migrate_pos < end; ++migrate_pos )
+		{
+		if ( old.ctrl[migrate_pos] >= CTRL_EMPTY )
+			continue;
+
+		const Entry& e = old.slots[migrate_pos];
+		cur.Place(e.key, HashKey(e.key), e.conn);
+
+		// Leave a tombstone so that probe sequences of entries still
+		// waiting to be migrated remain intact.
+		old.Erase(migrate_pos);
+		}
+
+	if ( migrate_pos == old.capacity )
+		{
+		old.Release();
+		migrate_pos = 0;
+		}
+	}
+
+size_t FlowTable::MemoryAllocation() const
+	{
+	return padded_sizeof(*this)
+		+ pad_size(Capacity() * sizeof(uint8_t))
+		+ pad_size(Capacity() * sizeof(Entry));
+	}
+
+std::vector<FlowTable::Entry> FlowTable::OrderedEntries() const
+	{
+	std::vector<Entry> entries;
+	entries.reserve(num_entries);
+
+	ForEach([&entries](const Entry& e) { entries.push_back(e); });
+
+	std::sort(entries.begin(), entries.end(),
+	          [](const Entry& a, const Entry& b) { return a.key < b.key; });
+
+	return entries;
+	}
+
+TEST_CASE("flowtable operation")
+	{
+	FlowTable t;
+	CHECK(t.Size() == 0);
+
+	ConnIDKey k1;
+	k1.port1 = 1;
+	ConnIDKey k2;
+	k2.port1 = 2;
+
+	auto c1 = reinterpret_cast<Connection*>(0x10);
+	auto c2 = reinterpret_cast<Connection*>(0x20);
+
+	CHECK(t.Insert(k1, c1) == nullptr);
+	CHECK(t.Insert(k2, c2) == nullptr);
+	CHECK(t.Size() == 2);
+	CHECK(t.Lookup(k1) == c1);
+	CHECK(t.Lookup(k2) == c2);
+
+	CHECK(t.Insert(k1, c2) == c1);
+	CHECK(t.Size() == 2);
+	CHECK(t.Lookup(k1) == c2);
+
+	CHECK(t.Remove(k1) == c2);
+	CHECK(t.Remove(k1) == nullptr);
+	CHECK(t.Lookup(k1) == nullptr);
+	CHECK(t.Size() == 1);
+
+	t.Clear();
+	CHECK(t.Size() == 0);
+	CHECK(t.Lookup(k2) == nullptr);
+	}
+
+TEST_CASE("flowtable incremental resize")
+	{
+	FlowTable t;
+	const uint32_t n = 10000;
+	bool saw_resize = false;
+
+	for ( uint32_t i = 0; i < n; ++i )
+		{
+		ConnIDKey k;
+		memcpy(&k.ip1, &i, sizeof(i));
+		t.Insert(k, reinterpret_cast<Connection*>(uintptr_t(i) + 1));
+		saw_resize = saw_resize || t.IsResizing();
+
+		if ( i % 3 == 0 )
+			{
+			ConnIDKey victim;
+			uint32_t v = i / 2;
+			memcpy(&victim.ip1, &v, sizeof(v));
+			t.Remove(victim);
+			}
+		}
+
+	CHECK(saw_resize);
+
+	size_t found = 0;
+
+	for ( uint32_t i = 0; i < n; ++i )
+		{
+		ConnIDKey k;
+		memcpy(&k.ip1, &i, sizeof(i));
+		Connection* c = t.Lookup(k);
+
+		if ( c )
+			{
+			CHECK(c == reinterpret_cast<Connection*>(uintptr_t(i) + 1));
+			++found;
+			}
+		}
+
+	CHECK(found == t.Size());
+
+	auto entries = t.OrderedEntries();
+	CHECK(entries.size() == t.Size());
+
+	for ( size_t i = 1; i < entries.size(); ++i )
+		CHECK(entries[i - 1].key < entries[i].key);
+	}
@@ -0,0 +1,183 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "IPAddr.h"
+#include "Hash.h"
+
+class Connection;
+
+/**
+ * An open-addressing hash table mapping ConnIDKeys to connections, used by
+ * NetSessions for the per-transport connection tables.
+ *
+ * Entries are stored in a flat slot array with a parallel array of one-byte
+ * control words, so that a probe sequence normally touches a single cache
+ * line of control bytes plus the one slot holding the match.  Probing is
+ * linear.  When the table needs to grow, a new table is allocated and the
+ * entries of the old one are migrated a few slots at a time on every
+ * subsequent insert or removal, so that no single packet pays for rehashing
+ * millions of flows.  Lookups consult both tables while a migration is in
+ * progress.
+ *
+ * Hashing uses the process-specific KeyedHash seed, so the layout is not
+ * predictable by an attacker and iteration order is not stable across runs;
+ * use OrderedEntries() when a deterministic order is required.
+ */
+class FlowTable {
+public:
+	struct Entry {
+		ConnIDKey key;
+		Connection* conn;
+	};
+
+	explicit FlowTable(size_t initial_capacity = 0);
+	~FlowTable();
+
+	FlowTable(const FlowTable&) = delete;
+	FlowTable& operator=(const FlowTable&) = delete;
+
+	/**
+	 * Computes the hash value used for placing a key in the table.
+	 */
+	static hash_t HashKey(const ConnIDKey& key)
+		{ return KeyedHash::Hash64(&key, sizeof(key)); }
+
+	/**
+	 * Returns the connection stored for the given key, or nullptr if
+	 * there is none.
+	 */
+	Connection* Lookup(const ConnIDKey& key) const
+		{ return Lookup(key, HashKey(key)); }
+
+	/**
+	 * Same as above, but with a hash precomputed through HashKey().
+	 */
+	Connection* Lookup(const ConnIDKey& key, hash_t h) const;
+
+	/**
+	 * Issues a prefetch for the control bytes and first slot a lookup for
+	 * the given hash would touch.  This is merely a hint.
+	 */
+	void Prefetch(hash_t h) const;
+
+	/**
+	 * Stores a connection under the given key, replacing any existing
+	 * entry.
+	 *
+	 * @return the connection previously stored under the key, or nullptr
+	 * if there was none.
+	 */
+	Connection* Insert(const ConnIDKey& key, Connection* conn);
+
+	/**
+	 * Removes the entry for the given key.
+	 *
+	 * @return the connection that was stored under the key, or nullptr if
+	 * there was none.
+	 */
+	Connection* Remove(const ConnIDKey& key);
+
+	/**
+	 * Removes all entries and releases the table's memory.  Does not
+	 * touch the stored connections.
+	 */
+	void Clear();
+
+	size_t Size() const	{ return num_entries; }
+	bool Empty() const	{ return num_entries == 0; }
+
+	/**
+	 * Returns the number of slots currently allocated, including those of
+	 * a table still being migrated.
+	 */
+	size_t Capacity() const
+		{ return cur.capacity + old.capacity; }
+
+	/**
+	 * Returns true while entries are being moved to a resized table.
+	 */
+	bool IsResizing() const	{ return old.capacity > 0; }
+
+	/**
+	 * Returns the number of bytes allocated for the table itself.
+	 */
+	size_t MemoryAllocation() const;
+
+	/**
+	 * Returns all entries ordered by ConnIDKey, matching the iteration
+	 * order of a std::map keyed the same way.
+	 */
+	std::vector<Entry> OrderedEntries() const;
+
+	/**
+	 * Calls the given function for each entry, in unspecified order.  The
+	 * table must not be modified from within the callback.
+	 */
+	template<typename F>
+	void ForEach(F f) const
+		{
+		old.ForEach(f);
+		cur.ForEach(f);
+		}
+
+private:
+	static constexpr uint8_t CTRL_EMPTY = 0x80;
+	static constexpr uint8_t CTRL_DELETED = 0xfe;
+	static constexpr size_t MIN_CAPACITY = 16;
+
+	// Number of old-table slots migrated per mutating operation.  Needs
+	// to be at least two to guarantee the migration completes before the
+	// new table, which has twice the capacity, reaches its own limit.
+	static constexpr size_t MIGRATE_STEP = 8;
+
+	static uint8_t Tag(hash_t h)	{ return uint8_t(h >> 57); }
+
+	struct Table {
+		uint8_t* ctrl = nullptr;
+		Entry* slots = nullptr;
+		size_t capacity = 0;	// always a power of two, or zero
+		size_t used = 0;	// live entries
+		size_t deleted = 0;	// tombstones
+
+		void Allocate(size_t cap);
+		void Release();
+
+		// Returns the slot index holding the key, or -1.
+		ptrdiff_t Find(const ConnIDKey& key, hash_t h) const;
+
+		// Places a key known not to be present.
+		void Place(const ConnIDKey& key, hash_t h, Connection* conn);
+
+		void Erase(size_t idx)
+			{
+			ctrl[idx] = CTRL_DELETED;
+			--used;
+			++deleted;
+			}
+
+		bool NeedsGrowth() const
+			{ return capacity == 0 || (used + deleted + 1) * 4 > capacity * 3; }
+
+		template<typename F>
+		void ForEach(F& f) const
+			{
+			for ( size_t i = 0; i < capacity; ++i )
+				if ( ctrl[i] < CTRL_EMPTY )
+					f(slots[i]);
+			}
+	};
+
+	void StartResize();
+	void MigrateSome(size_t n);
+
+	Table cur;
+	Table old;
+	size_t migrate_pos = 0;
+	size_t num_entries = 0;
+};
@@ -438,6 +438,9 @@ IntrusivePtr<Val> BroFunc::Call(const zeek::Args& args, Frame* parent) const
 		g_trace_state.LogTrace("Function return: %s\n", d.Description());
 		}
 
+	if ( zeek::detail::profile_sample_pending )
+		zeek::detail::take_profile_sample(nullptr);
+
 	g_frame_stack.pop_back();
 
 	return result;
@@ -634,6 +637,10 @@ IntrusivePtr<Val> BuiltinFunc::Call(const zeek::Args& args, Frame* parent) const
 	const CallExpr* call_expr = parent ? parent->GetCall() : nullptr;
 	call_stack.emplace_back(CallInfo{call_expr, this, args});
 	auto result = std::move(func(parent, &args).rval);
+
+	if ( zeek::detail::profile_sample_pending )
+		zeek::detail::take_profile_sample(nullptr, this);
+
 	call_stack.pop_back();
 
 	if ( result && g_trace_state.DoTrace() )
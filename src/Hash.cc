@@ -84,25 +84,19 @@ void init_hash_function()
 
 HashKey::HashKey(bro_int_t i)
 	{
-	key_u.i = i;
-	key = (void*) &key_u;
-	size = sizeof(i);
+	SetKey(&i, sizeof(i));
 	hash = HashBytes(key, size);
 	}
 
 HashKey::HashKey(bro_uint_t u)
 	{
-	key_u.i = bro_int_t(u);
-	key = (void*) &key_u;
-	size = sizeof(u);
+	SetKey(&u, sizeof(u));
 	hash = HashBytes(key, size);
 	}
 
 HashKey::HashKey(uint32_t u)
 	{
-	key_u.u32 = u;
-	key = (void*) &key_u;
-	size = sizeof(u);
+	SetKey(&u, sizeof(u));
 	hash = HashBytes(key, size);
 	}
 
@@ -115,22 +109,13 @@ HashKey::HashKey(const uint32_t u[], int n)
 
 HashKey::HashKey(double d)
 	{
-	union {
-		double d;
-		int i[2];
-	} u;
-
-	key_u.d = u.d = d;
-	key = (void*) &key_u;
-	size = sizeof(d);
+	SetKey(&d, sizeof(d));
 	hash = HashBytes(key, size);
 	}
 
 HashKey::HashKey(const void* p)
 	{
-	key_u.p = p;
-	key = (void*) &key_u;
-	size = sizeof(p);
+	SetKey(&p, sizeof(p));
 	hash = HashBytes(key, size);
 	}
 
@@ -150,26 +135,22 @@ HashKey::HashKey(const BroString* s)
 
 HashKey::HashKey(int copy_key, void* arg_key, int arg_size)
 	{
-	size = arg_size;
-	is_our_dynamic = true;
-
 	if ( copy_key )
-		{
-		key = (void*) new char[size];
-		memcpy(key, arg_key, size);
-		}
+		SetKey(arg_key, arg_size);
 	else
+		{
+		size = arg_size;
 		key = arg_key;
+		is_our_dynamic = true;
+		}
 
 	hash = HashBytes(key, size);
 	}
 
 HashKey::HashKey(const void* arg_key, int arg_size, hash_t arg_hash)
 	{
-	size = arg_size;
+	SetKey(arg_key, arg_size);
 	hash = arg_hash;
-	key = CopyKey(arg_key, size);
-	is_our_dynamic = true;
 	}
 
 HashKey::HashKey(const void* arg_key, int arg_size, hash_t arg_hash,
@@ -182,10 +163,8 @@ HashKey::HashKey(const void* arg_key, int arg_size, hash_t arg_hash,
 
 HashKey::HashKey(const void* bytes, int arg_size)
 	{
-	size = arg_size;
-	key = CopyKey(bytes, size);
+	SetKey(bytes, arg_size);
 	hash = HashBytes(key, size);
-	is_our_dynamic = true;
 	}
 
 void* HashKey::TakeKey()
@@ -199,6 +178,36 @@ void* HashKey::TakeKey()
 		return CopyKey(key, size);
 	}
 
+void* HashKey::Reserve(int arg_size)
+	{
+	ReleaseKey();
+
+	if ( arg_size <= INLINE_KEY_SIZE )
+		key = inline_key;
+	else
+		{
+		key = new char[arg_size];
+		is_our_dynamic = true;
+		}
+
+	size = arg_size;
+	return key;
+	}
+
+void HashKey::Seal(int arg_size)
+	{
+	size = arg_size;
+	hash = HashBytes(key, size);
+	}
+
+void HashKey::Borrow(const void* arg_key, int arg_size)
+	{
+	ReleaseKey();
+	key = const_cast<void*>(arg_key);
+	size = arg_size;
+	hash = HashBytes(key, size);
+	}
+
 void* HashKey::CopyKey(const void* k, int s) const
 	{
 	void* k_copy = (void*) new char[s];
@@ -206,6 +215,31 @@ void* HashKey::CopyKey(const void* k, int s) const
 	return k_copy;
 	}
 
+void HashKey::SetKey(const void* k, int s)
+	{
+	size = s;
+
+	if ( s <= INLINE_KEY_SIZE )
+		{
+		memcpy(inline_key, k, s);
+		key = inline_key;
+		}
+	else
+		{
+		key = CopyKey(k, s);
+		is_our_dynamic = true;
+		}
+	}
+
+void HashKey::ReleaseKey()
+	{
+	if ( is_our_dynamic )
+		{
+		delete [] (char*) key;
+		is_our_dynamic = false;
+		}
+	}
+
 hash_t HashKey::HashBytes(const void* bytes, int size)
 	{
 	return KeyedHash::Hash64(bytes, size);
@@ -208,6 +208,13 @@ typedef enum {
 
 class HashKey {
 public:
+	// Keys up to this size live inside the HashKey itself, so building
+	// one for a lookup doesn't need to allocate memory.
+	static constexpr int INLINE_KEY_SIZE = 64;
+
+	// Creates an empty key, to be filled in through Reserve() and Seal().
+	HashKey()	{ key = inline_key; hash = 0; size = 0; }
+
 	explicit HashKey(bro_int_t i);
 	explicit HashKey(bro_uint_t u);
 	explicit HashKey(uint32_t u);
@@ -222,6 +229,10 @@ public:
 			delete [] (char *) key;
 		}
 
+	// The key may point into the object itself.
+	HashKey(const HashKey&) = delete;
+	HashKey& operator=(const HashKey&) = delete;
+
 	// Create a HashKey given all of its components.  "key" is assumed
 	// to be dynamically allocated and to now belong to this HashKey
 	// (to delete upon destruct'ing).  If "copy_key" is true, it's
@@ -250,27 +261,40 @@ public:
 	// we give them a copy of it.
 	void* TakeKey();
 
+	// Returns space for a key of the given size, discarding the current
+	// key.  Space for keys of up to INLINE_KEY_SIZE bytes is the HashKey's
+	// own, aligned for any of the types keys get built from.  Once the
+	// key is written, Seal() sets its final size and computes its hash.
+	void* Reserve(int size);
+	void Seal(int size);
+
+	// Makes the key refer to the given bytes, *without* copying them
+	// and *without* taking ownership.
+	void Borrow(const void* key, int size);
+
 	const void* Key() const	{ return key; }
 	int Size() const	{ return size; }
 	hash_t Hash() const	{ return hash; }
 
-	unsigned int MemoryAllocation() const	{ return padded_sizeof(*this) + pad_size(size); }
+	unsigned int MemoryAllocation() const
+		{ return padded_sizeof(*this) + (is_our_dynamic ? pad_size(size) : 0); }
 
 	static hash_t HashBytes(const void* bytes, int size);
 protected:
 	void* CopyKey(const void* key, int size) const;
 
-	union {
-		bro_int_t i;
-		uint32_t u32;
-		double d;
-		const void* p;
-	} key_u;
+	// Sets the key to a copy of the given bytes, kept inline if they fit.
+	void SetKey(const void* key, int size);
+
+	// Frees the key if it's our dynamic.
+	void ReleaseKey();
 
 	void* key;
 	hash_t hash;
 	int size;
 	bool is_our_dynamic = false;
+
+	alignas(double) char inline_key[INLINE_KEY_SIZE];
 };
 
 extern void init_hash_function();
@@ -497,7 +497,7 @@ void ID::DescribeReST(ODesc* d, bool roles_only) const
 			{
 			switch ( type->Tag() ) {
 			case TYPE_TABLE:
-				if ( iv->AsTable()->Length() == 0 )
+				if ( iv->AsTableVal()->Size() == 0 )
 					{
 					d->Add(" ``{}``");
 					d->NL();
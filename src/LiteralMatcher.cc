@@ -0,0 +1,278 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "LiteralMatcher.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define HAVE_TEDDY_SSSE3
+#endif
+
+#include "3rdparty/doctest.h"
+
+using namespace zeek::detail;
+
+void LiteralMatcher::Add(std::string literal, int id)
+	{
+	assert(literal.size() >= MIN_LENGTH);
+
+	auto key = Key(reinterpret_cast<const u_char*>(literal.data()));
+	max_length = std::max(max_length, literal.size());
+	literals.push_back({std::move(literal), id, key});
+	}
+
+void LiteralMatcher::Compile()
+	{
+	std::stable_sort(literals.begin(), literals.end(),
+	                 [](const Literal& a, const Literal& b)
+	                 	{ return a.key < b.key; });
+
+	filter.assign((size_t(1) << FILTER_BITS) / 64, 0);
+
+	for ( const auto& l : literals )
+		{
+		auto idx = FilterIndex(l.key);
+		filter[idx / 64] |= uint64_t(1) << (idx % 64);
+		}
+
+	// Beyond a few literals per bucket, the nibble tables let most
+	// positions through.
+	use_teddy = literals.size() <= 8 * NUM_BUCKETS;
+
+	memset(lo_nibbles, 0, sizeof(lo_nibbles));
+	memset(hi_nibbles, 0, sizeof(hi_nibbles));
+
+	// Consecutive literals share a bucket, as they tend to have similar
+	// leading bytes.
+	size_t n = literals.size();
+
+	for ( size_t i = 0; i < n; ++i )
+		{
+		uint8_t bucket = 1 << (i * NUM_BUCKETS / n);
+
+		for ( size_t j = 0; j < MIN_LENGTH; ++j )
+			{
+			u_char c = literals[i].bytes[j];
+			lo_nibbles[j][c & 0x0f] |= bucket;
+			hi_nibbles[j][c >> 4] |= bucket;
+			}
+		}
+	}
+
+bool LiteralMatcher::Verify(const u_char* data, size_t len, size_t pos,
+                            const Callback& cb) const
+	{
+	auto key = Key(data + pos);
+	auto idx = FilterIndex(key);
+
+	if ( ! (filter[idx / 64] & (uint64_t(1) << (idx % 64))) )
+		return true;
+
+	auto it = std::lower_bound(literals.begin(), literals.end(), key,
+	                           [](const Literal& l, uint32_t k)
+	                           	{ return l.key < k; });
+
+	for ( ; it != literals.end() && it->key == key; ++it )
+		{
+		const auto& bytes = it->bytes;
+
+		if ( bytes.size() > len - pos ||
+		     memcmp(data + pos + MIN_LENGTH, bytes.data() + MIN_LENGTH,
+		            bytes.size() - MIN_LENGTH) != 0 )
+			continue;
+
+		if ( ! cb(it->id, pos) )
+			return false;
+		}
+
+	return true;
+	}
+
+bool LiteralMatcher::ScanScalar(const u_char* data, size_t len, size_t pos,
+                                const Callback& cb) const
+	{
+	for ( ; pos + MIN_LENGTH <= len; ++pos )
+		{
+		auto idx = FilterIndex(Key(data + pos));
+
+		if ( (filter[idx / 64] & (uint64_t(1) << (idx % 64))) &&
+		     ! Verify(data, len, pos, cb) )
+			return false;
+		}
+
+	return true;
+	}
+
+#ifdef HAVE_TEDDY_SSSE3
+
+__attribute__((target("ssse3")))
+bool LiteralMatcher::ScanTeddy(const u_char* data, size_t len, const Callback& cb) const
+	{
+	const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+	const __m128i zero = _mm_setzero_si128();
+
+	__m128i lo[MIN_LENGTH];
+	__m128i hi[MIN_LENGTH];
+
+	for ( size_t j = 0; j < MIN_LENGTH; ++j )
+		{
+		lo[j] = _mm_load_si128(reinterpret_cast<const __m128i*>(lo_nibbles[j]));
+		hi[j] = _mm_load_si128(reinterpret_cast<const __m128i*>(hi_nibbles[j]));
+		}
+
+	size_t pos = 0;
+
+	// Each round looks at 16 positions, reading two bytes beyond them.
+	for ( ; pos + 16 + MIN_LENGTH - 1 <= len; pos += 16 )
+		{
+		__m128i buckets = _mm_set1_epi8(-1);
+
+		for ( size_t j = 0; j < MIN_LENGTH; ++j )
+			{
+			auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos + j));
+			auto l = _mm_and_si128(d, nibble_mask);
+			auto h = _mm_and_si128(_mm_srli_epi16(d, 4), nibble_mask);
+
+			buckets = _mm_and_si128(buckets, _mm_shuffle_epi8(lo[j], l));
+			buckets = _mm_and_si128(buckets, _mm_shuffle_epi8(hi[j], h));
+			}
+
+		unsigned int candidates =
+			~_mm_movemask_epi8(_mm_cmpeq_epi8(buckets, zero)) & 0xffff;
+
+		while ( candidates )
+			{
+			int i = __builtin_ctz(candidates);
+			candidates &= candidates - 1;
+
+			if ( ! Verify(data, len, pos + i, cb) )
+				return false;
+			}
+		}
+
+	return ScanScalar(data, len, pos, cb);
+	}
+
+static bool have_ssse3()
+	{
+	static bool have = __builtin_cpu_supports("ssse3");
+	return have;
+	}
+
+#else
+
+bool LiteralMatcher::ScanTeddy(const u_char* data, size_t len, const Callback& cb) const
+	{
+	return ScanScalar(data, len, 0, cb);
+	}
+
+static bool have_ssse3()
+	{
+	return false;
+	}
+
+#endif
+
+bool LiteralMatcher::Scan(const u_char* data, size_t len, const Callback& cb) const
+	{
+	if ( literals.empty() )
+		return true;
+
+	if ( use_teddy && use_simd && have_ssse3() )
+		return ScanTeddy(data, len, cb);
+
+	return ScanScalar(data, len, 0, cb);
+	}
+
+static std::vector<std::pair<int, size_t>> scan_all(const LiteralMatcher& m,
+                                                    const std::string& s)
+	{
+	std::vector<std::pair<int, size_t>> hits;
+	m.Scan(reinterpret_cast<const u_char*>(s.data()), s.size(),
+	       [&hits](int id, size_t pos)
+	       	{
+	       	hits.emplace_back(id, pos);
+	       	return true;
+	       	});
+
+	std::sort(hits.begin(), hits.end());
+	return hits;
+	}
+
+TEST_CASE("literal matcher")
+	{
+	std::mt19937 rng(1);
+
+	// A small alphabet makes for plenty of near misses.
+	auto random_string = [&rng](size_t n)
+		{
+		std::string s;
+
+		for ( size_t i = 0; i < n; ++i )
+			s += "abcd\xff"[rng() % 5];
+
+		return s;
+		};
+
+	for ( size_t num_literals : { 1, 5, 40, 500 } )
+		{
+		std::vector<std::string> lits;
+		LiteralMatcher m;
+		LiteralMatcher scalar;
+		scalar.DisableSIMD();
+
+		for ( size_t i = 0; i < num_literals; ++i )
+			{
+			lits.push_back(random_string(3 + rng() % 6));
+			m.Add(lits.back(), i);
+			scalar.Add(lits.back(), i);
+			}
+
+		m.Compile();
+		scalar.Compile();
+
+		for ( size_t n : { 0, 2, 3, 17, 18, 19, 100, 1000 } )
+			{
+			auto s = random_string(n);
+
+			std::vector<std::pair<int, size_t>> expected;
+
+			for ( size_t i = 0; i < lits.size(); ++i )
+				for ( auto pos = s.find(lits[i]); pos != std::string::npos;
+				      pos = s.find(lits[i], pos + 1) )
+					expected.emplace_back(i, pos);
+
+			std::sort(expected.begin(), expected.end());
+
+			CHECK(scan_all(m, s) == expected);
+			CHECK(scan_all(scalar, s) == expected);
+			}
+		}
+
+	LiteralMatcher m;
+	m.Add("needle", 7);
+	m.Add("need", 8);
+	m.Compile();
+	CHECK(m.MaxLength() == 6);
+
+	std::string s = std::string(40, 'x') + "needle" + std::string(40, 'x') + "needle";
+	std::vector<size_t> positions;
+
+	// Occurrences get reported in order, and stopping works.
+	CHECK_FALSE(m.Scan(reinterpret_cast<const u_char*>(s.data()), s.size(),
+	                   [&positions](int id, size_t pos)
+	                   	{
+	                   	positions.push_back(pos);
+	                   	return positions.size() < 3;
+	                   	}));
+
+	std::vector<size_t> expected = {40, 40, 86};
+	CHECK(positions == expected);
+	}
@@ -0,0 +1,125 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace zeek { namespace detail {
+
+/**
+ * Finds occurrences of any of a set of literal strings in a buffer.
+ *
+ * Candidate positions get determined by a filter on the first three bytes
+ * of the literals. With few literals, that's the nibble-table filter of
+ * Hyperscan's "Teddy" matcher, which looks at 16 positions at once where
+ * the CPU supports SSSE3: the literals are distributed across eight
+ * buckets, and for each of the three bytes two tables map the low and the
+ * high nibble to the set of buckets having a literal that could match. A
+ * position is a candidate if the intersection of these sets is non-empty.
+ * With many literals, where that filter lets most positions pass, a bitmap
+ * over hashes of the first three bytes filters instead. Candidates then
+ * get verified against the literals sharing their first three bytes.
+ */
+class LiteralMatcher {
+public:
+	/**
+	 * The minimum length of a literal.
+	 */
+	static constexpr size_t MIN_LENGTH = 3;
+
+	/**
+	 * Callback reporting a literal's ID and the offset at which it
+	 * starts. Returning false stops the scan.
+	 */
+	using Callback = std::function<bool (int id, size_t pos)>;
+
+	/**
+	 * Adds a literal to look for.
+	 *
+	 * @param literal The literal, which must have at least MIN_LENGTH
+	 * bytes.
+	 *
+	 * @param id The ID to report for occurrences of the literal. Several
+	 * literals may share an ID.
+	 */
+	void Add(std::string literal, int id);
+
+	/**
+	 * Builds the data structures for scanning. Must be called after
+	 * adding literals and before scanning.
+	 */
+	void Compile();
+
+	/**
+	 * @return true if no literals have been added.
+	 */
+	bool Empty() const	{ return literals.empty(); }
+
+	/**
+	 * @return the length of the longest literal.
+	 */
+	size_t MaxLength() const	{ return max_length; }
+
+	/**
+	 * Reports all occurrences of the literals that lie completely within
+	 * a buffer, in order of the offsets they start at.
+	 *
+	 * @param data The buffer to search.
+	 *
+	 * @param len The length of the buffer.
+	 *
+	 * @param cb The callback to call for each occurrence.
+	 *
+	 * @return false if the callback stopped the scan.
+	 */
+	bool Scan(const u_char* data, size_t len, const Callback& cb) const;
+
+	/**
+	 * Makes Scan() avoid vector instructions, for testing and
+	 * benchmarking.
+	 */
+	void DisableSIMD()	{ use_simd = false; }
+
+private:
+	static constexpr int NUM_BUCKETS = 8;
+	static constexpr int FILTER_BITS = 18;
+
+	struct Literal {
+		std::string bytes;
+		int id;
+		uint32_t key;	// the first three bytes
+	};
+
+	static uint32_t Key(const u_char* p)
+		{ return p[0] | (p[1] << 8) | (p[2] << 16); }
+
+	static uint32_t FilterIndex(uint32_t key)
+		{ return (key * 2654435761u) >> (32 - FILTER_BITS); }
+
+	bool Verify(const u_char* data, size_t len, size_t pos,
+	            const Callback& cb) const;
+
+	bool ScanScalar(const u_char* data, size_t len, size_t pos,
+	                const Callback& cb) const;
+	bool ScanTeddy(const u_char* data, size_t len, const Callback& cb) const;
+
+	// Sorted by key.
+	std::vector<Literal> literals;
+	std::vector<uint64_t> filter;
+
+	// The nibble tables for the Teddy filter, each mapping to a bitmask
+	// of buckets.
+	alignas(16) uint8_t lo_nibbles[MIN_LENGTH][16];
+	alignas(16) uint8_t hi_nibbles[MIN_LENGTH][16];
+
+	size_t max_length = 0;
+	bool use_teddy = false;
+	bool use_simd = true;
+};
+
+}} // namespace zeek::detail
@@ -0,0 +1,659 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "MappedTable.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <set>
+
+#include "3rdparty/doctest.h"
+
+#include "CompHash.h"
+#include "Desc.h"
+#include "Hash.h"
+#include "Type.h"
+#include "Val.h"
+#include "util.h"
+
+// The file starts with a header, followed by the table type's signature
+// and the tag, then the elements' records, the index of the records
+// sorted by the static hash of their keys, and finally the buckets, which
+// hold for each value of the hash's top bits the position of the first
+// index entry with that value.
+//
+// Each record starts with the key's and the value's size, followed by the
+// key and the value.  Records, keys and values all start 8-aligned, as
+// CompositeHash aligns the pieces of a key by their address.
+static const char MAPPED_TABLE_MAGIC[8] = { 'Z', 'E', 'E', 'K', 'T', 'B', 'L', '\n' };
+static const uint32_t MAPPED_TABLE_VERSION = 1;
+
+// Tells apart files written on hosts with a different byte order.
+static const uint32_t MAPPED_TABLE_BYTE_ORDER = 0x01020304;
+
+// The static hash depends on digest_salt, so the file records what the
+// writer's hash made of this.
+static const char HASH_CHECK[] = "mapped table";
+
+static const int MAX_BUCKET_BITS = 24;
+
+struct FileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t hash_check;
+	uint32_t num_entries;
+	uint32_t bucket_bits;
+	uint64_t signature_len;
+	uint64_t tag_len;
+	uint64_t records_offset;
+	uint64_t index_offset;
+	uint64_t buckets_offset;
+	uint64_t file_size;
+};
+
+struct RecordHeader {
+	uint32_t key_size;
+	uint32_t val_size;
+};
+
+struct MappedTable::IndexEntry {
+	uint64_t hash;
+	uint64_t offset;	// of the record, from the start of the file
+};
+
+static uint64_t align8(uint64_t n)
+	{
+	return (n + 7) & ~uint64_t(7);
+	}
+
+static uint64_t value_offset(const RecordHeader& rh)
+	{
+	return align8(sizeof(RecordHeader) + rh.key_size);
+	}
+
+static uint64_t record_size(const RecordHeader& rh)
+	{
+	return align8(value_offset(rh) + rh.val_size);
+	}
+
+static uint64_t static_hash(const void* key, int size)
+	{
+	return KeyedHash::StaticHash64(key, size);
+	}
+
+static uint64_t bucket_of(uint64_t hash, int bits)
+	{
+	return bits ? hash >> (64 - bits) : 0;
+	}
+
+// Values get hashed on their own, with the yield type as the only index.
+static CompositeHash* value_hash(TableType* type)
+	{
+	if ( type->IsSet() )
+		return nullptr;
+
+	auto tl = make_intrusive<TypeList>(IntrusivePtr{NewRef{}, type->YieldType()});
+	tl->Append({NewRef{}, type->YieldType()});
+	return new CompositeHash(std::move(tl));
+	}
+
+static std::string type_signature(const TableType* type)
+	{
+	ODesc d;
+	type->Describe(&d);
+	return d.Description();
+	}
+
+static bool mappable_type(const BroType* t, std::set<const BroType*>* seen)
+	{
+	switch ( t->Tag() ) {
+	case TYPE_VOID:
+	case TYPE_TIMER:
+	case TYPE_ANY:
+	case TYPE_UNION:
+	case TYPE_FUNC:
+	case TYPE_FILE:
+	case TYPE_OPAQUE:
+	case TYPE_TYPE:
+	case TYPE_ERROR:
+		// Either CompositeHash can't take these at all, or it keeps
+		// an ID that only means something in the process hashing it.
+		return false;
+
+	case TYPE_RECORD:
+		{
+		if ( ! seen->insert(t).second )
+			return true;
+
+		const RecordType* rt = t->AsRecordType();
+
+		for ( int i = 0; i < rt->NumFields(); ++i )
+			if ( ! mappable_type(rt->FieldType(i), seen) )
+				return false;
+
+		return true;
+		}
+
+	case TYPE_TABLE:
+		{
+		const TableType* tt = t->AsTableType();
+
+		for ( const auto& it : *tt->IndexTypes() )
+			if ( ! mappable_type(it, seen) )
+				return false;
+
+		return tt->IsSet() || mappable_type(tt->YieldType(), seen);
+		}
+
+	case TYPE_VECTOR:
+		return mappable_type(t->AsVectorType()->YieldType(), seen);
+
+	case TYPE_LIST:
+		for ( const auto& lt : *t->AsTypeList()->Types() )
+			if ( ! mappable_type(lt, seen) )
+				return false;
+
+		return true;
+
+	default:
+		return true;
+	}
+	}
+
+bool MappedTable::IsMappable(const TableType* type)
+	{
+	// Lookups of addresses in a table indexed by subnet need the
+	// table's PrefixTable.
+	if ( type->IsSubNetIndex() )
+		return false;
+
+	std::set<const BroType*> seen;
+
+	if ( ! mappable_type(type->Indices(), &seen) )
+		return false;
+
+	if ( type->IsSet() )
+		return true;
+
+	// CompositeHash takes these only as part of a composite key.
+	const BroType* yield = type->YieldType();
+
+	if ( yield->Tag() == TYPE_TABLE || yield->Tag() == TYPE_VECTOR )
+		return false;
+
+	return mappable_type(yield, &seen);
+	}
+
+MappedTable::MappedTable(TableType* type, const char* arg_mapped,
+                         uint64_t arg_mapped_len)
+	: mapped(arg_mapped), mapped_len(arg_mapped_len)
+	{
+	val_hash = value_hash(type);
+	}
+
+MappedTable::~MappedTable()
+	{
+	delete val_hash;
+	munmap(const_cast<char*>(mapped), mapped_len);
+	}
+
+std::unique_ptr<MappedTable> MappedTable::Open(const std::string& path,
+                                               TableType* type,
+                                               const std::string& tag,
+                                               std::string* err)
+	{
+	int fd = open(path.c_str(), O_RDONLY);
+
+	if ( fd < 0 )
+		{
+		*err = strerror(errno);
+		return nullptr;
+		}
+
+	struct stat st;
+
+	if ( fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(FileHeader) )
+		{
+		*err = "file too short";
+		close(fd);
+		return nullptr;
+		}
+
+	void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if ( p == MAP_FAILED )
+		{
+		*err = strerror(errno);
+		return nullptr;
+		}
+
+	std::unique_ptr<MappedTable> m(new MappedTable(type, static_cast<const char*>(p),
+	                                               st.st_size));
+	m->path = path;
+
+	FileHeader hdr;
+	memcpy(&hdr, m->mapped, sizeof(hdr));
+
+	if ( memcmp(hdr.magic, MAPPED_TABLE_MAGIC, sizeof(MAPPED_TABLE_MAGIC)) != 0 ||
+	     hdr.version != MAPPED_TABLE_VERSION || hdr.byte_order != MAPPED_TABLE_BYTE_ORDER )
+		{
+		*err = "written by a different version or host";
+		return nullptr;
+		}
+
+	if ( hdr.hash_check != static_hash(HASH_CHECK, sizeof(HASH_CHECK)) )
+		{
+		*err = "written with a different digest_salt";
+		return nullptr;
+		}
+
+	uint64_t len = m->mapped_len;
+	uint64_t num_buckets = hdr.bucket_bits <= MAX_BUCKET_BITS ?
+		(uint64_t(1) << hdr.bucket_bits) + 1 : 0;
+
+	if ( hdr.file_size != len || hdr.bucket_bits > MAX_BUCKET_BITS ||
+	     hdr.signature_len > len || hdr.tag_len > len ||
+	     align8(sizeof(hdr) + hdr.signature_len) + hdr.tag_len > hdr.records_offset ||
+	     hdr.records_offset > hdr.index_offset || hdr.index_offset > len ||
+	     hdr.index_offset % 8 ||
+	     hdr.num_entries > (len - hdr.index_offset) / sizeof(IndexEntry) ||
+	     hdr.index_offset + hdr.num_entries * sizeof(IndexEntry) > hdr.buckets_offset ||
+	     hdr.buckets_offset > len || num_buckets > (len - hdr.buckets_offset) / sizeof(uint32_t) ||
+	     hdr.num_entries > INT_MAX )
+		{
+		*err = "file corrupt";
+		return nullptr;
+		}
+
+	const char* signature = m->mapped + sizeof(hdr);
+	const char* file_tag = m->mapped + align8(sizeof(hdr) + hdr.signature_len);
+
+	if ( std::string(signature, hdr.signature_len) != type_signature(type) )
+		{
+		*err = "written for a different table type";
+		return nullptr;
+		}
+
+	if ( std::string(file_tag, hdr.tag_len) != tag )
+		{
+		*err = "written from a different source";
+		return nullptr;
+		}
+
+	m->num_entries = hdr.num_entries;
+	m->bucket_bits = hdr.bucket_bits;
+	m->index = reinterpret_cast<const IndexEntry*>(m->mapped + hdr.index_offset);
+	m->buckets = reinterpret_cast<const uint32_t*>(m->mapped + hdr.buckets_offset);
+	m->records_offset = hdr.records_offset;
+	m->records_end = hdr.index_offset;
+
+	for ( uint64_t b = 0; b < num_buckets; ++b )
+		{
+		uint32_t prev = b ? m->buckets[b - 1] : 0;
+
+		if ( m->buckets[b] < prev || m->buckets[b] > hdr.num_entries )
+			{
+			*err = "file corrupt";
+			return nullptr;
+			}
+		}
+
+	if ( m->buckets[num_buckets - 1] != hdr.num_entries )
+		{
+		*err = "file corrupt";
+		return nullptr;
+		}
+
+	return m;
+	}
+
+const char* MappedTable::Record(uint64_t offset) const
+	{
+	if ( offset < records_offset || offset % 8 ||
+	     offset > records_end - sizeof(RecordHeader) )
+		return nullptr;
+
+	RecordHeader rh;
+	memcpy(&rh, mapped + offset, sizeof(rh));
+
+	if ( record_size(rh) > records_end - offset )
+		return nullptr;
+
+	return mapped + offset;
+	}
+
+IntrusivePtr<Val> MappedTable::DecodeValue(const char* record) const
+	{
+	if ( ! val_hash )
+		return nullptr;
+
+	RecordHeader rh;
+	memcpy(&rh, record, sizeof(rh));
+
+	HashKey k(record + value_offset(rh), rh.val_size, 0, true);
+	return {NewRef{}, val_hash->RecoverVals(&k)->Index(0)};
+	}
+
+bool MappedTable::Lookup(const HashKey& k, IntrusivePtr<Val>* value) const
+	{
+	uint64_t hash = static_hash(k.Key(), k.Size());
+	uint64_t b = bucket_of(hash, bucket_bits);
+
+	const IndexEntry* end = index + buckets[b + 1];
+	const IndexEntry* e = std::lower_bound(index + buckets[b], end, hash,
+	        [](const IndexEntry& ie, uint64_t h) { return ie.hash < h; });
+
+	for ( ; e != end && e->hash == hash; ++e )
+		{
+		const char* r = Record(e->offset);
+
+		if ( ! r )
+			continue;
+
+		RecordHeader rh;
+		memcpy(&rh, r, sizeof(rh));
+
+		if ( int(rh.key_size) != k.Size() ||
+		     memcmp(r + sizeof(rh), k.Key(), k.Size()) != 0 )
+			continue;
+
+		if ( value )
+			*value = DecodeValue(r);
+
+		return true;
+		}
+
+	return false;
+	}
+
+void MappedTable::GetKey(int i, HashKey* k) const
+	{
+	const char* r = Record(index[i].offset);
+
+	if ( ! r )
+		{
+		k->Borrow(nullptr, 0);
+		return;
+		}
+
+	RecordHeader rh;
+	memcpy(&rh, r, sizeof(rh));
+	k->Borrow(r + sizeof(rh), rh.key_size);
+	}
+
+IntrusivePtr<Val> MappedTable::GetValue(int i) const
+	{
+	const char* r = Record(index[i].offset);
+	return r ? DecodeValue(r) : nullptr;
+	}
+
+MappedTableBuilder::MappedTableBuilder(TableType* type)
+	{
+	signature = type_signature(type);
+	key_hash = new CompositeHash({NewRef{}, type->Indices()});
+	val_hash = value_hash(type);
+	}
+
+MappedTableBuilder::~MappedTableBuilder()
+	{
+	delete key_hash;
+	delete val_hash;
+	}
+
+bool MappedTableBuilder::Add(const Val* index, const Val* value)
+	{
+	if ( (value != nullptr) != (val_hash != nullptr) )
+		return false;
+
+	HashKey k;
+	HashKey vk;
+
+	if ( ! key_hash->ComputeHash(index, true, &k) )
+		return false;
+
+	if ( value && ! val_hash->ComputeHash(value, true, &vk) )
+		return false;
+
+	RecordHeader rh = { uint32_t(k.Size()), uint32_t(vk.Size()) };
+	uint64_t offset = records.size();
+
+	records.resize(offset + record_size(rh), 0);
+	memcpy(&records[offset], &rh, sizeof(rh));
+	memcpy(&records[offset + sizeof(rh)], k.Key(), k.Size());
+
+	if ( vk.Size() )
+		memcpy(&records[offset + value_offset(rh)], vk.Key(), vk.Size());
+
+	entries.push_back({static_hash(k.Key(), k.Size()), offset, entries.size()});
+	return true;
+	}
+
+bool MappedTableBuilder::Write(const std::string& path, const std::string& tag,
+                               std::string* err) const
+	{
+	auto same_key = [this](const Entry& a, const Entry& b)
+		{
+		RecordHeader ra, rb;
+		memcpy(&ra, &records[a.offset], sizeof(ra));
+		memcpy(&rb, &records[b.offset], sizeof(rb));
+
+		return ra.key_size == rb.key_size &&
+			memcmp(&records[a.offset + sizeof(ra)],
+			       &records[b.offset + sizeof(rb)], ra.key_size) == 0;
+		};
+
+	// Within the same hash, the latest addition of an index comes first,
+	// and replaces those before it.
+	std::vector<Entry> sorted(entries);
+	std::sort(sorted.begin(), sorted.end(), [](const Entry& a, const Entry& b)
+		{
+		return a.hash != b.hash ? a.hash < b.hash : a.seq > b.seq;
+		});
+
+	std::vector<Entry> kept;
+	kept.reserve(sorted.size());
+	size_t run = 0;
+
+	for ( const auto& e : sorted )
+		{
+		if ( kept.empty() || kept.back().hash != e.hash )
+			run = kept.size();
+
+		bool replaced = false;
+
+		for ( size_t i = run; i < kept.size() && ! replaced; ++i )
+			replaced = same_key(kept[i], e);
+
+		if ( ! replaced )
+			kept.push_back(e);
+		}
+
+	if ( kept.size() > INT_MAX )
+		{
+		*err = "too many elements";
+		return false;
+		}
+
+	int bits = 0;
+
+	while ( bits < MAX_BUCKET_BITS && (uint64_t(1) << (bits + 1)) <= kept.size() )
+		++bits;
+
+	std::vector<uint32_t> buckets((size_t(1) << bits) + 1, 0);
+
+	for ( const auto& e : kept )
+		++buckets[bucket_of(e.hash, bits) + 1];
+
+	for ( size_t b = 1; b < buckets.size(); ++b )
+		buckets[b] += buckets[b - 1];
+
+	FileHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, MAPPED_TABLE_MAGIC, sizeof(MAPPED_TABLE_MAGIC));
+	hdr.version = MAPPED_TABLE_VERSION;
+	hdr.byte_order = MAPPED_TABLE_BYTE_ORDER;
+	hdr.hash_check = static_hash(HASH_CHECK, sizeof(HASH_CHECK));
+	hdr.num_entries = kept.size();
+	hdr.bucket_bits = bits;
+	hdr.signature_len = signature.size();
+	hdr.tag_len = tag.size();
+	hdr.records_offset = align8(align8(sizeof(hdr) + signature.size()) + tag.size());
+
+	std::vector<MappedTable::IndexEntry> index;
+	index.reserve(kept.size());
+	uint64_t offset = hdr.records_offset;
+
+	for ( const auto& e : kept )
+		{
+		RecordHeader rh;
+		memcpy(&rh, &records[e.offset], sizeof(rh));
+		index.push_back({e.hash, offset});
+		offset += record_size(rh);
+		}
+
+	hdr.index_offset = offset;
+	hdr.buckets_offset = offset + index.size() * sizeof(MappedTable::IndexEntry);
+	hdr.file_size = hdr.buckets_offset + buckets.size() * sizeof(uint32_t);
+
+	// Other processes may be mapping the old file, so replace it as a
+	// whole.
+	std::string tmp = fmt("%s.%d.tmp", path.c_str(), getpid());
+	FILE* f = fopen(tmp.c_str(), "w");
+
+	if ( ! f )
+		{
+		*err = strerror(errno);
+		return false;
+		}
+
+	static const char padding[8] = { 0 };
+
+	auto write_padded = [f](const void* data, uint64_t len)
+		{
+		fwrite(data, len, 1, f);
+		fwrite(padding, align8(len) - len, 1, f);
+		};
+
+	fwrite(&hdr, sizeof(hdr), 1, f);
+	write_padded(signature.data(), signature.size());
+	write_padded(tag.data(), tag.size());
+
+	for ( const auto& e : kept )
+		{
+		RecordHeader rh;
+		memcpy(&rh, &records[e.offset], sizeof(rh));
+		fwrite(&records[e.offset], record_size(rh), 1, f);
+		}
+
+	fwrite(index.data(), sizeof(MappedTable::IndexEntry), index.size(), f);
+	fwrite(buckets.data(), sizeof(uint32_t), buckets.size(), f);
+
+	if ( ferror(f) | fclose(f) )
+		{
+		*err = strerror(errno);
+		unlink(tmp.c_str());
+		return false;
+		}
+
+	if ( rename(tmp.c_str(), path.c_str()) < 0 )
+		{
+		*err = strerror(errno);
+		unlink(tmp.c_str());
+		return false;
+		}
+
+	return true;
+	}
+
+TEST_CASE("mapped table")
+	{
+	if ( ! val_mgr )
+		val_mgr = new ValManager();
+
+	auto indices = make_intrusive<TypeList>();
+	indices->Append(base_type(TYPE_STRING));
+	indices->Append(base_type(TYPE_COUNT));
+	auto tt = make_intrusive<TableType>(std::move(indices), base_type(TYPE_STRING));
+
+	CHECK(MappedTable::IsMappable(tt.get()));
+
+	auto make_index = [](const char* s, int n)
+		{
+		auto lv = make_intrusive<ListVal>(TYPE_ANY);
+		lv->Append(new StringVal(s));
+		lv->Append(val_mgr->Count(n).release());
+		return lv;
+		};
+
+	MappedTableBuilder b(tt.get());
+
+	for ( int i = 0; i < 1000; ++i )
+		CHECK(b.Add(make_index("x", i).get(), make_intrusive<StringVal>(fmt("v%d", i)).get()));
+
+	// The later one wins.
+	CHECK(b.Add(make_index("x", 7).get(), make_intrusive<StringVal>("seven").get()));
+
+	// A set element doesn't fit a table.
+	CHECK_FALSE(b.Add(make_index("x", 1).get(), nullptr));
+
+	char path[] = "/tmp/zeek-mapped-table-XXXXXX";
+	int fd = mkstemp(path);
+	REQUIRE(fd >= 0);
+	close(fd);
+
+	std::string err;
+	REQUIRE(b.Write(path, "tag", &err));
+
+	CHECK_FALSE(MappedTable::Open(path, tt.get(), "other tag", &err));
+
+	auto m = MappedTable::Open(path, tt.get(), "tag", &err);
+	REQUIRE(m);
+	CHECK(m->Size() == 1000);
+
+	CompositeHash ch({NewRef{}, tt->Indices()});
+	HashKey k;
+	IntrusivePtr<Val> v;
+
+	REQUIRE(ch.ComputeHash(make_index("x", 42).get(), true, &k));
+	CHECK(m->Lookup(k, &v));
+	CHECK(v->AsString()->CheckString() == std::string("v42"));
+
+	REQUIRE(ch.ComputeHash(make_index("x", 7).get(), true, &k));
+	CHECK(m->Lookup(k, &v));
+	CHECK(v->AsString()->CheckString() == std::string("seven"));
+
+	REQUIRE(ch.ComputeHash(make_index("y", 42).get(), true, &k));
+	CHECK_FALSE(m->Lookup(k, &v));
+
+	int found = 0;
+
+	for ( int i = 0; i < m->Size(); ++i )
+		{
+		HashKey ki;
+		m->GetKey(i, &ki);
+		auto idx = ch.RecoverVals(&ki);
+		auto n = idx->Index(1)->AsCount();
+		auto vi = m->GetValue(i);
+
+		if ( vi->AsString()->CheckString() == (n == 7 ? std::string("seven") : std::string(fmt("v%d", int(n)))) )
+			++found;
+		}
+
+	CHECK(found == 1000);
+
+	auto st = make_intrusive<TableType>(IntrusivePtr{NewRef{}, tt->Indices()}, nullptr);
+	CHECK_FALSE(MappedTable::Open(path, st.get(), "tag", &err));
+
+	unlink(path);
+	}
@@ -0,0 +1,191 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "IntrusivePtr.h"
+
+class Val;
+class BroType;
+class TableType;
+class CompositeHash;
+class HashKey;
+
+/**
+ * A read-only table kept in a memory-mapped file, so that all processes
+ * of a host that map the same file share its pages through the page cache.
+ * The file holds the elements' index keys, in the form the table's
+ * CompositeHash gives them, and their values in the same composite form,
+ * found through an index sorted by a hash of the keys that stays the same
+ * across processes. A TableVal can be backed by a MappedTable in place of
+ * its own entries, see TableVal::SetMapping().
+ */
+class MappedTable {
+public:
+	/**
+	 * Maps a table file written by MappedTableBuilder::Write().
+	 *
+	 * @param path The file.
+	 *
+	 * @param type The type of the table the file has to hold.
+	 *
+	 * @param tag The tag the file has to have been written with.
+	 *
+	 * @param err Set to the reason if the file can't be used.
+	 *
+	 * @return The mapped table, or null if the file doesn't exist, can't
+	 * be mapped, or was written for another table type or tag.
+	 */
+	static std::unique_ptr<MappedTable> Open(const std::string& path,
+	                                         TableType* type,
+	                                         const std::string& tag,
+	                                         std::string* err);
+
+	/**
+	 * Returns true if tables of the given type can be mapped. That takes
+	 * index and value types that CompositeHash recovers the same in every
+	 * process, and values of a type other than a table or vector by
+	 * themselves.
+	 */
+	static bool IsMappable(const TableType* type);
+
+	~MappedTable();
+
+	MappedTable(const MappedTable&) = delete;
+	MappedTable& operator=(const MappedTable&) = delete;
+
+	/**
+	 * @return The number of elements.
+	 */
+	int Size() const	{ return num_entries; }
+
+	/**
+	 * Looks up an element.
+	 *
+	 * @param k The element's index key, as the table's CompositeHash
+	 * computes it.
+	 *
+	 * @param value If not null and the table isn't a set, set to the
+	 * element's value, which gets decoded anew for each lookup.
+	 *
+	 * @return True if the element exists.
+	 */
+	bool Lookup(const HashKey& k, IntrusivePtr<Val>* value) const;
+
+	/**
+	 * Makes a key refer to the index key of an element in the mapping,
+	 * for going through all elements.
+	 *
+	 * @param i The element's position, less than Size().
+	 *
+	 * @param k The key to set.
+	 */
+	void GetKey(int i, HashKey* k) const;
+
+	/**
+	 * Decodes the value of an element.
+	 *
+	 * @param i The element's position, less than Size().
+	 *
+	 * @return The value, or null for sets.
+	 */
+	IntrusivePtr<Val> GetValue(int i) const;
+
+	/**
+	 * @return The size of the mapped file.
+	 */
+	uint64_t FileSize() const	{ return mapped_len; }
+
+	/**
+	 * @return The path the file was mapped from.
+	 */
+	const std::string& Path() const	{ return path; }
+
+private:
+	friend class MappedTableBuilder;
+
+	struct IndexEntry;
+
+	MappedTable(TableType* type, const char* mapped, uint64_t mapped_len);
+
+	// Returns the start of the record for an element, or null if the
+	// record doesn't fit into the file.
+	const char* Record(uint64_t offset) const;
+	IntrusivePtr<Val> DecodeValue(const char* record) const;
+
+	std::string path;
+	const char* mapped;
+	uint64_t mapped_len;
+
+	int num_entries = 0;
+	int bucket_bits = 0;
+	const IndexEntry* index = nullptr;
+	const uint32_t* buckets = nullptr;
+	uint64_t records_offset = 0;
+	uint64_t records_end = 0;
+
+	CompositeHash* val_hash = nullptr;	// null for sets
+};
+
+/**
+ * Collects the elements of a table to write them to a file for
+ * MappedTable.
+ */
+class MappedTableBuilder {
+public:
+	/**
+	 * @param type The type of the table, which IsMappable() has to accept.
+	 */
+	explicit MappedTableBuilder(TableType* type);
+	~MappedTableBuilder();
+
+	MappedTableBuilder(const MappedTableBuilder&) = delete;
+	MappedTableBuilder& operator=(const MappedTableBuilder&) = delete;
+
+	/**
+	 * Adds an element, replacing one added before with the same index.
+	 *
+	 * @param index The element's index.
+	 *
+	 * @param value The element's value, null for sets.
+	 *
+	 * @return False if index or value don't match the table's types.
+	 */
+	bool Add(const Val* index, const Val* value);
+
+	/**
+	 * Writes the elements added so far to a file. The file gets written
+	 * under a temporary name first and then renamed, so that processes
+	 * mapping the previous version keep seeing that one whole.
+	 *
+	 * @param path The file.
+	 *
+	 * @param tag A tag that MappedTable::Open() checks, to tell files
+	 * built from different sources apart.
+	 *
+	 * @param err Set to the reason if the file can't be written.
+	 *
+	 * @return True if the file has been written.
+	 */
+	bool Write(const std::string& path, const std::string& tag,
+	           std::string* err) const;
+
+private:
+	struct Entry {
+		uint64_t hash;
+		uint64_t offset;	// in records
+		uint64_t seq;	// order of adding
+	};
+
+	std::string signature;
+	CompositeHash* key_hash;
+	CompositeHash* val_hash;	// null for sets
+
+	std::vector<char> records;
+	std::vector<Entry> entries;
+};
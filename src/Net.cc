@@ -36,6 +36,7 @@ extern "C" {
 #include "iosource/Manager.h"
 #include "iosource/PktSrc.h"
 #include "iosource/PktDumper.h"
+#include "FlowShards.h"
 #include "plugin/Manager.h"
 #include "broker/Manager.h"
 
@@ -174,6 +175,12 @@ void net_init(const std::optional<std::string>& interface,
 		if ( ! ps->IsOpen() )
 			reporter->FatalError("problem with interface %s (%s)",
 				interface->c_str(), ps->ErrorMsg());
+
+		// Otherwise every shard would capture and parse all of the
+		// interface's traffic just to drop most of it.
+		if ( zeek::num_flow_shards && ! ps->DistributesFlows() )
+			reporter->FatalError("--flow-shards needs a packet source that distributes flows to read from interface %s, like tpacket:: with TPacket::enable_fanout",
+				interface->c_str());
 		}
 
 	else
@@ -259,7 +266,9 @@ void net_packet_dispatch(double t, const Packet* pkt, iosource::PktSrc* src_ps)
 			}
 		}
 
+	PacketBuffer::SetCurrent(pkt->Buffer());
 	sessions->NextPacket(t, pkt);
+	PacketBuffer::SetCurrent(nullptr);
 	mgr.Drain();
 
 	if ( sp )
@@ -161,6 +161,10 @@ double gap_report_freq;
 int packet_filter_default;
 
 int sig_max_group_size;
+int sig_literal_prefilter;
+
+StringVal* dfa_cache_file;
+int dfa_cache_expand_states;
 
 TableType* irc_join_list;
 RecordType* irc_join_info;
@@ -222,6 +226,10 @@ void init_general_global_var()
 	packet_filter_default = opt_internal_int("packet_filter_default");
 
 	sig_max_group_size = opt_internal_int("sig_max_group_size");
+	sig_literal_prefilter = opt_internal_int("sig_literal_prefilter");
+
+	dfa_cache_file = internal_val("dfa_cache_file")->AsStringVal();
+	dfa_cache_expand_states = opt_internal_int("dfa_cache_expand_states");
 
 	check_for_unused_event_handlers =
 		opt_internal_int("check_for_unused_event_handlers");
@@ -160,6 +160,10 @@ extern int load_sample_freq;
 extern int packet_filter_default;
 
 extern int sig_max_group_size;
+extern int sig_literal_prefilter;
+
+extern StringVal* dfa_cache_file;
+extern int dfa_cache_expand_states;
 
 extern TableType* irc_join_list;
 extern RecordType* irc_join_info;
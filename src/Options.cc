@@ -115,6 +115,7 @@ void zeek::usage(const char* prog, int code)
 #endif
 	fprintf(stderr, "    --pseudo-realtime[=<speedup>]  | enable pseudo-realtime for performance evaluation (default 1)\n");
 	fprintf(stderr, "    -j|--jobs                      | enable supervisor mode\n");
+	fprintf(stderr, "    --flow-shards <n>              | split packet processing by flow across <n> processes\n");
 
 #ifdef USE_IDMEF
 	fprintf(stderr, "    -n|--idmef-dtd <idmef-msg.dtd> | specify path to IDMEF DTD file\n");
@@ -131,7 +132,8 @@ void zeek::usage(const char* prog, int code)
 	fprintf(stderr, "    $ZEEK_PROFILER_FILE            | Output file for script execution statistics (not set)\n");
 	fprintf(stderr, "    $ZEEK_DISABLE_ZEEKYGEN         | Disable Zeekygen documentation support (%s)\n", zeekenv("ZEEK_DISABLE_ZEEKYGEN") ? "set" : "not set");
 	fprintf(stderr, "    $ZEEK_DNS_RESOLVER             | IPv4/IPv6 address of DNS resolver to use (%s)\n", zeekenv("ZEEK_DNS_RESOLVER") ? zeekenv("ZEEK_DNS_RESOLVER") : "not set, will use first IPv4 address from /etc/resolv.conf");
-	fprintf(stderr, "    $ZEEK_DEBUG_LOG_STDERR         | Use stderr for debug logs generated via the -B flag");
+	fprintf(stderr, "    $ZEEK_DEBUG_LOG_STDERR         | Use stderr for debug logs generated via the -B flag\n");
+	fprintf(stderr, "    $ZEEK_TIMER_MGR                | timer manager implementation, 'pq' or 'wheel' (%s)\n", zeekenv("ZEEK_TIMER_MGR") ? zeekenv("ZEEK_TIMER_MGR") : "pq");
 
 	fprintf(stderr, "\n");
 
@@ -230,6 +232,7 @@ zeek::Options zeek::parse_cmdline(int argc, char** argv)
 
 		{"pseudo-realtime",	optional_argument, nullptr,	'E'},
 		{"jobs",	optional_argument, nullptr,	'j'},
+		{"flow-shards",	required_argument, nullptr,	'%'},
 		{"test",		no_argument,		nullptr,	'#'},
 
 		{nullptr,			0,			nullptr,	0},
@@ -397,6 +400,17 @@ zeek::Options zeek::parse_cmdline(int argc, char** argv)
 			break;
 #endif
 
+		case '%':
+			rval.flow_shards = atoi(optarg);
+
+			if ( rval.flow_shards < 1 )
+				{
+				fprintf(stderr, "ERROR: --flow-shards needs a positive number of shards.\n");
+				exit(1);
+				}
+
+			break;
+
 		case '#':
 			fprintf(stderr, "ERROR: --test only allowed as first argument.\n");
 			usage(zargs[0], 1);
@@ -477,5 +491,26 @@ zeek::Options zeek::parse_cmdline(int argc, char** argv)
 			canonify_script_path(&s);
 		}
 
+	if ( rval.flow_shards )
+		{
+		if ( rval.supervisor_mode )
+			{
+			fprintf(stderr, "ERROR: --flow-shards cannot be combined with supervisor mode.\n");
+			exit(1);
+			}
+
+		if ( ! rval.pcap_file && ! rval.interface )
+			{
+			fprintf(stderr, "ERROR: --flow-shards requires reading packets with -r or -i.\n");
+			exit(1);
+			}
+
+		if ( rval.pcap_file && *rval.pcap_file == "-" )
+			{
+			fprintf(stderr, "ERROR: --flow-shards cannot read packets from stdin.\n");
+			exit(1);
+			}
+		}
+
 	return rval;
 	}
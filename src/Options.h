@@ -48,6 +48,7 @@ struct Options {
 	DNS_MgrMode dns_mode = DNS_DEFAULT;
 
 	bool supervisor_mode = false;
+	int flow_shards = 0;
 	bool parse_only = false;
 	bool bare_mode = false;
 	bool debug_scripts = false;
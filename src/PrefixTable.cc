@@ -2,6 +2,552 @@
 #include "Reporter.h"
 #include "Val.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "3rdparty/doctest.h"
+
+namespace {
+
+// The number of prefixes from which on a table gets a PrefixIndex. Below
+// that, the patricia tree is about as fast and the index's top-level
+// arrays would take most of the table's memory.
+constexpr int MIN_INDEXED_PREFIXES = 4096;
+
+// An address as the index works with it, in host order.
+struct Key {
+	uint64_t hi = 0;
+	uint64_t lo = 0;
+
+	bool operator==(const Key& other) const
+		{ return hi == other.hi && lo == other.lo; }
+};
+
+Key make_key(const IPAddr& addr)
+	{
+	uint32_t w[4];
+	addr.CopyIPv6(w, IPAddr::Host);
+
+	Key k;
+	k.hi = (uint64_t(w[0]) << 32) | w[1];
+	k.lo = (uint64_t(w[2]) << 32) | w[3];
+	return k;
+	}
+
+Key make_key(const prefix_t* prefix)
+	{
+	return make_key(IPAddr(IPv6, reinterpret_cast<const uint32_t*>(&prefix->add.sin6), IPAddr::Network));
+	}
+
+// Clears all but the top width bits.
+Key mask_key(Key k, int width)
+	{
+	if ( width <= 0 )
+		return Key();
+
+	if ( width < 64 )
+		{
+		k.hi &= ~uint64_t(0) << (64 - width);
+		k.lo = 0;
+		}
+
+	else if ( width == 64 )
+		k.lo = 0;
+
+	else if ( width < 128 )
+		k.lo &= ~uint64_t(0) << (128 - width);
+
+	return k;
+	}
+
+bool key_bit(const Key& k, int bit)
+	{
+	return bit < 64 ? (k.hi >> (63 - bit)) & 1 : (k.lo >> (127 - bit)) & 1;
+	}
+
+// Returns the six bits starting at bit pos, with bits past the end of the
+// address taken as zero.
+unsigned int key_bits6(const Key& k, int pos)
+	{
+	if ( pos <= 58 )
+		return (k.hi >> (58 - pos)) & 0x3f;
+
+	if ( pos < 64 )
+		return ((k.hi << (pos - 58)) | (k.lo >> (122 - pos))) & 0x3f;
+
+	if ( pos <= 122 )
+		return (k.lo >> (122 - pos)) & 0x3f;
+
+	return (k.lo << (pos - 122)) & 0x3f;
+	}
+
+// The IPv4-mapped part of the address space, ::ffff:0:0/96.
+const Key v4_space = { 0, uint64_t(0xffff) << 32 };
+
+bool in_v4_space(const Key& k, int width)
+	{
+	return width >= 96 && mask_key(k, 96) == v4_space;
+	}
+
+}
+
+/**
+ * A multibit trie for finding the longest prefix of a PrefixTable that
+ * matches an address, in the way of Poptrie (Asai and Ohara, SIGCOMM 2015).
+ * The top 16 bits of an address, after the ::ffff:0:0/96 for IPv4 ones,
+ * select a slot of a directly indexed array, similar to DIR-24-8.
+ * Each slot holds either the data of the longest prefix that covers all of
+ * it, or the root of a trie for the longer prefixes within the slot. Trie
+ * nodes consume six bits at a time, and keep their children and their
+ * leaves each in one contiguous run that popcounts of per-node bitmaps
+ * index into, which makes them small enough for a lookup to touch only a
+ * handful of cache lines.
+ *
+ * The patricia tree remains the authority on the table's contents. A
+ * change of a prefix only marks the slots it overlaps as needing to be
+ * rebuilt from the tree, which their next lookup does. The nodes of
+ * rebuilt slots are left in place until they make up half of all nodes,
+ * at which point everything gets rebuilt.
+ */
+class PrefixIndex {
+public:
+	explicit PrefixIndex(patricia_tree_t* arg_tree) : tree(arg_tree)
+		{ Reset(); }
+
+	void* Lookup(const Key& k);
+	void Lookup(const IPAddr* addrs, int n, void** results);
+
+	// Marks the slots overlapping a prefix as needing to be rebuilt.
+	void Changed(Key k, int width);
+
+	unsigned int MemoryAllocation() const;
+
+private:
+	struct Node {
+		uint64_t vector;	// bit i: child i is a node
+		uint64_t leafvec;	// bit i: child i starts a run of leaves
+		uint32_t base0;	// index of the first leaf
+		uint32_t base1;	// index of the first child node
+	};
+
+	struct Entry {
+		Key key;
+		int width;
+		void* data;
+	};
+
+	// A slot is a leaf index, a node index with NODE set, or DIRTY.
+	static constexpr uint32_t NODE = 0x80000000;
+	static constexpr uint32_t DIRTY = 0xffffffff;
+
+	static constexpr int V4_SLOT_BITS = 16;
+	static constexpr int V6_SLOT_BITS = 16;
+
+	// Rebuilding more slots than that at once, everything gets rebuilt.
+	static constexpr uint32_t MAX_DIRTY_SLOTS = 4096;
+
+	uint32_t* Slot(const Key& k, bool v4, int* pos)
+		{
+		if ( v4 )
+			{
+			*pos = 96 + V4_SLOT_BITS;
+			return &slots4[(k.lo >> (32 - V4_SLOT_BITS)) & ((1 << V4_SLOT_BITS) - 1)];
+			}
+
+		*pos = V6_SLOT_BITS;
+		return &slots6[k.hi >> (64 - V6_SLOT_BITS)];
+		}
+
+	void* Walk(uint32_t s, const Key& k, int pos) const;
+
+	void Reset();
+	void MarkDirty(std::vector<uint32_t>* slots, uint32_t first, uint32_t count);
+	uint32_t BuildSlot(bool v4, uint32_t i);
+	void BuildNode(uint32_t self, const Entry* begin, const Entry* end,
+	               int pos, void* def);
+	void Collect(const Key& base, int width, bool skip_v4);
+	void* BestCovering(const Key& base, int width) const;
+	uint32_t CountNodes(uint32_t n) const;
+
+	patricia_tree_t* tree;
+
+	std::vector<uint32_t> slots4;
+	std::vector<uint32_t> slots6;
+	std::vector<Node> nodes;
+	std::vector<void*> leaves;	// leaves[0] is the null for no match
+	uint32_t garbage = 0;	// nodes and leaves of rebuilt slots
+	bool stale = false;
+
+	std::vector<Entry> entries;	// scratch space for BuildSlot()
+};
+
+void* PrefixIndex::Lookup(const Key& k)
+	{
+	if ( stale )
+		Reset();
+
+	bool v4 = (k.hi == 0 && (k.lo >> 32) == 0xffff);
+	int pos;
+	uint32_t* slot = Slot(k, v4, &pos);
+
+	if ( *slot == DIRTY )
+		*slot = BuildSlot(v4, slot - (v4 ? slots4.data() : slots6.data()));
+
+	return Walk(*slot, k, pos);
+	}
+
+void* PrefixIndex::Walk(uint32_t s, const Key& k, int pos) const
+	{
+	if ( ! (s & NODE) )
+		return leaves[s];
+
+	const Node* n = &nodes[s & ~NODE];
+
+	while ( true )
+		{
+		uint64_t bit = uint64_t(1) << key_bits6(k, pos);
+		uint64_t upto = (bit << 1) - 1;
+
+		if ( ! (n->vector & bit) )
+			return leaves[n->base0 + __builtin_popcountll(n->leafvec & upto) - 1];
+
+		n = &nodes[n->base1 + __builtin_popcountll(n->vector & upto) - 1];
+		pos += 6;
+		}
+	}
+
+void PrefixIndex::Lookup(const IPAddr* addrs, int n, void** results)
+	{
+	if ( stale )
+		Reset();
+
+	// Resolves the slots of a group of addresses first, prefetching
+	// what each of them leads to, so that the cache misses of the
+	// group overlap instead of following one another.
+	constexpr int GROUP = 16;
+	Key keys[GROUP];
+	uint32_t* slots[GROUP];
+	int pos[GROUP];
+
+	for ( int i = 0; i < n; i += GROUP )
+		{
+		int m = std::min(GROUP, n - i);
+
+		for ( int j = 0; j < m; ++j )
+			{
+			keys[j] = make_key(addrs[i + j]);
+			bool v4 = (keys[j].hi == 0 && (keys[j].lo >> 32) == 0xffff);
+			slots[j] = Slot(keys[j], v4, &pos[j]);
+			__builtin_prefetch(slots[j]);
+			}
+
+		for ( int j = 0; j < m; ++j )
+			{
+			uint32_t s = *slots[j];
+
+			if ( s == DIRTY )
+				continue;
+
+			if ( s & NODE )
+				__builtin_prefetch(&nodes[s & ~NODE]);
+			else
+				__builtin_prefetch(&leaves[s]);
+			}
+
+		for ( int j = 0; j < m; ++j )
+			{
+			if ( *slots[j] == DIRTY )
+				results[i + j] = Lookup(keys[j]);
+			else
+				results[i + j] = Walk(*slots[j], keys[j], pos[j]);
+			}
+		}
+	}
+
+void PrefixIndex::Changed(Key k, int width)
+	{
+	if ( stale )
+		return;
+
+	k = mask_key(k, width);
+
+	if ( in_v4_space(k, width) )
+		{
+		int rel = width - 96;
+		uint32_t first = (k.lo >> (32 - V4_SLOT_BITS)) & ((1 << V4_SLOT_BITS) - 1);
+		MarkDirty(&slots4, first, rel >= V4_SLOT_BITS ? 1 : 1 << (V4_SLOT_BITS - rel));
+		}
+
+	else
+		{
+		uint32_t first = k.hi >> (64 - V6_SLOT_BITS);
+		MarkDirty(&slots6, first, width >= V6_SLOT_BITS ? 1 : 1 << (V6_SLOT_BITS - width));
+
+		// Shorter IPv6 prefixes can cover IPv4 addresses, too.
+		if ( width < 96 && mask_key(v4_space, width) == k )
+			MarkDirty(&slots4, 0, slots4.size());
+		}
+
+	if ( garbage > (nodes.size() + leaves.size()) / 2 )
+		stale = true;
+	}
+
+void PrefixIndex::MarkDirty(std::vector<uint32_t>* slots, uint32_t first, uint32_t count)
+	{
+	if ( count > MAX_DIRTY_SLOTS )
+		{
+		stale = true;
+		return;
+		}
+
+	for ( uint32_t i = first; i < first + count; ++i )
+		{
+		uint32_t& s = (*slots)[i];
+
+		if ( s != DIRTY && (s & NODE) )
+			garbage += CountNodes(s & ~NODE);
+
+		s = DIRTY;
+		}
+	}
+
+uint32_t PrefixIndex::CountNodes(uint32_t i) const
+	{
+	const Node& n = nodes[i];
+	uint32_t count = 1 + __builtin_popcountll(n.leafvec);
+	int children = __builtin_popcountll(n.vector);
+
+	for ( int j = 0; j < children; ++j )
+		count += CountNodes(n.base1 + j);
+
+	return count;
+	}
+
+void PrefixIndex::Reset()
+	{
+	slots4.assign(1 << V4_SLOT_BITS, DIRTY);
+	slots6.assign(1 << V6_SLOT_BITS, DIRTY);
+	nodes.clear();
+	leaves.assign(1, nullptr);
+	garbage = 0;
+	stale = false;
+	}
+
+uint32_t PrefixIndex::BuildSlot(bool v4, uint32_t i)
+	{
+	Key base;
+	int width;
+
+	if ( v4 )
+		{
+		base.lo = v4_space.lo | (uint64_t(i) << (32 - V4_SLOT_BITS));
+		width = 96 + V4_SLOT_BITS;
+		}
+	else
+		{
+		base.hi = uint64_t(i) << (64 - V6_SLOT_BITS);
+		width = V6_SLOT_BITS;
+		}
+
+	void* def = BestCovering(base, width);
+	Collect(base, width, ! v4);
+
+	if ( entries.empty() )
+		{
+		if ( ! def )
+			return 0;
+
+		// Neighboring slots often fall under the same prefix.
+		if ( leaves.back() != def )
+			leaves.push_back(def);
+
+		return leaves.size() - 1;
+		}
+
+	uint32_t root = nodes.size();
+	nodes.emplace_back();
+	BuildNode(root, entries.data(), entries.data() + entries.size(), width, def);
+
+	return root | NODE;
+	}
+
+void PrefixIndex::BuildNode(uint32_t self, const Entry* begin, const Entry* end,
+                            int pos, void* def)
+	{
+	// Prefixes ending within the node's six bits cover a range of its
+	// children, longer ones go into a child node. The entries come in
+	// the order of the tree, by address and with shorter prefixes
+	// first, so the ones for a child node are adjacent, and a prefix
+	// comes before any longer one that it covers.
+	void* leaf[64];
+	const Entry* child_begin[64];
+	const Entry* child_end[64];
+	int end_pos = pos + 6;
+
+	for ( int i = 0; i < 64; ++i )
+		{
+		leaf[i] = def;
+		child_begin[i] = child_end[i] = nullptr;
+		}
+
+	for ( const Entry* e = begin; e != end; ++e )
+		{
+		unsigned int i = key_bits6(e->key, pos);
+
+		if ( e->width <= end_pos )
+			{
+			unsigned int span = 1u << (end_pos - e->width);
+
+			for ( unsigned int j = i; j < i + span; ++j )
+				leaf[j] = e->data;
+			}
+
+		else
+			{
+			if ( ! child_begin[i] )
+				child_begin[i] = e;
+
+			child_end[i] = e + 1;
+			}
+		}
+
+	Node n;
+	n.vector = n.leafvec = 0;
+	n.base0 = leaves.size();
+	n.base1 = nodes.size();
+
+	int children = 0;
+	bool have_leaf = false;
+
+	for ( int i = 0; i < 64; ++i )
+		{
+		uint64_t bit = uint64_t(1) << i;
+
+		if ( child_begin[i] )
+			{
+			n.vector |= bit;
+			++children;
+			continue;
+			}
+
+		if ( ! have_leaf || leaves.back() != leaf[i] )
+			{
+			n.leafvec |= bit;
+			leaves.push_back(leaf[i]);
+			have_leaf = true;
+			}
+		}
+
+	nodes.resize(nodes.size() + children);
+	nodes[self] = n;
+
+	int child = 0;
+
+	for ( int i = 0; i < 64; ++i )
+		{
+		if ( child_begin[i] )
+			BuildNode(n.base1 + child++, child_begin[i], child_end[i],
+			          end_pos, leaf[i]);
+		}
+	}
+
+void PrefixIndex::Collect(const Key& base, int width, bool skip_v4)
+	{
+	entries.clear();
+
+	// Finds the subtree of prefixes longer than the slot's, then keeps
+	// the ones within the slot.
+	patricia_node_t* node = tree->head;
+
+	while ( node && node->bit < unsigned(width) )
+		node = key_bit(base, node->bit) ? node->r : node->l;
+
+	if ( ! node )
+		return;
+
+	patricia_node_t* pn;
+
+	PATRICIA_WALK(node, pn) {
+		int pwidth = pn->prefix->bitlen;
+		Key k = mask_key(make_key(pn->prefix), pwidth);
+
+		if ( pwidth > width && mask_key(k, width) == base &&
+		     ! (skip_v4 && in_v4_space(k, pwidth)) )
+			entries.push_back({k, pwidth, pn->data});
+	} PATRICIA_WALK_END;
+	}
+
+void* PrefixIndex::BestCovering(const Key& base, int width) const
+	{
+	// Not patricia_search_best2(), which can also come up with a
+	// longer prefix that happens to match the slot's zero bits.
+	patricia_node_t* node = tree->head;
+	void* best = nullptr;
+
+	while ( node && node->bit <= unsigned(width) )
+		{
+		if ( node->prefix )
+			{
+			int pwidth = node->prefix->bitlen;
+
+			if ( mask_key(make_key(node->prefix), pwidth) == mask_key(base, pwidth) )
+				best = node->data;
+			}
+
+		if ( node->bit == unsigned(width) )
+			break;
+
+		node = key_bit(base, node->bit) ? node->r : node->l;
+		}
+
+	return best;
+	}
+
+unsigned int PrefixIndex::MemoryAllocation() const
+	{
+	return padded_sizeof(*this)
+		+ pad_size(slots4.capacity() * sizeof(uint32_t))
+		+ pad_size(slots6.capacity() * sizeof(uint32_t))
+		+ pad_size(nodes.capacity() * sizeof(Node))
+		+ pad_size(leaves.capacity() * sizeof(void*))
+		+ pad_size(entries.capacity() * sizeof(Entry));
+	}
+
+PrefixTable::PrefixTable(bool arg_indexed)
+	{
+	tree = New_Patricia(128);
+	delete_function = nullptr;
+	indexed = arg_indexed;
+	}
+
+PrefixTable::~PrefixTable()
+	{
+	Destroy_Patricia(tree, delete_function);
+	}
+
+void PrefixTable::Clear()
+	{
+	Clear_Patricia(tree, delete_function);
+	index.reset();
+	}
+
+void PrefixTable::Changed(const IPAddr& addr, int width)
+	{
+	if ( index )
+		{
+		if ( tree->num_active_node < MIN_INDEXED_PREFIXES / 2 )
+			index.reset();
+		else
+			index->Changed(make_key(addr), width);
+		}
+
+	else if ( indexed && tree->num_active_node >= MIN_INDEXED_PREFIXES )
+		index = std::make_unique<PrefixIndex>(tree);
+	}
+
 prefix_t* PrefixTable::MakePrefix(const IPAddr& addr, int width)
 	{
 	prefix_t* prefix = (prefix_t*) safe_malloc(sizeof(prefix_t));
@@ -37,6 +583,9 @@ void* PrefixTable::Insert(const IPAddr& addr, int width, void* data)
 	// node itself.
 	node->data = data ? data : node;
 
+	if ( node->data != old )
+		Changed(addr, width);
+
 	return old;
 	}
 
@@ -88,6 +637,9 @@ std::list<std::tuple<IPPrefix,void*>> PrefixTable::FindAll(const SubNetVal* valu
 
 void* PrefixTable::Lookup(const IPAddr& addr, int width, bool exact) const
 	{
+	if ( index && width == 128 && ! exact )
+		return index->Lookup(make_key(addr));
+
 	prefix_t* prefix = MakePrefix(addr, width);
 	patricia_node_t* node =
 		exact ? patricia_search_exact(tree, prefix) :
@@ -100,6 +652,18 @@ void* PrefixTable::Lookup(const IPAddr& addr, int width, bool exact) const
 	return node ? node->data : nullptr;
 	}
 
+void PrefixTable::Lookup(const IPAddr* addrs, int n, void** results) const
+	{
+	if ( index )
+		{
+		index->Lookup(addrs, n, results);
+		return;
+		}
+
+	for ( int i = 0; i < n; ++i )
+		results[i] = Lookup(addrs[i], 128);
+	}
+
 void* PrefixTable::Lookup(const Val* value, bool exact) const
 	{
 	// [elem] -> elem
@@ -135,6 +699,7 @@ void* PrefixTable::Remove(const IPAddr& addr, int width)
 
 	void* old = node->data;
 	patricia_remove(tree, node);
+	Changed(addr, width);
 
 	return old;
 	}
@@ -202,3 +767,139 @@ void* PrefixTable::GetNext(iterator* i)
 
 	// Not reached.
 	}
+
+unsigned int PrefixTable::MemoryAllocation() const
+	{
+	unsigned int size = padded_sizeof(*this) + padded_sizeof(*tree);
+	patricia_node_t* node;
+
+	PATRICIA_WALK_ALL(tree->head, node) {
+		size += padded_sizeof(*node);
+
+		if ( node->prefix )
+			size += padded_sizeof(*node->prefix);
+	} PATRICIA_WALK_END;
+
+	if ( index )
+		size += index->MemoryAllocation();
+
+	return size;
+	}
+
+TEST_CASE("prefix table index")
+	{
+	PrefixTable indexed(true);
+	PrefixTable plain(false);
+	std::vector<std::pair<IPAddr, int>> prefixes;
+	std::mt19937 rng(7);
+
+	auto insert = [&](const IPAddr& addr, int width, void* data)
+		{
+		indexed.Insert(addr, width, data);
+		plain.Insert(addr, width, data);
+		};
+
+	auto remove = [&](const IPAddr& addr, int width)
+		{
+		indexed.Remove(addr, width);
+		plain.Remove(addr, width);
+		};
+
+	auto random_addr = [&](bool v4)
+		{
+		uint32_t w[4];
+
+		if ( v4 )
+			{
+			w[0] = w[1] = 0;
+			w[2] = 0xffff;
+			w[3] = 0x0a000000 | (rng() & 0x00ffffff);
+			}
+		else
+			{
+			w[0] = 0x20010000 | (rng() & 0xff);
+			w[1] = rng();
+			w[2] = rng();
+			w[3] = rng();
+			}
+
+		return IPAddr(IPv6, w, IPAddr::Host);
+		};
+
+	auto check = [&]()
+		{
+		std::vector<IPAddr> addrs;
+
+		for ( int i = 0; i < 2000; ++i )
+			{
+			IPAddr a = random_addr(i % 3);
+
+			// Half of them next to a prefix.
+			if ( i % 2 )
+				{
+				uint32_t w[4];
+				prefixes[rng() % prefixes.size()].first.CopyIPv6(w, IPAddr::Host);
+				w[3] ^= rng() & 0xfff;
+				a = IPAddr(IPv6, w, IPAddr::Host);
+				}
+
+			addrs.push_back(a);
+			}
+
+		std::vector<void*> results(addrs.size());
+		indexed.Lookup(addrs.data(), addrs.size(), results.data());
+
+		int mismatches = 0;
+
+		for ( size_t i = 0; i < addrs.size(); ++i )
+			{
+			void* expected = plain.Lookup(addrs[i], 128);
+
+			if ( indexed.Lookup(addrs[i], 128) != expected ||
+			     results[i] != expected )
+				++mismatches;
+			}
+
+		CHECK(mismatches == 0);
+		};
+
+	for ( int i = 0; i < 2 * MIN_INDEXED_PREFIXES; ++i )
+		{
+		bool v4 = i % 3;
+		int width = v4 ? 104 + rng() % 25 : 16 + rng() % 113;
+		IPAddr a = random_addr(v4);
+		a.Mask(width);
+
+		prefixes.emplace_back(a, width);
+		insert(a, width, reinterpret_cast<void*>(uintptr_t(i + 1) << 4));
+		}
+
+	// Prefixes covering many slots, including all IPv4 ones.
+	uint32_t zero[4] = { 0, 0, 0, 0 };
+	uint32_t ten[4] = { 0, 0, 0xffff, 0x0a000000 };
+	insert(IPAddr(IPv6, zero, IPAddr::Host), 0, &indexed);
+	insert(IPAddr(IPv6, ten, IPAddr::Host), 104, &plain);
+	check();
+
+	// Changes invalidate the slots they touch.
+	for ( int i = 0; i < 500; ++i )
+		{
+		const auto& p = prefixes[rng() % prefixes.size()];
+
+		if ( i % 2 )
+			remove(p.first, p.second);
+		else
+			insert(p.first, p.second, reinterpret_cast<void*>(uintptr_t(rng()) << 4 | 16));
+
+		if ( i % 50 == 0 )
+			check();
+		}
+
+	remove(IPAddr(IPv6, zero, IPAddr::Host), 0);
+	remove(IPAddr(IPv6, ten, IPAddr::Host), 104);
+	check();
+
+	indexed.Clear();
+	plain.Clear();
+	CHECK(indexed.Lookup(prefixes[0].first, 128) == nullptr);
+	}
@@ -5,11 +5,13 @@ extern "C" {
 }
 
 #include <list>
+#include <memory>
 
 #include "IPAddr.h"
 
 class Val;
 class SubNetVal;
+class PrefixIndex;
 
 class PrefixTable {
 private:
@@ -21,8 +23,11 @@ private:
 	};
 
 public:
-	PrefixTable()	{ tree = New_Patricia(128); delete_function = nullptr; }
-	~PrefixTable()	{ Destroy_Patricia(tree, delete_function); }
+	// If indexed is true, longest-prefix lookups of single addresses go
+	// through a multibit trie built alongside the patricia tree once the
+	// table has grown large enough for it to pay off.
+	explicit PrefixTable(bool indexed = true);
+	~PrefixTable();
 
 	// Addr in network byte order. If data is zero, acts like a set.
 	// Returns ptr to old data if already existing.
@@ -38,6 +43,11 @@ public:
 	void* Lookup(const IPAddr& addr, int width, bool exact = false) const;
 	void* Lookup(const Val* value, bool exact = false) const;
 
+	// Looks up the longest prefix matching each of n addresses at once,
+	// setting results[i] to what Lookup(addrs[i], 128) returns. Faster
+	// than separate lookups when there are many addresses to check.
+	void Lookup(const IPAddr* addrs, int n, void** results) const;
+
 	// Returns list of all found matches or empty list otherwise.
 	std::list<std::tuple<IPPrefix,void*>> FindAll(const IPAddr& addr, int width) const;
 	std::list<std::tuple<IPPrefix,void*>> FindAll(const SubNetVal* value) const;
@@ -46,7 +56,7 @@ public:
 	void* Remove(const IPAddr& addr, int width);
 	void* Remove(const Val* value);
 
-	void Clear()	{ Clear_Patricia(tree, delete_function); }
+	void Clear();
 
 	// Sets a function to call for each node when table is cleared/destroyed.
 	void SetDeleteFunction(data_fn_t del_fn)	{ delete_function = del_fn; }
@@ -54,10 +64,19 @@ public:
 	iterator InitIterator();
 	void* GetNext(iterator* i);
 
+	// Returns the memory used by the tree and its index.
+	unsigned int MemoryAllocation() const;
+
 private:
 	static prefix_t* MakePrefix(const IPAddr& addr, int width);
 	static IPPrefix PrefixToIPPrefix(prefix_t* p);
 
+	// Keeps the index up to date with a prefix that has been inserted,
+	// changed or removed.
+	void Changed(const IPAddr& addr, int width);
+
 	patricia_tree_t* tree;
 	data_fn_t delete_function;
+	bool indexed;
+	std::unique_ptr<PrefixIndex> index;
 };
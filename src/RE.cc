@@ -11,6 +11,8 @@
 #include "EquivClass.h"
 #include "Reporter.h"
 #include "BroString.h"
+#include "DFACache.h"
+#include "digest.h"
 
 CCL* curr_ccl = nullptr;
 
@@ -36,6 +38,9 @@ Specific_RE_Matcher::Specific_RE_Matcher(match_type arg_mt, int arg_multiline)
 
 Specific_RE_Matcher::~Specific_RE_Matcher()
 	{
+	if ( dfa )
+		zeek::detail::unregister_dfa(this);
+
 	for ( int i = 0; i < ccl_list.length(); ++i )
 		delete ccl_list[i];
 
@@ -145,6 +150,8 @@ bool Specific_RE_Matcher::Compile(bool lazy)
 
 	ecs = EC()->EquivClasses();
 
+	RegisterDFA(fmt("%d %d %s", mt, multiline, pattern_text));
+
 	return true;
 	}
 
@@ -192,9 +199,28 @@ bool Specific_RE_Matcher::CompileSet(const string_list& set, const int_list& idx
 	dfa = new DFA_Machine(nfa, EC());
 	ecs = EC()->EquivClasses();
 
+	std::string desc = fmt("set %d", multiline);
+
+	loop_over_list(set, j)
+		{
+		desc += fmt(" %d ", idx[j]);
+		desc.append(set[j], strlen(set[j]) + 1);
+		}
+
+	RegisterDFA(desc);
+
 	return true;
 	}
 
+void Specific_RE_Matcher::RegisterDFA(const std::string& desc)
+	{
+	u_char digest[MD5_DIGEST_LENGTH];
+	internal_md5(reinterpret_cast<const u_char*>(desc.data()), desc.size(), digest);
+	cache_key.assign(reinterpret_cast<const char*>(digest), sizeof(digest));
+
+	zeek::detail::register_dfa(this);
+	}
+
 std::string Specific_RE_Matcher::LookupDef(const std::string& def)
 	{
 	const auto& iter = defs.find(def);
@@ -106,6 +106,9 @@ public:
 
 	DFA_Machine* DFA() const		{ return dfa; }
 
+	// Identifies the compiled patterns in the DFA cache.
+	const std::string& CacheKey() const	{ return cache_key; }
+
 	void Dump(FILE* f);
 
 	unsigned int MemoryAllocation() const;
@@ -119,6 +122,10 @@ protected:
 	// appending to an existing pattern_text.
 	void AddPat(const char* pat, const char* orig_fmt, const char* app_fmt);
 
+	// Sets the cache key from the given description of the patterns
+	// and registers with the DFA cache.
+	void RegisterDFA(const std::string& desc);
+
 	bool MatchAll(const u_char* bv, int n);
 	int Match(const u_char* bv, int n);
 
@@ -134,6 +141,7 @@ protected:
 	DFA_Machine* dfa;
 	CCL* any_ccl;
 	AcceptingSet* accepted;
+	std::string cache_key;
 };
 
 class RE_Match_State {
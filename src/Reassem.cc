@@ -4,6 +4,9 @@
 #include "Reassem.h"
 
 #include <algorithm>
+#include <string>
+
+#include "3rdparty/doctest.h"
 
 #include "Desc.h"
 
@@ -11,13 +14,26 @@ using std::min;
 
 uint64_t Reassembler::total_size = 0;
 uint64_t Reassembler::sizes[REASSEM_NUM];
+uint64_t Reassembler::fast_path_hits[REASSEM_NUM];
+uint64_t Reassembler::fast_path_misses[REASSEM_NUM];
 
-DataBlock::DataBlock(const u_char* data, uint64_t size, uint64_t arg_seq)
+void DataBlock::Keep(PacketBuffer* pkt_buffer)
 	{
-	seq = arg_seq;
-	upper = seq + size;
-	block = new u_char[size];
-	memcpy(block, data, size);
+	if ( buffer )
+		return;
+
+	// The reassembler's memory accounting only counts the block's own
+	// size, so pin the packet's buffer only if the block makes up most
+	// of it.  That keeps what a block actually holds on to within twice
+	// what gets accounted for.
+	if ( pkt_buffer && pkt_buffer->Contains(block, Size()) &&
+	     Size() * 2 >= pkt_buffer->Capacity() )
+		buffer = {NewRef{}, pkt_buffer};
+	else
+		{
+		buffer = make_intrusive<PacketBuffer>(block, Size());
+		block = buffer->Data();
+		}
 	}
 
 void DataBlockList::DataSize(uint64_t seq_cutoff, uint64_t* below, uint64_t* above) const
@@ -72,12 +88,16 @@ void DataBlockList::Clear()
 	Reassembler::sizes[reassembler->rtype] -= total;
 	total_data_size = 0;
 	block_map.clear();
+	borrowed.clear();
 	}
 
 void DataBlockList::Append(DataBlock block, uint64_t limit)
 	{
 	total_data_size += block.Size();
 
+	if ( block.Borrowed() )
+		borrowed.push_back(block.seq);
+
 	block_map.emplace_hint(block_map.end(), block.seq, std::move(block));
 
 	while ( block_map.size() > limit )
@@ -104,6 +124,7 @@ DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data,
 	{
 	auto size = upper - seq;
 	auto rval = block_map.emplace_hint(hint, seq, DataBlock(data, size, seq));
+	borrowed.push_back(seq);
 
 	total_data_size += size;
 	Reassembler::sizes[reassembler->rtype] += size + sizeof(DataBlock);
@@ -264,6 +285,19 @@ uint64_t DataBlockList::Trim(uint64_t seq, uint64_t max_old,
 	return num_missing;
 	}
 
+void DataBlockList::KeepBorrowed(PacketBuffer* pkt_buffer)
+	{
+	for ( auto seq : borrowed )
+		{
+		auto it = block_map.find(seq);
+
+		if ( it != block_map.end() )
+			it->second.Keep(pkt_buffer);
+		}
+
+	borrowed.clear();
+	}
+
 Reassembler::Reassembler(uint64_t init_seq, ReassemblerType reassem_type)
 	: block_list(this), old_block_list(this),
 	  last_reassem_seq(init_seq), trim_seq(init_seq),
@@ -345,8 +379,19 @@ void Reassembler::NewBlock(double t, uint64_t seq, uint64_t len, const u_char* d
 		len -= amount_old;
 		}
 
-	auto it = block_list.Insert(seq, upper_seq, data);;
+	auto it = block_list.Insert(seq, upper_seq, data);
 	BlockInserted(it);
+
+	// Whatever the subclass didn't consume right away needs to outlive
+	// the data passed in.
+	KeepBorrowedBlocks();
+	}
+
+void Reassembler::KeepBorrowedBlocks()
+	{
+	auto pkt_buffer = PacketBuffer::Current();
+	block_list.KeepBorrowed(pkt_buffer);
+	old_block_list.KeepBorrowed(pkt_buffer);
 	}
 
 uint64_t Reassembler::TrimToSeq(uint64_t seq)
@@ -385,3 +430,89 @@ uint64_t Reassembler::MemoryAllocation(ReassemblerType rtype)
 	return Reassembler::sizes[rtype];
 	}
 
+
+namespace {
+
+// Delivers in-order data right away and trims it, like TCP does.
+class TestReassembler final : public Reassembler {
+public:
+	TestReassembler() : Reassembler(0, REASSEM_UNKNOWN)	{ }
+
+	const DataBlockList& Blocks() const	{ return block_list; }
+
+	std::string delivered;
+
+protected:
+	void BlockInserted(DataBlockMap::const_iterator it) override
+		{
+		while ( it != block_list.End() && it->second.seq <= last_reassem_seq )
+			{
+			const auto& b = it->second;
+
+			if ( b.upper > last_reassem_seq )
+				{
+				auto offset = last_reassem_seq - b.seq;
+				delivered.append((const char*) b.block + offset, b.Size() - offset);
+				last_reassem_seq = b.upper;
+				}
+
+			++it;
+			}
+
+		TrimToSeq(last_reassem_seq);
+		}
+
+	void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override
+		{ }
+};
+
+}
+
+TEST_CASE("reassembler keeps only buffered data")
+	{
+	auto buf = make_intrusive<PacketBuffer>(20);
+	memcpy(buf->Data(), "0123456789abcdefghij", 20);
+	PacketBuffer::SetCurrent(buf.get());
+
+	TestReassembler r;
+
+	// Consumed right away, so nothing refers to the packet anymore.
+	r.NewBlock(0, 0, 5, buf->Data());
+	CHECK(r.delivered == "01234");
+	CHECK_FALSE(r.HasBlocks());
+	CHECK_FALSE(buf->Shared());
+
+	// Buffered behind a hole, which keeps a reference instead of copying.
+	r.NewBlock(0, 10, 10, buf->Data() + 10);
+	CHECK(r.HasBlocks());
+	CHECK(buf->Shared());
+	CHECK(r.Blocks().FirstBlock().block == buf->Data() + 10);
+
+	// Data outside of the packet gets copied.
+	u_char other[5];
+	memcpy(other, "KLMNO", 5);
+	r.NewBlock(0, 20, 5, other);
+	memset(other, 0, sizeof(other));
+	CHECK(memcmp(r.Blocks().LastBlock().block, "KLMNO", 5) == 0);
+
+	// So does a small part of a large packet, rather than pinning it.
+	auto big = make_intrusive<PacketBuffer>(64);
+	memcpy(big->Data(), "UVWXY", 5);
+	PacketBuffer::SetCurrent(big.get());
+	r.NewBlock(0, 30, 5, big->Data());
+	CHECK_FALSE(big->Shared());
+	CHECK(r.Blocks().LastBlock().block != big->Data());
+	CHECK(memcmp(r.Blocks().LastBlock().block, "UVWXY", 5) == 0);
+
+	PacketBuffer::SetCurrent(nullptr);
+
+	// Filling the first hole delivers up to the second one.
+	r.NewBlock(0, 5, 5, (const u_char*) "56789");
+	CHECK(r.delivered == "0123456789abcdefghijKLMNO");
+	CHECK(r.Blocks().NumBlocks() == 1);
+	CHECK_FALSE(buf->Shared());
+
+	r.NewBlock(0, 25, 5, (const u_char*) "PQRST");
+	CHECK(r.delivered == "0123456789abcdefghijKLMNOPQRSTUVWXY");
+	CHECK_FALSE(r.HasBlocks());
+	}
@@ -3,8 +3,10 @@
 #pragma once
 
 #include <map>
+#include <vector>
 
 #include "Obj.h"
+#include "iosource/Packet.h"
 
 #include <assert.h>
 #include <string.h>
@@ -27,62 +29,22 @@ class Reassembler;
 
 
 /**
- * A block/segment of data for use in the reassembly process.
+ * A block/segment of data for use in the reassembly process.  A block
+ * either refers to memory it doesn't own, which is only the case while the
+ * data is being added (see Reassembler::NewBlock()), or it holds a
+ * reference to a buffer with the data.  Copies of a block share the
+ * buffer.
  */
 class DataBlock {
 public:
 
 	/**
 	 * Create a data block/segment with associated sequence numbering.
+	 * The block refers to the data without copying it.
 	 */
-	DataBlock(const u_char* data, uint64_t size, uint64_t seq);
-
-	DataBlock(const DataBlock& other)
-		{
-		seq = other.seq;
-		upper = other.upper;
-		auto size = other.Size();
-		block = new u_char[size];
-		memcpy(block, other.block, size);
-		}
-
-	DataBlock(DataBlock&& other)
-		{
-		seq = other.seq;
-		upper = other.upper;
-		block = other.block;
-		other.block = nullptr;
-		}
-
-	DataBlock& operator=(const DataBlock& other)
-		{
-		if ( this == &other )
-			return *this;
-
-		seq = other.seq;
-		upper = other.upper;
-		auto size = other.Size();
-		delete [] block;
-		block = new u_char[size];
-		memcpy(block, other.block, size);
-		return *this;
-		}
-
-	DataBlock& operator=(DataBlock&& other)
-		{
-		if ( this == &other )
-			return *this;
-
-		seq = other.seq;
-		upper = other.upper;
-		delete [] block;
-		block = other.block;
-		other.block = nullptr;
-		return *this;
-		}
-
-	~DataBlock()
-		{ delete [] block; }
+	DataBlock(const u_char* data, uint64_t size, uint64_t seq)
+		: seq(seq), upper(seq + size), block(data)
+		{ }
 
 	/**
 	 * @return length of the data block
@@ -90,9 +52,23 @@ public:
 	uint64_t Size() const
 		{ return upper - seq; }
 
+	/**
+	 * @return whether the block refers to memory it doesn't own.
+	 */
+	bool Borrowed() const
+		{ return ! buffer; }
+
+	/**
+	 * Makes a borrowed block independent of the memory it refers to. If
+	 * that's part of the given packet buffer and fills at least half of
+	 * it, the block keeps a reference to it, otherwise it copies the data.
+	 */
+	void Keep(PacketBuffer* pkt_buffer);
+
 	uint64_t seq;
 	uint64_t upper;
-	u_char* block;
+	const u_char* block;
+	IntrusivePtr<PacketBuffer> buffer;
 };
 
 using DataBlockMap = std::map<uint64_t, DataBlock>;
@@ -208,6 +184,15 @@ public:
 	 */
 	uint64_t Trim(uint64_t seq, uint64_t max_old, DataBlockList* old_list);
 
+	/**
+	 * Makes the blocks inserted since the last call, as far as they are
+	 * still in the list, independent of the memory they were created
+	 * from.
+	 * @param pkt_buffer  the buffer of the packet the data came from, if
+	 * any, to keep a reference to rather than copying
+	 */
+	void KeepBorrowed(PacketBuffer* pkt_buffer);
+
 	/**
 	 * @return an iterator pointing to the first element with a segment whose
 	 * starting sequence number is less than or equal to "seq".  If no such
@@ -249,6 +234,9 @@ private:
 	Reassembler* reassembler = nullptr;
 	size_t total_data_size = 0;
 	DataBlockMap block_map;
+
+	// Starting sequence numbers of blocks that may still be borrowed.
+	std::vector<uint64_t> borrowed;
 };
 
 class Reassembler : public BroObj {
@@ -256,6 +244,13 @@ public:
 	Reassembler(uint64_t init_seq, ReassemblerType reassem_type = REASSEM_UNKNOWN);
 	~Reassembler() override	{}
 
+	// Adds data to the reassembly.  The data only needs to remain valid
+	// for the duration of the call: blocks are created referring to it,
+	// and only those that are still buffered once the subclass has
+	// processed the new block get made independent of it.  If the data
+	// is part of the current packet's buffer (see
+	// PacketBuffer::Current()), they keep a reference to that rather
+	// than copying.
 	void NewBlock(double t, uint64_t seq, uint64_t len, const u_char* data);
 
 	// Throws away all blocks up to seq.  Returns number of bytes
@@ -289,11 +284,33 @@ public:
 
 	void SetMaxOldBlocks(uint32_t count)	{ max_old_blocks = count; }
 
+	// Number of blocks that a reassembler of the given type delivered
+	// right away without going through the block list, and the number
+	// of blocks that it added through NewBlock() instead.
+	static uint64_t FastPathHits(ReassemblerType rtype)
+		{ return fast_path_hits[rtype]; }
+	static uint64_t FastPathMisses(ReassemblerType rtype)
+		{ return fast_path_misses[rtype]; }
+
 protected:
 	Reassembler()	{ }
 
 	friend class DataBlockList;
 
+	// Returns true if data starting at seq directly continues what has
+	// been reassembled so far, with nothing buffered beyond that.  Such
+	// data can't overlap anything buffered and can be delivered without
+	// looking at the block list.
+	bool IsNextInOrder(uint64_t seq) const
+		{
+		return seq == last_reassem_seq && seq >= trim_seq &&
+			(block_list.Empty() || block_list.LastBlock().upper <= seq);
+		}
+
+	// Makes blocks added from the data passed to the current call
+	// independent of it, see NewBlock().
+	void KeepBorrowedBlocks();
+
 	virtual void Undelivered(uint64_t up_to_seq);
 
 	virtual void BlockInserted(DataBlockMap::const_iterator it) = 0;
@@ -313,4 +330,6 @@ protected:
 
 	static uint64_t total_size;
 	static uint64_t sizes[REASSEM_NUM];
+	static uint64_t fast_path_hits[REASSEM_NUM];
+	static uint64_t fast_path_misses[REASSEM_NUM];
 };
@@ -5,6 +5,8 @@
 #include <algorithm>
 #include <functional>
 
+#include "3rdparty/doctest.h"
+
 #include "RuleAction.h"
 #include "RuleCondition.h"
 #include "BroString.h"
@@ -191,6 +193,7 @@ RuleEndpointState::RuleEndpointState(analyzer::Analyzer* arg_analyzer, bool arg_
 		opposite->opposite = this;
 
 	pia = arg_PIA;
+	num_unarmed = 0;
 	}
 
 RuleEndpointState::~RuleEndpointState()
@@ -221,6 +224,7 @@ RuleMatcher::RuleMatcher(int arg_RE_level)
 	RE_level = arg_RE_level;
 	parse_error = false;
 	has_non_file_magic_rule = false;
+	num_prefilter_sets = 0;
 	}
 
 RuleMatcher::~RuleMatcher()
@@ -279,6 +283,8 @@ bool RuleMatcher::ReadFiles(const std::vector<std::string>& files)
 	int_list ids[Rule::TYPES];
 	BuildRegEx(root, exprs, ids);
 
+	prefilter.Compile();
+
 	return ! parse_error;
 	}
 
@@ -395,7 +401,8 @@ void RuleMatcher::BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs,
 		{
 		for ( int i = 0; i < Rule::TYPES; ++i )
 			if ( exprs[i].length() )
-				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i]);
+				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i],
+				                 i == Rule::PAYLOAD && sig_literal_prefilter);
 		}
 
 	// Get the patterns on all of our children.
@@ -422,32 +429,232 @@ void RuleMatcher::BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs,
 		{
 		for ( int i = 0; i < Rule::TYPES; ++i )
 			if ( exprs[i].length() )
-				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i]);
+				BuildPatternSets(&hdr_test->psets[i], exprs[i], ids[i],
+				                 i == Rule::PAYLOAD && sig_literal_prefilter);
 		}
 
 	// If we're below the RE_level, the regexprs remains empty.
 	}
 
+// Signature patterns match from the beginning of the payload, so the ones
+// meant to match anywhere start with ".*".  If a pattern continues with a
+// literal that any match must contain, returns true and the literal.  That
+// only recognizes the simple, common case of a literal directly following.
+static bool required_literal(const char* pattern, std::string* literal)
+	{
+	if ( strncmp(pattern, ".*", 2) != 0 )
+		return false;
+
+	// The literal isn't required if there's an alternative on the top
+	// level.  Named definitions may hide one, too.
+	int depth = 0;
+	bool in_ccl = false;
+	bool in_quote = false;
+
+	for ( const char* p = pattern; *p; ++p )
+		{
+		if ( *p == '\\' )
+			{
+			if ( p[1] )
+				++p;
+
+			continue;
+			}
+
+		if ( in_quote )
+			{
+			if ( *p == '"' )
+				in_quote = false;
+
+			continue;
+			}
+
+		if ( in_ccl )
+			{
+			if ( *p == '[' && p[1] == ':' )
+				{
+				// A character class expression like "[:alpha:]".
+				const char* end = strstr(p, ":]");
+
+				if ( ! end )
+					return false;
+
+				p = end + 1;
+				}
+
+			else if ( *p == ']' )
+				in_ccl = false;
+
+			continue;
+			}
+
+		switch ( *p ) {
+		case '"':
+			in_quote = true;
+			break;
+
+		case '[':
+			in_ccl = true;
+
+			// A leading "]" is part of the class.
+			if ( p[1] == '^' )
+				++p;
+
+			if ( p[1] == ']' )
+				++p;
+
+			break;
+
+		case '(':
+			++depth;
+			break;
+
+		case ')':
+			--depth;
+			break;
+
+		case '|':
+			if ( depth == 0 )
+				return false;
+
+			break;
+
+		case '{':
+			if ( isalpha(p[1]) || p[1] == '_' )
+				return false;
+
+			break;
+		}
+		}
+
+	literal->clear();
+
+	for ( const char* p = pattern + 2; *p; )
+		{
+		int c;
+
+		if ( *p == '\\' )
+			{
+			if ( p[1] == 'x' && isxdigit(p[2]) && isxdigit(p[3]) )
+				{
+				c = decode_hex(p[2]) * 16 + decode_hex(p[3]);
+				p += 4;
+				}
+
+			else if ( p[1] == 'n' || p[1] == 'r' || p[1] == 't' )
+				{
+				c = p[1] == 'n' ? '\n' : (p[1] == 'r' ? '\r' : '\t');
+				p += 2;
+				}
+
+			else if ( p[1] && p[1] != '\n' && ! isalnum(p[1]) )
+				{
+				c = p[1];
+				p += 2;
+				}
+
+			else
+				break;
+			}
+
+		else if ( strchr("^\"$[](){}|*+?.\n", *p) )
+			break;
+
+		else
+			c = *p++;
+
+		// The character isn't required if it may be repeated zero
+		// times.
+		if ( *p == '*' || *p == '?' || *p == '{' )
+			break;
+
+		*literal += char(c);
+
+		if ( *p == '+' )
+			break;
+		}
+
+	return literal->size() >= zeek::detail::LiteralMatcher::MIN_LENGTH;
+	}
+
+TEST_CASE("signature pattern literals")
+	{
+	std::string l;
+
+	CHECK(required_literal(".*foobar", &l));
+	CHECK(l == "foobar");
+	CHECK(required_literal(".*User-Agent: [a-z]+", &l));
+	CHECK(l == "User-Agent: ");
+	CHECK(required_literal(".*GET \\/x\\x41\\r\\n(a|b)", &l));
+	CHECK(l == "GET /xA\r\n");
+	CHECK(required_literal(".*abcd?e", &l));
+	CHECK(l == "abc");
+	CHECK(required_literal(".*abcd+e", &l));
+	CHECK(l == "abcd");
+	CHECK(required_literal(".*[]|]abc|def]xyz", &l) == false);
+	CHECK(required_literal(".*abc[[:alpha:]|]", &l));
+	CHECK(l == "abc");
+
+	CHECK_FALSE(required_literal("foobar", &l));
+	CHECK_FALSE(required_literal(".*ab", &l));
+	CHECK_FALSE(required_literal(".*abc*", &l));
+	CHECK_FALSE(required_literal(".*foo|bar", &l));
+	CHECK_FALSE(required_literal(".*foo\\|bar|baz", &l));
+	CHECK_FALSE(required_literal(".*(?i:foobar)", &l));
+	CHECK_FALSE(required_literal(".*foo{name}", &l));
+	CHECK_FALSE(required_literal(".*\\101bcd", &l));
+	}
+
 void RuleMatcher::BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
-				const string_list& exprs, const int_list& ids)
+				const string_list& exprs, const int_list& ids,
+				bool prefilter)
 	{
 	assert(static_cast<size_t>(exprs.length()) == ids.size());
 
+	string_list plain_exprs;
+	int_list plain_ids;
+	string_list literal_exprs;
+	int_list literal_ids;
+	std::vector<std::string> literals;
+
+	loop_over_list(exprs, i)
+		{
+		std::string literal;
+
+		if ( prefilter && required_literal(exprs[i], &literal) )
+			{
+			literal_exprs.push_back(exprs[i]);
+			literal_ids.push_back(ids[i]);
+			literals.push_back(std::move(literal));
+			}
+		else
+			{
+			plain_exprs.push_back(exprs[i]);
+			plain_ids.push_back(ids[i]);
+			}
+		}
+
+	BuildPatternGroups(dst, plain_exprs, plain_ids, nullptr);
+	BuildPatternGroups(dst, literal_exprs, literal_ids, &literals);
+	}
+
+void RuleMatcher::BuildPatternGroups(RuleHdrTest::pattern_set_list* dst,
+				const string_list& exprs, const int_list& ids,
+				const std::vector<std::string>* literals)
+	{
 	// We build groups of at most sig_max_group_size regexps.
 
 	string_list group_exprs;
 	int_list group_ids;
+	int group_start = 0;
 
-	for ( int i = 0; i < exprs.length() + 1 /* sic! */; i++ )
+	for ( int i = 0; i < exprs.length(); i++ )
 		{
-		if ( i < exprs.length() )
-			{
-			group_exprs.push_back(exprs[i]);
-			group_ids.push_back(ids[i]);
-			}
+		group_exprs.push_back(exprs[i]);
+		group_ids.push_back(ids[i]);
 
 		if ( group_exprs.length() > sig_max_group_size ||
-		     i == exprs.length() )
+		     i == exprs.length() - 1 )
 			{
 			RuleHdrTest::PatternSet* set =
 				new RuleHdrTest::PatternSet;
@@ -455,10 +662,20 @@ void RuleMatcher::BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
 			set->re->CompileSet(group_exprs, group_ids);
 			set->patterns = group_exprs;
 			set->ids = group_ids;
+
+			if ( literals )
+				{
+				set->prefilter_id = num_prefilter_sets++;
+
+				for ( int j = group_start; j <= i; ++j )
+					prefilter.Add((*literals)[j], set->prefilter_id);
+				}
+
 			dst->push_back(set);
 
 			group_exprs.clear();
 			group_ids.clear();
+			group_start = i + 1;
 			}
 		}
 	}
@@ -777,7 +994,12 @@ RuleEndpointState* RuleMatcher::InitEndpoint(analyzer::Analyzer* analyzer,
 						new RuleEndpointState::Matcher;
 					m->state = new RE_Match_State(set->re);
 					m->type = (Rule::PatternType) i;
+					m->prefilter_id = set->prefilter_id;
+					m->armed = m->prefilter_id < 0;
 					state->matchers.push_back(m);
+
+					if ( ! m->armed )
+						++state->num_unarmed;
 					}
 				}
 			}
@@ -884,12 +1106,19 @@ void RuleMatcher::Match(RuleEndpointState* state, Rule::PatternType type,
 
 		else if ( state->payload_size < 0 )
 			state->payload_size = 0;
+
+		if ( clear )
+			state->prefilter_tail.clear();
+
+		if ( state->num_unarmed && data_len > 0 )
+			ArmMatchers(state, data, data_len);
 		}
 
-	// Feed data into all relevant matchers.
+	// Feed data into all relevant matchers.  The ones not armed yet
+	// can't match until their literals show up.
 	for ( const auto& m : state->matchers )
 		{
-		if ( m->type == type &&
+		if ( m->type == type && m->armed &&
 		     m->state->Match((const u_char*) data, data_len,
 					bol, eol, clear) )
 			newmatch = true;
@@ -970,6 +1199,78 @@ void RuleMatcher::Match(RuleEndpointState* state, Rule::PatternType type,
 		}
 	}
 
+void RuleMatcher::ArmMatchers(RuleEndpointState* state, const u_char* data, int len)
+	{
+	// A pattern set requiring literals can't match before one of them
+	// occurs.  Up to where the first one starts, all that its DFA does is
+	// track partial occurrences of the literals, which won't go anywhere
+	// but the following ".*" of the patterns would have started over at
+	// the literal. So it gets the same matches if it begins with the
+	// chunk that the literal starts in.
+	std::string& tail = state->prefilter_tail;
+	size_t keep = prefilter.MaxLength() - 1;
+
+	if ( ! tail.empty() )
+		{
+		// Look for literals that start in the previous chunk.
+		std::string window = tail;
+		window.append((const char*) data, std::min(size_t(len), keep));
+
+		prefilter.Scan((const u_char*) window.data(), window.size(),
+		               [&](int id, size_t pos)
+			{
+			if ( pos >= tail.size() )
+				return false;
+
+			ArmMatcher(state, id, (const u_char*) tail.data() + pos,
+			           tail.size() - pos);
+			return state->num_unarmed > 0;
+			});
+		}
+
+	if ( state->num_unarmed )
+		prefilter.Scan(data, len, [&](int id, size_t pos)
+			{
+			ArmMatcher(state, id, nullptr, 0);
+			return state->num_unarmed > 0;
+			});
+
+	if ( ! state->num_unarmed )
+		{
+		tail.clear();
+		return;
+		}
+
+	if ( size_t(len) >= keep )
+		tail.assign((const char*) data + len - keep, keep);
+	else
+		{
+		tail.append((const char*) data, len);
+
+		if ( tail.size() > keep )
+			tail.erase(0, tail.size() - keep);
+		}
+	}
+
+void RuleMatcher::ArmMatcher(RuleEndpointState* state, int prefilter_id,
+				const u_char* prefix, int prefix_len)
+	{
+	for ( const auto& m : state->matchers )
+		{
+		if ( m->armed || m->prefilter_id != prefilter_id )
+			continue;
+
+		DBG_LOG(DBG_RULES, "Prefilter arms pattern set %d", prefilter_id);
+
+		m->armed = true;
+		--state->num_unarmed;
+
+		// The literal isn't complete yet, so this can't match.
+		if ( prefix_len )
+			m->state->Match(prefix, prefix_len, false, false, false);
+		}
+	}
+
 void RuleMatcher::FinishEndpoint(RuleEndpointState* state)
 	{
 	// Send EOL to payload matchers.
@@ -1120,9 +1421,17 @@ void RuleMatcher::ClearEndpointState(RuleEndpointState* state)
 	ExecPureRules(state, true);
 
 	state->payload_size = -1;
+	state->num_unarmed = 0;
+	state->prefilter_tail.clear();
 
 	for ( const auto& matcher : state->matchers )
+		{
 		matcher->state->Clear();
+		matcher->armed = matcher->prefilter_id < 0;
+
+		if ( ! matcher->armed )
+			++state->num_unarmed;
+		}
 	}
 
 void RuleMatcher::ClearFileMagicState(RuleFileMagicState* state) const
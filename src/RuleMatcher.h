@@ -12,6 +12,7 @@
 #include "Rule.h"
 #include "RE.h"
 #include "CCL.h"
+#include "LiteralMatcher.h"
 
 //#define MATCHER_PRINT_STATS
 
@@ -103,7 +104,7 @@ private:
 	friend class RuleMatcher;
 
 	struct PatternSet {
-		PatternSet() : re() {}
+		PatternSet() : re(), prefilter_id(-1) {}
 
 		// If we're above the 'RE_level' (see RuleMatcher), this
 		// expr contains all patterns on this node. If we're on
@@ -114,6 +115,11 @@ private:
 		// All the patterns and their rule indices.
 		string_list patterns;
 		int_list ids;	// (only needed for debugging)
+
+		// If all of the patterns require one of the literals of the
+		// RuleMatcher's prefilter to occur, the ID under which the
+		// literals were added there, otherwise -1.
+		int prefilter_id;
 	};
 
 	typedef PList<PatternSet> pattern_set_list;
@@ -163,6 +169,14 @@ private:
 	struct Matcher {
 		RE_Match_State* state;
 		Rule::PatternType type;
+
+		// The pattern set's prefilter ID, see RuleHdrTest::PatternSet.
+		int prefilter_id;
+
+		// False as long as the prefilter hasn't found any of the
+		// literals for the set, in which case the data doesn't
+		// need to go through the DFA.
+		bool armed;
 	};
 
 	typedef PList<Matcher> matcher_list;
@@ -183,6 +197,11 @@ private:
 	int payload_size;
 	bool is_orig;
 
+	// The number of matchers not yet armed, and the end of the payload
+	// seen so far, for finding literals that continue in the next chunk.
+	int num_unarmed;
+	std::string prefilter_tail;
+
 	int_list matched_rules;		// Rules for which all conditions have matched
 };
 
@@ -324,9 +343,29 @@ private:
 	// Traverse tree building the combined regular expressions.
 	void BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs, int_list* ids);
 
-	// Build groups of regular epxressions.
+	// Build groups of regular epxressions.  If prefilter is true, the
+	// expressions requiring a literal get grouped separately and their
+	// literals added to the prefilter.
 	void BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
-				const string_list& exprs, const int_list& ids);
+				const string_list& exprs, const int_list& ids,
+				bool prefilter);
+
+	// Used by the above to build the groups from expressions that are
+	// either all prefiltered, with their literals given, or not.
+	void BuildPatternGroups(RuleHdrTest::pattern_set_list* dst,
+				const string_list& exprs, const int_list& ids,
+				const std::vector<std::string>* literals);
+
+	// Arms the matchers of an endpoint for which the data contains one
+	// of their literals, and remembers the end of the data for the next
+	// call.
+	void ArmMatchers(RuleEndpointState* state, const u_char* data, int len);
+
+	// Arms an endpoint's matchers with the given prefilter ID. If the
+	// literal started in the previous chunk of data, prefix is the part
+	// from there, which gets fed to the matchers right away.
+	void ArmMatcher(RuleEndpointState* state, int prefilter_id,
+				const u_char* prefix, int prefix_len);
 
 	// Check an arbitrary rule if it's satisfied right now.
 	// eos signals end of stream
@@ -362,6 +401,10 @@ private:
 	RuleHdrTest* root;
 	rule_list rules;
 	rule_dict rules_by_id;
+
+	// Literals of payload pattern sets, see RuleHdrTest::PatternSet.
+	zeek::detail::LiteralMatcher prefilter;
+	int num_prefilter_sets;
 };
 
 // Keeps bi-directional matching-state.
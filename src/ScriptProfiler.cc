@@ -0,0 +1,313 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "ScriptProfiler.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#ifdef HAVE_LINUX
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Older glibc versions lack the accessor.
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+#include "3rdparty/doctest.h"
+
+#include "Conn.h"
+#include "Event.h"
+#include "Frame.h"
+#include "Func.h"
+#include "NetVar.h"
+#include "Reporter.h"
+#include "Sessions.h"
+#include "Stmt.h"
+#include "util.h"
+
+volatile sig_atomic_t zeek::detail::profile_sample_pending = 0;
+
+namespace {
+
+struct ScriptProfiler {
+	std::string file;
+	bool running = false;
+	pthread_t main_thread;
+	struct sigaction old_action;
+
+#ifdef HAVE_LINUX
+	// Measures the main thread's CPU time only, and signals just that
+	// thread.
+	timer_t timer;
+#endif
+
+	// Folded stacks and how often they got sampled.
+	std::unordered_map<std::string, uint64_t> stacks;
+
+	// Samples taken while no script was executing, or while the signal
+	// interrupted a thread other than the main one.  The latter only
+	// happens with the process-wide timer used on other platforms than
+	// Linux.
+	std::atomic<uint64_t> outside_scripts{0};
+	std::atomic<uint64_t> other_threads{0};
+};
+
+}
+
+static ScriptProfiler profiler;
+
+static void profile_signal(int)
+	{
+	if ( ! pthread_equal(pthread_self(), profiler.main_thread) )
+		{
+		++profiler.other_threads;
+		return;
+		}
+
+	// Nothing that allocates or walks the frames is safe in here, so
+	// the actual sample gets taken at the next statement boundary.
+	if ( g_frame_stack.empty() )
+		++profiler.outside_scripts;
+	else
+		zeek::detail::profile_sample_pending = 1;
+	}
+
+// Appends a frame to a folded stack, which can't contain semicolons
+// and newlines.
+static void add_frame(std::string* stack, const char* frame)
+	{
+	if ( ! stack->empty() )
+		stack->push_back(';');
+
+	for ( const char* p = frame; *p; ++p )
+		stack->push_back(*p == ';' || *p == '\n' ? '_' : *p);
+	}
+
+// Returns the name of the analyzer that raised the event whose handler is
+// executing in the given frame, if that's one of a connection's.
+static const char* event_analyzer(const Frame* f)
+	{
+	auto func = f->GetFunction();
+	auto args = f->GetFuncArgs();
+
+	if ( ! func || func->Flavor() != FUNC_FLAVOR_EVENT || ! mgr.CurrentAnalyzer() ||
+	     ! args || args->empty() || ! sessions )
+		return nullptr;
+
+	const auto& arg = (*args)[0];
+
+	if ( ! arg || arg->Type() != connection_type )
+		return nullptr;
+
+	auto id = arg->AsRecordVal()->Lookup("id");
+	Connection* conn = id ? sessions->FindConnection(id.get()) : nullptr;
+	auto a = conn ? conn->FindAnalyzer(mgr.CurrentAnalyzer()) : nullptr;
+
+	return a ? a->GetAnalyzerName() : nullptr;
+	}
+
+void zeek::detail::take_profile_sample(const Stmt* stmt, const Func* bif)
+	{
+	profile_sample_pending = 0;
+
+	if ( ! profiler.running || g_frame_stack.empty() )
+		return;
+
+	std::string stack;
+
+	if ( auto a = event_analyzer(g_frame_stack.front()) )
+		add_frame(&stack, fmt("[%s]", a));
+
+	for ( auto f : g_frame_stack )
+		{
+		auto func = f->GetFunction();
+		add_frame(&stack, func ? func->Name() : "<unknown>");
+		}
+
+	if ( ! stmt )
+		stmt = g_frame_stack.back()->GetNextStmt();
+
+	if ( stmt && stmt->GetLocationInfo()->filename )
+		{
+		auto loc = stmt->GetLocationInfo();
+		auto base = strrchr(loc->filename, '/');
+		add_frame(&stack, fmt("%s:%d", base ? base + 1 : loc->filename,
+		                      loc->first_line));
+		}
+
+	if ( bif )
+		add_frame(&stack, bif->Name());
+
+	++profiler.stacks[stack];
+	}
+
+#ifdef HAVE_LINUX
+
+// With a process-wide CPU timer, the kernel would deliver the signal to
+// whatever thread happens to run, and count the CPU time of the logging
+// and Broker threads as well.  A timer on the main thread's CPU clock
+// that signals that thread avoids both.
+static bool start_timer(int frequency)
+	{
+	struct sigevent sev;
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_THREAD_ID;
+	sev.sigev_signo = SIGPROF;
+	sev.sigev_notify_thread_id = syscall(SYS_gettid);
+
+	if ( timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &profiler.timer) < 0 )
+		return false;
+
+	long interval = 1000000000L / frequency;
+
+	struct itimerspec spec;
+	spec.it_interval.tv_sec = interval / 1000000000L;
+	spec.it_interval.tv_nsec = interval % 1000000000L;
+	spec.it_value = spec.it_interval;
+
+	if ( timer_settime(profiler.timer, 0, &spec, nullptr) < 0 )
+		{
+		int err = errno;
+		timer_delete(profiler.timer);
+		errno = err;
+		return false;
+		}
+
+	return true;
+	}
+
+static void stop_timer()
+	{
+	timer_delete(profiler.timer);
+	}
+
+#else
+
+static bool start_timer(int frequency)
+	{
+	long interval = 1000000L / frequency;
+
+	struct itimerval timer;
+	timer.it_interval.tv_sec = interval / 1000000L;
+	timer.it_interval.tv_usec = interval % 1000000L;
+	timer.it_value = timer.it_interval;
+
+	return setitimer(ITIMER_PROF, &timer, nullptr) == 0;
+	}
+
+static void stop_timer()
+	{
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, nullptr);
+	}
+
+#endif
+
+bool zeek::detail::start_script_profiler(const std::string& file, int frequency)
+	{
+	if ( profiler.running || frequency <= 0 || frequency > 1000000 )
+		return false;
+
+	profiler.file = file;
+	profiler.main_thread = pthread_self();
+	profiler.stacks.clear();
+	profiler.outside_scripts = 0;
+	profiler.other_threads = 0;
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = profile_signal;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+
+	if ( sigaction(SIGPROF, &action, &profiler.old_action) < 0 )
+		{
+		reporter->Error("cannot install profiling signal handler: %s", strerror(errno));
+		return false;
+		}
+
+	profiler.running = true;
+
+	if ( ! start_timer(frequency) )
+		{
+		reporter->Error("cannot start profiling timer: %s", strerror(errno));
+		profiler.running = false;
+		sigaction(SIGPROF, &profiler.old_action, nullptr);
+		return false;
+		}
+
+	return true;
+	}
+
+bool zeek::detail::stop_script_profiler()
+	{
+	if ( ! profiler.running )
+		return false;
+
+	stop_timer();
+	sigaction(SIGPROF, &profiler.old_action, nullptr);
+
+	profiler.running = false;
+	profile_sample_pending = 0;
+
+	std::vector<std::pair<std::string, uint64_t>> stacks(profiler.stacks.begin(),
+	                                                     profiler.stacks.end());
+	profiler.stacks.clear();
+
+	if ( profiler.outside_scripts )
+		stacks.emplace_back("[outside scripts]", profiler.outside_scripts);
+
+	if ( profiler.other_threads )
+		stacks.emplace_back("[other threads]", profiler.other_threads);
+
+	std::sort(stacks.begin(), stacks.end());
+
+	FILE* f = fopen(profiler.file.c_str(), "w");
+
+	if ( ! f )
+		{
+		reporter->Error("cannot write script profile %s: %s",
+		                profiler.file.c_str(), strerror(errno));
+		return false;
+		}
+
+	for ( const auto& s : stacks )
+		fprintf(f, "%s %" PRIu64 "\n", s.first.c_str(), s.second);
+
+	if ( ferror(f) | fclose(f) )
+		{
+		reporter->Error("cannot write script profile %s: %s",
+		                profiler.file.c_str(), strerror(errno));
+		return false;
+		}
+
+	return true;
+	}
+
+bool zeek::detail::script_profiler_running()
+	{
+	return profiler.running;
+	}
+
+TEST_CASE("script profiler folded stacks")
+	{
+	std::string stack;
+	add_frame(&stack, "zeek_init");
+	add_frame(&stack, "a;b\nc");
+	CHECK(stack == "zeek_init;a_b_c");
+	}
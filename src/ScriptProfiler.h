@@ -0,0 +1,58 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A sampling profiler for script execution. A timer on the main thread's
+// CPU time interrupts it periodically; if scripts are executing at that
+// point, the next statement boundary records the script call stack.
+
+#pragma once
+
+#include <signal.h>
+
+#include <string>
+
+class Func;
+class Stmt;
+
+namespace zeek { namespace detail {
+
+// Set by the profiler's signal handler when a sample is due.
+extern volatile sig_atomic_t profile_sample_pending;
+
+/**
+ * Records the current script call stack as a sample, and clears the
+ * pending flag.
+ *
+ * @param stmt the statement executing in the innermost frame, or null
+ * to use the one the frame recorded last.
+ *
+ * @param bif a built-in function called from the innermost frame that is
+ * about to return, if any.
+ */
+void take_profile_sample(const Stmt* stmt, const Func* bif = nullptr);
+
+/**
+ * Starts sampling.
+ *
+ * @param file the file to write the samples into once stopped, in the
+ * folded stack format that flame graph tools take as input.
+ *
+ * @param frequency the number of samples per second of CPU time.
+ *
+ * @return false if the profiler is already running, or if the timer
+ * cannot be set up.
+ */
+bool start_script_profiler(const std::string& file, int frequency);
+
+/**
+ * Stops sampling and writes the samples collected since starting.
+ *
+ * @return false if the profiler isn't running, or if writing fails.
+ */
+bool stop_script_profiler();
+
+/**
+ * Returns whether the profiler is running.
+ */
+bool script_profiler_running();
+
+}} // namespace zeek::detail
@@ -104,12 +104,11 @@ NetSessions::~NetSessions()
 	delete discarder;
 	delete stp_manager;
 
-	for ( const auto& entry : tcp_conns )
-		Unref(entry.second);
-	for ( const auto& entry : udp_conns )
-		Unref(entry.second);
-	for ( const auto& entry : icmp_conns )
-		Unref(entry.second);
+	auto unref_conn = [](const FlowTable::Entry& entry) { Unref(entry.conn); };
+	tcp_conns.ForEach(unref_conn);
+	udp_conns.ForEach(unref_conn);
+	icmp_conns.ForEach(unref_conn);
+
 	for ( const auto& entry : fragments )
 		Unref(entry.second);
 	}
@@ -185,6 +184,72 @@ void NetSessions::NextPacket(double t, const Packet* pkt)
 		DumpPacket(pkt);
 	}
 
+void NetSessions::PrefetchConnection(const Packet* pkt)
+	{
+	if ( ! pkt->Layer2Valid() || pkt->hdr_size > pkt->cap_len )
+		return;
+
+	const u_char* data = pkt->data + pkt->hdr_size;
+	uint32_t caplen = pkt->cap_len - pkt->hdr_size;
+	ConnID id;
+	int proto;
+
+	if ( pkt->l3_proto == L3_IPV4 )
+		{
+		if ( caplen < sizeof(struct ip) )
+			return;
+
+		const struct ip* ip = (const struct ip*) data;
+		uint32_t ip_hdr_len = ip->ip_hl * 4;
+
+		// Fragments need to be reassembled first.
+		if ( (ntohs(ip->ip_off) & 0x3fff) || caplen < ip_hdr_len + 4 )
+			return;
+
+		id.src_addr = IPAddr(ip->ip_src);
+		id.dst_addr = IPAddr(ip->ip_dst);
+		proto = ip->ip_p;
+		data += ip_hdr_len;
+		}
+
+	else if ( pkt->l3_proto == L3_IPV6 )
+		{
+		if ( caplen < sizeof(struct ip6_hdr) + 4 )
+			return;
+
+		// Extension headers may affect the addresses (e.g., routing
+		// headers), so only handle the transport header coming first.
+		const struct ip6_hdr* ip6 = (const struct ip6_hdr*) data;
+		id.src_addr = IPAddr(ip6->ip6_src);
+		id.dst_addr = IPAddr(ip6->ip6_dst);
+		proto = ip6->ip6_nxt;
+		data += sizeof(struct ip6_hdr);
+		}
+
+	else
+		return;
+
+	const ConnectionMap* d;
+
+	if ( proto == IPPROTO_TCP )
+		d = &tcp_conns;
+	else if ( proto == IPPROTO_UDP )
+		d = &udp_conns;
+	else
+		return;
+
+	// TCP and UDP both start with the source and destination ports.
+	const uint16_t* ports = (const uint16_t*) data;
+	id.src_port = ports[0];
+	id.dst_port = ports[1];
+	id.is_one_way = false;
+
+	prefetched.conns = d;
+	prefetched.key = BuildConnIDKey(id);
+	prefetched.hash = ConnectionMap::HashKey(prefetched.key);
+	d->Prefetch(prefetched.hash);
+	}
+
 static unsigned int gre_header_len(uint16_t flags)
 	{
 	unsigned int len = 4;  // Always has 2 byte flags and 2 byte protocol type.
@@ -647,9 +712,7 @@ void NetSessions::DoNextPacket(double t, const Packet* pkt, const IP_Hdr* ip_hdr
 
 	// FIXME: The following is getting pretty complex. Need to split up
 	// into separate functions.
-	auto it = d->find(key);
-	if ( it != d->end() )
-		conn = it->second;
+	conn = LookupConn(*d, key);
 
 	if ( ! conn )
 		{
@@ -911,7 +974,7 @@ Connection* NetSessions::FindConnection(Val* v)
 		return nullptr;
 
 	RecordType* vr = vt->AsRecordType();
-	const val_list* vl = v->AsRecord();
+	RecordVal* rv = v->AsRecordVal();
 
 	int orig_h, orig_p;	// indices into record's value list
 	int resp_h, resp_p;
@@ -939,11 +1002,11 @@ Connection* NetSessions::FindConnection(Val* v)
 		// types, too.
 		}
 
-	const IPAddr& orig_addr = (*vl)[orig_h]->AsAddr();
-	const IPAddr& resp_addr = (*vl)[resp_h]->AsAddr();
+	const IPAddr& orig_addr = rv->Lookup(orig_h)->AsAddr();
+	const IPAddr& resp_addr = rv->Lookup(resp_h)->AsAddr();
 
-	PortVal* orig_portv = (*vl)[orig_p]->AsPortVal();
-	PortVal* resp_portv = (*vl)[resp_p]->AsPortVal();
+	PortVal* orig_portv = rv->Lookup(orig_p)->AsPortVal();
+	PortVal* resp_portv = rv->Lookup(resp_p)->AsPortVal();
 
 	ConnID id;
 
@@ -972,12 +1035,7 @@ Connection* NetSessions::FindConnection(Val* v)
 		return nullptr;
 		}
 
-	Connection* conn = nullptr;
-	auto it = d->find(key);
-	if ( it != d->end() )
-		conn = it->second;
-
-	return conn;
+	return LookupConn(*d, key);
 	}
 
 void NetSessions::Remove(Connection* c)
@@ -1007,17 +1065,17 @@ void NetSessions::Remove(Connection* c)
 
 		switch ( c->ConnTransport() ) {
 		case TRANSPORT_TCP:
-			if ( tcp_conns.erase(key) == 0 )
+			if ( ! tcp_conns.Remove(key) )
 				reporter->InternalWarning("connection missing");
 			break;
 
 		case TRANSPORT_UDP:
-			if ( udp_conns.erase(key) == 0 )
+			if ( ! udp_conns.Remove(key) )
 				reporter->InternalWarning("connection missing");
 			break;
 
 		case TRANSPORT_ICMP:
-			if ( icmp_conns.erase(key) == 0 )
+			if ( ! icmp_conns.Remove(key) )
 				reporter->InternalWarning("connection missing");
 			break;
 
@@ -1048,25 +1106,16 @@ void NetSessions::Insert(Connection* c)
 	Connection* old = nullptr;
 
 	switch ( c->ConnTransport() ) {
-	// Remove first. Otherwise the map would still reference the old key for
-	// already existing connections.
-
 	case TRANSPORT_TCP:
-		old = LookupConn(tcp_conns, c->Key());
-		tcp_conns.erase(c->Key());
-		InsertConnection(&tcp_conns, c->Key(), c);
+		old = InsertConnection(&tcp_conns, c->Key(), c);
 		break;
 
 	case TRANSPORT_UDP:
-		old = LookupConn(udp_conns, c->Key());
-		udp_conns.erase(c->Key());
-		InsertConnection(&udp_conns, c->Key(), c);
+		old = InsertConnection(&udp_conns, c->Key(), c);
 		break;
 
 	case TRANSPORT_ICMP:
-		old = LookupConn(icmp_conns, c->Key());
-		icmp_conns.erase(c->Key());
-		InsertConnection(&icmp_conns, c->Key(), c);
+		old = InsertConnection(&icmp_conns, c->Key(), c);
 		break;
 
 	default:
@@ -1087,23 +1136,26 @@ void NetSessions::Insert(Connection* c)
 
 void NetSessions::Drain()
 	{
-	for ( const auto& entry : tcp_conns )
+	// The flow tables iterate in hash order, which differs between runs.
+	// Walk them in key order instead to keep the removal events (and so
+	// the logs written at termination) deterministic.
+	for ( const auto& entry : tcp_conns.OrderedEntries() )
 		{
-		Connection* tc = entry.second;
+		Connection* tc = entry.conn;
 		tc->Done();
 		tc->RemovalEvent();
 		}
 
-	for ( const auto& entry : udp_conns )
+	for ( const auto& entry : udp_conns.OrderedEntries() )
 		{
-		Connection* uc = entry.second;
+		Connection* uc = entry.conn;
 		uc->Done();
 		uc->RemovalEvent();
 		}
 
-	for ( const auto& entry : icmp_conns )
+	for ( const auto& entry : icmp_conns.OrderedEntries() )
 		{
-		Connection* ic = entry.second;
+		Connection* ic = entry.conn;
 		ic->Done();
 		ic->RemovalEvent();
 		}
@@ -1111,28 +1163,27 @@ void NetSessions::Drain()
 
 void NetSessions::Clear()
 	{
-	for ( const auto& entry : tcp_conns )
-		Unref(entry.second);
-	for ( const auto& entry : udp_conns )
-		Unref(entry.second);
-	for ( const auto& entry : icmp_conns )
-		Unref(entry.second);
+	auto unref_conn = [](const FlowTable::Entry& entry) { Unref(entry.conn); };
+	tcp_conns.ForEach(unref_conn);
+	udp_conns.ForEach(unref_conn);
+	icmp_conns.ForEach(unref_conn);
+
 	for ( const auto& entry : fragments )
 		Unref(entry.second);
 
-	tcp_conns.clear();
-	udp_conns.clear();
-	icmp_conns.clear();
+	tcp_conns.Clear();
+	udp_conns.Clear();
+	icmp_conns.Clear();
 	fragments.clear();
 	}
 
 void NetSessions::GetStats(SessionStats& s) const
 	{
-	s.num_TCP_conns = tcp_conns.size();
+	s.num_TCP_conns = tcp_conns.Size();
 	s.cumulative_TCP_conns = stats.cumulative_TCP_conns;
-	s.num_UDP_conns = udp_conns.size();
+	s.num_UDP_conns = udp_conns.Size();
 	s.cumulative_UDP_conns = stats.cumulative_UDP_conns;
-	s.num_ICMP_conns = icmp_conns.size();
+	s.num_ICMP_conns = icmp_conns.Size();
 	s.cumulative_ICMP_conns = stats.cumulative_ICMP_conns;
 	s.num_fragments = fragments.size();
 	s.num_packets = num_packets_processed;
@@ -1203,15 +1254,6 @@ Connection* NetSessions::NewConn(const ConnIDKey& k, double t, const ConnID* id,
 	return conn;
 	}
 
-Connection* NetSessions::LookupConn(const ConnectionMap& conns, const ConnIDKey& key)
-	{
-	auto it = conns.find(key);
-	if ( it != conns.end() )
-		return it->second;
-
-	return nullptr;
-	}
-
 bool NetSessions::IsLikelyServerPort(uint32_t port, TransportProto proto) const
 	{
 	// We keep a cached in-core version of the table to speed up the lookup.
@@ -1332,14 +1374,12 @@ unsigned int NetSessions::ConnectionMemoryUsage()
 		// Connections have been flushed already.
 		return 0;
 
-	for ( const auto& entry : tcp_conns )
-		mem += entry.second->MemoryAllocation();
+	auto add_mem = [&mem](const FlowTable::Entry& entry)
+		{ mem += entry.conn->MemoryAllocation(); };
 
-	for ( const auto& entry : udp_conns )
-		mem += entry.second->MemoryAllocation();
-
-	for ( const auto& entry : icmp_conns )
-		mem += entry.second->MemoryAllocation();
+	tcp_conns.ForEach(add_mem);
+	udp_conns.ForEach(add_mem);
+	icmp_conns.ForEach(add_mem);
 
 	return mem;
 	}
@@ -1352,14 +1392,12 @@ unsigned int NetSessions::ConnectionMemoryUsageConnVals()
 		// Connections have been flushed already.
 		return 0;
 
-	for ( const auto& entry : tcp_conns )
-		mem += entry.second->MemoryAllocationConnVal();
-
-	for ( const auto& entry : udp_conns )
-		mem += entry.second->MemoryAllocationConnVal();
+	auto add_mem = [&mem](const FlowTable::Entry& entry)
+		{ mem += entry.conn->MemoryAllocationConnVal(); };
 
-	for ( const auto& entry : icmp_conns )
-		mem += entry.second->MemoryAllocationConnVal();
+	tcp_conns.ForEach(add_mem);
+	udp_conns.ForEach(add_mem);
+	icmp_conns.ForEach(add_mem);
 
 	return mem;
 	}
@@ -1372,35 +1410,37 @@ unsigned int NetSessions::MemoryAllocation()
 
 	return ConnectionMemoryUsage()
 		+ padded_sizeof(*this)
-		+ (tcp_conns.size() * (sizeof(ConnectionMap::key_type) + sizeof(ConnectionMap::value_type)))
-		+ (udp_conns.size() * (sizeof(ConnectionMap::key_type) + sizeof(ConnectionMap::value_type)))
-		+ (icmp_conns.size() * (sizeof(ConnectionMap::key_type) + sizeof(ConnectionMap::value_type)))
+		+ tcp_conns.MemoryAllocation()
+		+ udp_conns.MemoryAllocation()
+		+ icmp_conns.MemoryAllocation()
 		+ (fragments.size() * (sizeof(FragmentMap::key_type) + sizeof(FragmentMap::value_type)))
 		// FIXME: MemoryAllocation() not implemented for rest.
 		;
 	}
 
-void NetSessions::InsertConnection(ConnectionMap* m, const ConnIDKey& key, Connection* conn)
+Connection* NetSessions::InsertConnection(ConnectionMap* m, const ConnIDKey& key, Connection* conn)
 	{
-	(*m)[key] = conn;
+	Connection* old = m->Insert(key, conn);
 
 	switch ( conn->ConnTransport() )
 		{
 		case TRANSPORT_TCP:
 			stats.cumulative_TCP_conns++;
-			if ( m->size() > stats.max_TCP_conns )
-				stats.max_TCP_conns = m->size();
+			if ( m->Size() > stats.max_TCP_conns )
+				stats.max_TCP_conns = m->Size();
 			break;
 		case TRANSPORT_UDP:
 			stats.cumulative_UDP_conns++;
-			if ( m->size() > stats.max_UDP_conns )
-				stats.max_UDP_conns = m->size();
+			if ( m->Size() > stats.max_UDP_conns )
+				stats.max_UDP_conns = m->Size();
 			break;
 		case TRANSPORT_ICMP:
 			stats.cumulative_ICMP_conns++;
-			if ( m->size() > stats.max_ICMP_conns )
-				stats.max_ICMP_conns = m->size();
+			if ( m->Size() > stats.max_ICMP_conns )
+				stats.max_ICMP_conns = m->Size();
 			break;
 		default: break;
 		}
+
+	return old;
 	}
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "Frag.h"
+#include "FlowTable.h"
 #include "PacketFilter.h"
 #include "NetVar.h"
 #include "analyzer/protocol/tcp/Stats.h"
@@ -51,6 +52,15 @@ public:
 	// Main entry point for packet processing.
 	void NextPacket(double t, const Packet* pkt);
 
+	/**
+	 * Prefetches the connection table slot that processing the given
+	 * packet will look up, so that it is likely cached by the time the
+	 * packet's turn comes.  Only TCP and UDP directly on top of IPv4 or
+	 * IPv6 are considered.  The key's hash is kept for the lookup to
+	 * reuse.  This is merely a hint.
+	 */
+	void PrefetchConnection(const Packet* pkt);
+
 	void Done();	// call to drain events before destructing
 
 	// Returns a reassembled packet, or nil if there are still
@@ -93,7 +103,7 @@ public:
 
 	unsigned int CurrentConnections()
 		{
-		return tcp_conns.size() + udp_conns.size() + icmp_conns.size();
+		return tcp_conns.Size() + udp_conns.Size() + icmp_conns.Size();
 		}
 
 	void DoNextPacket(double t, const Packet *pkt, const IP_Hdr* ip_hdr,
@@ -172,14 +182,20 @@ protected:
 	friend class ConnCompressor;
 	friend class IPTunnelTimer;
 
-	using ConnectionMap = std::map<ConnIDKey, Connection*>;
+	using ConnectionMap = FlowTable;
 	using FragmentMap = std::map<FragReassemblerKey, FragReassembler*>;
 
 	Connection* NewConn(const ConnIDKey& k, double t, const ConnID* id,
 			const u_char* data, int proto, uint32_t flow_label,
 			const Packet* pkt, const EncapsulationStack* encapsulation);
 
-	Connection* LookupConn(const ConnectionMap& conns, const ConnIDKey& key);
+	Connection* LookupConn(const ConnectionMap& conns, const ConnIDKey& key)
+		{
+		if ( prefetched.conns == &conns && prefetched.key == key )
+			return conns.Lookup(key, prefetched.hash);
+
+		return conns.Lookup(key);
+		}
 
 	// Returns true if the port corresonds to an application
 	// for which there's a Bro analyzer (even if it might not
@@ -212,16 +228,23 @@ protected:
 
 	// Inserts a new connection into the sessions map. If a connection with
 	// the same key already exists in the map, it will be overwritten by
-	// the new one.  Connection count stats get updated either way (so most
-	// cases should likely check that the key is not already in the map to
-	// avoid unnecessary incrementing of connecting counts).
-	void InsertConnection(ConnectionMap* m, const ConnIDKey& key, Connection* conn);
+	// the new one and returned.  Connection count stats get updated either
+	// way (so most cases should likely check that the key is not already
+	// in the map to avoid unnecessary incrementing of connecting counts).
+	Connection* InsertConnection(ConnectionMap* m, const ConnIDKey& key, Connection* conn);
 
 	ConnectionMap tcp_conns;
 	ConnectionMap udp_conns;
 	ConnectionMap icmp_conns;
 	FragmentMap fragments;
 
+	// The most recent key passed through PrefetchConnection().
+	struct {
+		const ConnectionMap* conns = nullptr;
+		ConnIDKey key;
+		hash_t hash = 0;
+	} prefetched;
+
 	SessionStats stats;
 
 	using IPPair = std::pair<IPAddr, IPAddr>;
@@ -212,12 +212,14 @@ void ProfileLogger::Log()
 		{
 		threading::MsgThread::Stats s = i->second;
 		file->Write(fmt("%0.6f   %-25s in=%" PRIu64 " out=%" PRIu64 " pending=%" PRIu64 "/%" PRIu64
+				" backlog=%" PRIu64
 				" (#queue r/w: in=%" PRIu64 "/%" PRIu64 " out=%" PRIu64 "/%" PRIu64 ")"
 			        "\n",
 			    network_time,
 			    i->first.c_str(),
 			    s.sent_in, s.sent_out,
 			    s.pending_in, s.pending_out,
+			    s.backlog,
 			    s.queue_in_stats.num_reads, s.queue_in_stats.num_writes,
 			    s.queue_out_stats.num_reads, s.queue_out_stats.num_writes
 			    ));
@@ -271,7 +273,7 @@ void ProfileLogger::Log()
 
 				if ( v->Type()->Tag() == TYPE_TABLE )
 					{
-					entries = v->AsTable()->Length();
+					entries = v->AsTableVal()->Size();
 					total_table_entries += entries;
 
 					// ### 100 shouldn't be hardwired
@@ -8,6 +8,7 @@
 #include "Dict.h"
 #include "ID.h"
 #include "Obj.h"
+#include "ScriptProfiler.h"
 
 #include "StmtEnums.h"
 
@@ -55,7 +56,15 @@ public:
 		return (ForStmt*) this;
 		}
 
-	void RegisterAccess() const	{ last_access = network_time; access_count++; }
+	void RegisterAccess() const
+		{
+		last_access = network_time;
+		access_count++;
+
+		if ( zeek::detail::profile_sample_pending )
+			zeek::detail::take_profile_sample(this);
+		}
+
 	void AccessStats(ODesc* d) const;
 	uint32_t GetAccessCount() const { return access_count; }
 
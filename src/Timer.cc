@@ -2,6 +2,13 @@
 
 #include "zeek-config.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "3rdparty/doctest.h"
+
 #include "util.h"
 #include "Timer.h"
 #include "Desc.h"
@@ -187,3 +194,635 @@ double PQ_TimerMgr::GetNextTimeout()
 
 	return -1;
 	}
+
+
+Wheel_TimerMgr::Wheel_TimerMgr() : TimerMgr()
+	{
+	ready = new PriorityQueue;
+	memset(occupied, 0, sizeof(occupied));
+	}
+
+Wheel_TimerMgr::~Wheel_TimerMgr()
+	{
+	for ( int l = 0; l < NUM_LEVELS; ++l )
+		for ( int i = 0; i < NUM_SLOTS; ++i )
+			for ( auto timer : slots[l][i] )
+				delete timer;
+
+	delete ready;
+	}
+
+uint64_t Wheel_TimerMgr::Tick(double t)
+	{
+	double tick = t / TICK_RESOLUTION;
+
+	// This also catches NaNs.
+	if ( ! (tick > 0) )
+		return 0;
+
+	// Keep UINT64_MAX free so that a cursor past every tick exists.
+	if ( tick >= 1.8e19 )
+		return UINT64_MAX - 1;
+
+	return uint64_t(tick);
+	}
+
+int Wheel_TimerMgr::Level(uint64_t tick) const
+	{
+	uint64_t diff = tick ^ cursor;
+
+	if ( diff == 0 )
+		return 0;
+
+	return (63 - __builtin_clzll(diff)) / SLOT_BITS;
+	}
+
+void Wheel_TimerMgr::InsertIntoSlot(int level, int idx, Timer* timer)
+	{
+	Slot& slot = slots[level][idx];
+	timer->SetOffset(slot.size());
+	slot.push_back(timer);
+	occupied[level][idx / 64] |= (uint64_t(1) << (idx % 64));
+	++num_in_wheel;
+	}
+
+void Wheel_TimerMgr::RemoveFromSlot(int level, int idx, Timer* timer)
+	{
+	Slot& slot = slots[level][idx];
+	int off = timer->Offset();
+
+	if ( off < 0 || off >= int(slot.size()) || slot[off] != timer )
+		reporter->InternalError("asked to remove a missing timer");
+
+	// Swap with the last element to keep removal O(1).
+	slot[off] = slot.back();
+	slot[off]->SetOffset(off);
+	slot.pop_back();
+	timer->SetOffset(-1);
+
+	if ( slot.empty() )
+		occupied[level][idx / 64] &= ~(uint64_t(1) << (idx % 64));
+
+	--num_in_wheel;
+	}
+
+void Wheel_TimerMgr::Place(Timer* timer)
+	{
+	uint64_t tick = Tick(timer->Time());
+
+	if ( tick < cursor )
+		{
+		if ( ! ready->Add(timer) )
+			reporter->InternalError("out of memory");
+
+		return;
+		}
+
+	int level = Level(tick);
+	InsertIntoSlot(level, SlotIndex(tick, level), timer);
+	}
+
+void Wheel_TimerMgr::PullSlot(int level, int idx)
+	{
+	Slot& slot = slots[level][idx];
+
+	if ( slot.empty() )
+		return;
+
+	// Swap out first: Place() must not see the slot half-drained.
+	Slot timers;
+	timers.swap(slot);
+	occupied[level][idx / 64] &= ~(uint64_t(1) << (idx % 64));
+	num_in_wheel -= timers.size();
+
+	for ( auto timer : timers )
+		{
+		timer->SetOffset(-1);
+
+		if ( ! ready->Add(timer) )
+			reporter->InternalError("out of memory");
+		}
+	}
+
+void Wheel_TimerMgr::CascadeSlot(int level, int idx)
+	{
+	Slot& slot = slots[level][idx];
+
+	if ( slot.empty() )
+		return;
+
+	Slot timers;
+	timers.swap(slot);
+	occupied[level][idx / 64] &= ~(uint64_t(1) << (idx % 64));
+	num_in_wheel -= timers.size();
+
+	for ( auto timer : timers )
+		Place(timer);
+	}
+
+int Wheel_TimerMgr::FindNextSlot(int level, int after) const
+	{
+	int idx = after + 1;
+
+	while ( idx < NUM_SLOTS )
+		{
+		uint64_t word = occupied[level][idx / 64] >> (idx % 64);
+
+		if ( word )
+			return idx + __builtin_ctzll(word);
+
+		idx = (idx / 64 + 1) * 64;
+		}
+
+	return -1;
+	}
+
+uint64_t Wheel_TimerMgr::NextEventTick() const
+	{
+	if ( num_in_wheel == 0 )
+		return 0;
+
+	// Slots at or before the cursor's own index are empty on every level
+	// (they have been pulled or cascaded), except for level 0 which can
+	// still hold timers expiring exactly at the cursor.
+	if ( ! slots[0][SlotIndex(cursor, 0)].empty() )
+		return cursor;
+
+	for ( int level = 0; level < NUM_LEVELS; ++level )
+		{
+		int idx = FindNextSlot(level, SlotIndex(cursor, level));
+
+		if ( idx < 0 )
+			continue;
+
+		int shift = (level + 1) * SLOT_BITS;
+		uint64_t upper = shift < 64 ? (cursor >> shift) << shift : 0;
+		return upper | (uint64_t(idx) << (level * SLOT_BITS));
+		}
+
+	return 0;
+	}
+
+void Wheel_TimerMgr::MoveCursor(uint64_t new_cursor)
+	{
+	uint64_t old_cursor = cursor;
+	cursor = new_cursor;
+
+	uint64_t diff = old_cursor ^ new_cursor;
+
+	if ( diff == 0 )
+		return;
+
+	// Cascade top-down the slots the cursor now points into on every
+	// level whose index changed, so that timers trickle down to the
+	// lowest level before their tick comes up.
+	int top = (63 - __builtin_clzll(diff)) / SLOT_BITS;
+
+	for ( int level = top; level > 0; --level )
+		CascadeSlot(level, SlotIndex(cursor, level));
+	}
+
+void Wheel_TimerMgr::Add(Timer* timer)
+	{
+	DBG_LOG(DBG_TM, "Adding timer %s (%p) at %.6f",
+	        timer_type_to_string(timer->Type()), timer, timer->Time());
+
+	// As with PQ_TimerMgr, already expired timers get added as well, so
+	// that they'll execute in sorted order.
+	Place(timer);
+
+	++cumulative_num;
+	++current_timers[timer->Type()];
+
+	if ( Size() > peak_size )
+		peak_size = Size();
+	}
+
+void Wheel_TimerMgr::Expire()
+	{
+	for ( ;; )
+		{
+		if ( ready->Size() == 0 )
+			{
+			if ( num_in_wheel == 0 )
+				break;
+
+			for ( int l = 0; l < NUM_LEVELS; ++l )
+				for ( int i = 0; i < NUM_SLOTS; ++i )
+					PullSlot(l, i);
+
+			// Everything is in the ready queue now, which is also
+			// where timers added while dispatching need to go.
+			cursor = UINT64_MAX;
+			}
+
+		Timer* timer = (Timer*) ready->Remove();
+		DBG_LOG(DBG_TM, "Dispatching timer %s (%p)",
+		        timer_type_to_string(timer->Type()), timer);
+		timer->Dispatch(t, true);
+		--current_timers[timer->Type()];
+		delete timer;
+		}
+
+	// Both the wheel and the queue are empty, so we can start over.
+	cursor = 0;
+	}
+
+int Wheel_TimerMgr::DoAdvance(double new_t, int max_expire)
+	{
+	uint64_t end_tick = Tick(new_t);
+
+	for ( num_expired = 0; ; )
+		{
+		Timer* timer;
+
+		while ( (max_expire == 0 || num_expired < max_expire) &&
+		        (timer = (Timer*) ready->Top()) && timer->Time() <= new_t )
+			{
+			last_timestamp = timer->Time();
+			--current_timers[timer->Type()];
+
+			// Remove it before dispatching, since the dispatch
+			// can otherwise delete it, and then we won't know
+			// whether we should delete it too.
+			(void) ready->Remove();
+
+			DBG_LOG(DBG_TM, "Dispatching timer %s (%p)",
+			        timer_type_to_string(timer->Type()), timer);
+			timer->Dispatch(new_t, false);
+			delete timer;
+
+			++num_expired;
+			}
+
+		if ( (max_expire > 0 && num_expired >= max_expire) ||
+		     cursor > end_tick || cursor == UINT64_MAX )
+			break;
+
+		PullSlot(0, SlotIndex(cursor, 0));
+
+		// Skip straight to the next tick that has something to do,
+		// unless that's past the new time.
+		uint64_t next = NextEventTick();
+
+		if ( next > cursor && next <= end_tick + 1 )
+			MoveCursor(next);
+		else
+			cursor = end_tick + 1;
+		}
+
+	return num_expired;
+	}
+
+void Wheel_TimerMgr::Remove(Timer* timer)
+	{
+	uint64_t tick = Tick(timer->Time());
+
+	if ( tick < cursor )
+		{
+		if ( ! ready->Remove(timer) )
+			reporter->InternalError("asked to remove a missing timer");
+		}
+	else
+		{
+		int level = Level(tick);
+		RemoveFromSlot(level, SlotIndex(tick, level), timer);
+		}
+
+	--current_timers[timer->Type()];
+	delete timer;
+	}
+
+double Wheel_TimerMgr::GetNextTimeout()
+	{
+	Timer* top = (Timer*) ready->Top();
+
+	if ( top )
+		return std::max(0.0, top->Time() - ::network_time);
+
+	uint64_t next = NextEventTick();
+
+	if ( next == 0 && num_in_wheel == 0 )
+		return -1;
+
+	// The start of the next tick with pending timers is a lower bound
+	// for the next expiration, which is good enough for waking up.
+	return std::max(0.0, next * TICK_RESOLUTION - ::network_time);
+	}
+
+namespace {
+
+struct DispatchedTimer {
+	double time;
+	int id;
+	bool is_expire;
+};
+
+class TestTimer : public Timer {
+public:
+	TestTimer(double t, int arg_id, std::vector<DispatchedTimer>* arg_log)
+		: Timer(t, TIMER_SCHEDULE), id(arg_id), log(arg_log)	{}
+
+	void Dispatch(double t, bool is_expire) override
+		{ log->push_back({Time(), id, is_expire}); }
+
+private:
+	int id;
+	std::vector<DispatchedTimer>* log;
+};
+
+// Advances the managers without going through TimerMgr::Advance(), which
+// needs the global timer and broker managers.
+template<typename Mgr>
+class TestTimerMgr : public Mgr {
+public:
+	int AdvanceTo(double new_t, int max_expire = 0)
+		{
+		this->t = new_t;
+		return this->DoAdvance(new_t, max_expire);
+		}
+};
+
+// Distinct pseudo-random times from 0.001 to about 3000 seconds, so that
+// the timers spread over the wheel's first three levels.
+std::vector<double> spread_times(int n)
+	{
+	std::vector<double> times;
+	uint32_t x = 12345;
+
+	for ( int i = 0; i < n; ++i )
+		{
+		x = x * 1103515245 + 12345;
+		double scale = ((x >> 16) % 3 == 0) ? 0.001 : ((x >> 16) % 3 == 1) ? 0.37 : 29.3;
+		times.push_back(((x >> 8) % 100) * scale + i * 1e-7 + 0.001);
+		}
+
+	return times;
+	}
+
+template<typename Mgr>
+std::vector<DispatchedTimer> run_timers(const std::vector<double>& times,
+                                        const std::vector<double>& advances,
+                                        int max_expire)
+	{
+	std::vector<DispatchedTimer> log;
+	TestTimerMgr<Mgr> mgr;
+
+	for ( size_t i = 0; i < times.size(); ++i )
+		mgr.Add(new TestTimer(times[i], i, &log));
+
+	for ( auto a : advances )
+		while ( mgr.AdvanceTo(a, max_expire) > 0 )
+			;
+
+	CHECK(mgr.Size() == 0);
+	return log;
+	}
+
+bool same_dispatch(const std::vector<DispatchedTimer>& a,
+                   const std::vector<DispatchedTimer>& b)
+	{
+	if ( a.size() != b.size() )
+		return false;
+
+	for ( size_t i = 0; i < a.size(); ++i )
+		if ( a[i].time != b[i].time || a[i].id != b[i].id )
+			return false;
+
+	return true;
+	}
+
+}
+
+TEST_CASE("wheel timer ordering within a level")
+	{
+	// 200 timers, some sharing a tick, all within the first 256 ticks.
+	std::vector<double> times;
+
+	for ( int i = 0; i < 200; ++i )
+		times.push_back(((i * 37) % 200) * 0.0011 + 0.0001);
+
+	auto log = run_timers<Wheel_TimerMgr>(times, {0.1, 1.0}, 0);
+	REQUIRE(log.size() == times.size());
+
+	for ( size_t i = 1; i < log.size(); ++i )
+		CHECK(log[i - 1].time < log[i].time);
+
+	CHECK(same_dispatch(log, run_timers<PQ_TimerMgr>(times, {0.1, 1.0}, 0)));
+	}
+
+TEST_CASE("wheel timer ordering across levels")
+	{
+	auto times = spread_times(2000);
+	std::vector<double> advances = {0.05, 0.25, 1.0, 17.5, 64.0, 300.0, 2999.9, 4000.0};
+
+	auto log = run_timers<Wheel_TimerMgr>(times, advances, 0);
+	REQUIRE(log.size() == times.size());
+
+	for ( size_t i = 1; i < log.size(); ++i )
+		CHECK(log[i - 1].time < log[i].time);
+
+	CHECK(same_dispatch(log, run_timers<PQ_TimerMgr>(times, advances, 0)));
+
+	// Limiting the number of timers per advance must not change the order.
+	CHECK(same_dispatch(log, run_timers<Wheel_TimerMgr>(times, advances, 7)));
+	}
+
+TEST_CASE("wheel timer advancing")
+	{
+	std::vector<DispatchedTimer> log;
+	TestTimerMgr<Wheel_TimerMgr> mgr;
+
+	for ( int i = 0; i < 100; ++i )
+		mgr.Add(new TestTimer(i * 0.5 + 0.25, i, &log));
+
+	CHECK(mgr.Size() == 100);
+
+	// Every advance dispatches exactly the timers up to the new time.
+	for ( int i = 0; i < 100; ++i )
+		{
+		CHECK(mgr.AdvanceTo(i * 0.5 + 0.2) == 0);
+		CHECK(mgr.AdvanceTo(i * 0.5 + 0.25) == 1);
+		REQUIRE(log.size() == size_t(i + 1));
+		CHECK(log.back().id == i);
+		CHECK(! log.back().is_expire);
+		}
+
+	CHECK(mgr.Size() == 0);
+	CHECK(mgr.CumulativeNum() == 100);
+	}
+
+TEST_CASE("wheel timer cascade at level boundaries")
+	{
+	const double res = Wheel_TimerMgr::TICK_RESOLUTION;
+	const uint64_t n = Wheel_TimerMgr::NUM_SLOTS;
+
+	// Ticks right around where the cursor moves into a new slot of
+	// levels one, two and three.
+	std::vector<uint64_t> ticks = {
+		n - 1, n, n + 1, 2 * n - 1, 2 * n,
+		n * n - 1, n * n, n * n + 1,
+		n * n * n - 1, n * n * n, n * n * n + 1,
+	};
+
+	std::vector<DispatchedTimer> log;
+	TestTimerMgr<Wheel_TimerMgr> mgr;
+
+	for ( size_t i = 0; i < ticks.size(); ++i )
+		mgr.Add(new TestTimer(ticks[i] * res, i, &log));
+
+	for ( size_t i = 0; i < ticks.size(); ++i )
+		{
+		// Not yet due just before its tick, due exactly at it.
+		CHECK(mgr.AdvanceTo(ticks[i] * res - res / 2) == 0);
+		CHECK(mgr.AdvanceTo(ticks[i] * res) == 1);
+		REQUIRE(log.size() == i + 1);
+		CHECK(log.back().id == int(i));
+		}
+
+	// Timers added relative to a cursor that's not at zero anymore.
+	double now = ticks.back() * res;
+	log.clear();
+
+	for ( size_t i = 0; i < ticks.size(); ++i )
+		mgr.Add(new TestTimer(now + ticks[i] * res, i, &log));
+
+	for ( size_t i = 0; i < ticks.size(); ++i )
+		{
+		CHECK(mgr.AdvanceTo(now + ticks[i] * res - res / 2) == 0);
+		CHECK(mgr.AdvanceTo(now + ticks[i] * res) == 1);
+		REQUIRE(log.size() == i + 1);
+		CHECK(log.back().id == int(i));
+		}
+
+	CHECK(mgr.Size() == 0);
+	}
+
+TEST_CASE("wheel timer cancel")
+	{
+	std::vector<DispatchedTimer> log;
+	TestTimerMgr<Wheel_TimerMgr> mgr;
+	std::vector<Timer*> timers;
+
+	// Several timers per slot on a few levels, so that cancelling
+	// moves others around in their slot.
+	for ( int i = 0; i < 60; ++i )
+		{
+		auto timer = new TestTimer((i % 3) * 100.0 + (i / 3) * 0.01 + 0.5, i, &log);
+		timers.push_back(timer);
+		mgr.Add(timer);
+		}
+
+	for ( int i = 0; i < 60; i += 4 )
+		mgr.Cancel(timers[i]);
+
+	CHECK(mgr.Size() == 45);
+
+	// Let the level one and two timers cascade down, then cancel some of
+	// those as well as one that's already in the ready queue.
+	mgr.AdvanceTo(100.4);
+	auto late = new TestTimer(50.0, 1000, &log);
+	mgr.Add(late);
+	mgr.Cancel(late);
+
+	for ( int i = 1; i < 60; i += 4 )
+		if ( i % 3 != 0 )
+			mgr.Cancel(timers[i]);
+
+	mgr.AdvanceTo(1000.0);
+	CHECK(mgr.Size() == 0);
+
+	std::vector<int> ids;
+
+	for ( const auto& d : log )
+		ids.push_back(d.id);
+
+	for ( int i = 0; i < 60; ++i )
+		{
+		bool cancelled = i % 4 == 0 || (i % 4 == 1 && i % 3 != 0);
+		bool dispatched = std::find(ids.begin(), ids.end(), i) != ids.end();
+		CHECK(cancelled != dispatched);
+		}
+
+	CHECK(std::find(ids.begin(), ids.end(), 1000) == ids.end());
+
+	for ( size_t i = 1; i < log.size(); ++i )
+		CHECK(log[i - 1].time < log[i].time);
+	}
+
+TEST_CASE("wheel timer expire")
+	{
+	auto times = spread_times(500);
+	std::vector<DispatchedTimer> log;
+	TestTimerMgr<Wheel_TimerMgr> mgr;
+
+	for ( size_t i = 0; i < times.size(); ++i )
+		mgr.Add(new TestTimer(times[i], i, &log));
+
+	// Leave some timers in the ready queue and the rest in the wheel.
+	mgr.AdvanceTo(20.0, 10);
+	size_t advanced = log.size();
+	CHECK(advanced == 10);
+
+	mgr.Expire();
+	CHECK(mgr.Size() == 0);
+	REQUIRE(log.size() == times.size());
+
+	for ( size_t i = 1; i < log.size(); ++i )
+		CHECK(log[i - 1].time < log[i].time);
+
+	for ( size_t i = advanced; i < log.size(); ++i )
+		CHECK(log[i].is_expire);
+
+	// The wheel starts over afterwards.
+	log.clear();
+	mgr.Add(new TestTimer(5000.0, 0, &log));
+	mgr.Add(new TestTimer(4000.0, 1, &log));
+	CHECK(mgr.AdvanceTo(4500.0) == 1);
+	CHECK(mgr.AdvanceTo(5000.0) == 1);
+	REQUIRE(log.size() == 2);
+	CHECK(log[0].id == 1);
+	CHECK(log[1].id == 0);
+	}
+
+TEST_CASE("wheel timer ties")
+	{
+	// Groups of timers with identical times, added interleaved and on
+	// different levels.
+	std::vector<double> times;
+
+	for ( int i = 0; i < 300; ++i )
+		times.push_back((i % 7) * 13.1 + (i % 2) * 0.001 + 0.5);
+
+	std::vector<double> advances = {1.0, 40.0, 100.0};
+	auto wheel = run_timers<Wheel_TimerMgr>(times, advances, 0);
+	auto pq = run_timers<PQ_TimerMgr>(times, advances, 0);
+	REQUIRE(wheel.size() == pq.size());
+
+	// Both dispatch the same timers at the same times.  Which one of the
+	// tied timers goes first depends on the managers' heaps, so compare
+	// each group as a set.
+	size_t i = 0;
+
+	while ( i < wheel.size() )
+		{
+		size_t j = i;
+		std::vector<int> wheel_ids, pq_ids;
+
+		while ( j < wheel.size() && wheel[j].time == wheel[i].time )
+			{
+			CHECK(pq[j].time == wheel[i].time);
+			wheel_ids.push_back(wheel[j].id);
+			pq_ids.push_back(pq[j].id);
+			++j;
+			}
+
+		std::sort(wheel_ids.begin(), wheel_ids.end());
+		std::sort(pq_ids.begin(), pq_ids.end());
+		CHECK(wheel_ids == pq_ids);
+		i = j;
+		}
+
+	// The tie order only depends on the operations, so replays agree.
+	CHECK(same_dispatch(wheel, run_timers<Wheel_TimerMgr>(times, advances, 0)));
+	}
@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 
+#include <vector>
+
 // If you add a timer here, adjust TimerNames in Timer.cc.
 enum TimerType : uint8_t {
 	TIMER_BACKDOOR,
@@ -167,4 +169,90 @@ protected:
 	PriorityQueue* q;
 };
 
+/**
+ * A timer manager based on a hierarchical timing wheel.  Timers are hashed
+ * into slots by their expiration tick, which makes adding and canceling
+ * O(1) regardless of the number of pending timers.  Advancing moves the
+ * timers of each passed tick into a small priority queue from which they
+ * are dispatched in time order, so dispatch order matches PQ_TimerMgr
+ * except for how ties between identical timestamps are broken.  Like the
+ * latter, the order depends only on the sequence of operations, so it is
+ * deterministic when replaying traces.
+ *
+ * Selected at startup by setting $ZEEK_TIMER_MGR to "wheel".
+ */
+class Wheel_TimerMgr : public TimerMgr {
+public:
+	Wheel_TimerMgr();
+	~Wheel_TimerMgr() override;
+
+	void Add(Timer* timer) override;
+	void Expire() override;
+
+	int Size() const override { return num_in_wheel + ready->Size(); }
+	int PeakSize() const override { return peak_size; }
+	uint64_t CumulativeNum() const override { return cumulative_num; }
+	double GetNextTimeout() override;
+
+	// Each level has 2^SLOT_BITS slots; enough levels to cover all
+	// 64 bits of a tick.
+	static constexpr int SLOT_BITS = 8;
+	static constexpr int NUM_SLOTS = 1 << SLOT_BITS;
+	static constexpr int NUM_LEVELS = 64 / SLOT_BITS;
+
+	// Width of a tick at the lowest level, in seconds.
+	static constexpr double TICK_RESOLUTION = 1.0 / 1024;
+
+protected:
+	int DoAdvance(double t, int max_expire) override;
+	void Remove(Timer* timer) override;
+
+	using Slot = std::vector<Timer*>;
+
+	static uint64_t Tick(double t);
+
+	// Returns the level a timer expiring at the given tick belongs to
+	// relative to the current cursor.
+	int Level(uint64_t tick) const;
+
+	static int SlotIndex(uint64_t tick, int level)
+		{ return (tick >> (level * SLOT_BITS)) & (NUM_SLOTS - 1); }
+
+	// Puts a timer into the wheel or, if its tick has already been
+	// passed, into the ready queue.
+	void Place(Timer* timer);
+
+	void InsertIntoSlot(int level, int idx, Timer* timer);
+	void RemoveFromSlot(int level, int idx, Timer* timer);
+
+	// Moves all timers of the given slot to the ready queue.
+	void PullSlot(int level, int idx);
+
+	// Re-places all timers of the given slot relative to the current
+	// cursor, which moves them to lower levels.
+	void CascadeSlot(int level, int idx);
+
+	// Returns the next tick after the cursor at which a non-empty slot
+	// needs processing, or 0 if the wheel is empty.
+	uint64_t NextEventTick() const;
+
+	// Moves the cursor forward to the given tick, cascading the slots it
+	// enters along the way.
+	void MoveCursor(uint64_t new_cursor);
+
+	int FindNextSlot(int level, int after) const;
+
+	// Next tick to be moved into the ready queue.  All timers with
+	// smaller ticks are in the ready queue, all others in the wheel.
+	uint64_t cursor = 0;
+
+	Slot slots[NUM_LEVELS][NUM_SLOTS];
+	uint64_t occupied[NUM_LEVELS][NUM_SLOTS / 64];
+
+	PriorityQueue* ready;
+	int num_in_wheel = 0;
+	int peak_size = 0;
+	uint64_t cumulative_num = 0;
+};
+
 extern TimerMgr* timer_mgr;
@@ -731,6 +731,55 @@ int RecordType::FieldOffset(const char* field) const
 	return -1;
 	}
 
+void RecordType::ExtendLayout() const
+	{
+	int offset = NumSlots(layout.size());
+
+	for ( int i = layout.size(); i < num_fields; ++i )
+		{
+		FieldStorage storage;
+
+		switch ( FieldType(i)->Tag() ) {
+		case TYPE_BOOL:
+		case TYPE_INT:
+		case TYPE_ENUM:
+			storage = FIELD_INT;
+			break;
+
+		case TYPE_COUNT:
+		case TYPE_PORT:
+			storage = FIELD_UINT;
+			break;
+
+		case TYPE_DOUBLE:
+		case TYPE_TIME:
+		case TYPE_INTERVAL:
+			storage = FIELD_DOUBLE;
+			break;
+
+		case TYPE_ADDR:
+			storage = FIELD_ADDR;
+			break;
+
+		default:
+			storage = FIELD_BOXED;
+			break;
+		}
+
+		layout.push_back({offset, storage});
+		offset += storage == FIELD_ADDR ? 2 : 1;
+		}
+	}
+
+int RecordType::NumSlots(int n) const
+	{
+	if ( n <= 0 )
+		return 0;
+
+	const auto& last = FieldLayout(n - 1);
+	return last.offset + (last.storage == FIELD_ADDR ? 2 : 1);
+	}
+
 const char* RecordType::FieldName(int field) const
 	{
 	return FieldDecl(field)->id;
@@ -12,6 +12,7 @@
 #include <unordered_map>
 #include <map>
 #include <list>
+#include <vector>
 #include <optional>
 
 // BRO types.
@@ -588,11 +589,45 @@ public:
 
 	std::string GetFieldDeprecationWarning(int field, bool has_check) const;
 
+	// How a RecordVal stores the value of a field: unboxed in a slot
+	// (two for addresses), or as a Val in one.
+	enum FieldStorage : uint8_t {
+		FIELD_BOXED,
+		FIELD_INT,	// bool, int, enum
+		FIELD_UINT,	// count, port
+		FIELD_DOUBLE,	// double, time, interval
+		FIELD_ADDR,
+	};
+
+	struct FieldSlot {
+		int offset;
+		FieldStorage storage;
+	};
+
+	// Returns where a RecordVal stores the given field.  Adding fields
+	// only appends slots, so existing values keep their layout.
+	const FieldSlot& FieldLayout(int field) const
+		{
+		if ( field >= int(layout.size()) )
+			ExtendLayout();
+
+		return layout[field];
+		}
+
+	// Returns the number of slots the first n fields take.
+	int NumSlots(int n) const;
+
 protected:
 	RecordType() { types = nullptr; }
 
+	void ExtendLayout() const;
+
 	int num_fields;
 	type_decl_list* types;
+
+	// Computed on demand, as field types may not be resolved yet
+	// when the record type gets created.
+	mutable std::vector<FieldSlot> layout;
 };
 
 class SubNetType final : public BroType {
@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <cmath>
 #include <set>
 
@@ -26,6 +27,7 @@
 #include "Desc.h"
 #include "IntrusivePtr.h"
 #include "ID.h"
+#include "MappedTable.h"
 #include "RE.h"
 #include "Scope.h"
 #include "NetVar.h"
@@ -40,6 +42,8 @@
 
 #include "threading/formatters/JSON.h"
 
+#include "3rdparty/doctest.h"
+
 using namespace std;
 
 Val::Val(Func* f)
@@ -1388,7 +1392,6 @@ void TableVal::Init(IntrusivePtr<TableType> t)
 	table_type = std::move(t);
 	expire_func = nullptr;
 	expire_time = nullptr;
-	expire_cookie = nullptr;
 	timer = nullptr;
 	def_val = nullptr;
 
@@ -1409,26 +1412,74 @@ TableVal::~TableVal()
 		timer_mgr->Cancel(timer);
 
 	delete table_hash;
-	delete AsTable();
+	delete val.table_val;
 	delete subnets;
 	}
 
 void TableVal::RemoveAll()
 	{
 	// Here we take the brute force approach.
-	delete AsTable();
+	delete val.table_val;
 	val.table_val = new PDict<TableEntryVal>;
 	val.table_val->SetDeleteFunc(table_entry_val_delete_func);
+	expire_index.clear();
+	mapping.reset();
 	}
 
 int TableVal::Size() const
 	{
-	return AsTable()->Length();
+	if ( mapping )
+		return mapping->Size();
+
+	return val.table_val->Length();
+	}
+
+void TableVal::SetMapping(std::unique_ptr<MappedTable> m)
+	{
+	RemoveAll();
+	mapping = std::move(m);
+	Modified();
+	}
+
+// Returns the name of the global holding the given value, for messages.
+static std::string global_name(const Val* v)
+	{
+	for ( const auto& var : global_scope()->Vars() )
+		if ( var.second->ID_Val() == v )
+			return var.first;
+
+	return "a table";
+	}
+
+void TableVal::Unmap() const
+	{
+	if ( ! mapping )
+		return;
+
+	// Dropped first, as the entries are there from now on.
+	auto m = std::move(mapping);
+
+	// Unmapping gives up on sharing the elements, which a script may do
+	// by accident, so point it out once.
+	if ( ! unmap_warned )
+		{
+		unmap_warned = true;
+		reporter->Warning("%s, mapped from %s, turns into a regular table since it got changed or iterated over",
+		                  global_name(this).c_str(), m->Path().c_str());
+		}
+	PDict<TableEntryVal>* tbl = val.table_val;
+
+	for ( int i = 0; i < m->Size(); ++i )
+		{
+		HashKey k;
+		m->GetKey(i, &k);
+		delete tbl->Insert(&k, new TableEntryVal(m->GetValue(i)));
+		}
 	}
 
 int TableVal::RecursiveSize() const
 	{
-	int n = AsTable()->Length();
+	int n = Size();
 
 	if ( Type()->IsSet() ||
 	     const_cast<TableType*>(Type()->AsTableType())->YieldType()->Tag()
@@ -1493,6 +1544,9 @@ void TableVal::CheckExpireAttr(attr_tag at)
 		// we set a timer which fires immediately.
 		timer = new TableValTimer(this, 1);
 		timer_mgr->Add(timer);
+
+		if ( Size() > 0 )
+			RebuildExpireIndex();
 		}
 	}
 
@@ -1545,6 +1599,15 @@ bool TableVal::Assign(Val* index, HashKey* k, IntrusivePtr<Val> new_val)
 	if ( old_entry_val && attrs && attrs->FindAttr(ATTR_EXPIRE_CREATE) )
 		new_entry_val->SetExpireAccess(old_entry_val->ExpireAccessTime());
 
+	if ( ExpirationEnabled() )
+		{
+		// The old value's index entry stands for the key as a whole.
+		if ( old_entry_val && old_entry_val->expire_seq )
+			new_entry_val->expire_seq = old_entry_val->expire_seq;
+		else
+			AddToExpireIndex(&k_copy, new_entry_val);
+		}
+
 	Modified();
 
 	if ( change_func )
@@ -1891,15 +1954,28 @@ IntrusivePtr<Val> TableVal::Lookup(Val* index, bool use_default_val)
 		return Default(index);
 		}
 
-	const PDict<TableEntryVal>* tbl = AsTable();
+	if ( mapping )
+		{
+		HashKey k;
+		IntrusivePtr<Val> v;
+
+		if ( ComputeHash(index, &k) && mapping->Lookup(k, &v) )
+			return v ? v : IntrusivePtr<Val>{NewRef{}, this};
+
+		if ( ! use_default_val )
+			return nullptr;
+
+		return Default(index);
+		}
+
+	const PDict<TableEntryVal>* tbl = val.table_val;
 
 	if ( tbl->Length() > 0 )
 		{
-		HashKey* k = ComputeHash(index);
-		if ( k )
+		HashKey k;
+		if ( ComputeHash(index, &k) )
 			{
-			TableEntryVal* v = AsTable()->Lookup(k);
-			delete k;
+			TableEntryVal* v = tbl->Lookup(&k);
 
 			if ( v )
 				{
@@ -1969,13 +2045,11 @@ bool TableVal::UpdateTimestamp(Val* index)
 		v = (TableEntryVal*) subnets->Lookup(index);
 	else
 		{
-		HashKey* k = ComputeHash(index);
-		if ( ! k )
+		HashKey k;
+		if ( ! ComputeHash(index, &k) )
 			return false;
 
-		v = AsTable()->Lookup(k);
-
-		delete k;
+		v = AsTable()->Lookup(&k);
 		}
 
 	if ( ! v )
@@ -2054,14 +2128,16 @@ void TableVal::CallChangeFunc(const Val* index, Val* old_value, OnChangeType tpe
 
 IntrusivePtr<Val> TableVal::Delete(const Val* index)
 	{
-	HashKey* k = ComputeHash(index);
-	TableEntryVal* v = k ? AsNonConstTable()->RemoveEntry(k) : nullptr;
+	HashKey k;
+	TableEntryVal* v = ComputeHash(index, &k) ? AsNonConstTable()->RemoveEntry(&k) : nullptr;
 	IntrusivePtr<Val> va{NewRef{}, v ? (v->Value() ? v->Value() : this) : nullptr};
 
 	if ( subnets && ! subnets->Remove(index) )
 		reporter->InternalWarning("index not in prefix table");
 
-	delete k;
+	if ( v && ExpirationEnabled() )
+		CompactExpireIndex();
+
 	delete v;
 
 	Modified();
@@ -2085,6 +2161,9 @@ IntrusivePtr<Val> TableVal::Delete(const HashKey* k)
 			reporter->InternalWarning("index not in prefix table");
 		}
 
+	if ( v && ExpirationEnabled() )
+		CompactExpireIndex();
+
 	delete v;
 
 	Modified();
@@ -2293,12 +2372,115 @@ void TableVal::InitDefaultFunc(Frame* f)
 	def_val = def_attr->AttrExpr()->Eval(f);
 	}
 
+TableVal::ExpireIndexEntry::ExpireIndexEntry(const HashKey* k, int arg_access_time,
+                                             uint32_t arg_seq)
+	: access_time(arg_access_time), seq(arg_seq), key_size(k->Size()), hash(k->Hash())
+	{
+	char* dst = inline_key;
+
+	if ( key_size > HashKey::INLINE_KEY_SIZE )
+		dst = key = new char[key_size];
+
+	memcpy(dst, k->Key(), key_size);
+	}
+
+TableVal::ExpireIndexEntry::ExpireIndexEntry(ExpireIndexEntry&& other) noexcept
+	: access_time(other.access_time), seq(other.seq), key_size(other.key_size),
+	  hash(other.hash)
+	{
+	if ( key_size > HashKey::INLINE_KEY_SIZE )
+		{
+		key = other.key;
+		other.key_size = 0;
+		}
+	else
+		memcpy(inline_key, other.inline_key, key_size);
+	}
+
+TableVal::ExpireIndexEntry&
+TableVal::ExpireIndexEntry::operator=(ExpireIndexEntry&& other) noexcept
+	{
+	if ( this == &other )
+		return *this;
+
+	if ( key_size > HashKey::INLINE_KEY_SIZE )
+		delete [] key;
+
+	access_time = other.access_time;
+	seq = other.seq;
+	key_size = other.key_size;
+	hash = other.hash;
+
+	if ( key_size > HashKey::INLINE_KEY_SIZE )
+		{
+		key = other.key;
+		other.key_size = 0;
+		}
+	else
+		memcpy(inline_key, other.inline_key, key_size);
+
+	return *this;
+	}
+
+TableVal::ExpireIndexEntry::~ExpireIndexEntry()
+	{
+	if ( key_size > HashKey::INLINE_KEY_SIZE )
+		delete [] key;
+	}
+
 void TableVal::InitTimer(double delay)
 	{
 	timer = new TableValTimer(this, network_time + delay);
 	timer_mgr->Add(timer);
 	}
 
+void TableVal::AddToExpireIndex(const HashKey* k, TableEntryVal* v)
+	{
+	if ( ++expire_seq == 0 )
+		++expire_seq;
+
+	v->expire_seq = expire_seq;
+
+	expire_index.emplace_back(k, v->expire_access_time, expire_seq);
+	std::push_heap(expire_index.begin(), expire_index.end());
+	}
+
+void TableVal::CompactExpireIndex()
+	{
+	const PDict<TableEntryVal>* tbl = val.table_val;
+
+	if ( expire_index.size() <= 2 * size_t(tbl->Length()) + 16 )
+		return;
+
+	auto stale = [tbl](const ExpireIndexEntry& e)
+		{
+		HashKey k(e.Key(), e.key_size, e.hash, true);
+		TableEntryVal* v = tbl->Lookup(&k);
+		return ! v || v->expire_seq != e.seq;
+		};
+
+	expire_index.erase(std::remove_if(expire_index.begin(), expire_index.end(), stale),
+	                   expire_index.end());
+	std::make_heap(expire_index.begin(), expire_index.end());
+	}
+
+void TableVal::RebuildExpireIndex()
+	{
+	expire_index.clear();
+
+	const PDict<TableEntryVal>* tbl = AsTable();
+	IterCookie* c = tbl->InitForIteration();
+
+	HashKey* k;
+	TableEntryVal* v;
+
+	while ( (v = tbl->NextEntry(k, c)) )
+		{
+		AddToExpireIndex(k, v);
+		delete k;
+		}
+	}
+
 void TableVal::DoExpire(double t)
 	{
 	if ( ! type )
@@ -2313,93 +2495,104 @@ void TableVal::DoExpire(double t)
 		// error, it has been reported already.
 		return;
 
-	if ( ! expire_cookie )
-		{
-		expire_cookie = tbl->InitForIteration();
-		tbl->MakeRobustCookie(expire_cookie);
-		}
-
-	HashKey* k = nullptr;
-	TableEntryVal* v = nullptr;
-	TableEntryVal* v_saved = nullptr;
 	bool modified = false;
+	int i;
+
+	// Entries that &expire_func postponed, to not consider them again
+	// right away.
+	std::vector<ExpireIndexEntry> postponed;
 
-	for ( int i = 0; i < table_incremental_step &&
-			 (v = tbl->NextEntry(k, expire_cookie)); ++i )
+	for ( i = 0; i < table_incremental_step && ! expire_index.empty(); ++i )
 		{
-		if ( v->ExpireAccessTime() == 0 )
+		double access_time = bro_start_network_time +
+			expire_index.front().access_time;
+
+		// An access time of 0 happens when we insert val while
+		// network_time hasn't been initialized yet (e.g. in
+		// zeek_init()), and also when bro_start_network_time hasn't
+		// been initialized (e.g. before first packet).  The
+		// expire_access_time is correct, so we just need to wait.
+		if ( access_time == 0 || access_time + timeout >= t )
+			break;
+
+		std::pop_heap(expire_index.begin(), expire_index.end());
+		ExpireIndexEntry e = std::move(expire_index.back());
+		expire_index.pop_back();
+
+		HashKey k(e.Key(), e.key_size, e.hash, true);
+		TableEntryVal* v = tbl->Lookup(&k);
+
+		if ( ! v || v->expire_seq != e.seq )
+			// Deleted since.
+			continue;
+
+		if ( v->expire_access_time > e.access_time )
 			{
-			// This happens when we insert val while network_time
-			// hasn't been initialized yet (e.g. in zeek_init()), and
-			// also when bro_start_network_time hasn't been initialized
-			// (e.g. before first packet).  The expire_access_time is
-			// correct, so we just need to wait.
+			// Accessed since, so it's not due yet.
+			e.access_time = v->expire_access_time;
+			expire_index.emplace_back(std::move(e));
+			std::push_heap(expire_index.begin(), expire_index.end());
+			continue;
 			}
 
-		else if ( v->ExpireAccessTime() + timeout < t )
-			{
-			IntrusivePtr<ListVal> idx = nullptr;
+		IntrusivePtr<ListVal> idx = nullptr;
 
-			if ( expire_func )
-				{
-				idx = RecoverIndex(k);
-				double secs = CallExpireFunc(idx);
-
-				// It's possible that the user-provided
-				// function modified or deleted the table
-				// value, so look it up again.
-				v_saved = v;
-				v = tbl->Lookup(k);
-
-				if ( ! v )
-					{ // user-provided function deleted it
-					v = v_saved;
-					delete k;
-					continue;
-					}
+		if ( expire_func )
+			{
+			idx = RecoverIndex(&k);
+			double secs = CallExpireFunc(idx);
 
-				if ( secs > 0 )
-					{
-					// User doesn't want us to expire
-					// this now.
-					v->SetExpireAccess(network_time - timeout + secs);
-					delete k;
-					continue;
-					}
+			// It's possible that the user-provided
+			// function modified or deleted the table
+			// value, so look it up again.
+			v = tbl->Lookup(&k);
 
-				}
+			if ( ! v || v->expire_seq != e.seq )
+				// User-provided function deleted it.
+				continue;
 
-			if ( subnets )
+			if ( secs > 0 )
 				{
-				if ( ! idx )
-					idx = RecoverIndex(k);
-				if ( ! subnets->Remove(idx.get()) )
-					reporter->InternalWarning("index not in prefix table");
+				// User doesn't want us to expire
+				// this now.
+				v->SetExpireAccess(network_time - timeout + secs);
+				e.access_time = v->expire_access_time;
+				postponed.emplace_back(std::move(e));
+				continue;
 				}
+			}
 
-			tbl->RemoveEntry(k);
-			if ( change_func )
-				{
-				if ( ! idx )
-					idx = RecoverIndex(k);
-				CallChangeFunc(idx.get(), v->Value(), ELEMENT_EXPIRED);
-				}
+		if ( subnets )
+			{
+			if ( ! idx )
+				idx = RecoverIndex(&k);
+			if ( ! subnets->Remove(idx.get()) )
+				reporter->InternalWarning("index not in prefix table");
+			}
 
-			delete v;
-			modified = true;
+		tbl->RemoveEntry(&k);
+		if ( change_func )
+			{
+			if ( ! idx )
+				idx = RecoverIndex(&k);
+			CallChangeFunc(idx.get(), v->Value(), ELEMENT_EXPIRED);
 			}
 
-		delete k;
+		delete v;
+		modified = true;
+		}
+
+	for ( auto& e : postponed )
+		{
+		expire_index.emplace_back(std::move(e));
+		std::push_heap(expire_index.begin(), expire_index.end());
 		}
 
 	if ( modified )
 		Modified();
 
-	if ( ! v )
-		{
-		expire_cookie = nullptr;
+	if ( i < table_incremental_step )
 		InitTimer(table_expire_interval);
-		}
 	else
 		InitTimer(table_expire_delay);
 	}
@@ -2525,11 +2718,12 @@ IntrusivePtr<Val> TableVal::DoClone(CloneState* state)
 	if ( expire_time )
 		{
 		tv->expire_time = expire_time;
+		tv->RebuildExpireIndex();
 
 		// As network_time is not necessarily initialized yet, we set
 		// a timer which fires immediately.
-		timer = new TableValTimer(this, 1);
-		timer_mgr->Add(timer);
+		tv->timer = new TableValTimer(tv.get(), 1);
+		timer_mgr->Add(tv->timer);
 		}
 
 	if ( expire_func )
@@ -2556,8 +2750,21 @@ unsigned int TableVal::MemoryAllocation() const
 		size += padded_sizeof(TableEntryVal);
 		}
 
+	for ( const auto& e : expire_index )
+		if ( e.key_size > HashKey::INLINE_KEY_SIZE )
+			size += pad_size(e.key_size);
+
+	// A mapping's elements live in the page cache, shared between
+	// processes.
+	if ( mapping )
+		size += padded_sizeof(*mapping);
+
+	if ( subnets )
+		size += subnets->MemoryAllocation();
+
 	return size + padded_sizeof(*this) + val.table_val->MemoryAllocation()
-		+ table_hash->MemoryAllocation();
+		+ table_hash->MemoryAllocation()
+		+ pad_size(expire_index.capacity() * sizeof(ExpireIndexEntry));
 	}
 
 HashKey* TableVal::ComputeHash(const Val* index) const
@@ -2565,6 +2772,11 @@ HashKey* TableVal::ComputeHash(const Val* index) const
 	return table_hash->ComputeHash(index, true);
 	}
 
+bool TableVal::ComputeHash(const Val* index, HashKey* k) const
+	{
+	return table_hash->ComputeHash(index, true, k);
+	}
+
 void TableVal::SaveParseTimeTableState(RecordType* rt)
 	{
 	auto it = parse_time_table_record_dependencies.find(rt);
@@ -2632,8 +2844,14 @@ RecordVal::RecordTypeValMap RecordVal::parse_time_records;
 RecordVal::RecordVal(RecordType* t, bool init_fields) : Val(t)
 	{
 	origin = nullptr;
+	slots = nullptr;
+	num_slots = 0;
+	num_fields = 0;
+	boxes = nullptr;
+	field_list = nullptr;
+
 	int n = t->NumFields();
-	val_list* vl = val.val_list_val = new val_list(n);
+	Resize(n);
 
 	if ( is_parsing )
 		parse_time_records[t].emplace_back(NewRef{}, this);
@@ -2675,13 +2893,180 @@ RecordVal::RecordVal(RecordType* t, bool init_fields) : Val(t)
 				def = make_intrusive<VectorVal>(type->AsVectorType());
 			}
 
-		vl->push_back(def.release());
+		if ( def )
+			SetField(i, std::move(def));
 		}
 	}
 
 RecordVal::~RecordVal()
 	{
-	delete_vals(AsNonConstRecord());
+	for ( int i = 0; i < num_fields; ++i )
+		ClearField(i);
+
+	delete [] slots;
+	delete [] boxes;
+	delete field_list;
+	}
+
+void RecordVal::Resize(int n)
+	{
+	if ( n <= num_fields )
+		return;
+
+	auto rt = Type()->AsRecordType();
+	int new_num_slots = rt->NumSlots(n);
+	int words = (n + 63) / 64;
+	Slot* new_slots = new Slot[new_num_slots + words];
+
+	memset(new_slots, 0, (new_num_slots + words) * sizeof(Slot));
+
+	if ( slots )
+		{
+		memcpy(new_slots, slots, num_slots * sizeof(Slot));
+		memcpy(new_slots + new_num_slots, Bits(), (num_fields + 63) / 64 * sizeof(uint64_t));
+		delete [] slots;
+		}
+
+	if ( boxes )
+		{
+		Val** new_boxes = new Val*[n]();
+		std::copy(boxes, boxes + num_fields, new_boxes);
+		delete [] boxes;
+		boxes = new_boxes;
+		}
+
+	slots = new_slots;
+	num_slots = new_num_slots;
+	num_fields = n;
+	}
+
+void RecordVal::ClearField(int field)
+	{
+	if ( ! HasField(field) )
+		return;
+
+	const auto& fs = Type()->AsRecordType()->FieldLayout(field);
+
+	if ( fs.storage == RecordType::FIELD_BOXED )
+		{
+		Unref(slots[fs.offset].val);
+		slots[fs.offset].val = nullptr;
+		}
+
+	if ( boxes && boxes[field] )
+		{
+		Unref(boxes[field]);
+		boxes[field] = nullptr;
+		}
+
+	Bits()[field / 64] &= ~(uint64_t(1) << (field % 64));
+	}
+
+void RecordVal::SetField(int field, IntrusivePtr<Val> new_val)
+	{
+	if ( field >= num_fields )
+		return;
+
+	ClearField(field);
+
+	if ( ! new_val )
+		return;
+
+	const auto& fs = Type()->AsRecordType()->FieldLayout(field);
+
+	if ( fs.storage == RecordType::FIELD_BOXED )
+		slots[fs.offset].val = new_val.release();
+
+	else if ( ! Unbox(field, fs, new_val.get()) )
+		{
+		if ( ! boxes )
+			boxes = new Val*[num_fields]();
+
+		boxes[field] = new_val.release();
+		}
+
+	Bits()[field / 64] |= uint64_t(1) << (field % 64);
+	}
+
+bool RecordVal::Unbox(int field, const RecordType::FieldSlot& fs, Val* v)
+	{
+	BroType* ft = Type()->AsRecordType()->FieldType(field);
+
+	if ( v->Type()->Tag() != ft->Tag() ||
+	     (ft->Tag() == TYPE_ENUM && v->Type() != ft) )
+		return false;
+
+	Slot* s = &slots[fs.offset];
+
+	switch ( fs.storage ) {
+	case RecordType::FIELD_INT:
+		s->int_val = v->val.int_val;
+		break;
+
+	case RecordType::FIELD_UINT:
+		s->uint_val = v->val.uint_val;
+		break;
+
+	case RecordType::FIELD_DOUBLE:
+		s->double_val = v->val.double_val;
+		break;
+
+	case RecordType::FIELD_ADDR:
+		{
+		in6_addr in6;
+		v->val.addr_val->CopyIPv6(&in6);
+		memcpy(s, &in6, sizeof(in6));
+		break;
+		}
+
+	default:
+		return false;
+	}
+
+	return true;
+	}
+
+IntrusivePtr<Val> RecordVal::Box(int field, const RecordType::FieldSlot& fs) const
+	{
+	BroType* ft = Type()->AsRecordType()->FieldType(field);
+	const Slot* s = &slots[fs.offset];
+
+	switch ( ft->Tag() ) {
+	case TYPE_BOOL:
+		return val_mgr->Bool(s->int_val);
+
+	case TYPE_INT:
+		return val_mgr->Int(s->int_val);
+
+	case TYPE_ENUM:
+		return ft->AsEnumType()->GetVal(s->int_val);
+
+	case TYPE_COUNT:
+		return val_mgr->Count(s->uint_val);
+
+	case TYPE_PORT:
+		return val_mgr->Port(s->uint_val);
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+		return make_intrusive<Val>(s->double_val, ft->Tag());
+
+	case TYPE_INTERVAL:
+		return make_intrusive<IntervalVal>(s->double_val, 1.0);
+
+	case TYPE_ADDR:
+		return make_intrusive<AddrVal>(UnboxedAddr(field));
+
+	default:
+		reporter->InternalError("bad unboxed record field type");
+	}
+	}
+
+IPAddr RecordVal::UnboxedAddr(int field) const
+	{
+	in6_addr in6;
+	memcpy(&in6, &slots[Type()->AsRecordType()->FieldLayout(field).offset], sizeof(in6));
+	return IPAddr(in6);
 	}
 
 IntrusivePtr<Val> RecordVal::SizeVal() const
@@ -2691,8 +3076,7 @@ IntrusivePtr<Val> RecordVal::SizeVal() const
 
 void RecordVal::Assign(int field, IntrusivePtr<Val> new_val)
 	{
-	Val* old_val = AsNonConstRecord()->replace(field, new_val.release());
-	Unref(old_val);
+	SetField(field, std::move(new_val));
 	Modified();
 	}
 
@@ -2703,15 +3087,45 @@ void RecordVal::Assign(int field, Val* new_val)
 
 Val* RecordVal::Lookup(int field) const
 	{
-	return (*AsRecord())[field];
+	if ( ! HasField(field) )
+		return nullptr;
+
+	const auto& fs = Type()->AsRecordType()->FieldLayout(field);
+
+	if ( fs.storage == RecordType::FIELD_BOXED )
+		return slots[fs.offset].val;
+
+	if ( ! boxes )
+		boxes = new Val*[num_fields]();
+
+	if ( ! boxes[field] )
+		boxes[field] = Box(field, fs).release();
+
+	return boxes[field];
 	}
 
-IntrusivePtr<Val> RecordVal::LookupWithDefault(int field) const
+const val_list* RecordVal::FieldList() const
 	{
-	Val* val = (*AsRecord())[field];
+	if ( ! field_list )
+		field_list = new val_list(num_fields);
 
-	if ( val )
-		return {NewRef{}, val};
+	field_list->clear();
+
+	for ( int i = 0; i < num_fields; ++i )
+		field_list->push_back(Lookup(i));
+
+	return field_list;
+	}
+
+IntrusivePtr<Val> RecordVal::GetField(int field) const
+	{
+	return {NewRef{}, Lookup(field)};
+	}
+
+IntrusivePtr<Val> RecordVal::LookupWithDefault(int field) const
+	{
+	if ( HasField(field) )
+		return GetField(field);
 
 	return Type()->AsRecordType()->FieldDefault(field);
 	}
@@ -2727,16 +3141,15 @@ void RecordVal::ResizeParseTimeRecords(RecordType* rt)
 
 	for ( auto& rv : rvs )
 		{
-		auto vs = rv->val.val_list_val;
-		auto current_length = vs->length();
+		auto current_length = rv->num_fields;
 		auto required_length = rt->NumFields();
 
 		if ( required_length > current_length )
 			{
-			vs->resize(required_length);
+			rv->Resize(required_length);
 
 			for ( auto i = current_length; i < required_length; ++i )
-				vs->replace(i, rt->FieldDefault(i).release());
+				rv->SetField(i, rt->FieldDefault(i));
 			}
 		}
 	}
@@ -2753,7 +3166,7 @@ IntrusivePtr<Val> RecordVal::Lookup(const char* field, bool with_default) const
 	if ( idx < 0 )
 		reporter->InternalError("missing record field: %s", field);
 
-	return with_default ? LookupWithDefault(idx) : IntrusivePtr{NewRef{}, Lookup(idx)};
+	return with_default ? LookupWithDefault(idx) : GetField(idx);
 	}
 
 IntrusivePtr<RecordVal> RecordVal::CoerceTo(const RecordType* t, Val* aggr, bool allow_orphaning) const
@@ -2787,7 +3200,7 @@ IntrusivePtr<RecordVal> RecordVal::CoerceTo(const RecordType* t, Val* aggr, bool
 			break;
 			}
 
-		Val* v = Lookup(i);
+		auto v = GetField(i);
 
 		if ( ! v )
 			// Check for allowable optional fields is outside the loop, below.
@@ -2796,18 +3209,18 @@ IntrusivePtr<RecordVal> RecordVal::CoerceTo(const RecordType* t, Val* aggr, bool
 		if ( ar_t->FieldType(t_i)->Tag() == TYPE_RECORD &&
 		     ! same_type(ar_t->FieldType(t_i), v->Type()) )
 			{
-			auto rhs = make_intrusive<ConstExpr>(IntrusivePtr{NewRef{}, v});
+			auto rhs = make_intrusive<ConstExpr>(std::move(v));
 			auto e = make_intrusive<RecordCoerceExpr>(std::move(rhs),
 			        IntrusivePtr{NewRef{}, ar_t->FieldType(t_i)->AsRecordType()});
 			ar->Assign(t_i, e->Eval(nullptr));
 			continue;
 			}
 
-		ar->Assign(t_i, {NewRef{}, v});
+		ar->Assign(t_i, std::move(v));
 		}
 
 	for ( i = 0; i < ar_t->NumFields(); ++i )
-		if ( ! ar->Lookup(i) &&
+		if ( ! ar->HasField(i) &&
 			 ! ar_t->FieldDecl(i)->FindAttr(ATTR_OPTIONAL) )
 			{
 			char buf[512];
@@ -2834,8 +3247,7 @@ IntrusivePtr<TableVal> RecordVal::GetRecordFieldsVal() const
 
 void RecordVal::Describe(ODesc* d) const
 	{
-	const val_list* vl = AsRecord();
-	int n = vl->length();
+	int n = num_fields;
 	auto record_type = Type()->AsRecordType();
 
 	if ( d->IsBinary() || d->IsPortable() )
@@ -2848,7 +3260,7 @@ void RecordVal::Describe(ODesc* d) const
 	else
 		d->Add("[");
 
-	loop_over_list(*vl, i)
+	for ( int i = 0; i < n; ++i )
 		{
 		if ( ! d->IsBinary() && i > 0 )
 			d->Add(", ");
@@ -2858,7 +3270,7 @@ void RecordVal::Describe(ODesc* d) const
 		if ( ! d->IsBinary() )
 			d->Add("=");
 
-		Val* v = (*vl)[i];
+		auto v = GetField(i);
 		if ( v )
 			v->Describe(d);
 		else
@@ -2871,14 +3283,12 @@ void RecordVal::Describe(ODesc* d) const
 
 void RecordVal::DescribeReST(ODesc* d) const
 	{
-	const val_list* vl = AsRecord();
-	int n = vl->length();
 	auto record_type = Type()->AsRecordType();
 
 	d->Add("{");
 	d->PushIndent();
 
-	loop_over_list(*vl, i)
+	for ( int i = 0; i < num_fields; ++i )
 		{
 		if ( i > 0 )
 			d->NL();
@@ -2886,7 +3296,7 @@ void RecordVal::DescribeReST(ODesc* d) const
 		d->Add(record_type->FieldName(i));
 		d->Add("=");
 
-		Val* v = (*vl)[i];
+		auto v = GetField(i);
 
 		if ( v )
 			v->Describe(d);
@@ -2909,10 +3319,21 @@ IntrusivePtr<Val> RecordVal::DoClone(CloneState* state)
 	rv->origin = nullptr;
 	state->NewClone(this, rv);
 
-	for ( const auto& vlv : *val.val_list_val )
+	for ( int i = 0; i < num_fields; ++i )
 		{
-		auto v = vlv ? vlv->Clone(state) : nullptr;
-  		rv->val.val_list_val->push_back(v.release());
+		if ( HasUnboxedField(i) )
+			{
+			const auto& fs = Type()->AsRecordType()->FieldLayout(i);
+			int width = fs.storage == RecordType::FIELD_ADDR ? 2 : 1;
+			std::copy(slots + fs.offset, slots + fs.offset + width, rv->slots + fs.offset);
+			rv->Bits()[i / 64] |= uint64_t(1) << (i % 64);
+			continue;
+			}
+
+		auto v = Lookup(i);
+
+		if ( v )
+			rv->SetField(i, v->Clone(state));
 		}
 
 	return rv;
@@ -2920,16 +3341,22 @@ IntrusivePtr<Val> RecordVal::DoClone(CloneState* state)
 
 unsigned int RecordVal::MemoryAllocation() const
 	{
-	unsigned int size = 0;
-	const val_list* vl = AsRecord();
+	unsigned int size = padded_sizeof(*this);
+	size += pad_size((num_slots + (num_fields + 63) / 64) * sizeof(Slot));
+
+	if ( boxes )
+		size += pad_size(num_fields * sizeof(Val*));
 
-	for ( const auto& v : *vl )
+	for ( int i = 0; i < num_fields; ++i )
 		{
-		if ( v )
-		    size += v->MemoryAllocation();
+		if ( HasUnboxedField(i) )
+			continue;
+
+		if ( auto v = Lookup(i) )
+			size += v->MemoryAllocation();
 		}
 
-	return size + padded_sizeof(*this) + val.val_list_val->MemoryAllocation();
+	return size;
 	}
 
 IntrusivePtr<Val> EnumVal::SizeVal() const
@@ -3478,3 +3905,74 @@ PortVal* ValManager::GetPort(uint32_t port_num) const
 	{
 	return Port(port_num)->Ref()->AsPortVal();
 	}
+
+TEST_CASE("unboxed record fields")
+	{
+	// Unit tests run before the usual initialization.
+	if ( ! val_mgr )
+		val_mgr = new ValManager();
+
+	auto fields = new type_decl_list();
+	fields->push_back(new TypeDecl(base_type(TYPE_COUNT), copy_string("c")));
+	fields->push_back(new TypeDecl(base_type(TYPE_STRING), copy_string("s")));
+	fields->push_back(new TypeDecl(base_type(TYPE_ADDR), copy_string("a")));
+	fields->push_back(new TypeDecl(base_type(TYPE_INTERVAL), copy_string("i")));
+	fields->push_back(new TypeDecl(base_type(TYPE_PORT), copy_string("p")));
+	fields->push_back(new TypeDecl(base_type(TYPE_BOOL), copy_string("b")));
+	auto rt = make_intrusive<RecordType>(fields);
+
+	CHECK(rt->FieldLayout(0).storage == RecordType::FIELD_UINT);
+	CHECK(rt->FieldLayout(1).storage == RecordType::FIELD_BOXED);
+	CHECK(rt->FieldLayout(2).storage == RecordType::FIELD_ADDR);
+	CHECK(rt->FieldLayout(3).offset == 4);
+	CHECK(rt->NumSlots(6) == 7);
+
+	auto rv = make_intrusive<RecordVal>(rt.get());
+	rv->Assign(0, val_mgr->Count(12345678));
+	rv->Assign(1, make_intrusive<StringVal>("foo"));
+	rv->Assign(2, make_intrusive<AddrVal>("2001:db8::1"));
+	rv->Assign(3, make_intrusive<IntervalVal>(1.5, 1.0));
+	rv->Assign(4, val_mgr->Port(53, TRANSPORT_UDP));
+
+	CHECK(rv->HasUnboxedField(0));
+	CHECK(rv->UnboxedUnsigned(0) == 12345678);
+	CHECK_FALSE(rv->HasUnboxedField(1));
+	CHECK(rv->UnboxedAddr(2) == IPAddr("2001:db8::1"));
+	CHECK(rv->UnboxedDouble(3) == 1.5);
+	CHECK_FALSE(rv->HasField(5));
+	CHECK_FALSE(rv->Lookup(5));
+
+	// Boxes get created on demand, and looking up again yields the same.
+	auto i = rv->GetField(3);
+	CHECK(i->Type()->Tag() == TYPE_INTERVAL);
+	CHECK(i->AsInterval() == 1.5);
+	CHECK(rv->GetField(3) == i);
+	CHECK(rv->Lookup(3) == i.get());
+	CHECK(rv->UnboxedDouble(3) == 1.5);
+
+	Val* p = rv->Lookup(4);
+	CHECK(p->AsPortVal()->Port() == 53);
+	CHECK(p->AsPortVal()->IsUDP());
+	CHECK(rv->Lookup(4) == p);
+	CHECK_FALSE(rv->HasUnboxedField(4));
+
+	rv->Assign(4, val_mgr->Port(80, TRANSPORT_TCP));
+	CHECK(rv->HasUnboxedField(4));
+	CHECK(rv->Lookup(4)->AsPortVal()->Port() == 80);
+
+	// A value of another type than the field's stays boxed.
+	rv->Assign(5, val_mgr->Count(1));
+	CHECK(rv->HasField(5));
+	CHECK_FALSE(rv->HasUnboxedField(5));
+	CHECK(rv->Lookup(5)->Type()->Tag() == TYPE_COUNT);
+
+	auto c = rv->Clone();
+	auto crv = c->AsRecordVal();
+	CHECK(crv->UnboxedUnsigned(0) == 12345678);
+	CHECK(crv->UnboxedAddr(2) == IPAddr("2001:db8::1"));
+	CHECK(crv->Lookup(1)->AsString()->CheckString() == std::string("foo"));
+
+	rv->Assign(0, IntrusivePtr<Val>{});
+	CHECK_FALSE(rv->HasField(0));
+	CHECK(crv->HasField(0));
+	}
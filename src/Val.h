@@ -3,6 +3,7 @@
 #pragma once
 
 #include "IntrusivePtr.h"
+#include "Hash.h"
 #include "Type.h"
 #include "Timer.h"
 #include "Notifier.h"
@@ -11,6 +12,7 @@
 #include <vector>
 #include <list>
 #include <array>
+#include <memory>
 #include <unordered_map>
 
 #include <sys/types.h> // for u_char
@@ -34,6 +36,7 @@ class BroFunc;
 class Func;
 class BroFile;
 class PrefixTable;
+class MappedTable;
 
 class PortVal;
 class AddrVal;
@@ -80,7 +83,6 @@ union BroValUnion {
 	BroFile* file_val;
 	RE_Matcher* re_val;
 	PDict<TableEntryVal>* table_val;
-	val_list* val_list_val;
 
 	std::vector<Val*>* vector_val;
 
@@ -116,9 +118,6 @@ union BroValUnion {
 	constexpr BroValUnion(PDict<TableEntryVal>* value) noexcept
 		: table_val(value) {}
 
-	constexpr BroValUnion(val_list* value) noexcept
-		: val_list_val(value) {}
-
 	constexpr BroValUnion(std::vector<Val*> *value) noexcept
 		: vector_val(value) {}
 };
@@ -207,8 +206,12 @@ public:
 	CONST_ACCESSOR2(TYPE_ENUM, int, int_val, AsEnum)
 	CONST_ACCESSOR(TYPE_STRING, BroString*, string_val, AsString)
 	CONST_ACCESSOR(TYPE_FUNC, Func*, func_val, AsFunc)
-	CONST_ACCESSOR(TYPE_TABLE, PDict<TableEntryVal>*, table_val, AsTable)
-	CONST_ACCESSOR(TYPE_RECORD, val_list*, val_list_val, AsRecord)
+	// Defined after TableVal, as a table backed by a MappedTable needs
+	// its entries decoded first.
+	PDict<TableEntryVal>* AsTable() const;
+	// Defined after RecordVal, which boxes the fields for the list.
+	[[deprecated("Remove in v4.1.  Use RecordVal::Lookup() or RecordVal::GetField() instead.")]]
+	const val_list* AsRecord() const;
 	CONST_ACCESSOR(TYPE_FILE, BroFile*, file_val, AsFile)
 	CONST_ACCESSOR(TYPE_PATTERN, RE_Matcher*, re_val, AsPattern)
 	CONST_ACCESSOR(TYPE_VECTOR, std::vector<Val*>*, vector_val, AsVector)
@@ -356,8 +359,7 @@ protected:
 		{
 		}
 
-	ACCESSOR(TYPE_TABLE, PDict<TableEntryVal>*, table_val, AsNonConstTable)
-	ACCESSOR(TYPE_RECORD, val_list*, val_list_val, AsNonConstRecord)
+	PDict<TableEntryVal>* AsNonConstTable()	{ return AsTable(); }
 
 	// For internal use by the Val::Clone() methods.
 	struct CloneState {
@@ -693,6 +695,10 @@ protected:
 	// to save a few bytes, as we do not need a high resolution for these
 	// anyway.
 	int expire_access_time;
+
+	// Identifies the table's expiration index entry for this value's
+	// key, or 0 if there's none.
+	uint32_t expire_seq = 0;
 };
 
 class TableValTimer final : public Timer {
@@ -830,6 +836,24 @@ public:
 
 	HashKey* ComputeHash(const Val* index) const;
 
+	// Same, but into the given key.  Returns false if the index doesn't
+	// match the table's index type.
+	bool ComputeHash(const Val* index, HashKey* k) const;
+
+	// Backs the table by the given MappedTable, in place of its current
+	// entries.  Lookups and Size() go to the mapping from then on.  Any
+	// other access to the entries, including changes to the table,
+	// first makes the mapping's elements regular entries, see Unmap().
+	void SetMapping(std::unique_ptr<MappedTable> m);
+
+	// Returns true if the table is backed by a MappedTable.
+	bool IsMapped() const	{ return mapping != nullptr; }
+
+	// Decodes the elements of the MappedTable backing the table into
+	// regular entries and drops the mapping.  Does nothing for a table
+	// that isn't mapped.  Warns the first time it unmaps the table.
+	void Unmap() const;
+
 	notifier::Modifiable* Modifiable() override	{ return this; }
 
 	// Retrieves and saves all table state (key-value pairs) for
@@ -874,6 +898,16 @@ protected:
 	// Calls &expire_func and returns its return interval;
 	double CallExpireFunc(IntrusivePtr<ListVal> idx);
 
+	// Adds the element with the given key to the expiration index.
+	void AddToExpireIndex(const HashKey* k, TableEntryVal* v);
+
+	// Builds the expiration index anew from all current elements.
+	void RebuildExpireIndex();
+
+	// Drops the index entries of deleted elements once they make up
+	// the majority of the index.
+	void CompactExpireIndex();
+
 	// Enum for the different kinds of changes an &on_change handler can see
 	enum OnChangeType { ELEMENT_NEW, ELEMENT_CHANGED, ELEMENT_REMOVED, ELEMENT_EXPIRED };
 
@@ -888,17 +922,74 @@ protected:
 	IntrusivePtr<Expr> expire_time;
 	IntrusivePtr<Expr> expire_func;
 	TableValTimer* timer;
-	IterCookie* expire_cookie;
 	PrefixTable* subnets;
 	IntrusivePtr<Val> def_val;
 	IntrusivePtr<Expr> change_func;
 	// prevent recursion of change functions
 	bool in_change_func = false;
 
+	// The index of an expiring table's elements, as a heap ordered by
+	// their last expiration relevant access.  An entry doesn't move when
+	// its element gets accessed again; DoExpire() notices that once the
+	// entry comes up and puts it back with the newer time.  Entries of
+	// elements deleted since also stay until then, or until
+	// CompactExpireIndex() removes them.
+	struct ExpireIndexEntry {
+		ExpireIndexEntry(const HashKey* k, int access_time, uint32_t seq);
+		ExpireIndexEntry(ExpireIndexEntry&& other) noexcept;
+		ExpireIndexEntry& operator=(ExpireIndexEntry&& other) noexcept;
+		~ExpireIndexEntry();
+
+		const char* Key() const
+			{ return key_size <= HashKey::INLINE_KEY_SIZE ? inline_key : key; }
+
+		int access_time;	// the element's expire_access_time then
+		uint32_t seq;	// the element's expire_seq while current
+		int key_size;
+		uint64_t hash;	// the key's hash_t
+
+		// Keys that fit are kept inline, as HashKey does.
+		union {
+			char* key;
+			char inline_key[HashKey::INLINE_KEY_SIZE];
+		};
+
+		// Inverted, to put the earliest on top of the heap.  Ties go
+		// by age of the entry, so that elements accessed at the same
+		// time expire in the order of their insertion.
+		bool operator<(const ExpireIndexEntry& other) const
+			{
+			if ( access_time != other.access_time )
+				return access_time > other.access_time;
+
+			return seq > other.seq;
+			}
+	};
+
+	std::vector<ExpireIndexEntry> expire_index;
+	uint32_t expire_seq = 0;	// of the last index entry added
+
+	// The elements, if the table is backed by a MappedTable; the
+	// dictionary is empty then.
+	mutable std::unique_ptr<MappedTable> mapping;
+	mutable bool unmap_warned = false;
+
 	static TableRecordDependencies parse_time_table_record_dependencies;
 	static ParseTimeTableStates parse_time_table_states;
 };
 
+inline PDict<TableEntryVal>* Val::AsTable() const
+	{
+	CHECK_TAG(type->Tag(), TYPE_TABLE, "Val::AsTable", type_name)
+
+	auto tv = static_cast<const TableVal*>(this);
+
+	if ( tv->IsMapped() )
+		tv->Unmap();
+
+	return val.table_val;
+	}
+
 class RecordVal final : public Val, public notifier::Modifiable {
 public:
 	explicit RecordVal(RecordType* t, bool init_fields = true);
@@ -908,9 +999,39 @@ public:
 
 	void Assign(int field, IntrusivePtr<Val> new_val);
 	void Assign(int field, Val* new_val);
-	Val* Lookup(int field) const;	// Does not Ref() value.
+
+	// Does not Ref() value.  Fields stored unboxed get boxed on the
+	// first call and keep the box until reassigned.
+	Val* Lookup(int field) const;
+
+	// Returns the value of a field, boxing it like Lookup() if stored
+	// unboxed.
+	IntrusivePtr<Val> GetField(int field) const;
+
 	IntrusivePtr<Val> LookupWithDefault(int field) const;
 
+	// Returns whether a field has a value.
+	bool HasField(int field) const
+		{ return field < num_fields && (Bits()[field / 64] & (uint64_t(1) << (field % 64))); }
+
+	// Returns whether a field has a value that's stored unboxed, in
+	// which case the Unboxed*() methods return it without creating a
+	// Val.  These must only be called for fields of the right type.
+	bool HasUnboxedField(int field) const
+		{
+		return HasField(field) &&
+			Type()->AsRecordType()->FieldLayout(field).storage != RecordType::FIELD_BOXED &&
+			! (boxes && boxes[field]);
+		}
+
+	bro_int_t UnboxedInt(int field) const	// bool, int, enum
+		{ return slots[Type()->AsRecordType()->FieldLayout(field).offset].int_val; }
+	bro_uint_t UnboxedUnsigned(int field) const	// count, port
+		{ return slots[Type()->AsRecordType()->FieldLayout(field).offset].uint_val; }
+	double UnboxedDouble(int field) const	// double, time, interval
+		{ return slots[Type()->AsRecordType()->FieldLayout(field).offset].double_val; }
+	IPAddr UnboxedAddr(int field) const;
+
 	/**
 	 * Looks up the value of a field by field name.  If the field doesn't
 	 * exist in the record type, it's an internal error: abort.
@@ -960,14 +1081,60 @@ public:
 	static void DoneParsing();
 
 protected:
+	friend class Val;
+
 	IntrusivePtr<Val> DoClone(CloneState* state) override;
 
+	// Returns all fields boxed, with null for unset ones, for the
+	// deprecated Val::AsRecord().
+	const val_list* FieldList() const;
+
+	union Slot {
+		Val* val;
+		bro_int_t int_val;
+		bro_uint_t uint_val;
+		double double_val;
+	};
+
+	// Sets a field without flagging a modification.
+	void SetField(int field, IntrusivePtr<Val> new_val);
+	void ClearField(int field);
+
+	// Stores a value unboxed, returning false if its type differs from
+	// the field's.
+	bool Unbox(int field, const RecordType::FieldSlot& fs, Val* v);
+	IntrusivePtr<Val> Box(int field, const RecordType::FieldSlot& fs) const;
+
+	// Grows the storage to cover the first n fields of the type.
+	void Resize(int n);
+
+	// One bit per field telling whether it's set, stored after the slots.
+	uint64_t* Bits() const	{ return reinterpret_cast<uint64_t*>(slots + num_slots); }
+
 	BroObj* origin;
 
+	Slot* slots;
+	int num_slots;
+	int num_fields;
+
+	// Boxes of unboxed fields handed out by Lookup(), and values whose
+	// type doesn't exactly match their field's; these take precedence
+	// over the slot.  Allocated on first use.
+	mutable Val** boxes;
+
+	// The list last returned by FieldList(), allocated on first use.
+	mutable val_list* field_list;
+
 	using RecordTypeValMap = std::unordered_map<RecordType*, std::vector<IntrusivePtr<RecordVal>>>;
 	static RecordTypeValMap parse_time_records;
 };
 
+inline const val_list* Val::AsRecord() const
+	{
+	CHECK_TAG(type->Tag(), TYPE_RECORD, "Val::AsRecord", type_name)
+	return static_cast<const RecordVal*>(this)->FieldList();
+	}
+
 class EnumVal final : public Val {
 public:
 	IntrusivePtr<Val> SizeVal() const override;
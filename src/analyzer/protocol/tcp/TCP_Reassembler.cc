@@ -417,27 +417,69 @@ void TCP_Reassembler::BlockInserted(DataBlockMap::const_iterator it)
 		++it;
 		}
 
-	TCP_Endpoint* e = endp;
+	if ( ! KeepDelivered() )
+		TrimToSeq(last_reassem_seq);
+
+	// Note: don't make an EOF check here, because then we'd miss it
+	// for FIN packets that don't carry any payload (and thus
+	// endpoint->DataSent is not called).  Instead, do the check in
+	// TCP_Connection::NextPacket.
+	}
+
+bool TCP_Reassembler::KeepDelivered() const
+	{
+	const TCP_Endpoint* e = endp;
 
 	if ( ! e->peer->HasContents() )
 		// Our endpoint's peer doesn't do reassembly and so
 		// (presumably) isn't processing acks.  So don't hold
 		// the now-delivered data.
-		TrimToSeq(last_reassem_seq);
+		return false;
 
-	else if ( e->NoDataAcked() && tcp_max_initial_window &&
-		  e->Size() > static_cast<uint64_t>(tcp_max_initial_window) )
+	if ( e->NoDataAcked() && tcp_max_initial_window &&
+	     e->Size() > static_cast<uint64_t>(tcp_max_initial_window) )
 		// We've sent quite a bit of data, yet none of it has
 		// been acked.  Presume that we're not seeing the peer's
 		// acks (perhaps due to filtering or split routing) and
 		// don't hang onto the data further, as we may wind up
 		// carrying it all the way until this connection ends.
-		TrimToSeq(last_reassem_seq);
+		return false;
 
-	// Note: don't make an EOF check here, because then we'd miss it
-	// for FIN packets that don't carry any payload (and thus
-	// endpoint->DataSent is not called).  Instead, do the check in
-	// TCP_Connection::NextPacket.
+	return true;
+	}
+
+void TCP_Reassembler::DeliverInOrder(uint64_t seq, uint64_t len, const u_char* data)
+	{
+	// Same as adding the data through NewBlock() and BlockInserted()
+	// delivering it, minus the overlap checks and the searching, which
+	// IsNextInOrder() makes unnecessary.  Data that needs to be kept
+	// until acked still gets appended to the block list, but that
+	// can't miss the end of the list.
+	bool kept = KeepDelivered();
+
+	if ( kept )
+		block_list.Insert(seq, seq + len, data);
+
+	last_reassem_seq += len;
+
+	if ( record_contents_file )
+		RecordBlock(DataBlock(data, len, seq), record_contents_file);
+
+	DeliverBlock(seq, len, data);
+
+	// Like BlockInserted(), decide on keeping the data only after
+	// delivering it, as that can enable content recording or add a
+	// stream analyzer.  Unless the delivery has trimmed past it already,
+	// the data then goes into the block list late.
+	if ( KeepDelivered() )
+		{
+		if ( ! kept && seq >= TrimSeq() )
+			block_list.Insert(seq, seq + len, data);
+
+		KeepBorrowedBlocks();
+		}
+	else
+		TrimToSeq(last_reassem_seq);
 	}
 
 void TCP_Reassembler::Overlap(const u_char* b1, const u_char* b2, uint64_t n)
@@ -504,7 +546,20 @@ bool TCP_Reassembler::DataSent(double t, uint64_t seq, int len,
 		}
 
 	flags = arg_flags;
-	NewBlock(t, seq, len, data);
+
+	if ( len > 0 && IsNextInOrder(seq) )
+		{
+		++fast_path_hits[rtype];
+		DeliverInOrder(seq, len, data);
+		}
+	else
+		{
+		if ( len > 0 )
+			++fast_path_misses[rtype];
+
+		NewBlock(t, seq, len, data);
+		}
+
 	flags = TCP_Flags();
 
 	if ( Endpoint()->NoDataAcked() && tcp_max_above_hole_without_any_acks &&
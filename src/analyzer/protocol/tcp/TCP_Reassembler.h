@@ -98,6 +98,12 @@ private:
 	void BlockInserted(DataBlockMap::const_iterator it) override;
 	void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override;
 
+	// Returns true if delivered data needs to be kept until acked.
+	bool KeepDelivered() const;
+
+	// Delivers data for which IsNextInOrder() holds.
+	void DeliverInOrder(uint64_t seq, uint64_t len, const u_char* data);
+
 	TCP_Endpoint* endp;
 
 	bool deliver_tcp_contents;
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <array>
+#include <random>
+
+#include "Hash.h"
+
+namespace zeek { namespace detail { namespace bench {
+
+/**
+ * A simple monotonic stopwatch.
+ */
+class Stopwatch {
+public:
+	Stopwatch()	{ Reset(); }
+
+	void Reset()	{ clock_gettime(CLOCK_MONOTONIC, &start); }
+
+	double ElapsedNanos() const
+		{
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return (now.tv_sec - start.tv_sec) * 1e9 + (now.tv_nsec - start.tv_nsec);
+		}
+
+private:
+	struct timespec start;
+};
+
+/**
+ * Prints a single measurement in the common benchmark output format.
+ */
+inline void Report(const char* what, uint64_t n, double total_nanos)
+	{
+	printf("%-40s n=%-10llu %10.2f ns/op\n", what,
+	       static_cast<unsigned long long>(n), n ? total_nanos / n : 0.0);
+	fflush(stdout);
+	}
+
+/**
+ * Initializes the process-specific hash seeds from a fixed value so that
+ * results are reproducible between runs.
+ */
+inline void InitHashSeeds()
+	{
+	std::array<uint32_t, KeyedHash::SEED_INIT_SIZE> seed;
+	std::mt19937 rng(42);
+
+	for ( auto& s : seed )
+		s = rng();
+
+	KeyedHash::InitializeSeeds(seed);
+	}
+
+/**
+ * Keeps the compiler from optimizing away a computed value.
+ */
+template<typename T>
+inline void DoNotOptimize(const T& value)
+	{
+	asm volatile("" : : "r,m"(value) : "memory");
+	}
+
+}}} // namespace zeek::detail::bench
@@ -0,0 +1,166 @@
+// Compares FlowTable, the connection table used by NetSessions, against the
+// std::map it replaced, for insert, hit/miss lookup, and removal.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench-util.h"
+
+#include "FlowTable.h"
+
+using namespace zeek::detail::bench;
+
+static std::vector<ConnIDKey> make_keys(size_t n, std::mt19937_64& rng)
+	{
+	std::vector<ConnIDKey> keys(n);
+
+	for ( auto& k : keys )
+		{
+		// IPv4-mapped addresses with random hosts/ports, similar to what
+		// BuildConnIDKey() produces for IPv4 traffic.
+		static const uint8_t v4_mapped_prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+		memcpy(&k.ip1, v4_mapped_prefix, sizeof(v4_mapped_prefix));
+		memcpy(&k.ip2, v4_mapped_prefix, sizeof(v4_mapped_prefix));
+
+		uint32_t a1 = rng();
+		uint32_t a2 = rng();
+		memcpy(reinterpret_cast<uint8_t*>(&k.ip1) + 12, &a1, sizeof(a1));
+		memcpy(reinterpret_cast<uint8_t*>(&k.ip2) + 12, &a2, sizeof(a2));
+		k.port1 = rng();
+		k.port2 = rng();
+		}
+
+	return keys;
+	}
+
+static Connection* fake_conn(size_t i)
+	{
+	return reinterpret_cast<Connection*>(uintptr_t(i + 1) << 4);
+	}
+
+static void bench_map(const std::vector<ConnIDKey>& keys,
+                      const std::vector<ConnIDKey>& misses,
+                      const std::vector<size_t>& order)
+	{
+	size_t n = keys.size();
+	std::map<ConnIDKey, Connection*> m;
+	Stopwatch sw;
+
+	for ( size_t i = 0; i < n; ++i )
+		m[keys[i]] = fake_conn(i);
+
+	Report("std::map insert", n, sw.ElapsedNanos());
+
+	sw.Reset();
+	for ( auto i : order )
+		DoNotOptimize(m.find(keys[i])->second);
+
+	Report("std::map lookup hit", n, sw.ElapsedNanos());
+
+	sw.Reset();
+	for ( const auto& k : misses )
+		DoNotOptimize(m.find(k) == m.end());
+
+	Report("std::map lookup miss", misses.size(), sw.ElapsedNanos());
+
+	sw.Reset();
+	for ( auto i : order )
+		m.erase(keys[i]);
+
+	Report("std::map remove", n, sw.ElapsedNanos());
+	}
+
+static void bench_flowtable(const std::vector<ConnIDKey>& keys,
+                            const std::vector<ConnIDKey>& misses,
+                            const std::vector<size_t>& order)
+	{
+	size_t n = keys.size();
+	FlowTable t;
+	Stopwatch sw;
+
+	for ( size_t i = 0; i < n; ++i )
+		t.Insert(keys[i], fake_conn(i));
+
+	Report("FlowTable insert", n, sw.ElapsedNanos());
+
+	printf("%-40s %.1f bytes/flow (std::map node: ~%zu)\n", "FlowTable memory",
+	       double(t.MemoryAllocation()) / n,
+	       sizeof(std::pair<const ConnIDKey, Connection*>) + 4 * sizeof(void*));
+
+	sw.Reset();
+	for ( auto i : order )
+		DoNotOptimize(t.Lookup(keys[i]));
+
+	Report("FlowTable lookup hit", n, sw.ElapsedNanos());
+
+	sw.Reset();
+	for ( const auto& k : misses )
+		DoNotOptimize(t.Lookup(k));
+
+	Report("FlowTable lookup miss", misses.size(), sw.ElapsedNanos());
+
+	// Churn at steady state: what a worker sees with flows constantly
+	// starting and expiring.
+	sw.Reset();
+	for ( size_t i = 0; i < misses.size(); ++i )
+		{
+		t.Remove(keys[order[i]]);
+		t.Insert(misses[i], fake_conn(i));
+		}
+
+	Report("FlowTable churn (remove+insert)", misses.size(), sw.ElapsedNanos());
+
+	sw.Reset();
+	for ( const auto& k : misses )
+		t.Remove(k);
+	for ( size_t i = misses.size(); i < n; ++i )
+		t.Remove(keys[order[i]]);
+
+	Report("FlowTable remove", n, sw.ElapsedNanos());
+	}
+
+int main(int argc, char** argv)
+	{
+	std::vector<size_t> sizes;
+
+	for ( int i = 1; i < argc; ++i )
+		{
+		if ( strcmp(argv[i], "-h") == 0 )
+			{
+			fprintf(stderr, "usage: %s [num_flows ...]\n", argv[0]);
+			return 1;
+			}
+
+		sizes.push_back(strtoull(argv[i], nullptr, 10));
+		}
+
+	if ( sizes.empty() )
+		sizes = { 1000000, 10000000 };
+
+	InitHashSeeds();
+	std::mt19937_64 rng(1);
+
+	for ( auto n : sizes )
+		{
+		auto keys = make_keys(n, rng);
+		auto misses = make_keys(std::min(n, size_t(1000000)), rng);
+
+		std::vector<size_t> order(n);
+		for ( size_t i = 0; i < n; ++i )
+			order[i] = i;
+
+		std::shuffle(order.begin(), order.end(), rng);
+
+		printf("--- %zu flows\n", n);
+		bench_map(keys, misses, order);
+		bench_flowtable(keys, misses, order);
+		}
+
+	return 0;
+	}
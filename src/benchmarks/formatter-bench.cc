@@ -0,0 +1,134 @@
+// Measures rendering log records shaped like Conn::Info with the ASCII and
+// JSON formatters, with the columns compiled up front (as the ASCII writer
+// does at initialization) and without, where every value gets dispatched on
+// its type.  The records come from a batch, as the writers get them.
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <string>
+#include <vector>
+
+#include "bench-util.h"
+
+#include "Desc.h"
+#include "threading/RecordBatch.h"
+#include "threading/formatters/Ascii.h"
+#include "threading/formatters/JSON.h"
+
+using namespace zeek::detail::bench;
+using namespace threading;
+
+static void add_string(RecordBatch* b, int col, const char* s)
+	{
+	RecordBatch::Ref r = b->AddString(s, strlen(s));
+	b->Set(col).ref = r;
+	}
+
+static void add_addr(RecordBatch* b, int col, uint32_t a)
+	{
+	RecordBatch::Cell& c = b->Set(col);
+	c.addr_val.family = IPv4;
+	c.addr_val.in.in4.s_addr = htonl(a);
+	}
+
+static void fill(RecordBatch* b, int n)
+	{
+	for ( int i = 0; i < n; ++i )
+		{
+		b->AddRow();
+		b->Set(0).double_val = 1.5e9 + i + 0.123456;
+		add_string(b, 1, "CHhAvVGS1DHFjwGM9");
+		add_addr(b, 2, 0x0a000000 + i);
+		b->Set(3).port_val.port = 1024 + i % 60000;
+		add_addr(b, 4, 0xc0a80101);
+		b->Set(5).port_val.port = 80;
+		add_string(b, 6, "tcp");
+		add_string(b, 7, "http");
+		b->Set(8).double_val = 0.25 + i % 100;
+		b->Set(9).uint_val = 1000 + i;
+		b->Set(10).uint_val = 100000 + i;
+		add_string(b, 11, "SF");
+		b->Set(12).int_val = 1;
+		add_string(b, 13, "ShADadFf");
+
+		b->StartContainer(14);
+		RecordBatch::Ref r = b->AddString("CHhAvVGS1DHFjwGM9", 17);
+		b->AddElement(14).ref = r;
+		}
+	}
+
+static void run(const char* label, formatter::Formatter* f, int num_fields,
+                const Field* const* fields, const RecordBatch& b, int rounds)
+	{
+	ODesc desc;
+	desc.EnableEscaping();
+	desc.AddEscapeSequence("\t");
+
+	Stopwatch sw;
+
+	for ( int k = 0; k < rounds; ++k )
+		for ( int row = 0; row < b.NumRows(); ++row )
+			{
+			desc.Clear();
+			f->Describe(&desc, num_fields, fields, b, row);
+			DoNotOptimize(desc.Len());
+			}
+
+	Report(label, (uint64_t)rounds * b.NumRows(), sw.ElapsedNanos());
+	}
+
+int main(int argc, char** argv)
+	{
+	if ( argc > 1 && strcmp(argv[1], "-h") == 0 )
+		{
+		fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+		return 1;
+		}
+
+	int rounds = argc > 1 ? atoi(argv[1]) : 100;
+
+	std::vector<Field> fields = {
+		Field("ts", nullptr, TYPE_TIME, TYPE_VOID, false),
+		Field("uid", nullptr, TYPE_STRING, TYPE_VOID, false),
+		Field("id.orig_h", nullptr, TYPE_ADDR, TYPE_VOID, false),
+		Field("id.orig_p", nullptr, TYPE_PORT, TYPE_VOID, false),
+		Field("id.resp_h", nullptr, TYPE_ADDR, TYPE_VOID, false),
+		Field("id.resp_p", nullptr, TYPE_PORT, TYPE_VOID, false),
+		Field("proto", nullptr, TYPE_ENUM, TYPE_VOID, false),
+		Field("service", nullptr, TYPE_STRING, TYPE_VOID, true),
+		Field("duration", nullptr, TYPE_INTERVAL, TYPE_VOID, true),
+		Field("orig_bytes", nullptr, TYPE_COUNT, TYPE_VOID, true),
+		Field("resp_bytes", nullptr, TYPE_COUNT, TYPE_VOID, true),
+		Field("conn_state", nullptr, TYPE_STRING, TYPE_VOID, true),
+		Field("local_orig", nullptr, TYPE_BOOL, TYPE_VOID, true),
+		Field("history", nullptr, TYPE_STRING, TYPE_VOID, true),
+		Field("tunnel_parents", nullptr, TYPE_TABLE, TYPE_STRING, true),
+	};
+
+	std::vector<const Field*> fptrs;
+
+	for ( const auto& f : fields )
+		fptrs.push_back(&f);
+
+	int num_fields = fptrs.size();
+	RecordBatch b(num_fields, fptrs.data());
+	fill(&b, 1000);
+
+	// The formatters only need their thread for reporting errors.
+	formatter::Ascii::SeparatorInfo sep("\t", ",", "-", "(empty)");
+	formatter::Ascii ascii(nullptr, sep);
+	formatter::JSON json(nullptr, formatter::JSON::TS_EPOCH);
+
+	run("ascii", &ascii, num_fields, fptrs.data(), b, rounds);
+	run("json", &json, num_fields, fptrs.data(), b, rounds);
+
+	ascii.Compile(num_fields, fptrs.data());
+	json.Compile(num_fields, fptrs.data());
+
+	run("ascii, compiled", &ascii, num_fields, fptrs.data(), b, rounds);
+	run("json, compiled", &json, num_fields, fptrs.data(), b, rounds);
+
+	return 0;
+	}
@@ -0,0 +1,113 @@
+// Measures hashing the content of many concurrent files, as the file hash
+// analyzers see it: chunks of each file arrive interleaved with those of the
+// others.  Compares an OpenSSL digest context per file (the default) against
+// the multi-buffer hashing that hashes several files at once (see
+// FileHash::multi_buffer).
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench-util.h"
+
+#include "digest.h"
+#include "file_analysis/analyzer/hash/MultiBufferHash.h"
+
+using namespace zeek::detail::bench;
+using file_analysis::detail::MultiBufferHash;
+
+static const char* name(HashAlgorithm alg)
+	{
+	switch ( alg ) {
+	case Hash_MD5:
+		return "md5";
+
+	case Hash_SHA1:
+		return "sha1";
+
+	default:
+		return "sha256";
+	}
+	}
+
+// Reports the time per KB of file content.
+static void report(HashAlgorithm alg, const std::string& what, size_t bytes, double ns)
+	{
+	std::string label = name(alg);
+	label += ", " + what;
+	Report(label.c_str(), bytes / 1024, ns);
+	}
+
+static void run(HashAlgorithm alg, const std::vector<u_char>& data, int files,
+                size_t file_size, size_t chunk, size_t buffered)
+	{
+	size_t bytes = files * file_size;
+	std::vector<u_char> d1(files * SHA256_DIGEST_LENGTH);
+	std::vector<u_char> d2(files * SHA256_DIGEST_LENGTH);
+
+	Stopwatch sw;
+	std::vector<EVP_MD_CTX*> ctxs;
+
+	for ( int i = 0; i < files; ++i )
+		ctxs.push_back(hash_init(alg));
+
+	for ( size_t off = 0; off < file_size; off += chunk )
+		for ( int i = 0; i < files; ++i )
+			hash_update(ctxs[i], data.data() + i + off, std::min(chunk, file_size - off));
+
+	for ( int i = 0; i < files; ++i )
+		hash_final(ctxs[i], d1.data() + i * SHA256_DIGEST_LENGTH);
+
+	report(alg, "openssl", bytes, sw.ElapsedNanos());
+
+	sw.Reset();
+	MultiBufferHash h(alg, buffered);
+	std::vector<MultiBufferHash::Stream*> streams;
+
+	for ( int i = 0; i < files; ++i )
+		streams.push_back(h.Open());
+
+	for ( size_t off = 0; off < file_size; off += chunk )
+		for ( int i = 0; i < files; ++i )
+			h.Feed(streams[i], data.data() + i + off, std::min(chunk, file_size - off));
+
+	for ( int i = 0; i < files; ++i )
+		h.Finish(streams[i], d2.data() + i * SHA256_DIGEST_LENGTH);
+
+	report(alg, fmt("multi-buffer, %d lanes", h.Lanes()), bytes, sw.ElapsedNanos());
+
+	if ( d1 != d2 )
+		{
+		fprintf(stderr, "%s digests differ\n", name(alg));
+		exit(1);
+		}
+	}
+
+int main(int argc, char** argv)
+	{
+	if ( argc > 1 && strcmp(argv[1], "-h") == 0 )
+		{
+		fprintf(stderr, "usage: %s [files [file_size [chunk [buffered]]]]\n", argv[0]);
+		return 1;
+		}
+
+	int files = argc > 1 ? atoi(argv[1]) : 1000;
+	size_t file_size = argc > 2 ? atol(argv[2]) : 65536;
+	size_t chunk = argc > 3 ? atol(argv[3]) : 4096;
+	size_t buffered = argc > 4 ? atol(argv[4]) : 1048576;
+
+	// Each file starts at a different offset of the same data.
+	std::vector<u_char> data(file_size + files);
+	std::mt19937 rng(42);
+
+	for ( auto& c : data )
+		c = rng();
+
+	for ( auto alg : { Hash_MD5, Hash_SHA1, Hash_SHA256 } )
+		run(alg, data, files, file_size, chunk, buffered);
+
+	return 0;
+	}
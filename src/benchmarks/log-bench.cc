@@ -0,0 +1,190 @@
+// Measures writing records shaped like Conn::Info to a log stream with 1, 3,
+// and 5 filters, all using the "none" writer to keep the measurement to the
+// conversion on the main thread.  Filters logging the same columns share
+// their lookup and conversion, so each additional filter should cost less
+// than the first.  Zeek's global state can only be set up once per process,
+// so each filter count runs in a child.
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <vector>
+
+#include "bench-util.h"
+
+#include "zeek-setup.h"
+#include "IPAddr.h"
+#include "Val.h"
+#include "Var.h"
+#include "module_util.h"
+#include "logging/Manager.h"
+
+using namespace zeek::detail::bench;
+
+static const char* script = R"(
+@load base/frameworks/logging
+
+redef Log::default_writer = Log::WRITER_NONE;
+
+module Bench;
+
+export {
+	redef enum Log::ID += { LOG };
+
+	type Info: record {
+		ts: time &log;
+		uid: string &log;
+		id: conn_id &log;
+		proto: transport_proto &log;
+		service: string &log &optional;
+		duration: interval &log &optional;
+		orig_bytes: count &log &optional;
+		resp_bytes: count &log &optional;
+		conn_state: string &log &optional;
+		local_orig: bool &log &optional;
+		missed_bytes: count &log &default=0;
+		history: string &log &optional;
+		orig_pkts: count &log &optional;
+		resp_pkts: count &log &optional;
+		tunnel_parents: set[string] &log &optional;
+	};
+
+	global filters = 1 &redef;
+}
+
+event zeek_init()
+	{
+	Log::create_stream(LOG, [$columns=Info, $path="bench"]);
+
+	# Some filters log everything, others a subset, as for splitting
+	# a log by content.
+	local i = 1;
+
+	while ( i < filters )
+		{
+		if ( i % 2 == 1 )
+			Log::add_filter(LOG, [$name=cat("f", i), $path=cat("bench-", i)]);
+		else
+			Log::add_filter(LOG, [$name=cat("f", i), $path=cat("bench-", i),
+			                      $exclude=set("history", "tunnel_parents")]);
+		++i;
+		}
+	}
+)";
+
+static IntrusivePtr<RecordVal> build(RecordType* info, RecordType* conn_id,
+                                     const IntrusivePtr<EnumVal>& tcp, int i)
+	{
+	auto id = make_intrusive<RecordVal>(conn_id);
+	id->Assign(0, make_intrusive<AddrVal>(IPAddr(fmt("10.0.%d.%d", (i >> 8) & 0xff, i & 0xff))));
+	id->Assign(1, val_mgr->Port(1024 + i % 60000, TRANSPORT_TCP));
+	id->Assign(2, make_intrusive<AddrVal>(IPAddr("192.168.1.1")));
+	id->Assign(3, val_mgr->Port(80, TRANSPORT_TCP));
+
+	auto parents = make_intrusive<TableVal>(
+		IntrusivePtr{NewRef{}, info->FieldType(14)->AsTableType()});
+	parents->Assign(make_intrusive<StringVal>("CHhAvVGS1DHFjwGM9").get(), nullptr);
+
+	auto rec = make_intrusive<RecordVal>(info);
+	rec->Assign(0, make_intrusive<Val>(1.5e9 + i, TYPE_TIME));
+	rec->Assign(1, make_intrusive<StringVal>("CHhAvVGS1DHFjwGM9"));
+	rec->Assign(2, std::move(id));
+	rec->Assign(3, tcp);
+	rec->Assign(4, make_intrusive<StringVal>("http"));
+	rec->Assign(5, make_intrusive<IntervalVal>(0.25 + i % 100, 1.0));
+	rec->Assign(6, val_mgr->Count(1000 + i));
+	rec->Assign(7, val_mgr->Count(100000 + i));
+	rec->Assign(8, make_intrusive<StringVal>("SF"));
+	rec->Assign(9, val_mgr->True());
+	rec->Assign(11, make_intrusive<StringVal>("ShADadFf"));
+	rec->Assign(12, val_mgr->Count(10 + i % 50));
+	rec->Assign(13, val_mgr->Count(20 + i % 50));
+	rec->Assign(14, std::move(parents));
+
+	return rec;
+	}
+
+static int run(const char* argv0, int filters, int n)
+	{
+	zeek::Options options;
+	options.bare_mode = true;
+	options.script_code_to_exec = script;
+	options.script_options_to_set.emplace_back(fmt("Bench::filters=%d", filters));
+	options.deterministic_mode = true;
+
+	char* args[] = { const_cast<char*>(argv0), nullptr };
+
+	if ( zeek::detail::setup(1, args, &options).code )
+		return 1;
+
+	auto info = internal_type("Bench::Info")->AsRecordType();
+	auto conn_id = internal_type("conn_id")->AsRecordType();
+	auto proto = internal_type("transport_proto")->AsEnumType();
+	auto tcp = proto->GetVal(proto->Lookup(GLOBAL_MODULE_NAME, "tcp"));
+
+	auto log_id = internal_type("Log::ID")->AsEnumType();
+	auto stream = log_id->GetVal(log_id->Lookup("Bench", "LOG"));
+
+	std::vector<IntrusivePtr<RecordVal>> recs;
+	recs.reserve(n);
+
+	for ( int i = 0; i < n; ++i )
+		recs.emplace_back(build(info, conn_id, tcp, i));
+
+	Stopwatch sw;
+
+	for ( const auto& r : recs )
+		log_mgr->Write(stream.get(), r.get());
+
+	double elapsed = sw.ElapsedNanos();
+
+	std::string label = fmt("log_write, %d filter(s)", filters);
+	Report(label.c_str(), n, elapsed);
+
+	label = fmt("log_write per filter, %d filter(s)", filters);
+	Report(label.c_str(), n * filters, elapsed);
+	fflush(stdout);
+
+	recs.clear();
+
+	return zeek::detail::cleanup(true);
+	}
+
+int main(int argc, char** argv)
+	{
+	if ( argc > 1 && strcmp(argv[1], "-h") == 0 )
+		{
+		fprintf(stderr, "usage: %s [records]\n", argv[0]);
+		fprintf(stderr, "(ZEEKPATH needs to point at the scripts, see zeek-path-dev.sh)\n");
+		return 1;
+		}
+
+	int n = argc > 1 ? atoi(argv[1]) : 100000;
+
+	for ( int filters : { 1, 3, 5 } )
+		{
+		pid_t pid = fork();
+
+		if ( pid < 0 )
+			{
+			perror("fork");
+			return 1;
+			}
+
+		if ( pid == 0 )
+			_exit(run(argv[0], filters, n));
+
+		int status;
+
+		if ( waitpid(pid, &status, 0) < 0 || ! WIFEXITED(status) || WEXITSTATUS(status) != 0 )
+			{
+			fprintf(stderr, "run with %d filter(s) failed\n", filters);
+			return 1;
+			}
+		}
+
+	return 0;
+	}
@@ -0,0 +1,89 @@
+// Measures trace processing throughput, as with "zeek -b -r", for different
+// packet source batch sizes (see Pcap::batch_size).  Zeek's global state can
+// only be set up once per process, so each configuration runs in a child.
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <vector>
+
+#include "bench-util.h"
+
+#include "zeek-setup.h"
+#include "Net.h"
+#include "Sessions.h"
+
+using namespace zeek::detail::bench;
+
+static int run(const char* argv0, const std::string& trace, int batch_size)
+	{
+	zeek::Options options;
+	options.bare_mode = true;
+	options.pcap_file = trace;
+	options.script_options_to_set.emplace_back(fmt("Pcap::batch_size=%d", batch_size));
+	options.deterministic_mode = true;
+	options.ignore_checksums = true;
+
+	char* args[] = { const_cast<char*>(argv0), nullptr };
+
+	if ( zeek::detail::setup(1, args, &options).code )
+		return 1;
+
+	Stopwatch sw;
+	net_run();
+	double elapsed = sw.ElapsedNanos();
+
+	SessionStats s;
+	sessions->GetStats(s);
+
+	std::string label = fmt("-r, batch_size=%d (per packet)", batch_size);
+	Report(label.c_str(), s.num_packets, elapsed);
+
+	return zeek::detail::cleanup(true);
+	}
+
+int main(int argc, char** argv)
+	{
+	if ( argc < 2 || strcmp(argv[1], "-h") == 0 )
+		{
+		fprintf(stderr, "usage: %s <trace> [batch_size ...]\n", argv[0]);
+		fprintf(stderr, "(ZEEKPATH needs to point at the scripts, see zeek-path-dev.sh)\n");
+		return 1;
+		}
+
+	std::string trace = argv[1];
+	std::vector<int> sizes;
+
+	for ( int i = 2; i < argc; ++i )
+		sizes.push_back(atoi(argv[i]));
+
+	if ( sizes.empty() )
+		sizes = { 1, 8, 32, 128 };
+
+	for ( auto n : sizes )
+		{
+		pid_t pid = fork();
+
+		if ( pid < 0 )
+			{
+			perror("fork");
+			return 1;
+			}
+
+		if ( pid == 0 )
+			_exit(run(argv[0], trace, n));
+
+		int status;
+
+		if ( waitpid(pid, &status, 0) < 0 || ! WIFEXITED(status) || WEXITSTATUS(status) != 0 )
+			{
+			fprintf(stderr, "run with batch_size=%d failed\n", n);
+			return 1;
+			}
+		}
+
+	return 0;
+	}
@@ -0,0 +1,202 @@
+// Compares PrefixTable longest-prefix lookups of addresses through its
+// multibit trie index against the plain patricia tree, for single and
+// batched lookups, for lookups in between changes to the table, and for
+// memory.  The prefixes resemble a routing table: mostly IPv4 /24s and
+// shorter, plus some IPv6 /32 to /48.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <vector>
+
+#include "bench-util.h"
+
+#include "PrefixTable.h"
+
+using namespace zeek::detail::bench;
+
+namespace {
+
+struct Prefix {
+	IPAddr addr;
+	int width;	// in the IPv6 space, like PrefixTable takes it
+};
+
+IPAddr make_addr(const uint32_t w[4])
+	{
+	return IPAddr(IPv6, w, IPAddr::Host);
+	}
+
+IPAddr masked(IPAddr a, int width)
+	{
+	a.Mask(width);
+	return a;
+	}
+
+std::vector<Prefix> make_prefixes(size_t n, std::mt19937_64& rng)
+	{
+	std::vector<Prefix> prefixes(n);
+
+	for ( auto& p : prefixes )
+		{
+		unsigned int r = rng() % 100;
+
+		if ( r < 85 )
+			{
+			uint32_t w[4] = { 0, 0, 0xffff, uint32_t(rng()) };
+			int width = r < 55 ? 24 : r < 65 ? 22 + rng() % 2 :
+				r < 80 ? 16 + rng() % 6 : 8 + rng() % 8;
+
+			p.width = 96 + width;
+			p.addr = masked(make_addr(w), p.width);
+			}
+		else
+			{
+			uint32_t w[4] = { 0x20000000 | uint32_t(rng() & 0x1fffffff),
+			                  uint32_t(rng()), 0, 0 };
+
+			p.width = 32 + rng() % 17;
+			p.addr = masked(make_addr(w), p.width);
+			}
+		}
+
+	return prefixes;
+	}
+
+// Addresses of which most fall into one of the prefixes.
+std::vector<IPAddr> make_lookups(const std::vector<Prefix>& prefixes, size_t n,
+                                 std::mt19937_64& rng)
+	{
+	std::vector<IPAddr> addrs(n);
+
+	for ( auto& a : addrs )
+		{
+		uint32_t w[4];
+
+		if ( rng() % 10 < 7 )
+			{
+			prefixes[rng() % prefixes.size()].addr.CopyIPv6(w, IPAddr::Host);
+			w[2] |= (w[0] || w[1]) ? uint32_t(rng()) : 0;
+			w[3] |= uint32_t(rng()) & 0xffff;
+			}
+		else if ( rng() % 2 )
+			{
+			w[0] = w[1] = 0;
+			w[2] = 0xffff;
+			w[3] = rng();
+			}
+		else
+			{
+			w[0] = 0x20000000 | uint32_t(rng() & 0x1fffffff);
+			w[1] = rng();
+			w[2] = rng();
+			w[3] = rng();
+			}
+
+		a = make_addr(w);
+		}
+
+	return addrs;
+	}
+
+void* fake_data(size_t i)
+	{
+	return reinterpret_cast<void*>(uintptr_t(i + 1) << 4);
+	}
+
+void bench(const char* name, bool indexed, const std::vector<Prefix>& prefixes,
+           const std::vector<IPAddr>& addrs, int rounds)
+	{
+	size_t n = prefixes.size();
+	PrefixTable pt(indexed);
+	Stopwatch sw;
+	char what[64];
+
+	for ( size_t i = 0; i < n; ++i )
+		pt.Insert(prefixes[i].addr, prefixes[i].width, fake_data(i));
+
+	snprintf(what, sizeof(what), "%s insert", name);
+	Report(what, n, sw.ElapsedNanos());
+
+	// The first round builds the index.
+	for ( const auto& a : addrs )
+		DoNotOptimize(pt.Lookup(a, 128));
+
+	sw.Reset();
+
+	for ( int r = 0; r < rounds; ++r )
+		for ( const auto& a : addrs )
+			DoNotOptimize(pt.Lookup(a, 128));
+
+	snprintf(what, sizeof(what), "%s lookup", name);
+	Report(what, addrs.size() * rounds, sw.ElapsedNanos());
+
+	std::vector<void*> results(addrs.size());
+	sw.Reset();
+
+	for ( int r = 0; r < rounds; ++r )
+		{
+		pt.Lookup(addrs.data(), addrs.size(), results.data());
+		DoNotOptimize(results[0]);
+		}
+
+	snprintf(what, sizeof(what), "%s batched lookup", name);
+	Report(what, addrs.size() * rounds, sw.ElapsedNanos());
+
+	// Replaces a prefix after every 100 lookups.
+	sw.Reset();
+
+	for ( size_t i = 0; i < addrs.size(); ++i )
+		{
+		if ( i % 100 == 0 )
+			{
+			const auto& p = prefixes[(i / 100) % n];
+			pt.Remove(p.addr, p.width);
+			pt.Insert(p.addr, p.width, fake_data(i));
+			}
+
+		DoNotOptimize(pt.Lookup(addrs[i], 128));
+		}
+
+	snprintf(what, sizeof(what), "%s lookup w/ updates", name);
+	Report(what, addrs.size(), sw.ElapsedNanos());
+
+	printf("%-40s %.1f bytes/prefix\n", name,
+	       double(pt.MemoryAllocation()) / n);
+	}
+
+}
+
+int main(int argc, char** argv)
+	{
+	std::vector<size_t> sizes;
+
+	for ( int i = 1; i < argc; ++i )
+		{
+		if ( strcmp(argv[i], "-h") == 0 )
+			{
+			fprintf(stderr, "usage: %s [num_prefixes ...]\n", argv[0]);
+			return 1;
+			}
+
+		sizes.push_back(strtoull(argv[i], nullptr, 10));
+		}
+
+	if ( sizes.empty() )
+		sizes = { 10000, 100000, 1000000 };
+
+	std::mt19937_64 rng(1);
+
+	for ( auto n : sizes )
+		{
+		auto prefixes = make_prefixes(n, rng);
+		auto addrs = make_lookups(prefixes, 1000000, rng);
+
+		printf("--- %zu prefixes\n", n);
+		bench("patricia", false, prefixes, addrs, 5);
+		bench("index", true, prefixes, addrs, 5);
+		}
+
+	return 0;
+	}
@@ -0,0 +1,209 @@
+// Measures the literal prefilter of the signature engine: LiteralMatcher
+// with and without vector instructions against looking for each literal in
+// turn, and RuleMatcher payload matching with and without the prefilter for
+// signatures of the form /.*literal/.
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench-util.h"
+
+#include "LiteralMatcher.h"
+#include "NetVar.h"
+#include "RuleMatcher.h"
+
+using namespace zeek::detail;
+using namespace zeek::detail::bench;
+
+namespace {
+
+const size_t PACKET_SIZE = 1460;
+const size_t PACKETS_PER_CONN = 10;
+
+std::string random_word(std::mt19937_64& rng)
+	{
+	std::string w;
+	size_t n = 6 + rng() % 7;
+
+	for ( size_t i = 0; i < n; ++i )
+		w += 'a' + rng() % 26;
+
+	return w;
+	}
+
+// Printable text with the occasional literal in it, which is what
+// prefiltering faces on typical application-layer payload.
+std::vector<std::string> make_packets(size_t n, const std::vector<std::string>& literals,
+                                      std::mt19937_64& rng)
+	{
+	static const char alphabet[] =
+		"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 :/.-\r\n";
+
+	std::vector<std::string> packets(n);
+
+	for ( auto& p : packets )
+		{
+		p.resize(PACKET_SIZE);
+
+		for ( auto& c : p )
+			c = alphabet[rng() % (sizeof(alphabet) - 1)];
+
+		if ( rng() % 20 == 0 )
+			{
+			const auto& l = literals[rng() % literals.size()];
+			p.replace(rng() % (PACKET_SIZE - l.size()), l.size(), l);
+			}
+		}
+
+	return packets;
+	}
+
+void bench_literal_matcher(const std::vector<std::string>& literals,
+                           const std::vector<std::string>& packets)
+	{
+	LiteralMatcher simd;
+	LiteralMatcher scalar;
+	scalar.DisableSIMD();
+
+	for ( size_t i = 0; i < literals.size(); ++i )
+		{
+		simd.Add(literals[i], i);
+		scalar.Add(literals[i], i);
+		}
+
+	simd.Compile();
+	scalar.Compile();
+
+	size_t bytes = packets.size() * PACKET_SIZE;
+	size_t hits = 0;
+	auto count = [&hits](int id, size_t pos) { ++hits; return true; };
+
+	Stopwatch sw;
+	for ( const auto& p : packets )
+		simd.Scan(reinterpret_cast<const u_char*>(p.data()), p.size(), count);
+
+	Report("LiteralMatcher scan (per byte)", bytes, sw.ElapsedNanos());
+	DoNotOptimize(hits);
+
+	sw.Reset();
+	for ( const auto& p : packets )
+		scalar.Scan(reinterpret_cast<const u_char*>(p.data()), p.size(), count);
+
+	Report("LiteralMatcher scalar scan (per byte)", bytes, sw.ElapsedNanos());
+	DoNotOptimize(hits);
+
+	sw.Reset();
+	for ( const auto& p : packets )
+		for ( const auto& l : literals )
+			hits += memmem(p.data(), p.size(), l.data(), l.size()) != nullptr;
+
+	Report("memmem per literal (per byte)", bytes, sw.ElapsedNanos());
+	DoNotOptimize(hits);
+	}
+
+void bench_rule_matcher(const std::string& sig_file, bool prefilter,
+                        const std::vector<std::string>& packets)
+	{
+	sig_literal_prefilter = prefilter;
+	delete rule_matcher;
+	rule_matcher = new RuleMatcher();
+
+	Stopwatch sw;
+
+	if ( ! rule_matcher->ReadFiles({sig_file}) )
+		{
+		fprintf(stderr, "failed to read %s\n", sig_file.c_str());
+		exit(1);
+		}
+
+	Report(prefilter ? "RuleMatcher build with prefilter" :
+	                   "RuleMatcher build without prefilter", 1, sw.ElapsedNanos());
+
+	size_t bytes = packets.size() * PACKET_SIZE;
+
+	sw.Reset();
+	for ( size_t i = 0; i < packets.size(); i += PACKETS_PER_CONN )
+		{
+		auto state = rule_matcher->InitEndpoint(nullptr, nullptr, 0, nullptr,
+		                                        true, nullptr);
+
+		for ( size_t j = i; j < i + PACKETS_PER_CONN && j < packets.size(); ++j )
+			rule_matcher->Match(state, Rule::PAYLOAD,
+			                    reinterpret_cast<const u_char*>(packets[j].data()),
+			                    packets[j].size(), false, false, false);
+
+		rule_matcher->FinishEndpoint(state);
+		delete state;
+		}
+
+	Report(prefilter ? "RuleMatcher payload with prefilter (per byte)" :
+	                   "RuleMatcher payload without prefilter (per byte)",
+	       bytes, sw.ElapsedNanos());
+	}
+
+}
+
+int main(int argc, char** argv)
+	{
+	std::vector<size_t> sizes;
+
+	for ( int i = 1; i < argc; ++i )
+		{
+		if ( strcmp(argv[i], "-h") == 0 )
+			{
+			fprintf(stderr, "usage: %s [num_signatures ...]\n", argv[0]);
+			return 1;
+			}
+
+		sizes.push_back(strtoull(argv[i], nullptr, 10));
+		}
+
+	if ( sizes.empty() )
+		sizes = { 10, 100, 1000 };
+
+	InitHashSeeds();
+	sig_max_group_size = 50;
+
+	std::mt19937_64 rng(1);
+
+	for ( auto n : sizes )
+		{
+		std::vector<std::string> literals;
+
+		for ( size_t i = 0; i < n; ++i )
+			literals.push_back(random_word(rng));
+
+		char sig_file[] = "/tmp/zeek-rule-matcher-bench-XXXXXX";
+		int fd = mkstemp(sig_file);
+
+		if ( fd < 0 )
+			{
+			perror("mkstemp");
+			return 1;
+			}
+
+		FILE* f = fdopen(fd, "w");
+
+		for ( size_t i = 0; i < n; ++i )
+			fprintf(f, "signature s%zu {\n  payload /.*%s/\n}\n\n", i,
+			        literals[i].c_str());
+
+		fclose(f);
+
+		auto packets = make_packets(10000, literals, rng);
+
+		printf("--- %zu signatures\n", n);
+		bench_literal_matcher(literals, packets);
+		bench_rule_matcher(sig_file, false, packets);
+		bench_rule_matcher(sig_file, true, packets);
+
+		unlink(sig_file);
+		}
+
+	return 0;
+	}
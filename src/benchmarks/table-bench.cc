@@ -0,0 +1,133 @@
+// Measures script table lookups for the index types most tables have:
+// an address, an address plus a port or count, and a string.  Besides
+// the time, counts the heap allocations each lookup takes by replacing
+// the global operator new.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+#include <vector>
+
+#include "bench-util.h"
+
+#include "zeek-setup.h"
+#include "IPAddr.h"
+#include "Val.h"
+#include "Var.h"
+
+using namespace zeek::detail::bench;
+
+static uint64_t allocations = 0;
+
+void* operator new(size_t n)
+	{
+	++allocations;
+
+	if ( void* p = malloc(n) )
+		return p;
+
+	throw std::bad_alloc();
+	}
+
+void operator delete(void* p) noexcept
+	{
+	free(p);
+	}
+
+void operator delete(void* p, size_t) noexcept
+	{
+	free(p);
+	}
+
+static const char* script = R"(
+global by_addr: table[addr] of count;
+global by_addr_port: table[addr, port] of count;
+global by_addr_count: table[addr, count] of count;
+global by_string: table[string] of count;
+)";
+
+static IntrusivePtr<Val> make_addr(int i)
+	{
+	return make_intrusive<AddrVal>(IPAddr(fmt("10.%d.%d.%d", (i >> 16) & 0xff,
+	                                          (i >> 8) & 0xff, i & 0xff)));
+	}
+
+static IntrusivePtr<Val> make_index(IntrusivePtr<Val> a, IntrusivePtr<Val> b)
+	{
+	auto lv = make_intrusive<ListVal>(TYPE_ANY);
+	lv->Append(a.release());
+	lv->Append(b.release());
+	return lv;
+	}
+
+static void bench_lookups(const char* what, TableVal* t,
+                          const std::vector<IntrusivePtr<Val>>& indices, int rounds)
+	{
+	for ( size_t i = 0; i < indices.size(); ++i )
+		t->Assign(indices[i].get(), val_mgr->Count(i));
+
+	uint64_t n = uint64_t(rounds) * indices.size();
+	uint64_t allocs = allocations;
+	Stopwatch sw;
+
+	for ( int r = 0; r < rounds; ++r )
+		for ( const auto& idx : indices )
+			DoNotOptimize(t->Lookup(idx.get(), false).get());
+
+	double nanos = sw.ElapsedNanos();
+	allocs = allocations - allocs;
+
+	Report(what, n, nanos);
+	printf("%-40s n=%-10llu %10.2f allocs/op\n", what,
+	       static_cast<unsigned long long>(n), n ? double(allocs) / n : 0.0);
+	fflush(stdout);
+	}
+
+int main(int argc, char** argv)
+	{
+	if ( argc > 1 && strcmp(argv[1], "-h") == 0 )
+		{
+		fprintf(stderr, "usage: %s [entries] [rounds]\n", argv[0]);
+		fprintf(stderr, "(ZEEKPATH needs to point at the scripts, see zeek-path-dev.sh)\n");
+		return 1;
+		}
+
+	int n = argc > 1 ? atoi(argv[1]) : 100000;
+	int rounds = argc > 2 ? atoi(argv[2]) : 10;
+
+	zeek::Options options;
+	options.bare_mode = true;
+	options.script_code_to_exec = script;
+	options.deterministic_mode = true;
+
+	char* args[] = { argv[0], nullptr };
+
+	if ( zeek::detail::setup(1, args, &options).code )
+		return 1;
+
+	std::vector<IntrusivePtr<Val>> addrs, addr_ports, addr_counts, strings;
+
+	for ( int i = 0; i < n; ++i )
+		{
+		addrs.emplace_back(make_addr(i));
+		addr_ports.emplace_back(make_index(make_addr(i),
+		                                   val_mgr->Port(i % 65536, TRANSPORT_TCP)));
+		addr_counts.emplace_back(make_index(make_addr(i), val_mgr->Count(i)));
+		strings.emplace_back(make_intrusive<StringVal>(fmt("CHhAvVGS1DH%06d", i)));
+		}
+
+	bench_lookups("lookup table[addr]", opt_internal_table("by_addr"), addrs, rounds);
+	bench_lookups("lookup table[addr, port]", opt_internal_table("by_addr_port"),
+	              addr_ports, rounds);
+	bench_lookups("lookup table[addr, count]", opt_internal_table("by_addr_count"),
+	              addr_counts, rounds);
+	bench_lookups("lookup table[string]", opt_internal_table("by_string"), strings, rounds);
+
+	addrs.clear();
+	addr_ports.clear();
+	addr_counts.clear();
+	strings.clear();
+
+	return zeek::detail::cleanup(true);
+	}
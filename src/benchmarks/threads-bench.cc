@@ -0,0 +1,189 @@
+// Measures log writers and input readers running with a thread each against
+// running on thread pools of a few sizes (see Threading::pool_size).  A
+// script writes records to a number of ASCII writers while benchmark readers
+// feed events back, and the time from setup to the last writer finishing is
+// reported along with the context switches it took.  Zeek's global state can
+// only be set up once per process, so each configuration runs in a child.
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <string>
+
+#include "bench-util.h"
+
+#include "zeek-setup.h"
+#include "Net.h"
+
+using namespace zeek::detail::bench;
+
+static std::string make_script(int pool_size, int writers, int readers,
+                               int records, int lines)
+	{
+	return fmt(R"(
+@load base/frameworks/logging
+@load base/frameworks/input
+
+redef exit_only_after_terminate = T;
+redef Threading::pool_size = %d;
+
+module Bench;
+
+export {
+	redef enum Log::ID += { LOG };
+
+	type Info: record {
+		ts: time &log;
+		n: count &log;
+		s: string &log;
+		a: addr &log;
+		d: double &log;
+	};
+}
+
+type Line: record {
+	n: count;
+	s: string;
+	d: double;
+};
+
+global writers = %d;
+global readers = %d;
+global done = 0;
+
+event line(description: Input::EventDescription, tpe: Input::Event, r: Line)
+	{
+	}
+
+event zeek_init()
+	{
+	Log::create_stream(LOG, [$columns=Info]);
+	Log::remove_default_filter(LOG);
+
+	local i = 0;
+
+	while ( i < writers )
+		{
+		Log::add_filter(LOG, [$name=cat("f", i), $path=cat("bench-", i)]);
+		++i;
+		}
+
+	i = 0;
+
+	while ( i < readers )
+		{
+		Input::add_event([$source="%d", $name=cat("r", i), $reader=Input::READER_BENCHMARK,
+		                  $mode=Input::MANUAL, $fields=Line, $ev=line]);
+		++i;
+		}
+
+	local n = 0;
+
+	while ( n < %d )
+		{
+		Log::write(LOG, Info($ts=network_time(), $n=n, $s="some string to format",
+		                     $a=10.0.0.1, $d=n / 3.0));
+		++n;
+		}
+	}
+
+event Input::end_of_data(name: string, source: string)
+	{
+	Input::remove(name);
+
+	if ( ++done == readers )
+		terminate();
+	}
+)", pool_size, writers, readers, lines, records);
+	}
+
+static int run(const char* argv0, int pool_size, int writers, int readers,
+               int records, int lines)
+	{
+	char dir[] = "/tmp/threads-bench.XXXXXX";
+
+	if ( ! mkdtemp(dir) || chdir(dir) < 0 )
+		{
+		perror("mkdtemp");
+		return 1;
+		}
+
+	std::string script = make_script(pool_size, writers, readers, records, lines);
+
+	zeek::Options options;
+	options.bare_mode = true;
+	options.script_code_to_exec = script;
+	options.deterministic_mode = true;
+
+	char* args[] = { const_cast<char*>(argv0), nullptr };
+
+	Stopwatch sw;
+
+	if ( zeek::detail::setup(1, args, &options).code )
+		return 1;
+
+	net_run();
+
+	int rc = zeek::detail::cleanup(true);
+	double elapsed = sw.ElapsedNanos();
+
+	std::string label = fmt("pool_size=%d, records", pool_size);
+	Report(label.c_str(), records * writers, elapsed);
+
+	label = fmt("pool_size=%d, lines", pool_size);
+	Report(label.c_str(), lines * readers, elapsed);
+
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	printf("%-40s %ld voluntary, %ld involuntary ctx switches, %ld KB max rss\n",
+	       fmt("pool_size=%d", pool_size), ru.ru_nvcsw, ru.ru_nivcsw, ru.ru_maxrss);
+
+	for ( int i = 0; i < writers; ++i )
+		unlink(fmt("bench-%d.log", i));
+
+	chdir("/");
+	rmdir(dir);
+	return rc;
+	}
+
+int main(int argc, char** argv)
+	{
+	if ( argc > 1 && strcmp(argv[1], "-h") == 0 )
+		{
+		fprintf(stderr, "usage: %s [writers [readers [records [lines]]]]\n", argv[0]);
+		fprintf(stderr, "(ZEEKPATH needs to point at the scripts, see zeek-path-dev.sh)\n");
+		return 1;
+		}
+
+	int writers = argc > 1 ? atoi(argv[1]) : 32;
+	int readers = argc > 2 ? atoi(argv[2]) : 16;
+	int records = argc > 3 ? atoi(argv[3]) : 20000;
+	int lines = argc > 4 ? atoi(argv[4]) : 20000;
+
+	for ( int pool_size : { 0, 2, 4, 8 } )
+		{
+		pid_t pid = fork();
+
+		if ( pid < 0 )
+			{
+			perror("fork");
+			return 1;
+			}
+
+		if ( pid == 0 )
+			_exit(run(argv[0], pool_size, writers, readers, records, lines));
+
+		int status;
+
+		if ( waitpid(pid, &status, 0) < 0 || ! WIFEXITED(status) || WEXITSTATUS(status) != 0 )
+			{
+			fprintf(stderr, "run with pool_size=%d failed\n", pool_size);
+			return 1;
+			}
+		}
+
+	return 0;
+	}
@@ -0,0 +1,164 @@
+// Compares PQ_TimerMgr and Wheel_TimerMgr by adding, canceling and expiring
+// timers with a mix of types and delays resembling a busy worker.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench-util.h"
+
+#include "Timer.h"
+
+using namespace zeek::detail::bench;
+
+namespace {
+
+std::vector<class BenchTimer*> live;
+
+// Keeps track of itself in the live set so that the benchmark can cancel
+// random pending timers, like connection teardown does.
+class BenchTimer final : public Timer {
+public:
+	BenchTimer(double t, TimerType type) : Timer(t, type)
+		{
+		idx = live.size();
+		live.push_back(this);
+		}
+
+	~BenchTimer() override
+		{
+		live[idx] = live.back();
+		live[idx]->idx = idx;
+		live.pop_back();
+		}
+
+	void Dispatch(double t, bool is_expire) override
+		{ }
+
+	size_t idx;
+};
+
+struct TimerMix {
+	TimerType type;
+	double delay;
+	double weight;
+	double cancel_prob;	// likelihood of being canceled before firing
+};
+
+// Rough mix and delays as seen on a worker with mostly short TCP/UDP
+// connections, using default script-level timeouts.
+const TimerMix mix[] = {
+	{ TIMER_CONN_INACTIVITY,	300.0,	0.30,	0.90 },
+	{ TIMER_TCP_ATTEMPT,		5.0,	0.15,	0.80 },
+	{ TIMER_TCP_EXPIRE,		10.0,	0.10,	0.50 },
+	{ TIMER_CONN_STATUS_UPDATE,	60.0,	0.05,	0.90 },
+	{ TIMER_TABLE_VAL,		10.0,	0.10,	0.00 },
+	{ TIMER_FRAG,			60.0,	0.05,	0.95 },
+	{ TIMER_FILE_ANALYSIS_INACTIVITY, 120.0, 0.10,	0.70 },
+	{ TIMER_SCHEDULE,		1.0,	0.10,	0.00 },
+	{ TIMER_TRIGGER,		0.5,	0.05,	0.50 },
+};
+
+template<typename Mgr>
+class BenchMgr : public Mgr {
+public:
+	using Mgr::DoAdvance;
+};
+
+template<typename Mgr>
+void run(const char* name, size_t num_pending, uint64_t num_ops)
+	{
+	BenchMgr<Mgr> mgr;
+	std::mt19937_64 rng(7);
+	std::vector<double> weights;
+
+	for ( const auto& m : mix )
+		weights.push_back(m.weight);
+
+	std::discrete_distribution<int> pick_type(weights.begin(), weights.end());
+	std::uniform_real_distribution<double> jitter(0.5, 1.5);
+	std::uniform_real_distribution<double> coin(0.0, 1.0);
+
+	double now = 1600000000.0;
+	std::string label;
+
+	// Fill up to the steady state.
+	Stopwatch sw;
+
+	for ( size_t i = 0; i < num_pending; ++i )
+		{
+		const auto& m = mix[pick_type(rng)];
+		mgr.Add(new BenchTimer(now + m.delay * jitter(rng) * coin(rng), m.type));
+		}
+
+	label = std::string(name) + " add (fill)";
+	Report(label.c_str(), num_pending, sw.ElapsedNanos());
+
+	// Steady state: per "packet", add one timer, maybe cancel one, and
+	// advance time by a few microseconds.
+	uint64_t adds = 0, cancels = 0;
+	sw.Reset();
+
+	for ( uint64_t i = 0; i < num_ops; ++i )
+		{
+		const auto& m = mix[pick_type(rng)];
+		mgr.Add(new BenchTimer(now + m.delay * jitter(rng), m.type));
+		++adds;
+
+		if ( ! live.empty() && coin(rng) < m.cancel_prob )
+			{
+			mgr.Cancel(live[rng() % live.size()]);
+			++cancels;
+			}
+
+		now += 5e-6;
+
+		if ( i % 16 == 0 )
+			mgr.DoAdvance(now, 0);
+		}
+
+	double steady = sw.ElapsedNanos();
+	label = std::string(name) + " steady state (per packet)";
+	Report(label.c_str(), num_ops, steady);
+
+	printf("%-40s adds=%llu cancels=%llu pending=%d peak=%d\n", "",
+	       (unsigned long long)adds, (unsigned long long)cancels,
+	       mgr.Size(), mgr.PeakSize());
+
+	// Jump ahead far enough to dispatch everything that's left.
+	int pending = mgr.Size();
+	sw.Reset();
+	mgr.DoAdvance(now + 1000.0, 0);
+	label = std::string(name) + " advance (drain)";
+	Report(label.c_str(), pending, sw.ElapsedNanos());
+
+	mgr.Expire();
+	}
+
+}
+
+int main(int argc, char** argv)
+	{
+	size_t num_pending = 1000000;
+	uint64_t num_ops = 10000000;
+
+	if ( argc > 1 && strcmp(argv[1], "-h") == 0 )
+		{
+		fprintf(stderr, "usage: %s [num_pending [num_packets]]\n", argv[0]);
+		return 1;
+		}
+
+	if ( argc > 1 )
+		num_pending = strtoull(argv[1], nullptr, 10);
+
+	if ( argc > 2 )
+		num_ops = strtoull(argv[2], nullptr, 10);
+
+	run<PQ_TimerMgr>("PQ_TimerMgr", num_pending, num_ops);
+	run<Wheel_TimerMgr>("Wheel_TimerMgr", num_pending, num_ops);
+
+	return 0;
+	}
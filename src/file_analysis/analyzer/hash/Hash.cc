@@ -5,30 +5,65 @@
 #include "Hash.h"
 #include "util.h"
 #include "Event.h"
+#include "NetVar.h"
 #include "file_analysis/Manager.h"
 
 using namespace file_analysis;
 
-Hash::Hash(RecordVal* args, File* file, HashVal* hv, const char* arg_kind)
-	: file_analysis::Analyzer(file_mgr->GetComponentTag(to_upper(arg_kind).c_str()), args, file), hash(hv), fed(false), kind(arg_kind)
+Hash::Hash(RecordVal* args, File* file, HashAlgorithm alg, const char* arg_kind)
+	: file_analysis::Analyzer(file_mgr->GetComponentTag(to_upper(arg_kind).c_str()), args, file),
+	  hash(nullptr), multi(nullptr), stream(nullptr), fed(false), kind(arg_kind)
 	{
+	if ( BifConst::FileHash::multi_buffer )
+		{
+		auto h = detail::MultiBufferHash::Shared(alg);
+
+		if ( h->Preferable() )
+			{
+			multi = h;
+			stream = multi->Open();
+			return;
+			}
+		}
+
+	switch ( alg ) {
+	case Hash_MD5:
+		hash = new MD5Val();
+		break;
+
+	case Hash_SHA1:
+		hash = new SHA1Val();
+		break;
+
+	default:
+		hash = new SHA256Val();
+		break;
+	}
+
 	hash->Init();
 	}
 
 Hash::~Hash()
 	{
+	if ( stream )
+		multi->Close(stream);
+
 	Unref(hash);
 	}
 
 bool Hash::DeliverStream(const u_char* data, uint64_t len)
 	{
-	if ( ! hash->IsValid() )
+	if ( ! stream && ! hash->IsValid() )
 		return false;
 
 	if ( ! fed )
 		fed = len > 0;
 
-	hash->Feed(data, len);
+	if ( stream )
+		multi->Feed(stream, data, len);
+	else
+		hash->Feed(data, len);
+
 	return true;
 	}
 
@@ -45,15 +80,30 @@ bool Hash::Undelivered(uint64_t offset, uint64_t len)
 
 void Hash::Finalize()
 	{
-	if ( ! hash->IsValid() || ! fed )
+	if ( ! stream && ! hash->IsValid() )
+		return;
+
+	if ( ! fed )
 		return;
 
 	if ( ! file_hash )
 		return;
 
+	IntrusivePtr<StringVal> digest;
+
+	if ( stream )
+		{
+		u_char d[SHA256_DIGEST_LENGTH];
+		size_t n = multi->Finish(stream, d);
+		stream = nullptr;
+		digest = make_intrusive<StringVal>(digest_print(d, n));
+		}
+	else
+		digest = hash->Get();
+
 	mgr.Enqueue(file_hash,
 		IntrusivePtr{NewRef{}, GetFile()->GetVal()},
 		make_intrusive<StringVal>(kind),
-		hash->Get()
+		std::move(digest)
 	);
 	}
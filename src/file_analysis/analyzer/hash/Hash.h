@@ -8,6 +8,7 @@
 #include "OpaqueVal.h"
 #include "File.h"
 #include "Analyzer.h"
+#include "MultiBufferHash.h"
 
 #include "events.bif.h"
 
@@ -53,10 +54,10 @@ protected:
 	 * Constructor.
 	 * @param args the \c AnalyzerArgs value which represents the analyzer.
 	 * @param file the file to which the analyzer will be attached.
-	 * @param hv specific hash calculator object.
+	 * @param alg the hash algorithm to use.
 	 * @param kind human readable name of the hash algorithm to use.
 	 */
-	Hash(RecordVal* args, File* file, HashVal* hv, const char* kind);
+	Hash(RecordVal* args, File* file, HashAlgorithm alg, const char* kind);
 
 	/**
 	 * If some file contents have been seen, finalizes the hash of them and
@@ -65,7 +66,9 @@ protected:
 	void Finalize();
 
 private:
-	HashVal* hash;
+	HashVal* hash;	// null if hashing with multi-buffer
+	detail::MultiBufferHash* multi;
+	detail::MultiBufferHash::Stream* stream;
 	bool fed;
 	const char* kind;
 };
@@ -94,7 +97,7 @@ protected:
 	 * @param file the file to which the analyzer will be attached.
 	 */
 	MD5(RecordVal* args, File* file)
-		: Hash(args, file, new MD5Val(), "md5")
+		: Hash(args, file, Hash_MD5, "md5")
 		{}
 };
 
@@ -122,7 +125,7 @@ protected:
 	 * @param file the file to which the analyzer will be attached.
 	 */
 	SHA1(RecordVal* args, File* file)
-		: Hash(args, file, new SHA1Val(), "sha1")
+		: Hash(args, file, Hash_SHA1, "sha1")
 		{}
 };
 
@@ -150,7 +153,7 @@ protected:
 	 * @param file the file to which the analyzer will be attached.
 	 */
 	SHA256(RecordVal* args, File* file)
-		: Hash(args, file, new SHA256Val(), "sha256")
+		: Hash(args, file, Hash_SHA256, "sha256")
 		{}
 };
 
@@ -0,0 +1,756 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "MultiBufferHash.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "NetVar.h"
+#include "Reporter.h"
+
+#include "3rdparty/doctest.h"
+
+using namespace file_analysis::detail;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MB_VECTORS
+#define MB_INLINE inline __attribute__((always_inline))
+
+// The baseline vector width, SSE2 on x86-64 and NEON on ARM.
+typedef uint32_t u32x4 __attribute__((vector_size(16)));
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MB_AVX2
+#include <cpuid.h>
+typedef uint32_t u32x8 __attribute__((vector_size(32)));
+#endif
+
+#if defined(__clang__)
+#define MB_UNROLL _Pragma("unroll")
+#else
+#define MB_UNROLL _Pragma("GCC unroll 80")
+#endif
+
+#else
+#define MB_INLINE inline
+#define MB_UNROLL
+#endif
+
+// These work the same on scalars and on vectors, where they apply to each
+// lane.
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const size_t BLOCK_SIZE = 64;
+static const int MAX_LANES = 8;
+static const size_t MAX_IDLE_CAPACITY = 4096;
+
+class MultiBufferHash::Stream {
+public:
+	uint32_t state[8];
+	uint64_t length;	// bytes hashed so far
+	std::vector<u_char> pending;	// bytes not hashed yet
+	size_t index;	// position in the instance's streams
+};
+
+// Transposes the lanes' states into vectors, and back.
+
+template<typename V>
+static MB_INLINE void load_state(V* h, uint32_t* const* states, int words)
+	{
+	constexpr int L = sizeof(V) / sizeof(uint32_t);
+	uint32_t tmp[8 * L];
+
+	for ( int k = 0; k < words; ++k )
+		for ( int i = 0; i < L; ++i )
+			tmp[k * L + i] = states[i][k];
+
+	memcpy(h, tmp, words * sizeof(V));
+	}
+
+template<typename V>
+static MB_INLINE void store_state(const V* h, uint32_t* const* states, int words)
+	{
+	constexpr int L = sizeof(V) / sizeof(uint32_t);
+	uint32_t tmp[8 * L];
+	memcpy(tmp, h, words * sizeof(V));
+
+	for ( int k = 0; k < words; ++k )
+		for ( int i = 0; i < L; ++i )
+			states[i][k] = tmp[k * L + i];
+	}
+
+// Loads the next block of each lane as 16 words, and advances the lanes'
+// data past it.
+template<typename V>
+static MB_INLINE void load_block(V* w, const u_char** data, bool big_endian)
+	{
+	constexpr int L = sizeof(V) / sizeof(uint32_t);
+	uint32_t tmp[16 * L];
+
+	for ( int i = 0; i < L; ++i )
+		{
+		const u_char* p = data[i];
+
+		for ( int t = 0; t < 16; ++t, p += 4 )
+			{
+			if ( big_endian )
+				tmp[t * L + i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+				                 (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+			else
+				tmp[t * L + i] = uint32_t(p[0]) | (uint32_t(p[1]) << 8) |
+				                 (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+			}
+
+		data[i] = p;
+		}
+
+	memcpy(w, tmp, sizeof(tmp));
+	}
+
+static const uint32_t md5_k[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const int md5_r[64] = {
+	7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+	5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+	4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+	6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+};
+
+template<typename V>
+static MB_INLINE void md5_blocks(uint32_t* const* states, const u_char** data, size_t num_blocks)
+	{
+	V h[4];
+	load_state<V>(h, states, 4);
+
+	for ( size_t n = 0; n < num_blocks; ++n )
+		{
+		V w[16];
+		load_block<V>(w, data, false);
+
+		V a = h[0], b = h[1], c = h[2], d = h[3];
+
+		MB_UNROLL
+		for ( int t = 0; t < 64; ++t )
+			{
+			V f;
+			int g;
+
+			if ( t < 16 )
+				{
+				f = (b & c) | (~b & d);
+				g = t;
+				}
+			else if ( t < 32 )
+				{
+				f = (d & b) | (~d & c);
+				g = (5 * t + 1) & 15;
+				}
+			else if ( t < 48 )
+				{
+				f = b ^ c ^ d;
+				g = (3 * t + 5) & 15;
+				}
+			else
+				{
+				f = c ^ (b | ~d);
+				g = (7 * t) & 15;
+				}
+
+			V tmp = d;
+			d = c;
+			c = b;
+			f = a + f + md5_k[t] + w[g];
+			b = b + ROTL(f, md5_r[t]);
+			a = tmp;
+			}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		}
+
+	store_state<V>(h, states, 4);
+	}
+
+template<typename V>
+static MB_INLINE void sha1_blocks(uint32_t* const* states, const u_char** data, size_t num_blocks)
+	{
+	V h[5];
+	load_state<V>(h, states, 5);
+
+	for ( size_t n = 0; n < num_blocks; ++n )
+		{
+		V w[16];
+		load_block<V>(w, data, true);
+
+		V a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+		MB_UNROLL
+		for ( int t = 0; t < 80; ++t )
+			{
+			if ( t >= 16 )
+				{
+				V x = w[(t - 3) & 15] ^ w[(t - 8) & 15] ^ w[(t - 14) & 15] ^ w[t & 15];
+				w[t & 15] = ROTL(x, 1);
+				}
+
+			V f;
+			uint32_t k;
+
+			if ( t < 20 )
+				{
+				f = (b & c) | (~b & d);
+				k = 0x5a827999;
+				}
+			else if ( t < 40 )
+				{
+				f = b ^ c ^ d;
+				k = 0x6ed9eba1;
+				}
+			else if ( t < 60 )
+				{
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8f1bbcdc;
+				}
+			else
+				{
+				f = b ^ c ^ d;
+				k = 0xca62c1d6;
+				}
+
+			V tmp = ROTL(a, 5) + f + e + k + w[t & 15];
+			e = d;
+			d = c;
+			c = ROTL(b, 30);
+			b = a;
+			a = tmp;
+			}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+		}
+
+	store_state<V>(h, states, 5);
+	}
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+template<typename V>
+static MB_INLINE void sha256_blocks(uint32_t* const* states, const u_char** data, size_t num_blocks)
+	{
+	V h[8];
+	load_state<V>(h, states, 8);
+
+	for ( size_t n = 0; n < num_blocks; ++n )
+		{
+		V w[16];
+		load_block<V>(w, data, true);
+
+		V a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+
+		MB_UNROLL
+		for ( int t = 0; t < 64; ++t )
+			{
+			if ( t >= 16 )
+				{
+				V w2 = w[(t - 2) & 15];
+				V w15 = w[(t - 15) & 15];
+				V s0 = ROTR(w15, 7) ^ ROTR(w15, 18) ^ (w15 >> 3);
+				V s1 = ROTR(w2, 17) ^ ROTR(w2, 19) ^ (w2 >> 10);
+				w[t & 15] += s0 + s1 + w[(t - 7) & 15];
+				}
+
+			V t1 = hh + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) +
+			       ((e & f) ^ (~e & g)) + sha256_k[t] + w[t & 15];
+			V t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) +
+			       ((a & b) ^ (a & c) ^ (b & c));
+
+			hh = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+			}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+		h[5] += f;
+		h[6] += g;
+		h[7] += hh;
+		}
+
+	store_state<V>(h, states, 8);
+	}
+
+// Instantiations of the kernels for each lane width.
+
+#define MB_KERNELS(name) \
+	static void name##_x1(uint32_t* const* states, const u_char** data, size_t num_blocks) \
+		{ name##_blocks<uint32_t>(states, data, num_blocks); }
+
+#define MB_KERNELS_X4(name) \
+	static void name##_x4(uint32_t* const* states, const u_char** data, size_t num_blocks) \
+		{ name##_blocks<u32x4>(states, data, num_blocks); }
+
+#define MB_KERNELS_X8(name) \
+	__attribute__((target("avx2"))) \
+	static void name##_x8(uint32_t* const* states, const u_char** data, size_t num_blocks) \
+		{ name##_blocks<u32x8>(states, data, num_blocks); }
+
+MB_KERNELS(md5)
+MB_KERNELS(sha1)
+MB_KERNELS(sha256)
+
+#ifdef MB_VECTORS
+MB_KERNELS_X4(md5)
+MB_KERNELS_X4(sha1)
+MB_KERNELS_X4(sha256)
+#endif
+
+#ifdef MB_AVX2
+MB_KERNELS_X8(md5)
+MB_KERNELS_X8(sha1)
+MB_KERNELS_X8(sha256)
+#endif
+
+namespace {
+
+struct Algorithm {
+	int words;	// of state, all of which make up the digest
+	bool big_endian;
+	uint32_t init[8];
+};
+
+}
+
+static const Algorithm& algorithm(HashAlgorithm alg)
+	{
+	static const Algorithm md5 = { 4, false,
+		{ 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 } };
+	static const Algorithm sha1 = { 5, true,
+		{ 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 } };
+	static const Algorithm sha256 = { 8, true,
+		{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 } };
+
+	switch ( alg ) {
+	case Hash_MD5:
+		return md5;
+
+	case Hash_SHA1:
+		return sha1;
+
+	case Hash_SHA256:
+		return sha256;
+
+	default:
+		reporter->InternalError("unsupported algorithm for multi-buffer hashing");
+		return md5;
+	}
+	}
+
+MultiBufferHash::MultiBufferHash(HashAlgorithm arg_alg, size_t arg_max_buffered)
+	: alg(arg_alg), max_buffered(arg_max_buffered), buffered(0)
+	{
+	algorithm(alg);
+
+	switch ( alg ) {
+	case Hash_MD5:
+		scalar = md5_x1;
+		break;
+
+	case Hash_SHA1:
+		scalar = sha1_x1;
+		break;
+
+	default:
+		scalar = sha256_x1;
+		break;
+	}
+
+	wide = scalar;
+	lanes = 1;
+
+#ifdef MB_VECTORS
+	switch ( alg ) {
+	case Hash_MD5:
+		wide = md5_x4;
+		break;
+
+	case Hash_SHA1:
+		wide = sha1_x4;
+		break;
+
+	default:
+		wide = sha256_x4;
+		break;
+	}
+
+	lanes = 4;
+#endif
+
+#ifdef MB_AVX2
+	if ( __builtin_cpu_supports("avx2") )
+		{
+		switch ( alg ) {
+		case Hash_MD5:
+			wide = md5_x8;
+			break;
+
+		case Hash_SHA1:
+			wide = sha1_x8;
+			break;
+
+		default:
+			wide = sha256_x8;
+			break;
+		}
+
+		lanes = 8;
+		}
+#endif
+	}
+
+MultiBufferHash::~MultiBufferHash()
+	{
+	for ( auto s : streams )
+		delete s;
+	}
+
+MultiBufferHash* MultiBufferHash::Shared(HashAlgorithm alg)
+	{
+	static std::unique_ptr<MultiBufferHash> md5;
+	static std::unique_ptr<MultiBufferHash> sha1;
+	static std::unique_ptr<MultiBufferHash> sha256;
+
+	std::unique_ptr<MultiBufferHash>* h;
+
+	switch ( alg ) {
+	case Hash_MD5:
+		h = &md5;
+		break;
+
+	case Hash_SHA1:
+		h = &sha1;
+		break;
+
+	default:
+		h = &sha256;
+		break;
+	}
+
+	if ( ! *h )
+		h->reset(new MultiBufferHash(alg, BifConst::FileHash::multi_buffer_size));
+
+	return h->get();
+	}
+
+MultiBufferHash::Stream* MultiBufferHash::Open()
+	{
+	const Algorithm& a = algorithm(alg);
+
+	Stream* s = new Stream();
+	memcpy(s->state, a.init, sizeof(s->state));
+	s->length = 0;
+	s->index = streams.size();
+	streams.push_back(s);
+	return s;
+	}
+
+void MultiBufferHash::Feed(Stream* s, const u_char* data, size_t len)
+	{
+	s->pending.insert(s->pending.end(), data, data + len);
+	buffered += len;
+
+	if ( buffered >= max_buffered )
+		Flush();
+	}
+
+void MultiBufferHash::Flush()
+	{
+	std::vector<Stream*> work;
+
+	for ( auto s : streams )
+		if ( s->pending.size() >= BLOCK_SIZE )
+			work.push_back(s);
+
+	if ( work.empty() )
+		return;
+
+	HashLanes(work);
+
+	// Only partial blocks remain.
+	for ( auto s : work )
+		{
+		size_t done = s->pending.size() / BLOCK_SIZE * BLOCK_SIZE;
+		s->pending.erase(s->pending.begin(), s->pending.begin() + done);
+		s->length += done;
+		buffered -= done;
+
+		// Don't hold on to the space of large chunks for streams that
+		// may not see much more.
+		if ( s->pending.capacity() > MAX_IDLE_CAPACITY )
+			s->pending.shrink_to_fit();
+		}
+	}
+
+void MultiBufferHash::HashLanes(const std::vector<Stream*>& work)
+	{
+	if ( lanes == 1 || work.size() == 1 )
+		{
+		for ( auto s : work )
+			{
+			uint32_t* state = s->state;
+			const u_char* data = s->pending.data();
+			scalar(&state, &data, s->pending.size() / BLOCK_SIZE);
+			}
+
+		return;
+		}
+
+	// Each lane works through a stream's blocks, and picks up the next
+	// stream once it's done. Lanes that have run out of streams hash a
+	// busy lane's data again, to a state that's thrown away.
+	uint32_t* states[MAX_LANES];
+	const u_char* data[MAX_LANES];
+	size_t left[MAX_LANES];
+	bool active[MAX_LANES];
+	uint32_t scratch[MAX_LANES][8];
+	size_t next = 0;
+
+	auto assign = [&](int i)
+		{
+		active[i] = next < work.size();
+
+		if ( ! active[i] )
+			return;
+
+		Stream* s = work[next++];
+		states[i] = s->state;
+		data[i] = s->pending.data();
+		left[i] = s->pending.size() / BLOCK_SIZE;
+		};
+
+	for ( int i = 0; i < lanes; ++i )
+		assign(i);
+
+	while ( true )
+		{
+		int num_active = 0;
+		int busy = 0;
+		size_t n = SIZE_MAX;
+
+		for ( int i = 0; i < lanes; ++i )
+			{
+			if ( ! active[i] )
+				continue;
+
+			++num_active;
+			busy = i;
+			n = std::min(n, left[i]);
+			}
+
+		if ( num_active == 0 )
+			break;
+
+		if ( num_active == 1 )
+			{
+			// Nothing left to share the kernel with.
+			scalar(&states[busy], &data[busy], left[busy]);
+			break;
+			}
+
+		for ( int i = 0; i < lanes; ++i )
+			{
+			if ( ! active[i] )
+				{
+				states[i] = scratch[i];
+				data[i] = data[busy];
+				}
+			}
+
+		wide(states, data, n);
+
+		for ( int i = 0; i < lanes; ++i )
+			{
+			if ( active[i] && (left[i] -= n) == 0 )
+				assign(i);
+			}
+		}
+	}
+
+size_t MultiBufferHash::Finish(Stream* s, u_char* out)
+	{
+	// Hashing the other streams' blocks along with this one's makes for
+	// fewer idle lanes than hashing just this one.
+	if ( s->pending.size() >= BLOCK_SIZE )
+		Flush();
+
+	const Algorithm& a = algorithm(alg);
+
+	// Padding: a one bit, zeros, and the length in bits.
+	u_char block[2 * BLOCK_SIZE];
+	size_t r = s->pending.size();
+	size_t total = (r + 9 <= BLOCK_SIZE ? BLOCK_SIZE : 2 * BLOCK_SIZE);
+	uint64_t bits = (s->length + r) * 8;
+
+	memcpy(block, s->pending.data(), r);
+	block[r] = 0x80;
+	memset(block + r + 1, 0, total - r - 1);
+
+	for ( int i = 0; i < 8; ++i )
+		{
+		int shift = a.big_endian ? 56 - 8 * i : 8 * i;
+		block[total - 8 + i] = u_char(bits >> shift);
+		}
+
+	uint32_t* state = s->state;
+	const u_char* data = block;
+	scalar(&state, &data, total / BLOCK_SIZE);
+
+	for ( int k = 0; k < a.words; ++k )
+		{
+		for ( int i = 0; i < 4; ++i )
+			{
+			int shift = a.big_endian ? 24 - 8 * i : 8 * i;
+			out[4 * k + i] = u_char(s->state[k] >> shift);
+			}
+		}
+
+	Close(s);
+	return a.words * 4;
+	}
+
+void MultiBufferHash::Close(Stream* s)
+	{
+	buffered -= s->pending.size();
+
+	// Fill the gap with the last stream.
+	Stream* last = streams.back();
+	streams[s->index] = last;
+	last->index = s->index;
+	streams.pop_back();
+
+	delete s;
+	}
+
+size_t MultiBufferHash::DigestLength() const
+	{
+	return algorithm(alg).words * 4;
+	}
+
+bool MultiBufferHash::Preferable() const
+	{
+	if ( lanes == 1 )
+		return false;
+
+	if ( alg == Hash_MD5 )
+		return true;
+
+#ifdef MB_AVX2
+	// OpenSSL's SHA1 and SHA256 on the SHA extensions beat our lanes.
+	unsigned int eax, ebx, ecx, edx;
+
+	if ( __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29)) )
+		return false;
+
+	return true;
+#else
+	// Other platforms with vectors tend to have SHA instructions, too.
+	return false;
+#endif
+	}
+
+TEST_CASE("multi-buffer hash")
+	{
+	std::mt19937 rng(42);
+	std::string data;
+
+	for ( int i = 0; i < 100000; ++i )
+		data += char(rng());
+
+	for ( auto alg : { Hash_MD5, Hash_SHA1, Hash_SHA256 } )
+		{
+		// Small enough to hash while feeding.
+		MultiBufferHash h(alg, 10000);
+		CHECK(h.Lanes() >= 1);
+
+		// Streams of all sizes around the block and padding
+		// boundaries, fed in pieces of different sizes.
+		std::vector<MultiBufferHash::Stream*> streams;
+		std::vector<size_t> sizes;
+		std::vector<size_t> fed;
+
+		for ( size_t n = 0; n < 200; ++n )
+			{
+			streams.push_back(h.Open());
+			sizes.push_back(n < 130 ? n : rng() % data.size());
+			fed.push_back(0);
+			}
+
+		bool more = true;
+
+		while ( more )
+			{
+			more = false;
+
+			for ( size_t i = 0; i < streams.size(); ++i )
+				{
+				size_t len = std::min(sizes[i] - fed[i], size_t(rng() % 3000));
+				h.Feed(streams[i], reinterpret_cast<const u_char*>(data.data()) + fed[i], len);
+				fed[i] += len;
+				more = more || fed[i] < sizes[i];
+				}
+			}
+
+		for ( size_t i = 0; i < streams.size(); ++i )
+			{
+			u_char digest[SHA256_DIGEST_LENGTH];
+			u_char expected[SHA256_DIGEST_LENGTH];
+			size_t n = h.Finish(streams[i], digest);
+
+			calculate_digest(alg, reinterpret_cast<const u_char*>(data.data()), sizes[i], expected);
+			CHECK(n == h.DigestLength());
+			CHECK(memcmp(digest, expected, n) == 0);
+			}
+
+		// Abandoned streams leave nothing behind.
+		auto s = h.Open();
+		h.Feed(s, reinterpret_cast<const u_char*>(data.data()), 100);
+		h.Close(s);
+		CHECK(h.Buffered() == 0);
+		}
+	}
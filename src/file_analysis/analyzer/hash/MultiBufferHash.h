@@ -0,0 +1,141 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Multi-buffer MD5/SHA1/SHA256 hashing for the file hash analyzers.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <vector>
+
+#include "digest.h"
+
+namespace file_analysis { namespace detail {
+
+/**
+ * Computes digests of many files at once. Each file's data is held back
+ * until enough has come in across all of them, and then the 64-byte blocks
+ * of several files get hashed together, one file per lane of a SIMD
+ * kernel. The algorithms' rounds only depend on a single file's data, so
+ * the lanes work in lockstep without interfering with each other.
+ *
+ * The kernels are written with the compiler's generic vector types. Where
+ * the CPU supports AVX2 they run 8 lanes, otherwise they use the baseline
+ * vector width of the platform for 4 lanes. Without vector support, as
+ * well as when there's only one file with data to hash, a scalar version
+ * of the same code hashes one file at a time. The digests are the same as
+ * OpenSSL's.
+ *
+ * An instance must only be used by a single thread.
+ */
+class MultiBufferHash {
+public:
+	/**
+	 * The digest state of a single file.
+	 */
+	class Stream;
+
+	/**
+	 * Constructor.
+	 *
+	 * @param alg The algorithm, one of Hash_MD5, Hash_SHA1, or
+	 * Hash_SHA256.
+	 *
+	 * @param max_buffered The number of bytes across all streams to hold
+	 * back before hashing them.
+	 */
+	MultiBufferHash(HashAlgorithm alg, size_t max_buffered);
+
+	/**
+	 * Destructor. Releases any streams still open.
+	 */
+	~MultiBufferHash();
+
+	MultiBufferHash(const MultiBufferHash&) = delete;
+	MultiBufferHash& operator=(const MultiBufferHash&) = delete;
+
+	/**
+	 * Returns the instance for an algorithm that the file hash analyzers
+	 * share, creating it on first use with FileHash::multi_buffer_size.
+	 */
+	static MultiBufferHash* Shared(HashAlgorithm alg);
+
+	/**
+	 * Starts a new digest.
+	 *
+	 * @return The stream, which must later be passed to either Finish()
+	 * or Close().
+	 */
+	Stream* Open();
+
+	/**
+	 * Adds data to a stream's digest. The data may get hashed right away
+	 * or later, along with that of other streams.
+	 */
+	void Feed(Stream* s, const u_char* data, size_t len);
+
+	/**
+	 * Completes a stream's digest and releases the stream.
+	 *
+	 * @param out Buffer receiving the digest, with room for at least
+	 * DigestLength() bytes.
+	 *
+	 * @return The digest's length.
+	 */
+	size_t Finish(Stream* s, u_char* out);
+
+	/**
+	 * Releases a stream without completing its digest.
+	 */
+	void Close(Stream* s);
+
+	/**
+	 * Hashes all full blocks held back so far.
+	 */
+	void Flush();
+
+	/**
+	 * Returns the length of the digests in bytes.
+	 */
+	size_t DigestLength() const;
+
+	/**
+	 * Returns the number of files hashed together by the kernel in use.
+	 */
+	int Lanes() const	{ return lanes; }
+
+	/**
+	 * Returns whether hashing with this instance is expected to be faster
+	 * on this CPU than hashing each file on its own with OpenSSL. That's
+	 * not the case without vector support, or for SHA1 and SHA256 on
+	 * CPUs with instructions for them.
+	 */
+	bool Preferable() const;
+
+	/**
+	 * Returns the number of bytes currently held back.
+	 */
+	size_t Buffered() const	{ return buffered; }
+
+private:
+	// Hashes a number of blocks for each lane; a lane's state is updated
+	// in place and its data pointer is advanced past the blocks.
+	typedef void (*Kernel)(uint32_t* const* states, const u_char** data, size_t num_blocks);
+
+	// Hashes some streams' full blocks together.
+	void HashLanes(const std::vector<Stream*>& work);
+
+	HashAlgorithm alg;
+	size_t max_buffered;
+	size_t buffered;
+
+	Kernel scalar;	// a single lane
+	Kernel wide;	// lanes at once
+	int lanes;
+
+	std::vector<Stream*> streams;
+};
+
+}}
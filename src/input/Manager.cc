@@ -2,6 +2,9 @@
 
 #include "Manager.h"
 
+#include <sys/stat.h>
+
+#include <memory>
 #include <string>
 #include <utility>
 
@@ -17,6 +20,7 @@
 #include "NetVar.h"
 #include "Net.h"
 #include "CompHash.h"
+#include "MappedTable.h"
 
 #include "../file_analysis/Manager.h"
 #include "../threading/SerialTypes.h"
@@ -105,6 +109,21 @@ public:
 
 	EventHandlerPtr event;
 
+	// For a table kept in a mapped file: the file, the elements the
+	// current read brought so far, and the state of the source that
+	// the read started from.
+	string mapped_file;
+	MappedTableBuilder* mapped_builder;
+	string mapped_tag;
+
+	// Set while the read only repeats what the mapped file holds.
+	bool skip_mapped_read;
+
+	// The fields for initializing the reader, if the mapped file was
+	// current and so that waits until an update gets forced.
+	Field** deferred_fields;
+	int num_deferred_fields;
+
 	TableStream();
 	~TableStream() override;
 };
@@ -132,7 +151,9 @@ public:
 Manager::TableStream::TableStream()
 	: Manager::Stream::Stream(TABLE_STREAM),
 	  num_idx_fields(), num_val_fields(), want_record(), tab(), rtype(),
-	  itype(), currDict(), lastDict(), pred(), event()
+	  itype(), currDict(), lastDict(), pred(), event(), mapped_file(),
+	  mapped_builder(), mapped_tag(), skip_mapped_read(), deferred_fields(),
+	  num_deferred_fields()
 	{
 	}
 
@@ -170,6 +191,16 @@ Manager::TableStream::~TableStream()
 		lastDict->Clear();;
 		delete lastDict;
 		}
+
+	delete mapped_builder;
+
+	if ( deferred_fields )
+		{
+		for ( int i = 0; i < num_deferred_fields; i++ )
+			delete deferred_fields[i];
+
+		delete [] deferred_fields;
+		}
 	}
 
 Manager::AnalysisStream::AnalysisStream()
@@ -197,6 +228,28 @@ Manager::~Manager()
 
 	}
 
+// Identifies the state of a mapped table's source, so that the mapped
+// file gets used only for as long as the source doesn't change.  Sources
+// that aren't files can't tell, and always get read.
+static string mapped_file_tag(const ReaderFrontend* reader)
+	{
+	const ReaderBackend::ReaderInfo& info = reader->Info();
+	struct stat st;
+
+	if ( stat(info.source, &st) < 0 )
+		return "";
+
+	string tag = fmt("%s %llu %llu %lld", reader->Name(),
+	                 static_cast<unsigned long long>(st.st_ino),
+	                 static_cast<unsigned long long>(st.st_size),
+	                 static_cast<long long>(st.st_mtime));
+
+	for ( const auto& c : info.config )
+		tag += fmt(" %s=%s", c.first, c.second);
+
+	return tag;
+	}
+
 ReaderBackend* Manager::CreateBackend(ReaderFrontend* frontend, EnumVal* tag)
 	{
 	Component* c = Lookup(tag);
@@ -621,6 +674,39 @@ bool Manager::CreateTableStream(RecordVal* fval)
 	if ( ! CheckErrorEventTypes(stream_name, error_event, true) )
 		return false;
 
+	auto mapped_file_val = fval->Lookup("mapped_file", true);
+	string mapped_file = mapped_file_val ? mapped_file_val->AsString()->CheckString() : "";
+
+	if ( ! mapped_file.empty() )
+		{
+		// The elements of a mapped table don't get added one by one,
+		// nor do they exist as values that the table could track.
+		TableVal* dst_table = dst->AsTableVal();
+		const char* problem = nullptr;
+
+		if ( event || pred )
+			problem = "cannot have an event or predicate";
+
+		// Input::STREAM
+		else if ( fval->Lookup("mode", true)->AsEnumVal()->InternalInt() == 2 )
+			problem = "cannot use STREAM mode";
+
+		else if ( dst_table->FindAttr(ATTR_EXPIRE_READ) ||
+		          dst_table->FindAttr(ATTR_EXPIRE_WRITE) ||
+		          dst_table->FindAttr(ATTR_EXPIRE_CREATE) ||
+		          dst_table->FindAttr(ATTR_ON_CHANGE) )
+			problem = "cannot have a table with expiration or &on_change";
+
+		else if ( ! MappedTable::IsMappable(dst_table->Type()->AsTableType()) )
+			problem = "has a table type that cannot be mapped";
+
+		if ( problem )
+			{
+			reporter->Error("Input stream %s: Stream with a mapped file %s", stream_name.c_str(), problem);
+			return false;
+			}
+		}
+
 	vector<Field*> fieldsV; // vector, because we don't know the length beforehands
 
 	bool status = (! UnrollRecordType(&fieldsV, idx, "", false));
@@ -677,12 +763,35 @@ bool Manager::CreateTableStream(RecordVal* fval)
 	stream->lastDict = new PDict<InputHash>;
 	stream->lastDict->SetDeleteFunc(input_hash_delete_func);
 	stream->want_record = ( want_record->InternalInt() == 1 );
+	stream->mapped_file = mapped_file;
 
 	assert(stream->reader);
-	stream->reader->Init(fieldsV.size(), fields );
-
 	readers[stream->reader] = stream;
 
+	string tag = mapped_file.empty() ? "" : mapped_file_tag(stream->reader);
+	string err;
+
+	if ( ! tag.empty() && MapCurrentFile(stream, tag, &err) )
+		{
+		// The mapped file already holds what the source has.  Without
+		// rereads, there's nothing to read until an update is forced.
+		if ( stream->reader->Info().mode == MODE_MANUAL )
+			{
+			stream->deferred_fields = fields;
+			stream->num_deferred_fields = fieldsV.size();
+			SendEndOfData(stream);
+
+			DBG_LOG(DBG_INPUT, "Successfully created table stream %s from mapped file %s",
+				stream->name.c_str(), mapped_file.c_str());
+
+			return true;
+			}
+
+		stream->skip_mapped_read = true;
+		}
+
+	stream->reader->Init(fieldsV.size(), fields );
+
 	DBG_LOG(DBG_INPUT, "Successfully created table stream %s",
 		stream->name.c_str());
 
@@ -977,6 +1086,29 @@ bool Manager::ForceUpdate(const string &name)
 		return false;
 		}
 
+	if ( i->stream_type == TABLE_STREAM )
+		{
+		TableStream* stream = static_cast<TableStream*>(i);
+
+		if ( stream->deferred_fields )
+			{
+			string tag = mapped_file_tag(stream->reader);
+			string err;
+
+			if ( ! tag.empty() && MapCurrentFile(stream, tag, &err) )
+				SendEndOfData(stream);
+			else
+				{
+				// The reader reads everything when it starts.
+				stream->reader->Init(stream->num_deferred_fields,
+				                     stream->deferred_fields);
+				stream->deferred_fields = nullptr;
+				}
+
+			return true;
+			}
+		}
+
 	i->reader->Update();
 
 #ifdef DEBUG
@@ -1091,6 +1223,9 @@ int Manager::SendEntryTable(Stream* i, const Value* const *vals)
 	assert(i->stream_type == TABLE_STREAM);
 	TableStream* stream = (TableStream*) i;
 
+	if ( ! stream->mapped_file.empty() )
+		return SendEntryMapped(stream, vals);
+
 	HashKey* idxhash = HashValues(stream->num_idx_fields, vals);
 
 	if ( idxhash == nullptr )
@@ -1317,6 +1452,13 @@ void Manager::EndCurrentSend(ReaderFrontend* reader)
 	assert(i->stream_type == TABLE_STREAM);
 	TableStream* stream = (TableStream*) i;
 
+	if ( ! stream->mapped_file.empty() )
+		{
+		EndMappedSend(stream);
+		SendEndOfData(i);
+		return;
+		}
+
 	// lastdict contains all deleted entries and should be empty apart from that
 	IterCookie *c = stream->lastDict->InitForIteration();
 	stream->lastDict->MakeRobustCookie(c);
@@ -1396,6 +1538,102 @@ void Manager::EndCurrentSend(ReaderFrontend* reader)
 	SendEndOfData(i);
 	}
 
+int Manager::SendEntryMapped(TableStream* stream, const Value* const *vals)
+	{
+	int num_fields = stream->num_idx_fields + stream->num_val_fields;
+
+	if ( stream->skip_mapped_read )
+		return num_fields;
+
+	bool convert_error = false;
+
+	Val* idxval = ValueToIndexVal(stream, stream->num_idx_fields, stream->itype, vals, convert_error);
+	Val* valval;
+
+	int position = stream->num_idx_fields;
+
+	if ( stream->num_val_fields == 0 )
+		valval = nullptr;
+
+	else if ( stream->num_val_fields == 1 && ! stream->want_record )
+		valval = ValueToVal(stream, vals[position], stream->rtype->FieldType(0), convert_error);
+
+	else
+		valval = ValueToRecordVal(stream, vals, stream->rtype, &position, convert_error);
+
+	if ( ! convert_error )
+		{
+		if ( ! stream->mapped_builder )
+			{
+			stream->mapped_builder = new MappedTableBuilder(stream->tab->Type()->AsTableType());
+			stream->mapped_tag = mapped_file_tag(stream->reader);
+			}
+
+		if ( ! stream->mapped_builder->Add(idxval, valval) )
+			Warning(stream, "Could not add line to mapped table. Ignoring");
+		}
+
+	Unref(valval);
+	Unref(idxval);
+
+	return num_fields;
+	}
+
+void Manager::EndMappedSend(TableStream* stream)
+	{
+	if ( stream->skip_mapped_read )
+		{
+		stream->skip_mapped_read = false;
+		return;
+		}
+
+	unique_ptr<MappedTableBuilder> builder(stream->mapped_builder);
+	string tag = stream->mapped_tag;
+	stream->mapped_builder = nullptr;
+	stream->mapped_tag.clear();
+
+	if ( ! builder )
+		{
+		// The source had nothing.
+		builder.reset(new MappedTableBuilder(stream->tab->Type()->AsTableType()));
+		tag = mapped_file_tag(stream->reader);
+		}
+
+	string err;
+
+	// Another process may have read the same state of the source in the
+	// meantime.
+	if ( ! tag.empty() && MapCurrentFile(stream, tag, &err) )
+		return;
+
+	if ( ! builder->Write(stream->mapped_file, tag, &err) )
+		{
+		Error(stream, "Could not write mapped file %s: %s",
+		      stream->mapped_file.c_str(), err.c_str());
+		return;
+		}
+
+	if ( ! MapCurrentFile(stream, tag, &err) )
+		Error(stream, "Could not map file %s: %s",
+		      stream->mapped_file.c_str(), err.c_str());
+	}
+
+bool Manager::MapCurrentFile(TableStream* stream, const string& tag, string* err)
+	{
+	auto m = MappedTable::Open(stream->mapped_file, stream->tab->Type()->AsTableType(),
+	                           tag, err);
+
+	if ( ! m )
+		{
+		DBG_LOG(DBG_INPUT, "Not using mapped file %s for stream %s: %s",
+			stream->mapped_file.c_str(), stream->name.c_str(), err->c_str());
+		return false;
+		}
+
+	stream->tab->SetMapping(std::move(m));
+	return true;
+	}
+
 void Manager::SendEndOfData(ReaderFrontend* reader)
 	{
 	Stream *i = FindStream(reader);
@@ -1527,6 +1765,9 @@ int Manager::PutTable(Stream* i, const Value* const *vals)
 	assert(i->stream_type == TABLE_STREAM);
 	TableStream* stream = (TableStream*) i;
 
+	if ( ! stream->mapped_file.empty() )
+		return SendEntryMapped(stream, vals);
+
 	bool convert_error = false;
 
 	Val* idxval = ValueToIndexVal(i, stream->num_idx_fields, stream->itype, vals, convert_error);
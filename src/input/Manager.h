@@ -193,6 +193,18 @@ private:
 	// Put implementation for Table stream.
 	int PutTable(Stream* i, const threading::Value* const *vals);
 
+	// SendEntry and Put implementation for Table streams kept in a
+	// mapped file.
+	int SendEntryMapped(TableStream* stream, const threading::Value* const *vals);
+
+	// EndCurrentSend implementation for Table streams kept in a mapped
+	// file: writes the file from what the read brought, and maps it.
+	void EndMappedSend(TableStream* stream);
+
+	// Maps the stream's file into its table, if it has been written with
+	// the given tag.  Returns false, with the reason in err, if not.
+	bool MapCurrentFile(TableStream* stream, const std::string& tag, std::string* err);
+
 	// SendEntry and Put implementation for Event stream.
 	int SendEventStreamEvent(Stream* i, EnumVal* type, const threading::Value* const *vals);
 
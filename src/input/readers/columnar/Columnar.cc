@@ -0,0 +1,204 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <sys/stat.h>
+
+#include "Columnar.h"
+
+#include "threading/SerialTypes.h"
+
+using namespace input::reader;
+using namespace logging::writer::columnar;
+using namespace std;
+using threading::Value;
+using threading::Field;
+
+Columnar::Columnar(ReaderFrontend *frontend)
+	: ReaderBackend(frontend), mtime(0), ino(0), firstrun(true)
+	{
+	}
+
+Columnar::~Columnar()
+	{
+	DoClose();
+	}
+
+void Columnar::DoClose()
+	{
+	file.Close();
+	}
+
+bool Columnar::OpenInput()
+	{
+	if ( ! file.Open(fname) )
+		{
+		Error(Fmt("Init: %s", file.Error().c_str()));
+		return false;
+		}
+
+	columns.clear();
+
+	for ( int i = 0; i < NumFields(); ++i )
+		{
+		const Field* f = Fields()[i];
+		int col = file.FindColumn(f->name);
+
+		if ( col < 0 )
+			{
+			Error(Fmt("Did not find requested field %s in input data file %s.",
+			          f->name, fname.c_str()));
+			return false;
+			}
+
+		const ColumnSchema& s = file.Schema()[col];
+
+		if ( ! s.Feeds(f->type, f->subtype) )
+			{
+			Error(Fmt("Field %s of type %s cannot be read from column of type %s in %s.",
+			          f->name, type_name(f->type), LogicalTypeName(s.logical),
+			          fname.c_str()));
+			return false;
+			}
+
+		columns.push_back(col);
+		}
+
+	return true;
+	}
+
+bool Columnar::DoInit(const ReaderInfo& info, int num_fields,
+                      const Field* const* fields)
+	{
+	mtime = 0;
+	ino = 0;
+	firstrun = true;
+
+	if ( ! info.source || strlen(info.source) == 0 )
+		{
+		Error("No source path provided");
+		return false;
+		}
+
+	if ( info.mode == MODE_STREAM )
+		{
+		Error("Columnar files cannot be read in streaming mode");
+		return false;
+		}
+
+	fname = info.source;
+
+	if ( UpdateModificationTime() == -1 )
+		return false;
+
+	if ( ! OpenInput() )
+		return false;
+
+	DoUpdate();
+
+	return true;
+	}
+
+int Columnar::UpdateModificationTime()
+	{
+	struct stat sb;
+
+	if ( stat(fname.c_str(), &sb) == -1 )
+		{
+		Error(Fmt("Could not get stat for %s", fname.c_str()));
+		return -1;
+		}
+
+	if ( sb.st_ino == ino && sb.st_mtime == mtime )
+		// no change
+		return 0;
+
+	mtime = sb.st_mtime;
+	ino = sb.st_ino;
+	return 1;
+	}
+
+// Read the entire file and send its records back to the input manager.
+bool Columnar::DoUpdate()
+	{
+	if ( firstrun )
+		firstrun = false;
+
+	else
+		{
+		switch ( Info().mode ) {
+		case MODE_REREAD:
+			{
+			switch ( UpdateModificationTime() ) {
+			case -1:
+				return false; // error
+			case 0:
+				return true; // no change
+			case 1:
+				break; // file changed. reread.
+			default:
+				assert(false);
+			}
+			// fallthrough
+			}
+
+		case MODE_MANUAL:
+			if ( ! OpenInput() )
+				return false;
+
+			break;
+
+		default:
+			assert(false);
+		}
+		}
+
+	int num_fields = NumFields();
+	vector<ColumnData> data(num_fields);
+
+	for ( size_t rg = 0; rg < file.RowGroups().size(); ++rg )
+		{
+		for ( int i = 0; i < num_fields; ++i )
+			{
+			if ( ! file.ReadColumn(rg, columns[i], &data[i]) )
+				{
+				Error(Fmt("%s: %s", fname.c_str(), file.Error().c_str()));
+				return false;
+				}
+			}
+
+		for ( uint32_t row = 0; row < file.RowGroups()[rg].num_rows; ++row )
+			{
+			Value** fields = new Value*[num_fields];
+
+			for ( int i = 0; i < num_fields; ++i )
+				fields[i] = data[i].NextValue(Fields()[i]->type, Fields()[i]->subtype);
+
+			SendEntry(fields);
+			}
+		}
+
+	// The next update reopens the file to pick up a new version.
+	file.Close();
+
+	EndCurrentSend();
+
+	return true;
+	}
+
+bool Columnar::DoHeartbeat(double network_time, double current_time)
+	{
+	switch ( Info().mode ) {
+		case MODE_MANUAL:
+			// yay, we do nothing :)
+			break;
+
+		case MODE_REREAD:
+			Update();	// call update and not DoUpdate, because update
+					// checks disabled.
+			break;
+
+		default:
+			assert(false);
+	}
+
+	return true;
+	}
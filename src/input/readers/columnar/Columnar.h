@@ -0,0 +1,48 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <vector>
+
+#include "input/ReaderBackend.h"
+#include "logging/writers/columnar/ColumnFile.h"
+
+namespace input { namespace reader {
+
+/**
+ * Reader for files of the Columnar log writer. Fields are matched to columns
+ * by name.
+ */
+class Columnar : public ReaderBackend {
+public:
+	explicit Columnar(ReaderFrontend* frontend);
+	~Columnar() override;
+
+	static ReaderBackend* Instantiate(ReaderFrontend* frontend)
+		{ return new Columnar(frontend); }
+
+protected:
+	bool DoInit(const ReaderInfo& info, int arg_num_fields,
+	            const threading::Field* const* fields) override;
+	void DoClose() override;
+	bool DoUpdate() override;
+	bool DoHeartbeat(double network_time, double current_time) override;
+
+private:
+	bool OpenInput();
+	int UpdateModificationTime();
+
+	std::string fname;
+	logging::writer::columnar::FileReader file;
+	time_t mtime;
+	ino_t ino;
+	bool firstrun;
+
+	// Column index for each field.
+	std::vector<int> columns;
+};
+
+}
+}
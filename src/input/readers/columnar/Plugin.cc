@@ -0,0 +1,24 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "plugin/Plugin.h"
+
+#include "Columnar.h"
+
+namespace plugin {
+namespace Zeek_ColumnarReader {
+
+class Plugin : public plugin::Plugin {
+public:
+	plugin::Configuration Configure() override
+		{
+		AddComponent(new ::input::Component("Columnar", ::input::reader::Columnar::Instantiate));
+
+		plugin::Configuration config;
+		config.name = "Zeek::ColumnarReader";
+		config.description = "Columnar input reader";
+		return config;
+		}
+} plugin;
+
+}
+}
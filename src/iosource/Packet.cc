@@ -18,29 +18,47 @@ extern "C" {
 #endif
 }
 
+PacketBuffer* PacketBuffer::current = nullptr;
+
+PacketBuffer::PacketBuffer(const u_char* arg_data, uint32_t arg_capacity)
+	: PacketBuffer(arg_capacity)
+	{
+	memcpy(data, arg_data, arg_capacity);
+	}
+
 void Packet::Init(int arg_link_type, pkt_timeval *arg_ts, uint32_t arg_caplen,
 		  uint32_t arg_len, const u_char *arg_data, bool arg_copy,
 		  std::string arg_tag)
 	{
-	if ( data && copy )
-		delete [] data;
+	if ( arg_data && arg_copy )
+		Init(arg_link_type, arg_ts, arg_caplen, arg_len,
+		     make_intrusive<PacketBuffer>(arg_data, arg_caplen), std::move(arg_tag));
+	else
+		{
+		buffer = nullptr;
+		data = arg_data;
+		InitFields(arg_link_type, arg_ts, arg_caplen, arg_len, std::move(arg_tag));
+		}
+	}
 
+void Packet::Init(int arg_link_type, pkt_timeval *arg_ts, uint32_t arg_caplen,
+		  uint32_t arg_len, IntrusivePtr<PacketBuffer> arg_buffer,
+		  std::string arg_tag)
+	{
+	buffer = std::move(arg_buffer);
+	data = buffer->Data();
+	InitFields(arg_link_type, arg_ts, arg_caplen, arg_len, std::move(arg_tag));
+	}
+
+void Packet::InitFields(int arg_link_type, pkt_timeval *arg_ts, uint32_t arg_caplen,
+		  uint32_t arg_len, std::string arg_tag)
+	{
 	link_type = arg_link_type;
 	ts = *arg_ts;
 	cap_len = arg_caplen;
 	len = arg_len;
 	tag = std::move(arg_tag);
 
-	copy = arg_copy;
-
-	if ( arg_data && arg_copy )
-		{
-		data = new u_char[arg_caplen];
-		memcpy(const_cast<u_char *>(data), arg_data, arg_caplen);
-		}
-	else
-		data = arg_data;
-
 	time = ts.tv_sec + double(ts.tv_usec) / 1e6;
 	hdr_size = GetLinkHeaderSize(arg_link_type);
 	eth_type = 0;
@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include <sys/types.h> // for u_char
 
+#include "IntrusivePtr.h"
+
 #if defined(__OpenBSD__)
 #include <net/bpf.h>
 typedef struct bpf_timeval pkt_timeval;
@@ -29,6 +31,77 @@ enum Layer3Proto : int32_t {
 	L3_ARP = 3,			/// Layer 3 is ARP.
 };
 
+/**
+ * Reference-counted heap memory holding packet data.  A packet source that
+ * can leave the data of each packet in a buffer of its own attaches that
+ * buffer to the Packet (see Packet::Init()).  Components that need to hold
+ * on to parts of the data beyond the packet's processing, such as the
+ * reassemblers, then keep a reference to the buffer instead of copying.
+ * Sources should only reuse a buffer for another packet once nothing else
+ * refers to it anymore, see Shared().
+ */
+class PacketBuffer {
+public:
+	/**
+	 * Allocates a buffer of the given size.
+	 */
+	explicit PacketBuffer(uint32_t arg_capacity)
+		: data(new u_char[arg_capacity]), capacity(arg_capacity)
+		{ }
+
+	/**
+	 * Allocates a buffer holding a copy of the given data.
+	 */
+	PacketBuffer(const u_char* arg_data, uint32_t arg_capacity);
+
+	~PacketBuffer()
+		{ delete [] data; }
+
+	PacketBuffer(const PacketBuffer&) = delete;
+	PacketBuffer& operator=(const PacketBuffer&) = delete;
+
+	u_char* Data()			{ return data; }
+	const u_char* Data() const	{ return data; }
+	uint32_t Capacity() const	{ return capacity; }
+
+	/**
+	 * Returns true if anything besides the caller holds a reference.
+	 */
+	bool Shared() const	{ return ref_cnt > 1; }
+
+	/**
+	 * Returns true if the given range of memory lies within the buffer.
+	 */
+	bool Contains(const u_char* p, uint64_t n) const
+		{ return p >= data && n <= capacity && uint64_t(p - data) <= capacity - n; }
+
+	/**
+	 * Returns the buffer of the packet currently being processed, or null
+	 * if there's none or its source didn't provide one.
+	 */
+	static PacketBuffer* Current()	{ return current; }
+
+	/**
+	 * Sets the buffer that Current() returns.
+	 */
+	static void SetCurrent(PacketBuffer* b)	{ current = b; }
+
+	friend void Ref(PacketBuffer* b)	{ ++b->ref_cnt; }
+
+	friend void Unref(PacketBuffer* b)
+		{
+		if ( b && --b->ref_cnt == 0 )
+			delete b;
+		}
+
+private:
+	u_char* data;
+	uint32_t capacity;
+	int ref_cnt = 1;
+
+	static PacketBuffer* current;
+};
+
 /**
  * A link-layer packet.
  */
@@ -73,14 +146,6 @@ public:
 		Init(0, &ts, 0, 0, nullptr);
 		}
 
-	/**
-	 * Destructor.
-	 */
-	~Packet()
-		{
-		if ( copy )
-			delete [] data;
-		}
 
 	/**
 	 * (Re-)initialize from packet data.
@@ -108,6 +173,31 @@ public:
 		uint32_t len, const u_char *data, bool copy = false,
 		std::string tag = std::string(""));
 
+	/**
+	 * (Re-)initialize from packet data held in a buffer, which the packet
+	 * keeps a reference to.  Otherwise the same as above.
+	 *
+	 * @param buffer The buffer, starting with the layer 2 header.
+	 */
+	void Init(int link_type, pkt_timeval *ts, uint32_t caplen,
+		uint32_t len, IntrusivePtr<PacketBuffer> buffer,
+		std::string tag = std::string(""));
+
+	/**
+	 * Returns the buffer holding the packet's data, or null if the data
+	 * lives elsewhere.
+	 */
+	PacketBuffer* Buffer() const
+		{ return buffer.get(); }
+
+	/**
+	 * Takes the packet's buffer away, for a source to reuse it for the
+	 * next packet.  The packet's data must not be accessed anymore
+	 * afterwards.
+	 */
+	IntrusivePtr<PacketBuffer> TakeBuffer()
+		{ return std::move(buffer); }
+
 	/**
 	 * Returns true if parsing the layer 2 fields failed, including when
 	 * no data was passed into the constructor in the first place.
@@ -214,6 +304,10 @@ public:
 	bool l3_checksummed;
 
 private:
+	// Sets up everything but the data.
+	void InitFields(int link_type, pkt_timeval *ts, uint32_t caplen,
+		uint32_t len, std::string tag);
+
 	// Calculate layer 2 attributes.
 	void ProcessLayer2();
 
@@ -223,9 +317,8 @@ private:
 	// Renders an MAC address into its ASCII representation.
 	Val* FmtEUI48(const u_char *mac) const;
 
-	// True if we need to delete associated packet memory upon
-	// destruction.
-	bool copy;
+	// Holds the packet's data, if it's in a buffer.
+	IntrusivePtr<PacketBuffer> buffer;
 
 	// True if L2 processing succeeded.
 	bool l2_valid;
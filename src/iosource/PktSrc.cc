@@ -6,9 +6,11 @@
 #include <sys/stat.h>
 
 #include "util.h"
+#include "Var.h"
 #include "Hash.h"
 #include "Net.h"
 #include "Sessions.h"
+#include "FlowShards.h"
 #include "broker/Manager.h"
 #include "iosource/Manager.h"
 #include "BPF_Program.h"
@@ -23,11 +25,16 @@ PktSrc::Properties::Properties()
 	link_type = -1;
 	netmask = NETMASK_UNKNOWN;
 	is_live = false;
+	distributes_flows = false;
+	batch_size = 1;
 	}
 
 PktSrc::PktSrc()
 	{
 	have_packet = false;
+	batch = new Packet[1];
+	batch_size = 1;
+	batch_len = batch_pos = 0;
 	errbuf = "";
 	SetClosed(true);
 
@@ -41,6 +48,8 @@ PktSrc::~PktSrc()
 	{
 	for ( auto code : filters )
 		delete code;
+
+	delete [] batch;
 	}
 
 const std::string& PktSrc::Path() const
@@ -74,6 +83,11 @@ bool PktSrc::IsLive() const
 	return props.is_live;
 	}
 
+bool PktSrc::DistributesFlows() const
+	{
+	return props.distributes_flows;
+	}
+
 double PktSrc::CurrentPacketTimestamp()
 	{
 	return current_pseudo;
@@ -102,6 +116,7 @@ void PktSrc::Opened(const Properties& arg_props)
 
 	props = arg_props;
 	SetClosed(false);
+	InitBatch();
 
 	if ( ! PrecompileFilter(0, "") || ! SetFilter(0) )
 		{
@@ -174,12 +189,26 @@ double PktSrc::CheckPseudoTime()
 	if ( ! ExtractNextPacketInternal() )
 		return 0;
 
-	double pseudo_time = current_packet.time - first_timestamp;
+	double pseudo_time = CurrentPacket()->time - first_timestamp;
 	double ct = (current_time(true) - first_wallclock) * pseudo_realtime;
 
 	return pseudo_time <= ct ? bro_start_time + pseudo_time : 0;
 	}
 
+void PktSrc::InitBatch()
+	{
+	// Pseudo-realtime mode paces each packet individually.
+	int n = pseudo_realtime ? 1 : std::max(1, props.batch_size);
+
+	if ( n == batch_size )
+		return;
+
+	delete [] batch;
+	batch = new Packet[n];
+	batch_size = n;
+	batch_len = batch_pos = 0;
+	}
+
 void PktSrc::InitSource()
 	{
 	Open();
@@ -196,25 +225,53 @@ void PktSrc::Process()
 	if ( ! IsOpen() )
 		return;
 
+	// Leave the rest of a batch alone while processing is suspended.
+	if ( have_packet && net_is_processing_suspended() && first_timestamp )
+		return;
+
 	if ( ! ExtractNextPacketInternal() )
 		return;
 
-	if ( current_packet.Layer2Valid() )
+	// Process the batch back to back.  We stop early if something
+	// happens that the main loop needs to see, and pick up the rest of
+	// the batch on the next call.
+	do
 		{
-		if ( pseudo_realtime )
+		Packet* pkt = CurrentPacket();
+
+		// Get the next packet's connection state into the cache
+		// while this one is being processed.
+		if ( batch_pos + 1 < batch_len )
+			sessions->PrefetchConnection(&batch[batch_pos + 1]);
+
+		if ( pkt->time < 0 )
+			Weird("negative_packet_timestamp", pkt);
+
+		else if ( pkt->Layer2Valid() &&
+		          (props.distributes_flows || zeek::in_flow_shard(pkt)) )
 			{
-			current_pseudo = CheckPseudoTime();
-			net_packet_dispatch(current_pseudo, &current_packet, this);
-			if ( ! first_wallclock )
-				first_wallclock = current_time(true);
+			if ( pseudo_realtime )
+				{
+				current_pseudo = CheckPseudoTime();
+				net_packet_dispatch(current_pseudo, pkt, this);
+				if ( ! first_wallclock )
+					first_wallclock = current_time(true);
+				}
+
+			else
+				net_packet_dispatch(pkt->time, pkt, this);
 			}
 
-		else
-			net_packet_dispatch(current_packet.time, &current_packet, this);
+		++batch_pos;
 		}
+	while ( batch_pos < batch_len && IsOpen() && ! signal_val &&
+	        ! net_is_processing_suspended() );
+
+	if ( batch_pos < batch_len )
+		return;
 
 	have_packet = false;
-	DoneWithPacket();
+	DoneWithPackets();
 	}
 
 const char* PktSrc::Tag()
@@ -237,16 +294,13 @@ bool PktSrc::ExtractNextPacketInternal()
 	if ( pseudo_realtime )
 		current_wallclock = current_time(true);
 
-	if ( ExtractNextPacket(&current_packet) )
-		{
-		if ( current_packet.time < 0 )
-			{
-			Weird("negative_packet_timestamp", &current_packet);
-			return false;
-			}
+	batch_len = ExtractNextPackets(batch, batch_size);
+	batch_pos = 0;
 
-		if ( ! first_timestamp )
-			first_timestamp = current_packet.time;
+	if ( batch_len > 0 )
+		{
+		if ( ! first_timestamp && batch[0].time >= 0 )
+			first_timestamp = batch[0].time;
 
 		have_packet = true;
 		return true;
@@ -261,6 +315,16 @@ bool PktSrc::ExtractNextPacketInternal()
 	return false;
 	}
 
+int PktSrc::ExtractNextPackets(Packet* pkts, int max)
+	{
+	return ExtractNextPacket(&pkts[0]) ? 1 : 0;
+	}
+
+void PktSrc::DoneWithPackets()
+	{
+	DoneWithPacket();
+	}
+
 bool PktSrc::PrecompileBPFFilter(int index, const std::string& filter)
 	{
 	if ( index < 0 )
@@ -326,7 +390,7 @@ bool PktSrc::GetCurrentPacket(const Packet** pkt)
 	if ( ! have_packet )
 		return false;
 
-	*pkt = &current_packet;
+	*pkt = CurrentPacket();
 	return true;
 	}
 
@@ -352,7 +416,10 @@ double PktSrc::GetNextTimeout()
 	if ( ! have_packet )
 		ExtractNextPacketInternal();
 
-	double pseudo_time = current_packet.time - first_timestamp;
+	if ( ! have_packet )
+		return -1;
+
+	double pseudo_time = CurrentPacket()->time - first_timestamp;
 	double ct = (current_time(true) - first_wallclock) * pseudo_realtime;
 	return std::max(0.0, pseudo_time - ct);
 	}
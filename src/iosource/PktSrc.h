@@ -70,6 +70,12 @@ public:
 	 */
 	bool IsLive() const;
 
+	/**
+	 * Returns true if the source spreads flows across the processes
+	 * reading from it by itself, such as with kernel fanout.
+	 */
+	bool DistributesFlows() const;
+
 	/**
 	 * Returns the link type of the source.
 	 */
@@ -258,6 +264,20 @@ protected:
 		 */
 		bool is_live;
 
+		/**
+		 * True if the source already spreads flows across the
+		 * processes reading from it, such as with kernel fanout. The
+		 * flow shards then don't filter its packets any further.
+		 */
+		bool distributes_flows;
+
+		/**
+		 * The maximum number of packets the source wants to hand
+		 * over per call to \a ExtractNextPackets(). Sources that
+		 * only implement \a ExtractNextPacket() leave this at 1.
+		 */
+		int batch_size;
+
 		Properties();
 	};
 
@@ -348,14 +368,50 @@ protected:
 	 */
 	virtual void DoneWithPacket() = 0;
 
+	/**
+	 * Provides up to \a max packets from the source at once, which the
+	 * core then processes back to back without going through the main
+	 * loop in between.
+	 *
+	 * The default implementation provides a single packet through \a
+	 * ExtractNextPacket(). Sources overriding this must keep the data of
+	 * all returned packets available until \a DoneWithPackets() is
+	 * called. It is guaranteed that no two calls to this method will
+	 * happen without \a DoneWithPackets() in between.
+	 *
+	 * @param pkts An array of at least \a max packets to fill in.
+	 *
+	 * @param max The maximum number of packets to provide.
+	 *
+	 * @return The number of packets filled in. Zero if no packet is
+	 * available or an error occured (which must be flagged via Error()).
+	 */
+	virtual int ExtractNextPackets(Packet* pkts, int max);
+
+	/**
+	 * Signals that the data of the packets provided by the previous \a
+	 * ExtractNextPackets() will no longer be needed. The default
+	 * implementation calls \a DoneWithPacket().
+	 */
+	virtual void DoneWithPackets();
+
 private:
 	// Checks if the current packet has a pseudo-time <= current_time. If
 	// yes, returns pseudo-time, otherwise 0.
 	double CheckPseudoTime();
 
-	// Internal helper for ExtractNextPacket().
+	// Internal helper for ExtractNextPacket(). Makes sure there's a
+	// current packet, fetching a new batch if the previous one has been
+	// processed.
 	bool ExtractNextPacketInternal();
 
+	// Returns the packet of the current batch that's next in line.
+	Packet* CurrentPacket()	{ return &batch[batch_pos]; }
+
+	// Determines the batch size from the source's properties, and
+	// (re-)allocates the batch.
+	void InitBatch();
+
 	// IOSource interface implementation.
 	void InitSource() override;
 	void Done() override;
@@ -365,7 +421,13 @@ private:
 	Properties props;
 
 	bool have_packet;
-	Packet current_packet;
+
+	// The packets of the current batch, of which [batch_pos, batch_len)
+	// remain to be processed.
+	Packet* batch;
+	int batch_size;
+	int batch_len;
+	int batch_pos;
 
 	// For BPF filtering support.
 	std::vector<BPF_Program *> filters;
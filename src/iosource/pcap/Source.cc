@@ -31,6 +31,8 @@ PcapSource::PcapSource(const std::string& path, bool is_live)
 
 void PcapSource::Open()
 	{
+	props.batch_size = BifConst::Pcap::batch_size;
+
 	if ( props.is_live )
 		OpenLive();
 	else
@@ -224,6 +226,58 @@ bool PcapSource::ExtractNextPacket(Packet* pkt)
 	return true;
 	}
 
+int PcapSource::ExtractNextPackets(Packet* pkts, int max)
+	{
+	if ( max <= 1 )
+		return ExtractNextPacket(pkts) ? 1 : 0;
+
+	if ( ! pd )
+		return 0;
+
+	int n = 0;
+
+	while ( n < max )
+		{
+		struct pcap_pkthdr* hdr;
+		const u_char* data;
+
+		if ( pcap_next_ex(pd, &hdr, &data) != 1 )
+			{
+			// See ExtractNextPacket(). If we still have packets
+			// buffered, the source gets closed on the next call.
+			if ( ! props.is_live && n == 0 )
+				Close();
+
+			break;
+			}
+
+		if ( hdr->len == 0 || hdr->caplen == 0 )
+			{
+			pkts[n].Init(props.link_type, &hdr->ts, hdr->caplen, hdr->len, data);
+			Weird("empty_pcap_header", &pkts[n]);
+			continue;
+			}
+
+		// libpcap reuses its memory for the next packet, so batched
+		// packets get copied into buffers of their own. That also
+		// lets the reassemblers keep referring to them. A buffer gets
+		// reused unless something still does.
+		auto buf = pkts[n].TakeBuffer();
+
+		if ( ! buf || buf->Shared() || buf->Capacity() < hdr->caplen )
+			buf = make_intrusive<PacketBuffer>(hdr->caplen);
+
+		memcpy(buf->Data(), data, hdr->caplen);
+		pkts[n].Init(props.link_type, &hdr->ts, hdr->caplen, hdr->len, std::move(buf));
+
+		++stats.received;
+		stats.bytes_received += hdr->len;
+		++n;
+		}
+
+	return n;
+	}
+
 void PcapSource::DoneWithPacket()
 	{
 	// Nothing to do.
@@ -0,0 +1,24 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "Source.h"
+#include "plugin/Plugin.h"
+#include "iosource/Component.h"
+
+namespace plugin {
+namespace Zeek_TPacket {
+
+class Plugin : public plugin::Plugin {
+public:
+	plugin::Configuration Configure() override
+		{
+		AddComponent(new ::iosource::PktSrcComponent("TPacketReader", "tpacket", ::iosource::PktSrcComponent::LIVE, ::iosource::tpacket::TPacketSource::Instantiate));
+
+		plugin::Configuration config;
+		config.name = "Zeek::TPacket";
+		config.description = "Packet acquisition via AF_PACKET TPACKET_V3 rings";
+		return config;
+		}
+} plugin;
+
+}
+}
@@ -0,0 +1,140 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "RX_Ring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+using namespace iosource::tpacket;
+
+RX_Ring::~RX_Ring()
+	{
+	Cleanup();
+	}
+
+bool RX_Ring::Init(int sock, uint32_t arg_block_size, uint32_t arg_num_blocks,
+                   uint32_t block_timeout_msec, std::string* err)
+	{
+	int version = TPACKET_V3;
+
+	if ( setsockopt(sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 )
+		{
+		*err = std::string("failed to set TPACKET_V3: ") + strerror(errno);
+		return false;
+		}
+
+	// With TPACKET_V3 frames are variably sized and packed into blocks,
+	// the frame size only needs to pass the kernel's sanity checks.
+	const uint32_t frame_size = TPACKET_ALIGNMENT << 7;
+
+	struct tpacket_req3 req;
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = arg_block_size;
+	req.tp_block_nr = arg_num_blocks;
+	req.tp_frame_size = frame_size;
+	req.tp_frame_nr = (arg_block_size / frame_size) * arg_num_blocks;
+	req.tp_retire_blk_tov = block_timeout_msec;
+	req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+
+	if ( setsockopt(sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0 )
+		{
+		*err = std::string("failed to set up receive ring: ") + strerror(errno);
+		return false;
+		}
+
+	ring_size = size_t(arg_block_size) * arg_num_blocks;
+	void* m = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE,
+	               MAP_SHARED | MAP_LOCKED | MAP_POPULATE, sock, 0);
+
+	if ( m == MAP_FAILED )
+		{
+		// Locking may fail due to RLIMIT_MEMLOCK, try again without.
+		m = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE,
+		         MAP_SHARED | MAP_POPULATE, sock, 0);
+
+		if ( m == MAP_FAILED )
+			{
+			*err = std::string("failed to map receive ring: ") + strerror(errno);
+			ring_size = 0;
+			return false;
+			}
+		}
+
+	ring = static_cast<uint8_t*>(m);
+	block_size = arg_block_size;
+	num_blocks = arg_num_blocks;
+	cur_block = 0;
+	block_acquired = false;
+	packets_left = 0;
+	cur_packet = next_packet = nullptr;
+
+	return true;
+	}
+
+const tpacket3_hdr* RX_Ring::NextPacket()
+	{
+	if ( ! ring )
+		return nullptr;
+
+	while ( ! block_acquired )
+		{
+		tpacket_block_desc* block = Block(cur_block);
+		uint32_t status = __atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE);
+
+		if ( ! (status & TP_STATUS_USER) )
+			return nullptr;
+
+		packets_left = block->hdr.bh1.num_pkts;
+
+		if ( packets_left == 0 )
+			{
+			ReleaseBlock();
+			continue;
+			}
+
+		next_packet = reinterpret_cast<const tpacket3_hdr*>(
+			reinterpret_cast<const uint8_t*>(block) + block->hdr.bh1.offset_to_first_pkt);
+		block_acquired = true;
+		}
+
+	cur_packet = next_packet;
+	next_packet = reinterpret_cast<const tpacket3_hdr*>(
+		reinterpret_cast<const uint8_t*>(cur_packet) + cur_packet->tp_next_offset);
+	--packets_left;
+
+	return cur_packet;
+	}
+
+void RX_Ring::ReleasePacket()
+	{
+	cur_packet = nullptr;
+
+	if ( block_acquired && packets_left == 0 )
+		ReleaseBlock();
+	}
+
+void RX_Ring::ReleaseBlock()
+	{
+	tpacket_block_desc* block = Block(cur_block);
+	__atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+
+	block_acquired = false;
+	next_packet = nullptr;
+	cur_block = (cur_block + 1) % num_blocks;
+	}
+
+void RX_Ring::Cleanup()
+	{
+	if ( ring )
+		munmap(ring, ring_size);
+
+	ring = nullptr;
+	ring_size = 0;
+	block_acquired = false;
+	packets_left = 0;
+	cur_packet = next_packet = nullptr;
+	}
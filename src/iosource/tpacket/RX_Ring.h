@@ -0,0 +1,90 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include <linux/if_packet.h>
+
+namespace iosource {
+namespace tpacket {
+
+/**
+ * A memory-mapped TPACKET_V3 receive ring attached to an AF_PACKET socket.
+ *
+ * The kernel fills the ring block by block; a block becomes visible to
+ * user space once it's full or its timeout expires.  Packets are handed
+ * out in place, and a block is returned to the kernel only after its last
+ * packet has been released, so packet data remains valid between
+ * NextPacket() and the corresponding ReleasePacket().
+ */
+class RX_Ring {
+public:
+	RX_Ring() = default;
+	~RX_Ring();
+
+	RX_Ring(const RX_Ring&) = delete;
+	RX_Ring& operator=(const RX_Ring&) = delete;
+
+	/**
+	 * Configures the socket for TPACKET_V3 and maps its receive ring.
+	 *
+	 * @param sock The AF_PACKET socket.
+	 *
+	 * @param block_size Size of a block in bytes, a power of two
+	 * multiple of the page size.
+	 *
+	 * @param num_blocks Number of blocks in the ring.
+	 *
+	 * @param block_timeout_msec Time after which the kernel retires a
+	 * partially filled block.
+	 *
+	 * @param err Receives an error message on failure.
+	 *
+	 * @return True on success.
+	 */
+	bool Init(int sock, uint32_t block_size, uint32_t num_blocks,
+	          uint32_t block_timeout_msec, std::string* err);
+
+	/**
+	 * Returns the next packet from the ring, or null if the kernel has
+	 * not handed over any further block yet.  Must be followed by
+	 * ReleasePacket() before the next call.
+	 */
+	const tpacket3_hdr* NextPacket();
+
+	/**
+	 * Releases the packet returned by the most recent NextPacket(),
+	 * returning its block to the kernel if it was the block's last one.
+	 */
+	void ReleasePacket();
+
+	/**
+	 * Unmaps the ring.
+	 */
+	void Cleanup();
+
+	uint32_t BlockSize() const	{ return block_size; }
+	uint32_t NumBlocks() const	{ return num_blocks; }
+
+private:
+	tpacket_block_desc* Block(uint32_t idx) const
+		{ return reinterpret_cast<tpacket_block_desc*>(ring + size_t(idx) * block_size); }
+
+	void ReleaseBlock();
+
+	uint8_t* ring = nullptr;
+	size_t ring_size = 0;
+	uint32_t block_size = 0;
+	uint32_t num_blocks = 0;
+
+	uint32_t cur_block = 0;
+	bool block_acquired = false;
+	uint32_t packets_left = 0;
+	const tpacket3_hdr* cur_packet = nullptr;
+	const tpacket3_hdr* next_packet = nullptr;
+};
+
+}
+}
@@ -0,0 +1,358 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "Source.h"
+#include "iosource/Packet.h"
+#include "iosource/BPF_Program.h"
+
+#include "Val.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_LINUX
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+#include "RX_Ring.h"
+#endif
+
+#include "tpacket.bif.h"
+
+using namespace iosource::tpacket;
+
+TPacketSource::~TPacketSource()
+	{
+	Close();
+	}
+
+TPacketSource::TPacketSource(const std::string& path, bool is_live)
+	{
+	props.path = path;
+	props.is_live = is_live;
+	socket_fd = -1;
+	if_index = 0;
+	ring = nullptr;
+	have_packet = false;
+	memset(&current_ts, 0, sizeof(current_ts));
+	}
+
+bool TPacketSource::PrecompileFilter(int index, const std::string& filter)
+	{
+	return PktSrc::PrecompileBPFFilter(index, filter);
+	}
+
+iosource::PktSrc* TPacketSource::Instantiate(const std::string& path, bool is_live)
+	{
+	return new TPacketSource(path, is_live);
+	}
+
+bool TPacketSource::CheckOptions()
+	{
+	bro_uint_t page_size = sysconf(_SC_PAGESIZE);
+	bro_uint_t block_size = BifConst::TPacket::block_size;
+
+	if ( block_size < page_size || block_size % page_size ||
+	     ((block_size / page_size) & (block_size / page_size - 1)) )
+		{
+		Error("TPacket::block_size must be a power of two multiple of the page size");
+		return false;
+		}
+
+	if ( BifConst::TPacket::buffer_size < block_size )
+		{
+		Error("TPacket::buffer_size must hold at least one block");
+		return false;
+		}
+
+	if ( BifConst::TPacket::fanout_id > 0xffff )
+		{
+		Error("TPacket::fanout_id must fit into 16 bits");
+		return false;
+		}
+
+	return true;
+	}
+
+#ifdef HAVE_LINUX
+
+void TPacketSource::Open()
+	{
+	if ( ! props.is_live )
+		{
+		Error("AF_PACKET sources can only read from network interfaces");
+		return;
+		}
+
+	if ( ! CheckOptions() )
+		return;
+
+	if_index = if_nametoindex(props.path.c_str());
+
+	if ( ! if_index )
+		{
+		Error(fmt("unknown interface %s", props.path.c_str()));
+		return;
+		}
+
+	socket_fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+
+	if ( socket_fd < 0 )
+		{
+		SocketError("socket");
+		return;
+		}
+
+	uint32_t block_size = BifConst::TPacket::block_size;
+	uint32_t num_blocks = BifConst::TPacket::buffer_size / block_size;
+	uint32_t block_timeout_msec = BifConst::TPacket::block_timeout * 1000;
+
+	if ( block_timeout_msec == 0 )
+		block_timeout_msec = 1;
+
+	ring = new RX_Ring();
+	std::string err;
+
+	if ( ! ring->Init(socket_fd, block_size, num_blocks, block_timeout_msec, &err) )
+		{
+		Error(fmt("%s (%s)", err.c_str(), props.path.c_str()));
+		Close();
+		return;
+		}
+
+	if ( ! BindInterface() || ! EnablePromisc() )
+		return;
+
+	if ( BifConst::TPacket::enable_fanout && ! JoinFanoutGroup() )
+		return;
+
+	props.selectable_fd = socket_fd;
+	props.netmask = NETMASK_UNKNOWN;
+	props.link_type = BifConst::TPacket::link_type;
+	props.is_live = true;
+	props.distributes_flows = BifConst::TPacket::enable_fanout;
+
+	Opened(props);
+	}
+
+bool TPacketSource::BindInterface()
+	{
+	struct sockaddr_ll addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sll_family = AF_PACKET;
+	addr.sll_protocol = htons(ETH_P_ALL);
+	addr.sll_ifindex = if_index;
+
+	if ( bind(socket_fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 )
+		{
+		SocketError("bind");
+		return false;
+		}
+
+	return true;
+	}
+
+bool TPacketSource::EnablePromisc()
+	{
+	struct packet_mreq mreq;
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.mr_ifindex = if_index;
+	mreq.mr_type = PACKET_MR_PROMISC;
+
+	if ( setsockopt(socket_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0 )
+		{
+		SocketError("PACKET_ADD_MEMBERSHIP");
+		return false;
+		}
+
+	return true;
+	}
+
+int TPacketSource::FanoutMode() const
+	{
+	switch ( BifConst::TPacket::fanout_mode->AsEnum() ) {
+	case BifEnum::TPacket::FANOUT_CPU:
+		return PACKET_FANOUT_CPU;
+
+	case BifEnum::TPacket::FANOUT_QM:
+		return PACKET_FANOUT_QM;
+
+	default:
+		return PACKET_FANOUT_HASH;
+	}
+	}
+
+bool TPacketSource::JoinFanoutGroup()
+	{
+	uint32_t mode = FanoutMode();
+
+	// Defragmentation makes sure all fragments of a datagram end up with
+	// the same process when hashing on the flow.
+	if ( BifConst::TPacket::enable_defrag )
+		mode |= PACKET_FANOUT_FLAG_DEFRAG;
+
+	uint32_t arg = (BifConst::TPacket::fanout_id & 0xffff) | (mode << 16);
+
+	if ( setsockopt(socket_fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0 )
+		{
+		SocketError("PACKET_FANOUT");
+		return false;
+		}
+
+	return true;
+	}
+
+void TPacketSource::Close()
+	{
+	if ( socket_fd < 0 )
+		return;
+
+	delete ring;
+	ring = nullptr;
+	have_packet = false;
+
+	close(socket_fd);
+	socket_fd = -1;
+
+	Closed();
+	}
+
+bool TPacketSource::ExtractNextPacket(Packet* pkt)
+	{
+	if ( ! ring )
+		return false;
+
+	const tpacket3_hdr* hdr = ring->NextPacket();
+
+	if ( ! hdr )
+		return false;
+
+	have_packet = true;
+
+	current_ts.tv_sec = hdr->tp_sec;
+	current_ts.tv_usec = hdr->tp_nsec / 1000;
+
+	const u_char* data = reinterpret_cast<const u_char*>(hdr) + hdr->tp_mac;
+	pkt->Init(props.link_type, &current_ts, hdr->tp_snaplen, hdr->tp_len, data);
+
+	// The kernel strips the outer 802.1Q tag for us, so restore the
+	// VLAN ID from the ring's metadata.
+	if ( (hdr->tp_status & TP_STATUS_VLAN_VALID) && ! pkt->vlan )
+		pkt->vlan = hdr->hv1.tp_vlan_tci & 0x0fff;
+
+	if ( hdr->tp_len == 0 || hdr->tp_snaplen == 0 )
+		{
+		Weird("empty_tpacket_header", pkt);
+		DoneWithPacket();
+		return false;
+		}
+
+	++stats.received;
+	stats.bytes_received += hdr->tp_len;
+
+	return true;
+	}
+
+void TPacketSource::DoneWithPacket()
+	{
+	if ( ring && have_packet )
+		ring->ReleasePacket();
+
+	have_packet = false;
+	}
+
+bool TPacketSource::SetFilter(int index)
+	{
+	if ( socket_fd < 0 )
+		return true; // Prevent error message
+
+	BPF_Program* code = GetBPFFilter(index);
+
+	if ( ! code )
+		{
+		Error(fmt("No precompiled filter for index %d", index));
+		return false;
+		}
+
+	bpf_program* prog = code->GetProgram();
+
+	struct sock_fprog fprog;
+	fprog.len = prog->bf_len;
+	fprog.filter = reinterpret_cast<struct sock_filter*>(prog->bf_insns);
+
+	if ( setsockopt(socket_fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0 )
+		{
+		SocketError("SO_ATTACH_FILTER");
+		return false;
+		}
+
+	return true;
+	}
+
+void TPacketSource::Statistics(Stats* s)
+	{
+	if ( socket_fd < 0 )
+		{
+		s->received = s->dropped = s->link = s->bytes_received = 0;
+		return;
+		}
+
+	// The kernel resets its counters on every read, so accumulate.
+	struct tpacket_stats_v3 tp_stats;
+	socklen_t len = sizeof(tp_stats);
+
+	if ( getsockopt(socket_fd, SOL_PACKET, PACKET_STATISTICS, &tp_stats, &len) == 0 )
+		stats.dropped += tp_stats.tp_drops;
+
+	s->received = stats.received;
+	s->bytes_received = stats.bytes_received;
+	s->dropped = stats.dropped;
+	s->link = stats.received + stats.dropped;
+	}
+
+void TPacketSource::SocketError(const char* where)
+	{
+	Error(fmt("%s failed on %s: %s", where, props.path.c_str(), strerror(errno)));
+	Close();
+	}
+
+#else
+
+void TPacketSource::Open()
+	{
+	if ( ! CheckOptions() )
+		return;
+
+	Error("TPACKET_V3 sources are only available on Linux");
+	}
+
+void TPacketSource::Close()
+	{
+	}
+
+bool TPacketSource::ExtractNextPacket(Packet* pkt)
+	{
+	return false;
+	}
+
+void TPacketSource::DoneWithPacket()
+	{
+	}
+
+bool TPacketSource::SetFilter(int index)
+	{
+	return true;
+	}
+
+void TPacketSource::Statistics(Stats* s)
+	{
+	s->received = s->dropped = s->link = s->bytes_received = 0;
+	}
+
+#endif
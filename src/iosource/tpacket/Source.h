@@ -0,0 +1,59 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include "../PktSrc.h"
+
+namespace iosource {
+namespace tpacket {
+
+class RX_Ring;
+
+/**
+ * A live packet source reading from Linux AF_PACKET sockets through a
+ * memory-mapped TPACKET_V3 ring, avoiding libpcap's per-packet copy.
+ *
+ * With TPacket::enable_fanout set, several Zeek processes opening the same
+ * interface with the same TPacket::fanout_id join one fanout group, and
+ * the kernel splits the traffic between them according to
+ * TPacket::fanout_mode.  Use as "-i tpacket::eth0".
+ *
+ * On other platforms than Linux, opening the source fails.
+ */
+class TPacketSource : public iosource::PktSrc {
+public:
+	TPacketSource(const std::string& path, bool is_live);
+	~TPacketSource() override;
+
+	static PktSrc* Instantiate(const std::string& path, bool is_live);
+
+protected:
+	// PktSrc interface.
+	void Open() override;
+	void Close() override;
+	bool ExtractNextPacket(Packet* pkt) override;
+	void DoneWithPacket() override;
+	bool PrecompileFilter(int index, const std::string& filter) override;
+	bool SetFilter(int index) override;
+	void Statistics(Stats* stats) override;
+
+private:
+	bool CheckOptions();
+	bool BindInterface();
+	bool EnablePromisc();
+	bool JoinFanoutGroup();
+	int FanoutMode() const;
+	void SocketError(const char* where);
+
+	Properties props;
+	Stats stats;
+
+	int socket_fd;
+	int if_index;
+	RX_Ring* ring;
+	bool have_packet;
+	pkt_timeval current_ts;
+};
+
+}
+}
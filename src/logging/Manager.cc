@@ -2,6 +2,7 @@
 
 #include "Manager.h"
 
+#include <algorithm>
 #include <utility>
 
 #include "Event.h"
@@ -55,7 +56,11 @@ struct Manager::Filter {
 	// Vector indexed by field number. Each element is a list of record
 	// indices defining a path leading to the value across potential
 	// sub-records.
-	vector<list<int> > indices;
+	vector<vector<int> > indices;
+
+	// Vector indexed by field number, giving the stream column for each
+	// field, or -1 for extension fields.
+	vector<int> columns;
 
 	~Filter();
 };
@@ -87,11 +92,183 @@ struct Manager::Stream {
 
 	WriterMap writers;	// Writers indexed by id/path pair.
 
+	// Paths of record indices to the values that the filters log, each
+	// path only once, so that filters logging the same value can share
+	// its lookup and conversion. Filters map their fields to these.
+	vector<vector<int> > columns_logged;
+
 	bool enable_remote;
 
 	~Stream();
 	};
 
+// A value that filters log, looked up in the record being written and, for
+// the types that take some work, prepared for conversion.
+struct Manager::CachedColumn {
+	bool resolved = false;
+	Val* val = nullptr;	// The value, or null if unset or unboxed.
+	RecordVal* rec = nullptr;	// Record holding the value if unboxed.
+	int field = 0;
+	TypeTag type = TYPE_VOID;	// Type, if str is set.
+	const char* str = nullptr;	// Enums, files, and functions.
+	int len = 0;
+	string desc;	// Holds str for files and functions.
+	ListVal* set = nullptr;	// A set's elements.
+
+	~CachedColumn()	{ Unref(set); }
+
+	void Reset()
+		{
+		Unref(set);
+		*this = CachedColumn();
+		}
+
+	// Follows the path of record indices from the given record and
+	// prepares the value found.
+	void Resolve(RecordVal* r, const vector<int>& path);
+
+	void SetString(TypeTag t, const char* s, int n)
+		{ type = t; str = s; len = n; }
+};
+
+// The values of a stream's columns in the record being written, each looked
+// up once for all the filters that log it. These point into the record, so
+// the cache needs to be cleared whenever script code may have changed it.
+class Manager::ColumnCache {
+public:
+	explicit ColumnCache(size_t n) : size(n)	{ }
+	~ColumnCache()	{ Clear(); }
+
+	const CachedColumn& Get(int column, RecordVal* rec, const vector<int>& path)
+		{
+		if ( size_t(column) >= size )
+			{
+			// From a filter that script code added while writing.
+			spare.Reset();
+			spare.Resolve(rec, path);
+			return spare;
+			}
+
+		if ( cached.empty() )
+			cached.resize(size);
+
+		CachedColumn& c = cached[column];
+
+		if ( ! c.resolved )
+			{
+			c.Resolve(rec, path);
+			resolved.push_back(column);
+			}
+
+		return c;
+		}
+
+	void Clear()
+		{
+		for ( auto i : resolved )
+			cached[i].Reset();
+
+		resolved.clear();
+		}
+
+private:
+	size_t size;
+	vector<CachedColumn> cached;
+	vector<int> resolved;
+	CachedColumn spare;
+};
+
+void Manager::CachedColumn::Resolve(RecordVal* r, const vector<int>& path)
+	{
+	resolved = true;
+
+	for ( size_t i = 0; i + 1 < path.size(); ++i )
+		{
+		Val* v = r->Lookup(path[i]);
+
+		if ( ! v )
+			// Any of the parents is not set.
+			return;
+
+		r = v->AsRecordVal();
+		}
+
+	int f = path.back();
+
+	// Fields stored unboxed get converted without creating a Val.
+	if ( r->HasUnboxedField(f) )
+		{
+		rec = r;
+		field = f;
+
+		BroType* t = r->Type()->AsRecordType()->FieldType(f);
+
+		if ( t->Tag() == TYPE_ENUM )
+			{
+			const char* s = t->AsEnumType()->Lookup(r->UnboxedInt(f));
+
+			if ( ! s )
+				{
+				t->Error("enum type does not contain value");
+				s = "";
+				}
+
+			SetString(TYPE_ENUM, s, strlen(s));
+			}
+
+		return;
+		}
+
+	val = r->Lookup(f);
+
+	if ( ! val )
+		return;
+
+	switch ( val->Type()->Tag() ) {
+	case TYPE_ENUM:
+		{
+		const char* s =
+			val->Type()->AsEnumType()->Lookup(val->InternalInt());
+
+		if ( ! s )
+			{
+			val->Type()->Error("enum type does not contain value", val);
+			s = "";
+			}
+
+		SetString(TYPE_ENUM, s, strlen(s));
+		break;
+		}
+
+	case TYPE_FILE:
+		desc = val->AsFile()->Name();
+		SetString(TYPE_FILE, desc.c_str(), desc.size());
+		break;
+
+	case TYPE_FUNC:
+		{
+		ODesc d;
+		val->AsFunc()->Describe(&d);
+		desc = d.Description();
+		SetString(TYPE_FUNC, desc.c_str(), desc.size());
+		break;
+		}
+
+	case TYPE_TABLE:
+		set = val->AsTableVal()->ConvertToPureList();
+
+		if ( ! set )
+			// ConvertToPureList has reported an internal warning
+			// already. Just keep going by making something up.
+			set = new ListVal(TYPE_INT);
+
+		break;
+
+	default:
+		break;
+	}
+	}
+
 Manager::Filter::~Filter()
 	{
 	Unref(fval);
@@ -388,7 +565,7 @@ bool Manager::DisableStream(EnumVal* id)
 
 // Helper for recursive record field unrolling.
 bool Manager::TraverseRecord(Stream* stream, Filter* filter, RecordType* rt,
-			    TableVal* include, TableVal* exclude, const string& path, const list<int>& indices)
+			    TableVal* include, TableVal* exclude, const string& path, const vector<int>& indices)
 	{
 	// Only include extensions for the outer record.
 	int num_ext_fields = (indices.size() == 0) ? filter->num_ext_fields : 0;
@@ -415,7 +592,7 @@ bool Manager::TraverseRecord(Stream* stream, Filter* filter, RecordType* rt,
 		if ( ! rtype->FieldDecl(i)->FindAttr(ATTR_LOG) )
 			continue;
 
-		list<int> new_indices = indices;
+		vector<int> new_indices = indices;
 		new_indices.push_back(i);
 
 		// Build path name.
@@ -609,12 +786,30 @@ bool Manager::AddFilter(EnumVal* id, RecordVal* fval)
 	if ( ! TraverseRecord(stream, filter, stream->columns,
 			      include ? include->AsTableVal() : nullptr,
 			      exclude ? exclude->AsTableVal() : nullptr,
-			      "", list<int>()) )
+			      "", vector<int>()) )
 		{
 		delete filter;
 		return false;
 		}
 
+	// Find the stream columns of the fields, adding any the stream's
+	// filters don't log yet.
+	for ( int i = 0; i < filter->num_fields; ++i )
+		{
+		if ( i < filter->num_ext_fields )
+			{
+			filter->columns.push_back(-1);
+			continue;
+			}
+
+		auto& logged = stream->columns_logged;
+		auto c = std::find(logged.begin(), logged.end(), filter->indices[i]);
+		filter->columns.push_back(c - logged.begin());
+
+		if ( c == logged.end() )
+			logged.push_back(filter->indices[i]);
+		}
+
 	// Get the path for the filter.
 	auto path_val = fval->Lookup("path");
 
@@ -713,6 +908,8 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 	if ( stream->event )
 		mgr.Enqueue(stream->event, columns);
 
+	ColumnCache cache(stream->columns_logged.size());
+
 	// Send to each of our filters.
 	for ( list<Filter*>::iterator i = stream->filters.begin();
 	      i != stream->filters.end(); ++i )
@@ -726,6 +923,7 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 			// to log this record.
 			int result = 1;
 			auto v = filter->pred->Call(columns);
+			cache.Clear();
 
 			if ( v )
 				result = v->AsBool();
@@ -755,6 +953,7 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 			auto v = filter->path_func->Call(IntrusivePtr{NewRef{}, id},
 			                                 std::move(path_arg),
 			                                 std::move(rec_arg));
+			cache.Clear();
 
 			if ( ! v )
 				return false;
@@ -888,7 +1087,21 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 
 		// Alright, can do the write now.
 
-		threading::Value** vals = RecordToFilterVals(stream, filter, columns.get());
+		if ( ! writer->Remote() && ! plugin_mgr->HavePluginForHook(plugin::HOOK_LOG_WRITE) )
+			{
+			// Nothing needs to see the record as a list of
+			// values, so convert it straight into the writer's
+			// batch.
+			RecordToFilterBatch(stream, filter, columns.get(), writer, &cache);
+
+#ifdef DEBUG
+			DBG_LOG(DBG_LOGGING, "Wrote record to filter '%s' on stream '%s'",
+				filter->name.c_str(), stream->name.c_str());
+#endif
+			continue;
+			}
+
+		threading::Value** vals = RecordToFilterVals(stream, filter, columns.get(), &cache);
 
 		if ( ! PLUGIN_HOOK_WITH_RESULT(HOOK_LOG_WRITE,
 		                               HookLogWrite(filter->writer->Type()->AsEnumType()->Lookup(filter->writer->InternalInt()),
@@ -1052,14 +1265,71 @@ threading::Value* Manager::ValToLogVal(Val* val, BroType* ty)
 	return lval;
 	}
 
+threading::Value* Manager::UnboxedToLogVal(RecordVal* rec, int field)
+	{
+	// Keep this in sync with ValToLogVal().
+	BroType* ty = rec->Type()->AsRecordType()->FieldType(field);
+	threading::Value* lval = new threading::Value(ty->Tag());
+
+	switch ( lval->type ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+		lval->val.int_val = rec->UnboxedInt(field);
+		break;
+
+	case TYPE_ENUM:
+		{
+		const char* s = ty->AsEnumType()->Lookup(rec->UnboxedInt(field));
+
+		if ( ! s )
+			{
+			ty->Error("enum type does not contain value");
+			s = "";
+			}
+
+		lval->val.string_val.data = copy_string(s);
+		lval->val.string_val.length = strlen(s);
+		break;
+		}
+
+	case TYPE_COUNT:
+		lval->val.uint_val = rec->UnboxedUnsigned(field);
+		break;
+
+	case TYPE_PORT:
+		{
+		const auto& p = val_mgr->Port(rec->UnboxedUnsigned(field));
+		lval->val.port_val.port = p->Port();
+		lval->val.port_val.proto = p->PortType();
+		break;
+		}
+
+	case TYPE_ADDR:
+		rec->UnboxedAddr(field).ConvertToThreadingValue(&lval->val.addr_val);
+		break;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		lval->val.double_val = rec->UnboxedDouble(field);
+		break;
+
+	default:
+		reporter->InternalError("unsupported unboxed type %s for log_write", type_name(lval->type));
+	}
+
+	return lval;
+	}
+
 threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
-                                               RecordVal* columns)
+                                               RecordVal* columns, ColumnCache* cache)
 	{
 	IntrusivePtr<RecordVal> ext_rec;
 
 	if ( filter->num_ext_fields > 0 )
 		{
 		auto res = filter->ext_func->Call(IntrusivePtr{NewRef{}, filter->path_val});
+		cache->Clear();
 
 		if ( res )
 			ext_rec = {AdoptRef{}, res.release()->AsRecordVal()};
@@ -1069,42 +1339,311 @@ threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
 
 	for ( int i = 0; i < filter->num_fields; ++i )
 		{
-		Val* val;
-		if ( i < filter->num_ext_fields )
+		if ( i >= filter->num_ext_fields )
 			{
-			if ( ! ext_rec )
-				{
-				// executing function did not return record. Send empty for all vals.
-				vals[i] = new threading::Value(filter->fields[i]->type, false);
-				continue;
-				}
+			// Shared with the other filters.
+			const CachedColumn& c = cache->Get(filter->columns[i], columns, filter->indices[i]);
+			vals[i] = ColumnToLogVal(c, filter->fields[i]->type);
+			continue;
+			}
 
-			val = ext_rec.get();
+		if ( ! ext_rec )
+			{
+			// executing function did not return record. Send empty for all vals.
+			vals[i] = new threading::Value(filter->fields[i]->type, false);
+			continue;
 			}
-		else
-			val = columns;
 
-		// For each field, first find the right value, which can
-		// potentially be nested inside other records.
-		list<int>& indices = filter->indices[i];
+		CachedColumn c;
+		c.Resolve(ext_rec.get(), filter->indices[i]);
+		vals[i] = ColumnToLogVal(c, filter->fields[i]->type);
+		}
+
+	return vals;
+	}
+
+threading::Value* Manager::ColumnToLogVal(const CachedColumn& c, TypeTag type)
+	{
+	if ( c.str )
+		{
+		threading::Value* lval = new threading::Value(c.type);
+		lval->val.string_val.data = copy_string(c.str);
+		lval->val.string_val.length = c.len;
+		return lval;
+		}
+
+	if ( c.rec )
+		return UnboxedToLogVal(c.rec, c.field);
+
+	if ( ! c.val )
+		// Value, or any of its parents, is not set.
+		return new threading::Value(type, false);
+
+	if ( ! c.set )
+		return ValToLogVal(c.val);
+
+	threading::Value* lval = new threading::Value(TYPE_TABLE);
+	lval->val.set_val.size = c.set->Length();
+	lval->val.set_val.vals = new threading::Value* [lval->val.set_val.size];
+
+	for ( int i = 0; i < lval->val.set_val.size; i++ )
+		lval->val.set_val.vals[i] = ValToLogVal(c.set->Index(i));
+
+	return lval;
+	}
+
+void Manager::RecordToFilterBatch(Stream* stream, Filter* filter,
+                                  RecordVal* columns, WriterFrontend* writer,
+                                  ColumnCache* cache)
+	{
+	IntrusivePtr<RecordVal> ext_rec;
+
+	if ( filter->num_ext_fields > 0 )
+		{
+		auto res = filter->ext_func->Call(IntrusivePtr{NewRef{}, filter->path_val});
+		cache->Clear();
+
+		if ( res )
+			ext_rec = {AdoptRef{}, res.release()->AsRecordVal()};
+		}
+
+	threading::RecordBatch* batch = writer->BatchForWrite();
+
+	if ( ! batch )
+		return;
+
+	// All columns start out unset.
+	batch->AddRow();
 
-		for ( list<int>::iterator j = indices.begin(); j != indices.end(); ++j )
+	for ( int i = 0; i < filter->num_fields; ++i )
+		{
+		if ( i >= filter->num_ext_fields )
 			{
-			val = val->AsRecordVal()->Lookup(*j);
+			// Shared with the other filters.
+			ColumnToLogCell(batch, i, cache->Get(filter->columns[i], columns,
+			                                     filter->indices[i]));
+			continue;
+			}
 
-			if ( ! val )
-				{
-				// Value, or any of its parents, is not set.
-				vals[i] = new threading::Value(filter->fields[i]->type, false);
-				break;
-				}
+		if ( ! ext_rec )
+			// executing function did not return record.
+			continue;
+
+		CachedColumn c;
+		c.Resolve(ext_rec.get(), filter->indices[i]);
+		ColumnToLogCell(batch, i, c);
+		}
+
+	writer->FinishBatchWrite();
+	}
+
+void Manager::ColumnToLogCell(threading::RecordBatch* batch, int col,
+                              const CachedColumn& c)
+	{
+	if ( c.str )
+		{
+		batch->Set(col).ref = batch->AddString(c.str, c.len);
+		return;
+		}
+
+	if ( c.rec )
+		{
+		UnboxedToLogCell(batch, col, c.rec, c.field);
+		return;
+		}
+
+	if ( ! c.val )
+		// Value, or any of its parents, is not set.
+		return;
+
+	if ( ! c.set )
+		{
+		ValToLogCell(batch, col, c.val);
+		return;
+		}
+
+	batch->StartContainer(col);
+
+	for ( int i = 0; i < c.set->Length(); i++ )
+		ValToLogCell(batch, col, c.set->Index(i), nullptr, true);
+	}
+
+void Manager::UnboxedToLogCell(threading::RecordBatch* batch, int col,
+                               RecordVal* rec, int field)
+	{
+	// Keep this in sync with ValToLogCell().
+	BroType* ty = rec->Type()->AsRecordType()->FieldType(field);
+	threading::RecordBatch::Cell& c = batch->Set(col);
+
+	switch ( ty->Tag() ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+		c.int_val = rec->UnboxedInt(field);
+		break;
+
+	case TYPE_ENUM:
+		{
+		const char* s = ty->AsEnumType()->Lookup(rec->UnboxedInt(field));
+
+		if ( ! s )
+			{
+			ty->Error("enum type does not contain value");
+			s = "";
 			}
 
-		if ( val )
-			vals[i] = ValToLogVal(val);
+		c.ref = batch->AddString(s, strlen(s));
+		break;
 		}
 
-	return vals;
+	case TYPE_COUNT:
+		c.uint_val = rec->UnboxedUnsigned(field);
+		break;
+
+	case TYPE_PORT:
+		{
+		const auto& p = val_mgr->Port(rec->UnboxedUnsigned(field));
+		c.port_val.port = p->Port();
+		c.port_val.proto = p->PortType();
+		break;
+		}
+
+	case TYPE_ADDR:
+		rec->UnboxedAddr(field).ConvertToThreadingValue(&c.addr_val);
+		break;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		c.double_val = rec->UnboxedDouble(field);
+		break;
+
+	default:
+		reporter->InternalError("unsupported unboxed type %s for log_write", type_name(ty->Tag()));
+	}
+	}
+
+void Manager::ValToLogCell(threading::RecordBatch* batch, int col, Val* val,
+                           BroType* ty, bool element)
+	{
+	// Keep this in sync with ValToLogVal().
+	if ( ! val )
+		{
+		if ( element )
+			batch->AddUnsetElement(col);
+
+		return;
+		}
+
+	if ( ! ty )
+		ty = val->Type();
+
+	TypeTag tag = ty->Tag();
+
+	if ( tag == TYPE_TABLE )
+		{
+		ListVal* set = val->AsTableVal()->ConvertToPureList();
+		if ( ! set )
+			// ConvertToPureList has reported an internal warning
+			// already. Just keep going by making something up.
+			set = new ListVal(TYPE_INT);
+
+		batch->StartContainer(col);
+
+		for ( int i = 0; i < set->Length(); i++ )
+			ValToLogCell(batch, col, set->Index(i), nullptr, true);
+
+		Unref(set);
+		return;
+		}
+
+	if ( tag == TYPE_VECTOR )
+		{
+		VectorVal* vec = val->AsVectorVal();
+		batch->StartContainer(col);
+
+		for ( unsigned int i = 0; i < vec->Size(); i++ )
+			ValToLogCell(batch, col, vec->Lookup(i),
+				     vec->Type()->YieldType(), true);
+
+		return;
+		}
+
+	threading::RecordBatch::Cell& c = element ? batch->AddElement(col) : batch->Set(col);
+
+	switch ( tag ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+		c.int_val = val->InternalInt();
+		break;
+
+	case TYPE_ENUM:
+		{
+		const char* s =
+			val->Type()->AsEnumType()->Lookup(val->InternalInt());
+
+		if ( s )
+			c.ref = batch->AddString(s, strlen(s));
+
+		else
+			{
+			val->Type()->Error("enum type does not contain value", val);
+			c.ref = batch->AddString("", 0);
+			}
+		break;
+		}
+
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+		c.uint_val = val->InternalUnsigned();
+		break;
+
+	case TYPE_PORT:
+		c.port_val.port = val->AsPortVal()->Port();
+		c.port_val.proto = val->AsPortVal()->PortType();
+		break;
+
+	case TYPE_SUBNET:
+		val->AsSubNet().ConvertToThreadingValue(&c.subnet_val);
+		break;
+
+	case TYPE_ADDR:
+		val->AsAddr().ConvertToThreadingValue(&c.addr_val);
+		break;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		c.double_val = val->InternalDouble();
+		break;
+
+	case TYPE_STRING:
+		{
+		const BroString* s = val->AsString();
+		c.ref = batch->AddString((const char*)s->Bytes(), s->Len());
+		break;
+		}
+
+	case TYPE_FILE:
+		{
+		const BroFile* f = val->AsFile();
+		string s = f->Name();
+		c.ref = batch->AddString(s.data(), s.size());
+		break;
+		}
+
+	case TYPE_FUNC:
+		{
+		ODesc d;
+		const Func* f = val->AsFunc();
+		f->Describe(&d);
+		const char* s = d.Description();
+		c.ref = batch->AddString(s, strlen(s));
+		break;
+		}
+
+	default:
+		reporter->InternalError("unsupported type %s for log_write", type_name(tag));
+	}
 	}
 
 bool Manager::CreateWriterForRemoteLog(EnumVal* id, EnumVal* writer, WriterBackend::WriterInfo* info,
@@ -254,14 +254,30 @@ private:
 	struct Filter;
 	struct Stream;
 	struct WriterInfo;
+	struct CachedColumn;
+	class ColumnCache;
 
 	bool TraverseRecord(Stream* stream, Filter* filter, RecordType* rt,
-			    TableVal* include, TableVal* exclude, const std::string& path, const std::list<int>& indices);
+			    TableVal* include, TableVal* exclude, const std::string& path, const std::vector<int>& indices);
 
 	threading::Value** RecordToFilterVals(Stream* stream, Filter* filter,
-				    RecordVal* columns);
+				    RecordVal* columns, ColumnCache* cache);
 
 	threading::Value* ValToLogVal(Val* val, BroType* ty = nullptr);
+	threading::Value* UnboxedToLogVal(RecordVal* rec, int field);
+	threading::Value* ColumnToLogVal(const CachedColumn& c, TypeTag type);
+
+	void RecordToFilterBatch(Stream* stream, Filter* filter,
+				 RecordVal* columns, WriterFrontend* writer,
+				 ColumnCache* cache);
+
+	void ValToLogCell(threading::RecordBatch* batch, int col, Val* val,
+			  BroType* ty = nullptr, bool element = false);
+	void UnboxedToLogCell(threading::RecordBatch* batch, int col,
+			      RecordVal* rec, int field);
+	void ColumnToLogCell(threading::RecordBatch* batch, int col,
+			     const CachedColumn& c);
+
 	Stream* FindStream(EnumVal* id);
 	void RemoveDisabledWriters(Stream* stream);
 	void InstallRotationTimer(WriterInfo* winfo);
@@ -126,6 +126,7 @@ WriterBackend::WriterBackend(WriterFrontend* arg_frontend) : MsgThread()
 	frontend = arg_frontend;
 	info = new WriterInfo(frontend->Info());
 	rotation_counter = 0;
+	batch_row = nullptr;
 
 	SetName(frontend->Name());
 	}
@@ -141,6 +142,7 @@ WriterBackend::~WriterBackend()
 		}
 
 	delete info;
+	delete batch_row;
 	}
 
 void WriterBackend::DeleteVals(int num_writes, Value*** vals)
@@ -253,6 +255,65 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 	return success;
 	}
 
+bool WriterBackend::WriteBatch(threading::RecordBatch* batch)
+	{
+	// Double-check that the columns match. If we get this from remote,
+	// something might be mixed up.
+	if ( num_fields != batch->NumFields() )
+		{
+#ifdef DEBUG
+		const char* msg = Fmt("Number of fields don't match in WriterBackend::WriteBatch() (%d vs. %d)",
+				      batch->NumFields(), num_fields);
+		Debug(DBG_LOGGING, msg);
+#endif
+
+		delete batch;
+		DisableFrontend();
+		return false;
+		}
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		if ( batch->Type(i) != fields[i]->type )
+			{
+#ifdef DEBUG
+			const char* msg = Fmt("Field #%d type doesn't match in WriterBackend::WriteBatch() (%d vs. %d)",
+					      i, batch->Type(i), fields[i]->type);
+			Debug(DBG_LOGGING, msg);
+#endif
+			delete batch;
+			DisableFrontend();
+			return false;
+			}
+		}
+
+	bool success = true;
+
+	if ( ! Failed() && ! batch->Empty() )
+		success = DoWriteBatch(*batch);
+
+	delete batch;
+
+	if ( ! success )
+		DisableFrontend();
+
+	return success;
+	}
+
+bool WriterBackend::DoWriteBatch(const threading::RecordBatch& batch)
+	{
+	if ( ! batch_row )
+		batch_row = new threading::RecordBatchRow(num_fields);
+
+	for ( int j = 0; j < batch.NumRows(); j++ )
+		{
+		if ( ! DoWrite(num_fields, fields, batch_row->Fill(batch, j)) )
+			return false;
+		}
+
+	return true;
+	}
+
 bool WriterBackend::SetBuf(bool enabled)
 	{
 	if ( enabled == buffering )
@@ -5,6 +5,7 @@
 #pragma once
 
 #include "threading/MsgThread.h"
+#include "threading/RecordBatch.h"
 
 #include "Component.h"
 
@@ -149,6 +150,19 @@ public:
 	 */
 	bool Write(int num_fields, int num_writes, threading::Value*** vals);
 
+	/**
+	 * Writes a batch of log entries.
+	 *
+	 * @param batch The entries. Its columns must match the fields passed
+	 * to Init(). The method takes ownership of the batch.
+	 *
+	 * Returns false if an error occured, in which case the writer must
+	 * not be used any further.
+	 *
+	 * @return False if an error occured.
+	 */
+	bool WriteBatch(threading::RecordBatch* batch);
+
 	/**
 	 * Sets the buffering status for the writer, assuming the writer
 	 * supports that. (If not, it will be ignored).
@@ -280,6 +294,24 @@ protected:
 	virtual bool DoWrite(int num_fields, const threading::Field* const*  fields,
 			     threading::Value** vals) = 0;
 
+	/**
+	 * Writer-specific output method implementing recording of a batch
+	 * of log entries.
+	 *
+	 * A writer implementation may override this method to process
+	 * batches directly, which avoids setting up threading::Value objects
+	 * for each entry. The default implementation passes each entry on to
+	 * DoWrite(), so writers that don't override it keep working
+	 * unchanged.
+	 *
+	 * If the method returns false, it will be assumed that a fatal error
+	 * has occured that prevents the writer from further operation; it
+	 * will then be disabled and eventually deleted. When returning
+	 * false, an implementation should also call Error() to indicate what
+	 * happened.
+	 */
+	virtual bool DoWriteBatch(const threading::RecordBatch& batch);
+
 	/**
 	 * Writer-specific method implementing a change of fthe buffering
 	 * state.  If buffering is disabled, the writer should attempt to
@@ -385,6 +417,9 @@ private:
 	bool buffering;	// True if buffering is enabled.
 
 	int rotation_counter; // Tracks FinishedRotation() calls.
+
+	// Reused by the default DoWriteBatch() to pass entries to DoWrite().
+	threading::RecordBatchRow* batch_row;
 };
 
 
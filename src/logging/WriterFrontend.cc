@@ -52,19 +52,17 @@ private:
 	const bool terminating;
 };
 
-class WriteMessage final : public threading::InputMessage<WriterBackend>
+class WriteBatchMessage final : public threading::InputMessage<WriterBackend>
 {
 public:
-	WriteMessage(WriterBackend* backend, int num_fields, int num_writes, Value*** vals)
-		: threading::InputMessage<WriterBackend>("Write", backend),
-		num_fields(num_fields), num_writes(num_writes), vals(vals)	{}
+	WriteBatchMessage(WriterBackend* backend, threading::RecordBatch* batch)
+		: threading::InputMessage<WriterBackend>("WriteBatch", backend),
+		batch(batch)	{}
 
-	bool Process() override { return Object()->Write(num_fields, num_writes, vals); }
+	bool Process() override { return Object()->WriteBatch(batch); }
 
 private:
-	int num_fields;
-	int num_writes;
-	Value ***vals;
+	threading::RecordBatch* batch;
 };
 
 class SetBufMessage final : public threading::InputMessage<WriterBackend>
@@ -109,8 +107,7 @@ WriterFrontend::WriterFrontend(const WriterBackend::WriterInfo& arg_info, EnumVa
 	buf = true;
 	local = arg_local;
 	remote = arg_remote;
-	write_buffer = nullptr;
-	write_buffer_pos = 0;
+	write_batch = nullptr;
 	info = new WriterBackend::WriterInfo(arg_info);
 
 	num_fields = 0;
@@ -142,6 +139,7 @@ WriterFrontend::~WriterFrontend()
 	Unref(writer);
 	delete info;
 	delete [] name;
+	delete write_batch;
 	}
 
 void WriterFrontend::Stop()
@@ -220,33 +218,49 @@ void WriterFrontend::Write(int arg_num_fields, Value** vals)
 		return;
 		}
 
-	if ( ! write_buffer )
-		{
+	threading::RecordBatch* batch = BatchForWrite();
+
+	if ( ! batch->AddRow(num_fields, vals) )
+		reporter->Warning("WriterFrontend %s got mismatching field types in write. Skipping line.", name);
+
+	DeleteVals(num_fields, vals);
+	FinishBatchWrite();
+	}
+
+threading::RecordBatch* WriterFrontend::BatchForWrite()
+	{
+	if ( disabled || ! backend )
+		return nullptr;
+
+	if ( ! write_batch )
 		// Need new buffer.
-		write_buffer = new Value**[WRITER_BUFFER_SIZE];
-		write_buffer_pos = 0;
-		}
+		write_batch = new threading::RecordBatch(num_fields, fields);
 
-	write_buffer[write_buffer_pos++] = vals;
+	return write_batch;
+	}
 
-	if ( write_buffer_pos >= WRITER_BUFFER_SIZE || ! buf || terminating )
+void WriterFrontend::FinishBatchWrite()
+	{
+	if ( write_batch->NumRows() >= WRITER_BUFFER_SIZE || ! buf || terminating )
 		// Buffer full (or no bufferin desired or termiating).
 		FlushWriteBuffer();
-
 	}
 
 void WriterFrontend::FlushWriteBuffer()
 	{
-	if ( ! write_buffer_pos )
+	if ( ! write_batch || write_batch->Empty() )
 		// Nothing to do.
 		return;
 
 	if ( backend )
-		backend->SendIn(new WriteMessage(backend, num_fields, write_buffer_pos, write_buffer));
+		{
+		// No delete, we pass ownership to child thread.
+		backend->SendIn(new WriteBatchMessage(backend, write_batch));
+		write_batch = nullptr;
+		}
 
-	// Clear buffer (no delete, we pass ownership to child thread.)
-	write_buffer = nullptr;
-	write_buffer_pos = 0;
+	else
+		write_batch->Clear();
 	}
 
 void WriterFrontend::SetBuf(bool enabled)
@@ -92,6 +92,30 @@ public:
 	 */
 	void Write(int num_fields, threading::Value** vals);
 
+	/**
+	 * Returns the batch that buffered writes go into, for appending a
+	 * record to it directly instead of passing it to Write(). After
+	 * adding one row to the batch, the caller must call
+	 * FinishBatchWrite().
+	 *
+	 * This bypasses publishing the record to remote peers, so it must
+	 * be used only with writers for which Remote() returns false.
+	 *
+	 * This method must only be called from the main thread.
+	 *
+	 * @return The batch, or null if the record is to be discarded
+	 * because the writer has been disabled or has no local backend.
+	 */
+	threading::RecordBatch* BatchForWrite();
+
+	/**
+	 * Completes a write started with BatchForWrite(), sending the
+	 * buffered records to the backend as Write() would.
+	 *
+	 * This method must only be called from the main thread.
+	 */
+	void FinishBatchWrite();
+
 	/**
 	 * Sets the buffering state.
 	 *
@@ -182,6 +206,11 @@ public:
 	 */
 	const threading::Field* const * Fields() const	{ return fields; }
 
+	/**
+	 * Returns true if the writer forwards records to remote peers.
+	 */
+	bool Remote() const	{ return remote; }
+
 protected:
 	friend class Manager;
 
@@ -204,8 +233,7 @@ protected:
 
 	// Buffer for bulk writes.
 	static const int WRITER_BUFFER_SIZE = 1000;
-	int write_buffer_pos;	// Position of next write in buffer.
-	threading::Value*** write_buffer;	// Buffer of size WRITER_BUFFER_SIZE.
+	threading::RecordBatch* write_batch;	// Buffer of up to WRITER_BUFFER_SIZE records.
 };
 
 }
@@ -1,10 +1,12 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
 #include <string>
+#include <vector>
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 
+#include "threading/Manager.h"
 #include "threading/SerialTypes.h"
 
 #include "Ascii.h"
@@ -27,7 +29,9 @@ Ascii::Ascii(WriterFrontend* frontend) : WriterBackend(frontend)
 	enable_utf_8 = false;
 	formatter = nullptr;
 	gzip_level = 0;
-	gzfile = nullptr;
+	rotation_gzip_level = 0;
+	compressor = nullptr;
+	compression_backlog = 0;
 
 	InitConfigOptions();
 	init_options = InitFilterOptions();
@@ -40,6 +44,13 @@ void Ascii::InitConfigOptions()
 	use_json = BifConst::LogAscii::use_json;
 	enable_utf_8 = BifConst::LogAscii::enable_utf_8;
 	gzip_level = BifConst::LogAscii::gzip_level;
+	rotation_gzip_level = BifConst::LogAscii::rotation_gzip_level;
+
+	// Compression shares the thread pool with the writers if there's one.
+	if ( auto pool = thread_mgr->Pool() )
+		detail::BlockCompressor::SetThreadPool(pool);
+	else
+		detail::BlockCompressor::SetThreads(BifConst::LogAscii::gzip_threads);
 
 	separator.assign(
 			(const char*) BifConst::LogAscii::separator->Bytes(),
@@ -110,6 +121,18 @@ bool Ascii::InitFilterOptions()
 				return false;
 				}
 			}
+
+		else if ( strcmp(i->first, "rotation_gzip_level" ) == 0 )
+			{
+			rotation_gzip_level = atoi(i->second);
+
+			if ( rotation_gzip_level < 0 || rotation_gzip_level > 9 )
+				{
+				Error("invalid value for 'rotation_gzip_level', must be a number between 0 and 9.");
+				return false;
+				}
+			}
+
 		else if ( strcmp(i->first, "use_json") == 0 )
 			{
 			if ( strcmp(i->second, "T") == 0 )
@@ -246,7 +269,6 @@ void Ascii::CloseFile(double t)
 
 	InternalClose(fd);
 	fd = 0;
-	gzfile = nullptr;
 	}
 
 bool Ascii::DoInit(const WriterInfo& info, int num_fields, const Field* const * fields)
@@ -287,21 +309,7 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const Field* const *
 			return false;
 			}
 
-		char mode[4];
-		snprintf(mode, sizeof(mode), "wb%d", gzip_level);
-		errno = 0; // errno will only be set under certain circumstances by gzdopen.
-		gzfile = gzdopen(fd, mode);
-
-		if ( gzfile == nullptr )
-			{
-			Error(Fmt("cannot gzip %s: %s", fname.c_str(),
-			                                Strerror(errno)));
-			return false;
-			}
-		}
-	else
-		{
-		gzfile = nullptr;
+		compressor = new detail::BlockCompressor(fd, gzip_level, &compression_backlog);
 		}
 
 	if ( ! WriteHeader(path) )
@@ -310,6 +318,9 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const Field* const *
 		return false;
 		}
 
+	// Decide once how to render each column, the rows all follow it.
+	formatter->Compile(num_fields, fields);
+
 	return true;
 	}
 
@@ -367,6 +378,14 @@ bool Ascii::WriteHeader(const string& path)
 
 bool Ascii::DoFlush(double network_time)
 	{
+	// Small amounts of output wait for more rather than becoming a gzip
+	// member of their own; closing the file writes them out.
+	if ( compressor && ! compressor->Flush(detail::BlockCompressor::MIN_FLUSH_SIZE) )
+		{
+		Error(Fmt("error writing to %s: %s", fname.c_str(), compressor->Error().c_str()));
+		return false;
+		}
+
 	fsync(fd);
 	return true;
 	}
@@ -430,6 +449,62 @@ write_error:
 	return false;
 	}
 
+bool Ascii::DoWriteBatch(const threading::RecordBatch& batch)
+	{
+	if ( ! fd )
+		DoInit(Info(), NumFields(), Fields());
+
+	// Render all lines into the buffer first, then write them out at
+	// once.
+	desc.Clear();
+
+	// Lines that would be mistaken for meta data need their first
+	// character escaped. Everything before such a line gets written
+	// out directly, so that the escape can go in between.
+	std::vector<int> escapes;
+
+	for ( int j = 0; j < batch.NumRows(); j++ )
+		{
+		int start = desc.Len();
+
+		if ( ! formatter->Describe(&desc, NumFields(), Fields(), batch, j) )
+			return false;
+
+		desc.AddRaw("\n", 1);
+
+		if ( strncmp((const char*)desc.Bytes() + start, meta_prefix.data(), meta_prefix.size()) == 0 )
+			escapes.push_back(start);
+		}
+
+	const char* bytes = (const char*)desc.Bytes();
+	int len = desc.Len();
+	int pos = 0;
+
+	for ( auto start : escapes )
+		{
+		char hex[4] = {'\\', 'x', '0', '0'};
+		bytetohex(bytes[start], hex + 2);
+
+		if ( ! InternalWrite(fd, bytes + pos, start - pos) ||
+		     ! InternalWrite(fd, hex, 4) )
+			goto write_error;
+
+		pos = start + 1;
+		}
+
+	if ( ! InternalWrite(fd, bytes + pos, len - pos) )
+		goto write_error;
+
+	if ( ! IsBuf() )
+		fsync(fd);
+
+	return true;
+
+write_error:
+	Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
+	return false;
+	}
+
 bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool terminating)
 	{
 	// Don't rotate special files or if there's not one currently open.
@@ -442,14 +517,31 @@ bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool t
 	CloseFile(close);
 
 	string nname = string(rotated_path) + "." + LogExt();
+	string ext = gzip_file_extension.empty() ? "gz" : gzip_file_extension;
+	bool compressed = false;
 
 	if ( gzip_level > 0 )
+		nname += "." + ext;
+
+	else if ( rotation_gzip_level > 0 )
 		{
-		nname += ".";
-		nname += gzip_file_extension.empty() ? "gz" : gzip_file_extension;
+		// Compress the file in-process instead of leaving that to a
+		// postprocessor command; this removes the original.
+		string error;
+
+		if ( detail::BlockCompressor::CompressFile(fname, nname + "." + ext,
+		                                           rotation_gzip_level,
+		                                           &compression_backlog, &error) )
+			{
+			nname += "." + ext;
+			compressed = true;
+			}
+		else
+			Warning(Fmt("failed to compress %s, rotating it uncompressed: %s",
+			            fname.c_str(), error.c_str()));
 		}
 
-	if ( rename(fname.c_str(), nname.c_str()) != 0 )
+	if ( ! compressed && ! move_file(fname.c_str(), nname.c_str()) )
 		{
 		char buf[256];
 		bro_strerror_r(errno, buf, sizeof(buf));
@@ -516,22 +608,13 @@ string Ascii::Timestamp(double t)
 
 bool Ascii::InternalWrite(int fd, const char* data, int len)
 	{
-	if ( ! gzfile )
+	if ( ! compressor )
 		return safe_write(fd, data, len);
 
-	while ( len > 0 )
+	if ( ! compressor->Write(data, len) )
 		{
-		int n = gzwrite(gzfile, data, len);
-
-		if ( n <= 0 )
-			{
-			const char* err = gzerror(gzfile, &n);
-			Error(Fmt("Ascii::InternalWrite error: %s\n", err));
-			return false;
-			}
-
-		data += n;
-		len -= n;
+		Error(Fmt("Ascii::InternalWrite error: %s\n", compressor->Error().c_str()));
+		return false;
 		}
 
 	return true;
@@ -539,33 +622,20 @@ bool Ascii::InternalWrite(int fd, const char* data, int len)
 
 bool Ascii::InternalClose(int fd)
 	{
-	if ( ! gzfile )
+	if ( ! compressor )
 		{
 		safe_close(fd);
 		return true;
 		}
 
-	int res = gzclose(gzfile);
+	bool ok = compressor->Finish();
 
-	if ( res == Z_OK )
-		return true;
+	if ( ! ok )
+		Error(Fmt("Ascii::InternalClose error: %s\n", compressor->Error().c_str()));
 
-	switch ( res ) {
-	case Z_STREAM_ERROR:
-		Error("Ascii::InternalClose gzclose error: invalid file stream");
-		break;
-	case Z_BUF_ERROR:
-		Error("Ascii::InternalClose gzclose error: "
-		      "no compression progress possible during buffer flush");
-		break;
-	case Z_ERRNO:
-		Error(Fmt("Ascii::InternalClose gzclose error: %s\n", Strerror(errno)));
-		break;
-	default:
-		Error("Ascii::InternalClose invalid gzclose result");
-		break;
-	}
+	delete compressor;
+	compressor = nullptr;
+	safe_close(fd);
 
-	return false;
+	return ok;
 	}
-
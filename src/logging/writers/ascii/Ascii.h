@@ -8,7 +8,7 @@
 #include "threading/formatters/Ascii.h"
 #include "threading/formatters/JSON.h"
 #include "Desc.h"
-#include "zlib.h"
+#include "BlockCompressor.h"
 
 namespace logging { namespace writer {
 
@@ -27,6 +27,7 @@ protected:
 			    const threading::Field* const* fields) override;
 	bool DoWrite(int num_fields, const threading::Field* const* fields,
 			     threading::Value** vals) override;
+	bool DoWriteBatch(const threading::RecordBatch& batch) override;
 	bool DoSetBuf(bool enabled) override;
 	bool DoRotate(const char* rotated_path, double open,
 			      double close, bool terminating) override;
@@ -34,6 +35,9 @@ protected:
 	bool DoFinish(double network_time) override;
 	bool DoHeartbeat(double network_time, double current_time) override;
 
+	uint64_t Backlog() override
+		{ return compression_backlog.load(std::memory_order_relaxed); }
+
 private:
 	bool IsSpecial(const std::string &path) 	{ return path.find("/dev/") == 0; }
 	bool WriteHeader(const std::string& path);
@@ -47,7 +51,7 @@ private:
 	bool InternalClose(int fd);
 
 	int fd;
-	gzFile gzfile;
+	detail::BlockCompressor* compressor;
 	std::string fname;
 	ODesc desc;
 	bool ascii_done;
@@ -64,6 +68,7 @@ private:
 	std::string meta_prefix;
 
 	int gzip_level; // level > 0 enables gzip compression
+	int rotation_gzip_level; // level > 0 compresses files at rotation
 	std::string gzip_file_extension;
 	bool use_json;
 	bool enable_utf_8;
@@ -71,6 +76,9 @@ private:
 
 	threading::formatter::Formatter* formatter;
 	bool init_options;
+
+	// Bytes written but not yet compressed; read by the main thread.
+	std::atomic<uint64_t> compression_backlog;
 };
 
 }
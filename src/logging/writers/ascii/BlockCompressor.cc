@@ -0,0 +1,615 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "BlockCompressor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "zlib.h"
+
+#include "3rdparty/doctest.h"
+
+#include "threading/ThreadPool.h"
+#include "util.h"
+
+using namespace logging::writer::detail;
+
+struct BlockCompressor::Block {
+	std::string in;
+	std::string out;
+	size_t in_size;
+	int level;
+	bool ok = false;
+	std::atomic<bool> claimed{false};
+	std::atomic<bool> done{false};
+};
+
+// Compresses a block into a complete gzip member.
+static bool compress_block(const std::string& in, int level, std::string* out)
+	{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+
+	// 16 added to the window bits selects the gzip wrapper.
+	if ( deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK )
+		return false;
+
+	out->resize(deflateBound(&zs, in.size()) + 32);
+
+	zs.next_in = (Bytef*)in.data();
+	zs.avail_in = in.size();
+	zs.next_out = (Bytef*)&(*out)[0];
+	zs.avail_out = out->size();
+
+	int rc;
+
+	while ( (rc = deflate(&zs, Z_FINISH)) == Z_OK )
+		{
+		// Out of space after all; shouldn't happen with the bound.
+		size_t used = out->size() - zs.avail_out;
+		out->resize(out->size() * 2);
+		zs.next_out = (Bytef*)&(*out)[used];
+		zs.avail_out = out->size() - used;
+		}
+
+	out->resize(out->size() - zs.avail_out);
+	deflateEnd(&zs);
+
+	return rc == Z_STREAM_END;
+	}
+
+class BlockCompressor::Pool : public std::enable_shared_from_this<Pool> {
+public:
+	// Compresses on threads of its own.
+	explicit Pool(int n)
+		{
+		for ( int i = 0; i < n; ++i )
+			threads.emplace_back(&Pool::Run, this);
+		}
+
+	// Compresses as tasks on a pool shared with other work.
+	explicit Pool(threading::ThreadPool* arg_thread_pool)
+		: thread_pool(arg_thread_pool)
+		{
+		}
+
+	~Pool()
+		{
+		std::unique_lock<std::mutex> lock(mutex);
+		stop = true;
+		lock.unlock();
+		work.notify_all();
+
+		for ( auto& t : threads )
+			t.join();
+		}
+
+	void Submit(std::shared_ptr<Block> b)
+		{
+		if ( thread_pool )
+			{
+			thread_pool->Schedule(new BlockTask(shared_from_this(), std::move(b)));
+			return;
+			}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		queue.push_back(std::move(b));
+		lock.unlock();
+		work.notify_one();
+		}
+
+	void Wait(Block* b)
+		{
+		// On a shared pool, the caller may be a task occupying the
+		// worker that the block waits for, so it rather compresses a
+		// block that hasn't started yet itself.
+		if ( Compress(b) )
+			return;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [b]	{ return b->done.load(std::memory_order_acquire); });
+		}
+
+private:
+	class BlockTask : public threading::ThreadPool::Task {
+	public:
+		BlockTask(std::shared_ptr<Pool> arg_pool, std::shared_ptr<Block> arg_block)
+			: pool(std::move(arg_pool)), block(std::move(arg_block))
+			{
+			}
+
+		// Runs only once, so the task goes away right after.
+		bool RunSlice() override
+			{
+			pool->Compress(block.get());
+			delete this;
+			return false;
+			}
+
+	private:
+		std::shared_ptr<Pool> pool;
+		std::shared_ptr<Block> block;
+	};
+
+	// Compresses a block unless another thread took it on already.
+	// Returns false in that case.
+	bool Compress(Block* b)
+		{
+		if ( b->claimed.exchange(true, std::memory_order_acq_rel) )
+			return false;
+
+		b->ok = compress_block(b->in, b->level, &b->out);
+		b->in.clear();
+		b->in.shrink_to_fit();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		b->done.store(true, std::memory_order_release);
+		finished.notify_all();
+		return true;
+		}
+
+	void Run()
+		{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		while ( true )
+			{
+			work.wait(lock, [this]	{ return stop || ! queue.empty(); });
+
+			if ( queue.empty() )
+				return;
+
+			auto b = std::move(queue.front());
+			queue.pop_front();
+			lock.unlock();
+
+			Compress(b.get());
+
+			lock.lock();
+			}
+		}
+
+	threading::ThreadPool* thread_pool = nullptr;
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable work;
+	std::condition_variable finished;
+	std::deque<std::shared_ptr<Block>> queue;
+	bool stop = false;
+};
+
+static std::mutex pool_mutex;
+static int pool_threads = 2;
+static threading::ThreadPool* shared_thread_pool = nullptr;
+static bool pool_changed = false;
+
+void BlockCompressor::SetThreads(int n)
+	{
+	std::lock_guard<std::mutex> lock(pool_mutex);
+
+	if ( n != pool_threads || shared_thread_pool )
+		pool_changed = true;
+
+	pool_threads = n;
+	shared_thread_pool = nullptr;
+	}
+
+void BlockCompressor::SetThreadPool(threading::ThreadPool* thread_pool)
+	{
+	std::lock_guard<std::mutex> lock(pool_mutex);
+
+	if ( thread_pool != shared_thread_pool )
+		pool_changed = true;
+
+	shared_thread_pool = thread_pool;
+	}
+
+std::shared_ptr<BlockCompressor::Pool> BlockCompressor::GetPool()
+	{
+	// Created on first use, which happens on a writer thread, so that
+	// its own workers inherit the signal mask. Instances keep the pool
+	// they started with, so a replaced one shuts down with the last of
+	// them.
+	static std::shared_ptr<Pool> pool;
+	std::lock_guard<std::mutex> lock(pool_mutex);
+
+	if ( pool_changed )
+		{
+		pool.reset();
+		pool_changed = false;
+		}
+
+	if ( ! pool )
+		{
+		if ( shared_thread_pool )
+			pool = std::make_shared<Pool>(shared_thread_pool);
+		else if ( pool_threads > 0 )
+			pool = std::make_shared<Pool>(pool_threads);
+		}
+
+	return pool;
+	}
+
+BlockCompressor::BlockCompressor(int arg_fd, int arg_level, std::atomic<uint64_t>* arg_backlog)
+	: fd(arg_fd), level(arg_level), backlog(arg_backlog), pool(GetPool()),
+	  wrote_member(false)
+	{
+	buffer.reserve(BLOCK_SIZE);
+	}
+
+BlockCompressor::~BlockCompressor()
+	{
+	for ( auto& b : pending )
+		{
+		if ( pool )
+			pool->Wait(b.get());
+
+		AddBacklog(-int64_t(b->in_size));
+		}
+
+	AddBacklog(-int64_t(buffer.size()));
+	}
+
+bool BlockCompressor::Write(const char* data, size_t len)
+	{
+	while ( len )
+		{
+		size_t n = std::min(len, BLOCK_SIZE - buffer.size());
+		buffer.append(data, n);
+		AddBacklog(n);
+		data += n;
+		len -= n;
+
+		if ( buffer.size() >= BLOCK_SIZE && ! Submit() )
+			return false;
+		}
+
+	return true;
+	}
+
+bool BlockCompressor::Submit()
+	{
+	auto b = std::make_shared<Block>();
+	b->in.swap(buffer);
+	b->in_size = b->in.size();
+	b->level = level;
+	buffer.reserve(BLOCK_SIZE);
+
+	if ( ! pool )
+		{
+		b->ok = compress_block(b->in, b->level, &b->out);
+		b->done.store(true, std::memory_order_relaxed);
+		pending.push_back(std::move(b));
+		return Drain(0);
+		}
+
+	pool->Submit(b);
+	pending.push_back(std::move(b));
+
+	// Bound the memory that a writer can tie up, which also makes a
+	// writer that produces faster than the pool compresses wait.
+	return Drain(4);
+	}
+
+bool BlockCompressor::Drain(size_t max_pending)
+	{
+	while ( ! pending.empty() )
+		{
+		Block& b = *pending.front();
+
+		if ( ! b.done.load(std::memory_order_acquire) )
+			{
+			if ( pending.size() <= max_pending )
+				break;
+
+			pool->Wait(&b);
+			}
+
+		if ( ! b.ok )
+			{
+			error = "gzip compression failed";
+			return false;
+			}
+
+		if ( ! safe_write(fd, b.out.data(), b.out.size()) )
+			{
+			error = strerror(errno);
+			return false;
+			}
+
+		wrote_member = true;
+		AddBacklog(-int64_t(b.in_size));
+		pending.pop_front();
+		}
+
+	return true;
+	}
+
+bool BlockCompressor::Flush(size_t min_size)
+	{
+	if ( ! buffer.empty() && buffer.size() >= min_size && ! Submit() )
+		return false;
+
+	return Drain(0);
+	}
+
+bool BlockCompressor::Finish()
+	{
+	if ( ! Flush() )
+		return false;
+
+	if ( wrote_member )
+		return true;
+
+	// An empty member, as gzip readers don't accept an empty file.
+	return Submit() && Drain(0);
+	}
+
+bool BlockCompressor::CompressFile(const std::string& src, const std::string& dst,
+                                   int level, std::atomic<uint64_t>* backlog,
+                                   std::string* error)
+	{
+	int in = open(src.c_str(), O_RDONLY);
+
+	if ( in < 0 )
+		{
+		*error = fmt("cannot open %s: %s", src.c_str(), strerror(errno));
+		return false;
+		}
+
+	int out = open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+	if ( out < 0 )
+		{
+		*error = fmt("cannot open %s: %s", dst.c_str(), strerror(errno));
+		safe_close(in);
+		return false;
+		}
+
+	bool ok = true;
+
+	{
+	BlockCompressor c(out, level, backlog);
+	std::vector<char> buf(BLOCK_SIZE);
+
+	while ( ok )
+		{
+		ssize_t n = read(in, buf.data(), buf.size());
+
+		if ( n < 0 && errno == EINTR )
+			continue;
+
+		if ( n < 0 )
+			{
+			*error = fmt("error reading %s: %s", src.c_str(), strerror(errno));
+			ok = false;
+			break;
+			}
+
+		if ( n == 0 )
+			break;
+
+		if ( ! c.Write(buf.data(), n) )
+			{
+			*error = fmt("error writing %s: %s", dst.c_str(), c.Error().c_str());
+			ok = false;
+			}
+		}
+
+	if ( ok && ! c.Finish() )
+		{
+		*error = fmt("error writing %s: %s", dst.c_str(), c.Error().c_str());
+		ok = false;
+		}
+	}
+
+	safe_close(in);
+	safe_close(out);
+
+	if ( ok )
+		unlink(src.c_str());
+	else
+		unlink(dst.c_str());
+
+	return ok;
+	}
+
+// Decompresses all gzip members in a buffer.
+static bool gunzip(const std::string& in, std::string* out)
+	{
+	size_t pos = 0;
+	out->clear();
+
+	while ( pos < in.size() )
+		{
+		z_stream zs;
+		memset(&zs, 0, sizeof(zs));
+
+		if ( inflateInit2(&zs, 15 + 16) != Z_OK )
+			return false;
+
+		zs.next_in = (Bytef*)in.data() + pos;
+		zs.avail_in = in.size() - pos;
+
+		char buf[4096];
+		int rc;
+
+		do
+			{
+			zs.next_out = (Bytef*)buf;
+			zs.avail_out = sizeof(buf);
+			rc = inflate(&zs, Z_NO_FLUSH);
+			out->append(buf, sizeof(buf) - zs.avail_out);
+			} while ( rc == Z_OK );
+
+		pos = in.size() - zs.avail_in;
+		inflateEnd(&zs);
+
+		if ( rc != Z_STREAM_END )
+			return false;
+		}
+
+	return true;
+	}
+
+static std::string read_file(const std::string& path)
+	{
+	std::string data;
+	int fd = open(path.c_str(), O_RDONLY);
+	char buf[4096];
+	ssize_t n;
+
+	while ( fd >= 0 && (n = read(fd, buf, sizeof(buf))) > 0 )
+		data.append(buf, n);
+
+	if ( fd >= 0 )
+		close(fd);
+
+	return data;
+	}
+
+namespace {
+
+// Compresses data into a file from a task on the thread pool.
+class WriteTask : public threading::ThreadPool::Task {
+public:
+	WriteTask(const std::string& arg_path, const std::string& arg_data)
+		: path(arg_path), data(arg_data)
+		{
+		}
+
+	bool RunSlice() override
+		{
+		int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+		if ( fd >= 0 )
+			{
+			BlockCompressor c(fd, 6);
+			ok = c.Write(data.data(), data.size()) && c.Finish();
+			close(fd);
+			}
+
+		finished.store(true);
+		return false;
+		}
+
+	bool ok = false;
+	std::atomic<bool> finished{false};
+
+private:
+	std::string path;
+	std::string data;
+};
+
+}
+
+TEST_CASE("block compressor")
+	{
+	const char* dir = getenv("TMPDIR");
+	std::string base = fmt("%s/zeek-block-compressor-%d", dir ? dir : "/tmp", int(getpid()));
+	std::string path = base + ".gz";
+
+	std::string data;
+
+	for ( int i = 0; data.size() < 3 * BlockCompressor::BLOCK_SIZE + 100; ++i )
+		data += fmt("%d\tsome log line\t%x\n", i, i * 7919);
+
+	threading::ThreadPool thread_pool(1);
+
+	// No threads, threads of its own, and a shared pool.
+	for ( int mode = 0; mode < 3; ++mode )
+		{
+		if ( mode < 2 )
+			BlockCompressor::SetThreads(mode * 2);
+		else
+			BlockCompressor::SetThreadPool(&thread_pool);
+
+		int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		REQUIRE(fd >= 0);
+
+		std::atomic<uint64_t> backlog(0);
+		std::string out;
+
+		{
+		BlockCompressor c(fd, 6, &backlog);
+
+		// Odd-sized writes, straddling blocks.
+		for ( size_t pos = 0; pos < data.size(); pos += 9999 )
+			CHECK(c.Write(data.data() + pos, std::min(size_t(9999), data.size() - pos)));
+
+		CHECK(c.Flush());
+		CHECK(backlog == 0);
+		CHECK(c.Write("x\n", 2));
+		CHECK(backlog == 2);
+
+		// Too little for a member of its own.
+		CHECK(c.Flush(BlockCompressor::MIN_FLUSH_SIZE));
+		CHECK(backlog == 2);
+		CHECK(c.Finish());
+		}
+
+		close(fd);
+
+		CHECK(backlog == 0);
+		CHECK(gunzip(read_file(path), &out));
+		CHECK(out == data + "x\n");
+		}
+
+	// From a task that occupies the pool's only worker, which must not
+	// end up waiting for its own blocks queued behind it.
+	WriteTask task(path, data);
+	thread_pool.Schedule(&task);
+
+	for ( int waited = 0; ! task.finished.load() && waited < 10000; ++waited )
+		usleep(1000);
+
+	REQUIRE(task.finished.load());
+	CHECK(task.ok);
+	std::string out;
+	CHECK(gunzip(read_file(path), &out));
+	CHECK(out == data);
+
+	BlockCompressor::SetThreads(2);
+
+	// An empty file still becomes valid gzip.
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	REQUIRE(fd >= 0);
+
+	{
+	BlockCompressor c(fd, 1);
+	CHECK(c.Finish());
+	}
+
+	close(fd);
+
+	std::string compressed = read_file(path);
+	CHECK(! compressed.empty());
+	CHECK(gunzip(compressed, &out));
+	CHECK(out.empty());
+
+	// Compressing a file in one go.
+	int src = open(base.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	REQUIRE(src >= 0);
+	CHECK(safe_write(src, data.data(), data.size()));
+	close(src);
+
+	std::string error;
+	CHECK(BlockCompressor::CompressFile(base, path, 6, nullptr, &error));
+	CHECK(access(base.c_str(), F_OK) != 0);
+	CHECK(gunzip(read_file(path), &out));
+	CHECK(out == data);
+
+	CHECK(! BlockCompressor::CompressFile(base, path, 6, nullptr, &error));
+	CHECK(! error.empty());
+
+	unlink(path.c_str());
+	}
@@ -0,0 +1,152 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Block-parallel gzip compression for the ASCII writer.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+
+namespace threading { class ThreadPool; }
+
+namespace logging { namespace writer { namespace detail {
+
+/**
+ * Writes gzip-compressed output to a file descriptor as a series of
+ * independent gzip members, one per block of input. Decompressors treat
+ * concatenated members like a single stream, so the output is an ordinary
+ * gzip file.
+ *
+ * Full blocks get compressed by a pool of worker threads that all instances
+ * share, while the instance writes the finished members out in order the
+ * next time it's called. This keeps compression from stalling the calling
+ * writer thread, and lets the writers of several busy logs use more than
+ * one core. The pool either has threads of its own, or runs the blocks as
+ * tasks on a threading::ThreadPool. With a pool size of zero, blocks get
+ * compressed on the calling thread instead.
+ *
+ * An instance must only be used by a single thread.
+ */
+class BlockCompressor {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param fd The file descriptor to write the compressed output to. The
+	 * instance does not close it.
+	 *
+	 * @param level The zlib compression level, between 1 and 9.
+	 *
+	 * @param backlog Optional counter to keep updated with the number of
+	 * input bytes accepted but not yet written out compressed. The counter
+	 * may be read by other threads.
+	 */
+	BlockCompressor(int fd, int level, std::atomic<uint64_t>* backlog = nullptr);
+
+	/**
+	 * Destructor. Waits for pending blocks, but discards them; call
+	 * Finish() first to write them out.
+	 */
+	~BlockCompressor();
+
+	BlockCompressor(const BlockCompressor&) = delete;
+	BlockCompressor& operator=(const BlockCompressor&) = delete;
+
+	/**
+	 * Adds data to the compressed output.
+	 *
+	 * @return False if writing out a compressed block failed; see
+	 * Error().
+	 */
+	bool Write(const char* data, size_t len);
+
+	/**
+	 * Compresses all data added so far and waits until it's written out.
+	 * Further writes start a new member.
+	 *
+	 * @param min_size If less data than this has been added since the
+	 * last member, it stays buffered for a later one. Each member starts
+	 * compressing from scratch, so frequent small ones compress badly.
+	 *
+	 * @return False if writing out a compressed block failed; see
+	 * Error().
+	 */
+	bool Flush(size_t min_size = 0);
+
+	/**
+	 * Like Flush(), but also makes sure that the output is a valid gzip
+	 * file even if no data was ever added.
+	 */
+	bool Finish();
+
+	/**
+	 * Returns a description of the last error.
+	 */
+	const std::string& Error() const	{ return error; }
+
+	/**
+	 * Sets the number of worker threads of the compressor's own. Takes
+	 * effect for instances created afterwards.
+	 */
+	static void SetThreads(int n);
+
+	/**
+	 * Makes instances created afterwards compress their blocks as tasks
+	 * on a thread pool, instead of on threads of the compressor's own.
+	 * The pool must stay around as long as they do.
+	 */
+	static void SetThreadPool(threading::ThreadPool* thread_pool);
+
+	/**
+	 * Compresses a file into a new one, removing the original on
+	 * success.
+	 *
+	 * @return False if reading, compressing or writing failed, in which
+	 * case the original file remains in place; see \a error for why.
+	 */
+	static bool CompressFile(const std::string& src, const std::string& dst,
+	                         int level, std::atomic<uint64_t>* backlog,
+	                         std::string* error);
+
+	// The amount of input per gzip member.
+	static const size_t BLOCK_SIZE = 1024 * 1024;
+
+	// The least amount of input that a writer's flush turns into a
+	// member of its own.
+	static const size_t MIN_FLUSH_SIZE = 64 * 1024;
+
+private:
+	struct Block;
+	class Pool;
+
+	// Hands the buffered data over for compression.
+	bool Submit();
+
+	// Writes out finished blocks in order, waiting as long as more than
+	// max_pending are outstanding.
+	bool Drain(size_t max_pending);
+
+	void AddBacklog(int64_t n)
+		{
+		if ( backlog )
+			backlog->fetch_add(n, std::memory_order_relaxed);
+		}
+
+	static std::shared_ptr<Pool> GetPool();
+
+	int fd;
+	int level;
+	std::atomic<uint64_t>* backlog;
+	std::shared_ptr<Pool> pool;
+	std::string buffer;
+	std::deque<std::shared_ptr<Block>> pending;
+	bool wrote_member;
+	std::string error;
+};
+
+} } }
@@ -0,0 +1,1430 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "ColumnFile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "zlib.h"
+
+#include "3rdparty/doctest.h"
+
+#include "util.h"
+
+using namespace logging::writer::columnar;
+using threading::Value;
+using threading::Field;
+using threading::RecordBatch;
+
+static const char MAGIC[4] = { 'Z', 'C', 'L', '1' };
+static const uint64_t FORMAT_VERSION = 1;
+
+// Statistics keys longer than this are truncated, which keeps a valid
+// minimum but loses the maximum.
+static const size_t MAX_STATS_KEY = 64;
+
+static void put_varint(std::string* out, uint64_t v)
+	{
+	while ( v >= 0x80 )
+		{
+		out->push_back(char(v | 0x80));
+		v >>= 7;
+		}
+
+	out->push_back(char(v));
+	}
+
+static uint64_t zigzag(int64_t v)
+	{
+	return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+	}
+
+static int64_t unzigzag(uint64_t v)
+	{
+	return int64_t(v >> 1) ^ -int64_t(v & 1);
+	}
+
+static void put_fixed(std::string* out, uint64_t v, int bytes)
+	{
+	// Little-endian.
+	for ( int i = 0; i < bytes; ++i )
+		out->push_back(char(v >> (8 * i)));
+	}
+
+static void put_big_endian(std::string* out, uint64_t v)
+	{
+	for ( int i = 7; i >= 0; --i )
+		out->push_back(char(v >> (8 * i)));
+	}
+
+static void put_string(std::string* out, const char* data, size_t len)
+	{
+	put_varint(out, len);
+	out->append(data, len);
+	}
+
+static void put_bitmap(std::string* out, const std::vector<uint8_t>& bits)
+	{
+	size_t start = out->size();
+	out->resize(start + (bits.size() + 7) / 8, '\0');
+
+	for ( size_t i = 0; i < bits.size(); ++i )
+		{
+		if ( bits[i] )
+			(*out)[start + i / 8] |= char(1 << (i % 8));
+		}
+	}
+
+static int64_t to_micros(double d)
+	{
+	return int64_t(llround(d * 1e6));
+	}
+
+namespace {
+
+// Bounds-checked decoding from a buffer. Once a read fails, all further
+// ones do as well.
+struct Cursor {
+	const char* p;
+	const char* end;
+	bool ok = true;
+
+	Cursor(const char* data, size_t len) : p(data), end(data + len)	{ }
+
+	bool Fail()	{ ok = false; p = end; return false; }
+
+	bool Varint(uint64_t* v)
+		{
+		*v = 0;
+
+		for ( int shift = 0; shift < 64; shift += 7 )
+			{
+			if ( p >= end )
+				return Fail();
+
+			uint8_t b = *p++;
+			*v |= uint64_t(b & 0x7f) << shift;
+
+			if ( ! (b & 0x80) )
+				return true;
+			}
+
+		return Fail();
+		}
+
+	bool Varint32(uint32_t* v)
+		{
+		uint64_t x;
+
+		if ( ! Varint(&x) || x > UINT32_MAX )
+			return Fail();
+
+		*v = uint32_t(x);
+		return true;
+		}
+
+	bool Byte(uint8_t* b)
+		{
+		if ( p >= end )
+			return Fail();
+
+		*b = *p++;
+		return true;
+		}
+
+	bool Bytes(void* dst, size_t len)
+		{
+		if ( size_t(end - p) < len )
+			return Fail();
+
+		memcpy(dst, p, len);
+		p += len;
+		return true;
+		}
+
+	bool Fixed(uint64_t* v, int bytes)
+		{
+		uint8_t buf[8];
+
+		if ( ! Bytes(buf, bytes) )
+			return false;
+
+		*v = 0;
+
+		for ( int i = 0; i < bytes; ++i )
+			*v |= uint64_t(buf[i]) << (8 * i);
+
+		return true;
+		}
+
+	bool String(std::string* s)
+		{
+		uint64_t len;
+
+		if ( ! Varint(&len) || uint64_t(end - p) < len )
+			return Fail();
+
+		s->assign(p, len);
+		p += len;
+		return true;
+		}
+
+	bool Bitmap(size_t n, std::vector<uint8_t>* bits)
+		{
+		size_t len = (n + 7) / 8;
+
+		if ( size_t(end - p) < len )
+			return Fail();
+
+		bits->resize(n);
+
+		for ( size_t i = 0; i < n; ++i )
+			(*bits)[i] = (p[i / 8] >> (i % 8)) & 1;
+
+		p += len;
+		return true;
+		}
+};
+
+}
+
+LogicalType logging::writer::columnar::ToLogicalType(TypeTag type)
+	{
+	switch ( type ) {
+	case TYPE_BOOL:		return LT_BOOL;
+	case TYPE_INT:		return LT_INT64;
+	case TYPE_COUNT:
+	case TYPE_COUNTER:	return LT_UINT64;
+	case TYPE_DOUBLE:	return LT_DOUBLE;
+	case TYPE_TIME:		return LT_TIMESTAMP_MICROS;
+	case TYPE_INTERVAL:	return LT_DURATION_MICROS;
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+	case TYPE_PATTERN:	return LT_STRING;
+	case TYPE_ENUM:		return LT_ENUM;
+	case TYPE_ADDR:		return LT_IP_ADDRESS;
+	case TYPE_SUBNET:	return LT_IP_SUBNET;
+	case TYPE_PORT:		return LT_PORT;
+	case TYPE_TABLE:	return LT_SET;
+	case TYPE_VECTOR:	return LT_LIST;
+	default:		return LT_NONE;
+	}
+	}
+
+const char* logging::writer::columnar::LogicalTypeName(LogicalType lt)
+	{
+	switch ( lt ) {
+	case LT_BOOL:			return "bool";
+	case LT_INT64:			return "int64";
+	case LT_UINT64:			return "uint64";
+	case LT_DOUBLE:			return "double";
+	case LT_TIMESTAMP_MICROS:	return "timestamp(us)";
+	case LT_DURATION_MICROS:	return "duration(us)";
+	case LT_STRING:			return "string";
+	case LT_ENUM:			return "enum";
+	case LT_IP_ADDRESS:		return "ip-address";
+	case LT_IP_SUBNET:		return "ip-subnet";
+	case LT_PORT:			return "port";
+	case LT_SET:			return "set";
+	case LT_LIST:			return "list";
+	default:			return "none";
+	}
+	}
+
+static bool is_textual(LogicalType lt)
+	{
+	return lt == LT_STRING || lt == LT_ENUM;
+	}
+
+bool ColumnSchema::Feeds(TypeTag arg_type, TypeTag arg_subtype) const
+	{
+	LogicalType want = ToLogicalType(arg_type);
+
+	if ( want == LT_NONE )
+		return false;
+
+	if ( logical == LT_SET || logical == LT_LIST )
+		{
+		if ( want != logical )
+			return false;
+
+		LogicalType want_element = ToLogicalType(arg_subtype);
+		return want_element == element_logical ||
+			(is_textual(want_element) && is_textual(element_logical));
+		}
+
+	return want == logical || (is_textual(want) && is_textual(logical));
+	}
+
+// Returns a subnet's prefix length as used for the address family, rather
+// than relative to the IPv6 representation.
+static uint8_t subnet_length(const Value::subnet_t& s)
+	{
+	if ( s.prefix.family == IPv4 && s.length >= 96 )
+		return s.length - 96;
+
+	return s.length;
+	}
+
+static void put_addr(std::string* out, const Value::addr_t& a)
+	{
+	if ( a.family == IPv4 )
+		{
+		out->push_back(4);
+		out->append((const char*)&a.in.in4, sizeof(a.in.in4));
+		}
+	else
+		{
+		out->push_back(6);
+		out->append((const char*)&a.in.in6, sizeof(a.in.in6));
+		}
+	}
+
+static void put_addr_key(std::string* out, const Value::addr_t& a)
+	{
+	// Order IPv4 addresses as their IPv4-mapped IPv6 counterparts.
+	static const char v4_mapped_prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, char(0xff), char(0xff) };
+
+	if ( a.family == IPv4 )
+		{
+		out->append(v4_mapped_prefix, sizeof(v4_mapped_prefix));
+		out->append((const char*)&a.in.in4, sizeof(a.in.in4));
+		}
+	else
+		out->append((const char*)&a.in.in6, sizeof(a.in.in6));
+	}
+
+// Encodes an atomic value in its plain representation.
+static void encode_atom(LogicalType lt, const RecordBatch& batch,
+                        const RecordBatch::Cell& c, std::string* out)
+	{
+	switch ( lt ) {
+	case LT_BOOL:
+		out->push_back(c.int_val ? 1 : 0);
+		break;
+
+	case LT_INT64:
+		put_varint(out, zigzag(c.int_val));
+		break;
+
+	case LT_UINT64:
+		put_varint(out, c.uint_val);
+		break;
+
+	case LT_DOUBLE:
+		{
+		uint64_t bits;
+		memcpy(&bits, &c.double_val, sizeof(bits));
+		put_fixed(out, bits, 8);
+		break;
+		}
+
+	case LT_TIMESTAMP_MICROS:
+	case LT_DURATION_MICROS:
+		put_varint(out, zigzag(to_micros(c.double_val)));
+		break;
+
+	case LT_STRING:
+	case LT_ENUM:
+		put_string(out, batch.String(c), c.ref.length);
+		break;
+
+	case LT_IP_ADDRESS:
+		put_addr(out, c.addr_val);
+		break;
+
+	case LT_IP_SUBNET:
+		put_addr(out, c.subnet_val.prefix);
+		out->push_back(subnet_length(c.subnet_val));
+		break;
+
+	case LT_PORT:
+		put_varint(out, c.port_val.port);
+		out->push_back(c.port_val.proto);
+		break;
+
+	default:
+		break;
+	}
+	}
+
+void logging::writer::columnar::StatsKey(LogicalType lt, const RecordBatch& batch,
+                                         const RecordBatch::Cell& c, std::string* key)
+	{
+	key->clear();
+
+	switch ( lt ) {
+	case LT_BOOL:
+		key->push_back(c.int_val ? 1 : 0);
+		break;
+
+	case LT_INT64:
+		put_big_endian(key, uint64_t(c.int_val) ^ (uint64_t(1) << 63));
+		break;
+
+	case LT_UINT64:
+		put_big_endian(key, c.uint_val);
+		break;
+
+	case LT_DOUBLE:
+		{
+		if ( isnan(c.double_val) )
+			// Not ordered; leave out of the statistics.
+			break;
+
+		uint64_t bits;
+		memcpy(&bits, &c.double_val, sizeof(bits));
+
+		if ( bits & (uint64_t(1) << 63) )
+			bits = ~bits;
+		else
+			bits |= uint64_t(1) << 63;
+
+		put_big_endian(key, bits);
+		break;
+		}
+
+	case LT_TIMESTAMP_MICROS:
+	case LT_DURATION_MICROS:
+		put_big_endian(key, uint64_t(to_micros(c.double_val)) ^ (uint64_t(1) << 63));
+		break;
+
+	case LT_STRING:
+	case LT_ENUM:
+		key->assign(batch.String(c), c.ref.length);
+		break;
+
+	case LT_IP_ADDRESS:
+		put_addr_key(key, c.addr_val);
+		break;
+
+	case LT_IP_SUBNET:
+		put_addr_key(key, c.subnet_val.prefix);
+		key->push_back(c.subnet_val.prefix.family == IPv4 ?
+		               subnet_length(c.subnet_val) + 96 : c.subnet_val.length);
+		break;
+
+	case LT_PORT:
+		key->push_back(char(c.port_val.port >> 8));
+		key->push_back(char(c.port_val.port));
+		key->push_back(c.port_val.proto);
+		break;
+
+	default:
+		break;
+	}
+	}
+
+ColumnBuilder::ColumnBuilder(const ColumnSchema& arg_schema, size_t arg_max_dictionary_size)
+	: schema(arg_schema), max_dictionary_size(arg_max_dictionary_size)
+	{
+	use_dictionary = max_dictionary_size > 0;
+	}
+
+void ColumnBuilder::Add(const RecordBatch& batch, int row, int col)
+	{
+	++num_rows;
+
+	if ( ! batch.Present(row, col) )
+		{
+		present.push_back(0);
+		++null_count;
+		return;
+		}
+
+	present.push_back(1);
+
+	const RecordBatch::Cell& c = batch.Get(row, col);
+
+	if ( schema.logical != LT_SET && schema.logical != LT_LIST )
+		{
+		AddAtom(batch, schema.logical, c);
+		return;
+		}
+
+	int n = batch.NumElements(c);
+	lengths.push_back(n);
+
+	for ( int j = 0; j < n; ++j )
+		{
+		if ( ! batch.ElementPresent(c, j) )
+			{
+			element_present.push_back(0);
+			++element_null_count;
+			continue;
+			}
+
+		element_present.push_back(1);
+		AddAtom(batch, schema.element_logical, batch.Element(c, j));
+		}
+	}
+
+void ColumnBuilder::AddAtom(const RecordBatch& batch, LogicalType lt,
+                            const RecordBatch::Cell& c)
+	{
+	atom.clear();
+	encode_atom(lt, batch, c, &atom);
+	plain.append(atom);
+	++num_values;
+
+	if ( use_dictionary )
+		{
+		auto i = dictionary.find(atom);
+
+		if ( i != dictionary.end() )
+			indices.push_back(i->second);
+
+		else if ( dictionary.size() < max_dictionary_size )
+			{
+			uint32_t idx = dictionary.size();
+			auto r = dictionary.emplace(atom, idx);
+			dictionary_values.push_back(&r.first->first);
+			indices.push_back(idx);
+			}
+
+		else
+			{
+			// Too many distinct values to be worth it.
+			use_dictionary = false;
+			dictionary.clear();
+			dictionary_values.clear();
+			indices.clear();
+			}
+		}
+
+	StatsKey(lt, batch, c, &key);
+
+	if ( key.empty() && lt != LT_STRING && lt != LT_ENUM )
+		return;
+
+	if ( key.size() > MAX_STATS_KEY )
+		{
+		// A prefix is still a lower bound, but not an upper one.
+		key.resize(MAX_STATS_KEY);
+		has_max = false;
+		}
+
+	else if ( ! has_stats || key > max )
+		max = key;
+
+	if ( ! has_stats || key < min )
+		min = key;
+
+	has_stats = true;
+	}
+
+void ColumnBuilder::Finish(int compression_level, std::string* out, ChunkMeta* meta)
+	{
+	std::string payload;
+
+	if ( null_count )
+		put_bitmap(&payload, present);
+
+	for ( auto l : lengths )
+		put_varint(&payload, l);
+
+	if ( element_null_count )
+		put_bitmap(&payload, element_present);
+
+	bool dict = false;
+
+	if ( use_dictionary && dictionary_values.size() < num_values )
+		{
+		// Only use the dictionary if it actually saves space.
+		std::string encoded;
+		put_varint(&encoded, dictionary_values.size());
+
+		for ( auto v : dictionary_values )
+			encoded.append(*v);
+
+		for ( auto idx : indices )
+			put_varint(&encoded, idx);
+
+		if ( encoded.size() < plain.size() )
+			{
+			payload.append(encoded);
+			dict = true;
+			}
+		}
+
+	if ( ! dict )
+		payload.append(plain);
+
+	*meta = ChunkMeta();
+	meta->uncompressed_size = payload.size();
+	meta->encoding = dict ? ENCODING_DICTIONARY : ENCODING_PLAIN;
+	meta->num_values = num_values;
+	meta->null_count = null_count;
+	meta->element_null_count = element_null_count;
+	meta->dictionary_size = dict ? dictionary_values.size() : 0;
+	meta->has_min = has_stats;
+	meta->has_max = has_stats && has_max;
+
+	if ( meta->has_min )
+		meta->min = min;
+
+	if ( meta->has_max )
+		meta->max = max;
+
+	out->clear();
+
+	if ( compression_level > 0 && ! payload.empty() )
+		{
+		uLongf clen = compressBound(payload.size());
+		out->resize(clen);
+
+		if ( compress2((Bytef*)&(*out)[0], &clen, (const Bytef*)payload.data(),
+		               payload.size(), compression_level) == Z_OK &&
+		     clen < payload.size() )
+			{
+			out->resize(clen);
+			meta->codec = CODEC_ZLIB;
+			}
+		else
+			out->clear();
+		}
+
+	if ( meta->codec == CODEC_NONE )
+		out->swap(payload);
+
+	meta->compressed_size = out->size();
+
+	// Reset for the next row group.
+	num_rows = 0;
+	present.clear();
+	lengths.clear();
+	element_present.clear();
+	null_count = element_null_count = 0;
+	num_values = 0;
+	plain.clear();
+	use_dictionary = max_dictionary_size > 0;
+	dictionary.clear();
+	dictionary_values.clear();
+	indices.clear();
+	has_stats = false;
+	has_max = true;
+	min.clear();
+	max.clear();
+	}
+
+FileWriter::FileWriter(int arg_compression_level, size_t arg_max_dictionary_size)
+	: compression_level(arg_compression_level),
+	  max_dictionary_size(arg_max_dictionary_size)
+	{
+	}
+
+FileWriter::~FileWriter()
+	{
+	if ( fd >= 0 )
+		Close();
+	}
+
+bool FileWriter::Write(const void* data, size_t len)
+	{
+	if ( ! safe_write(fd, (const char*)data, len) )
+		{
+		error = fmt("error writing to %s: %s", path.c_str(), strerror(errno));
+		return false;
+		}
+
+	offset += len;
+	return true;
+	}
+
+bool FileWriter::Open(const std::string& arg_path, int num_fields, const Field* const* fields)
+	{
+	path = arg_path;
+	fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+	if ( fd < 0 )
+		{
+		error = fmt("cannot open %s: %s", path.c_str(), strerror(errno));
+		return false;
+		}
+
+	offset = 0;
+	buffered_rows = 0;
+	row_groups.clear();
+	builders.clear();
+	schema.clear();
+	schema.reserve(num_fields);
+	builders.reserve(num_fields);
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		ColumnSchema s;
+		s.name = fields[i]->name;
+		s.type = fields[i]->type;
+		s.subtype = fields[i]->subtype;
+		s.logical = ToLogicalType(s.type);
+		s.element_logical = LT_NONE;
+
+		if ( s.logical == LT_SET || s.logical == LT_LIST )
+			s.element_logical = ToLogicalType(s.subtype);
+
+		schema.push_back(s);
+		builders.emplace_back(schema.back(), max_dictionary_size);
+		}
+
+	return Write(MAGIC, sizeof(MAGIC));
+	}
+
+void FileWriter::Add(const RecordBatch& batch, int row)
+	{
+	for ( size_t i = 0; i < builders.size(); ++i )
+		builders[i].Add(batch, row, i);
+
+	++buffered_rows;
+	}
+
+bool FileWriter::FinishRowGroup()
+	{
+	if ( ! buffered_rows )
+		return true;
+
+	RowGroupMeta rg;
+	rg.num_rows = buffered_rows;
+	buffered_rows = 0;
+
+	for ( auto& b : builders )
+		{
+		ChunkMeta meta;
+		b.Finish(compression_level, &chunk, &meta);
+		meta.offset = offset;
+
+		if ( ! Write(chunk.data(), chunk.size()) )
+			return false;
+
+		rg.chunks.push_back(std::move(meta));
+		}
+
+	row_groups.push_back(std::move(rg));
+	return true;
+	}
+
+bool FileWriter::Close()
+	{
+	if ( fd < 0 )
+		return true;
+
+	bool ok = FinishRowGroup();
+
+	if ( ok )
+		{
+		std::string footer;
+		put_varint(&footer, FORMAT_VERSION);
+		put_varint(&footer, schema.size());
+
+		for ( const auto& s : schema )
+			{
+			put_string(&footer, s.name.data(), s.name.size());
+			put_varint(&footer, s.type);
+			put_varint(&footer, s.subtype);
+			put_varint(&footer, s.logical);
+			put_varint(&footer, s.element_logical);
+			}
+
+		put_varint(&footer, row_groups.size());
+
+		for ( const auto& rg : row_groups )
+			{
+			put_varint(&footer, rg.num_rows);
+
+			for ( const auto& c : rg.chunks )
+				{
+				put_varint(&footer, c.offset);
+				put_varint(&footer, c.compressed_size);
+				put_varint(&footer, c.uncompressed_size);
+				footer.push_back(c.encoding);
+				footer.push_back(c.codec);
+				put_varint(&footer, c.num_values);
+				put_varint(&footer, c.null_count);
+				put_varint(&footer, c.element_null_count);
+				put_varint(&footer, c.dictionary_size);
+				footer.push_back((c.has_min ? 1 : 0) | (c.has_max ? 2 : 0));
+
+				if ( c.has_min )
+					put_string(&footer, c.min.data(), c.min.size());
+
+				if ( c.has_max )
+					put_string(&footer, c.max.data(), c.max.size());
+				}
+			}
+
+		put_fixed(&footer, footer.size(), 4);
+		footer.append(MAGIC, sizeof(MAGIC));
+		ok = Write(footer.data(), footer.size());
+		}
+
+	safe_close(fd);
+	fd = -1;
+	row_groups.clear();
+	return ok;
+	}
+
+threading::Value* ColumnData::NextValue(TypeTag type, TypeTag subtype)
+	{
+	if ( next_row >= present.size() )
+		return nullptr;
+
+	if ( ! present[next_row++] )
+		return new Value(type, subtype, false);
+
+	if ( ! container )
+		{
+		Value* val = new Value(type, true);
+		AtomToValue(next_cell++, val);
+		return val;
+		}
+
+	// Decoding has verified that the counts add up.
+	uint32_t n = lengths[next_length++];
+	Value* val = new Value(type, subtype, true);
+	val->val.set_val.size = n;
+	val->val.set_val.vals = new Value*[n];
+
+	for ( uint32_t j = 0; j < n; ++j )
+		{
+		bool p = element_present[next_element++];
+		Value* e = new Value(subtype, p);
+
+		if ( p )
+			AtomToValue(next_cell++, e);
+
+		val->val.set_val.vals[j] = e;
+		}
+
+	return val;
+	}
+
+bool ColumnData::AtomToValue(size_t idx, Value* val) const
+	{
+	const RecordBatch::Cell& c = cells[idx];
+
+	switch ( val->type ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+		val->val.int_val = c.int_val;
+		break;
+
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+		val->val.uint_val = c.uint_val;
+		break;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		val->val.double_val = c.double_val;
+		break;
+
+	case TYPE_PORT:
+		val->val.port_val = c.port_val;
+		break;
+
+	case TYPE_ADDR:
+		val->val.addr_val = c.addr_val;
+		break;
+
+	case TYPE_SUBNET:
+		val->val.subnet_val = c.subnet_val;
+		break;
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		{
+		char* s = new char[c.ref.length + 1];
+		memcpy(s, strings.data() + c.ref.offset, c.ref.length);
+		s[c.ref.length] = '\0';
+		val->val.string_val.data = s;
+		val->val.string_val.length = c.ref.length;
+		break;
+		}
+
+	case TYPE_PATTERN:
+		{
+		char* s = new char[c.ref.length + 1];
+		memcpy(s, strings.data() + c.ref.offset, c.ref.length);
+		s[c.ref.length] = '\0';
+		val->val.pattern_text_val = s;
+		break;
+		}
+
+	default:
+		return false;
+	}
+
+	return true;
+	}
+
+FileReader::FileReader()
+	{
+	}
+
+FileReader::~FileReader()
+	{
+	Close();
+	}
+
+void FileReader::Close()
+	{
+	if ( fd >= 0 )
+		safe_close(fd);
+
+	fd = -1;
+	schema.clear();
+	row_groups.clear();
+	}
+
+bool FileReader::Fail(const std::string& msg)
+	{
+	error = msg;
+	return false;
+	}
+
+bool FileReader::ReadAt(uint64_t off, size_t len, std::string* out)
+	{
+	if ( off > size || len > size - off )
+		return Fail("chunk outside of file");
+
+	out->resize(len);
+	size_t done = 0;
+
+	while ( done < len )
+		{
+		ssize_t n = pread(fd, &(*out)[done], len - done, off + done);
+
+		if ( n < 0 && errno == EINTR )
+			continue;
+
+		if ( n <= 0 )
+			return Fail(fmt("read error: %s", n < 0 ? strerror(errno) : "unexpected end of file"));
+
+		done += n;
+		}
+
+	return true;
+	}
+
+bool FileReader::Open(const std::string& path)
+	{
+	Close();
+
+	fd = open(path.c_str(), O_RDONLY);
+
+	if ( fd < 0 )
+		return Fail(fmt("cannot open %s: %s", path.c_str(), strerror(errno)));
+
+	struct stat st;
+
+	if ( fstat(fd, &st) < 0 )
+		return Fail(fmt("cannot stat %s: %s", path.c_str(), strerror(errno)));
+
+	size = st.st_size;
+
+	std::string head, tail;
+
+	if ( size < 2 * sizeof(MAGIC) + 4 ||
+	     ! ReadAt(0, sizeof(MAGIC), &head) ||
+	     ! ReadAt(size - sizeof(MAGIC) - 4, sizeof(MAGIC) + 4, &tail) ||
+	     memcmp(head.data(), MAGIC, sizeof(MAGIC)) != 0 ||
+	     memcmp(tail.data() + 4, MAGIC, sizeof(MAGIC)) != 0 )
+		return Fail(fmt("%s is not a complete columnar log file", path.c_str()));
+
+	uint64_t footer_len;
+	Cursor t(tail.data(), 4);
+	t.Fixed(&footer_len, 4);
+
+	if ( footer_len > size - 2 * sizeof(MAGIC) - 4 ||
+	     ! ReadAt(size - sizeof(MAGIC) - 4 - footer_len, footer_len, &buffer) )
+		return Fail(fmt("%s has a corrupt footer", path.c_str()));
+
+	Cursor c(buffer.data(), buffer.size());
+	uint64_t version, num_columns, num_row_groups;
+
+	if ( ! c.Varint(&version) || version != FORMAT_VERSION )
+		return Fail(fmt("%s has unsupported format version", path.c_str()));
+
+	c.Varint(&num_columns);
+
+	for ( uint64_t i = 0; i < num_columns && c.ok; ++i )
+		{
+		ColumnSchema s;
+		uint64_t type, subtype, logical, element_logical;
+
+		c.String(&s.name);
+		c.Varint(&type);
+		c.Varint(&subtype);
+		c.Varint(&logical);
+		c.Varint(&element_logical);
+
+		s.type = TypeTag(type);
+		s.subtype = TypeTag(subtype);
+		s.logical = LogicalType(logical);
+		s.element_logical = LogicalType(element_logical);
+
+		if ( s.logical == LT_NONE || s.logical > LT_LIST ||
+		     s.element_logical > LT_PORT )
+			c.Fail();
+
+		schema.push_back(std::move(s));
+		}
+
+	c.Varint(&num_row_groups);
+
+	for ( uint64_t i = 0; i < num_row_groups && c.ok; ++i )
+		{
+		RowGroupMeta rg;
+		c.Varint32(&rg.num_rows);
+
+		for ( uint64_t j = 0; j < num_columns && c.ok; ++j )
+			{
+			ChunkMeta m;
+			uint8_t flags = 0;
+
+			c.Varint(&m.offset);
+			c.Varint32(&m.compressed_size);
+			c.Varint32(&m.uncompressed_size);
+			c.Byte(&m.encoding);
+			c.Byte(&m.codec);
+			c.Varint32(&m.num_values);
+			c.Varint32(&m.null_count);
+			c.Varint32(&m.element_null_count);
+			c.Varint32(&m.dictionary_size);
+			c.Byte(&flags);
+
+			m.has_min = flags & 1;
+			m.has_max = flags & 2;
+
+			if ( m.has_min )
+				c.String(&m.min);
+
+			if ( m.has_max )
+				c.String(&m.max);
+
+			rg.chunks.push_back(std::move(m));
+			}
+
+		row_groups.push_back(std::move(rg));
+		}
+
+	if ( ! c.ok )
+		{
+		Close();
+		return Fail(fmt("%s has a corrupt footer", path.c_str()));
+		}
+
+	return true;
+	}
+
+int FileReader::FindColumn(const std::string& name) const
+	{
+	for ( size_t i = 0; i < schema.size(); ++i )
+		{
+		if ( schema[i].name == name )
+			return i;
+		}
+
+	return -1;
+	}
+
+static bool decode_addr(Cursor* c, Value::addr_t* a)
+	{
+	uint8_t family;
+
+	if ( ! c->Byte(&family) )
+		return false;
+
+	if ( family == 4 )
+		{
+		a->family = IPv4;
+		return c->Bytes(&a->in.in4, sizeof(a->in.in4));
+		}
+
+	if ( family == 6 )
+		{
+		a->family = IPv6;
+		return c->Bytes(&a->in.in6, sizeof(a->in.in6));
+		}
+
+	return c->Fail();
+	}
+
+static bool decode_atom(Cursor* c, LogicalType lt, RecordBatch::Cell* cell, std::string* strings)
+	{
+	uint64_t v;
+
+	switch ( lt ) {
+	case LT_BOOL:
+		{
+		uint8_t b;
+
+		if ( ! c->Byte(&b) )
+			return false;
+
+		cell->int_val = b;
+		return true;
+		}
+
+	case LT_INT64:
+		if ( ! c->Varint(&v) )
+			return false;
+
+		cell->int_val = unzigzag(v);
+		return true;
+
+	case LT_UINT64:
+		if ( ! c->Varint(&v) )
+			return false;
+
+		cell->uint_val = v;
+		return true;
+
+	case LT_DOUBLE:
+		if ( ! c->Fixed(&v, 8) )
+			return false;
+
+		memcpy(&cell->double_val, &v, sizeof(v));
+		return true;
+
+	case LT_TIMESTAMP_MICROS:
+	case LT_DURATION_MICROS:
+		if ( ! c->Varint(&v) )
+			return false;
+
+		cell->double_val = double(unzigzag(v)) / 1e6;
+		return true;
+
+	case LT_STRING:
+	case LT_ENUM:
+		{
+		if ( ! c->Varint(&v) || uint64_t(c->end - c->p) < v )
+			return c->Fail();
+
+		cell->ref.offset = strings->size();
+		cell->ref.length = v;
+		strings->append(c->p, v);
+		c->p += v;
+		return true;
+		}
+
+	case LT_IP_ADDRESS:
+		return decode_addr(c, &cell->addr_val);
+
+	case LT_IP_SUBNET:
+		return decode_addr(c, &cell->subnet_val.prefix) &&
+			c->Byte(&cell->subnet_val.length);
+
+	case LT_PORT:
+		{
+		uint8_t proto;
+
+		if ( ! c->Varint(&v) || ! c->Byte(&proto) || proto > TRANSPORT_ICMP )
+			return c->Fail();
+
+		cell->port_val.port = v;
+		cell->port_val.proto = TransportProto(proto);
+		return true;
+		}
+
+	default:
+		return c->Fail();
+	}
+	}
+
+bool FileReader::ReadColumn(size_t row_group, int col, ColumnData* data)
+	{
+	if ( row_group >= row_groups.size() || col < 0 || size_t(col) >= schema.size() )
+		return Fail("no such column chunk");
+
+	const ColumnSchema& s = schema[col];
+	const RowGroupMeta& rg = row_groups[row_group];
+	const ChunkMeta& m = rg.chunks[col];
+
+	if ( ! ReadAt(m.offset, m.compressed_size, &buffer) )
+		return false;
+
+	if ( m.codec == CODEC_ZLIB )
+		{
+		std::string raw(m.uncompressed_size, '\0');
+		uLongf len = m.uncompressed_size;
+
+		if ( uncompress((Bytef*)&raw[0], &len, (const Bytef*)buffer.data(), buffer.size()) != Z_OK ||
+		     len != m.uncompressed_size )
+			return Fail(fmt("corrupt compressed chunk for column %s", s.name.c_str()));
+
+		buffer.swap(raw);
+		}
+
+	else if ( m.codec != CODEC_NONE )
+		return Fail(fmt("unknown compression for column %s", s.name.c_str()));
+
+	*data = ColumnData();
+	data->container = (s.logical == LT_SET || s.logical == LT_LIST);
+	data->logical = data->container ? s.element_logical : s.logical;
+
+	Cursor c(buffer.data(), buffer.size());
+
+	if ( m.null_count > rg.num_rows )
+		return Fail(fmt("corrupt chunk for column %s", s.name.c_str()));
+
+	if ( m.null_count )
+		c.Bitmap(rg.num_rows, &data->present);
+	else
+		data->present.assign(rg.num_rows, 1);
+
+	uint64_t expected = rg.num_rows - m.null_count;
+
+	if ( data->container )
+		{
+		uint64_t num_elements = 0;
+
+		for ( uint64_t i = 0; i < expected && c.ok; ++i )
+			{
+			uint32_t n = 0;
+			c.Varint32(&n);
+			data->lengths.push_back(n);
+			num_elements += n;
+			}
+
+		if ( num_elements > UINT32_MAX || m.element_null_count > num_elements )
+			c.Fail();
+
+		else if ( m.element_null_count )
+			c.Bitmap(num_elements, &data->element_present);
+		else
+			data->element_present.assign(num_elements, 1);
+
+		expected = num_elements - m.element_null_count;
+		}
+
+	if ( expected != m.num_values )
+		c.Fail();
+
+	// Make sure the presence information agrees with the counts.
+	size_t set = 0;
+
+	for ( auto p : data->present )
+		set += p;
+
+	if ( set != rg.num_rows - m.null_count )
+		c.Fail();
+
+	if ( data->container )
+		{
+		set = 0;
+
+		for ( auto p : data->element_present )
+			set += p;
+
+		if ( set != data->element_present.size() - m.element_null_count )
+			c.Fail();
+		}
+
+	data->cells.resize(m.num_values);
+
+	if ( m.encoding == ENCODING_DICTIONARY )
+		{
+		uint64_t n;
+		std::vector<RecordBatch::Cell> dict;
+
+		if ( c.Varint(&n) && n == m.dictionary_size && n <= m.num_values )
+			{
+			dict.resize(n);
+
+			for ( uint64_t i = 0; i < n && c.ok; ++i )
+				decode_atom(&c, data->logical, &dict[i], &data->strings);
+			}
+		else
+			c.Fail();
+
+		for ( uint32_t i = 0; i < m.num_values && c.ok; ++i )
+			{
+			uint64_t idx;
+
+			if ( c.Varint(&idx) && idx < dict.size() )
+				data->cells[i] = dict[idx];
+			else
+				c.Fail();
+			}
+		}
+
+	else if ( m.encoding == ENCODING_PLAIN )
+		{
+		for ( uint32_t i = 0; i < m.num_values && c.ok; ++i )
+			decode_atom(&c, data->logical, &data->cells[i], &data->strings);
+		}
+
+	else
+		c.Fail();
+
+	if ( ! c.ok || c.p != c.end )
+		return Fail(fmt("corrupt chunk for column %s", s.name.c_str()));
+
+	return true;
+	}
+
+static std::string test_path(const char* name)
+	{
+	const char* dir = getenv("TMPDIR");
+	return fmt("%s/zeek-columnar-test-%d-%s", dir ? dir : "/tmp", int(getpid()), name);
+	}
+
+TEST_CASE("columnar file roundtrip")
+	{
+	Field f_ts("ts", nullptr, TYPE_TIME, TYPE_VOID, false);
+	Field f_addr("addr", nullptr, TYPE_ADDR, TYPE_VOID, false);
+	Field f_port("port", nullptr, TYPE_PORT, TYPE_VOID, false);
+	Field f_str("str", nullptr, TYPE_STRING, TYPE_VOID, true);
+	Field f_vec("vec", nullptr, TYPE_VECTOR, TYPE_COUNT, false);
+	const Field* fields[] = { &f_ts, &f_addr, &f_port, &f_str, &f_vec };
+
+	RecordBatch b(5, fields);
+
+	for ( int i = 0; i < 1000; ++i )
+		{
+		b.AddRow();
+		b.Set(0).double_val = 1500000000.0 + i * 0.25;
+
+		RecordBatch::Cell& a = b.Set(1);
+		a.addr_val.family = IPv4;
+		a.addr_val.in.in4.s_addr = htonl(0x0a000000 + i % 7);
+
+		RecordBatch::Cell& p = b.Set(2);
+		p.port_val.port = 1024 + i;
+		p.port_val.proto = TRANSPORT_TCP;
+
+		if ( i % 3 )
+			{
+			const char* s = (i % 2) ? "odd" : "even";
+			b.Set(3).ref = b.AddString(s, strlen(s));
+			}
+
+		b.StartContainer(4);
+
+		for ( int j = 0; j < i % 4; ++j )
+			b.AddElement(4).uint_val = j;
+		}
+
+	for ( int level = 0; level <= 6; level += 6 )
+		{
+		std::string path = test_path("roundtrip");
+		FileWriter w(level, 1024);
+		REQUIRE(w.Open(path, 5, fields));
+
+		// Two row groups.
+		for ( int i = 0; i < 600; ++i )
+			w.Add(b, i);
+
+		CHECK(w.FinishRowGroup());
+
+		for ( int i = 600; i < 1000; ++i )
+			w.Add(b, i);
+
+		CHECK(w.Close());
+
+		FileReader r;
+		REQUIRE(r.Open(path));
+		CHECK(r.Schema().size() == 5);
+		CHECK(r.Schema()[0].logical == LT_TIMESTAMP_MICROS);
+		CHECK(r.Schema()[4].logical == LT_LIST);
+		CHECK(r.Schema()[4].element_logical == LT_UINT64);
+		CHECK(r.Schema()[3].Feeds(TYPE_ENUM, TYPE_VOID));
+		CHECK(! r.Schema()[3].Feeds(TYPE_COUNT, TYPE_VOID));
+		CHECK(r.FindColumn("port") == 2);
+		REQUIRE(r.RowGroups().size() == 2);
+		CHECK(r.RowGroups()[0].num_rows == 600);
+
+		// Few distinct addresses and strings make for dictionaries.
+		const ChunkMeta& am = r.RowGroups()[0].chunks[1];
+		CHECK(am.encoding == ENCODING_DICTIONARY);
+		CHECK(am.dictionary_size == 7);
+		CHECK(r.RowGroups()[0].chunks[3].null_count == 200);
+
+		// Statistics.
+		const ChunkMeta& pm = r.RowGroups()[1].chunks[2];
+		CHECK(pm.has_min);
+		CHECK(pm.has_max);
+		CHECK(uint8_t(pm.min[0]) * 256 + uint8_t(pm.min[1]) == 1624);
+		CHECK(uint8_t(pm.max[0]) * 256 + uint8_t(pm.max[1]) == 2023);
+
+		int row = 0;
+
+		for ( size_t g = 0; g < r.RowGroups().size(); ++g )
+			{
+			ColumnData cols[5];
+
+			for ( int i = 0; i < 5; ++i )
+				REQUIRE(r.ReadColumn(g, i, &cols[i]));
+
+			for ( uint32_t k = 0; k < r.RowGroups()[g].num_rows; ++k, ++row )
+				{
+				Value* ts = cols[0].NextValue(TYPE_TIME, TYPE_VOID);
+				Value* addr = cols[1].NextValue(TYPE_ADDR, TYPE_VOID);
+				Value* port = cols[2].NextValue(TYPE_PORT, TYPE_VOID);
+				Value* str = cols[3].NextValue(TYPE_STRING, TYPE_VOID);
+				Value* vec = cols[4].NextValue(TYPE_VECTOR, TYPE_COUNT);
+
+				CHECK(ts->val.double_val == 1500000000.0 + row * 0.25);
+				CHECK(addr->val.addr_val.in.in4.s_addr == htonl(0x0a000000 + row % 7));
+				CHECK(port->val.port_val.port == bro_uint_t(1024 + row));
+				CHECK(port->val.port_val.proto == TRANSPORT_TCP);
+				CHECK(str->present == (row % 3 != 0));
+
+				if ( str->present )
+					CHECK(strcmp(str->val.string_val.data, (row % 2) ? "odd" : "even") == 0);
+
+				REQUIRE(vec->val.vector_val.size == row % 4);
+
+				for ( int j = 0; j < row % 4; ++j )
+					CHECK(vec->val.vector_val.vals[j]->val.uint_val == bro_uint_t(j));
+
+				delete ts;
+				delete addr;
+				delete port;
+				delete str;
+				delete vec;
+				}
+
+			CHECK(cols[0].NextValue(TYPE_TIME, TYPE_VOID) == nullptr);
+			}
+
+		CHECK(row == 1000);
+		unlink(path.c_str());
+		}
+	}
+
+TEST_CASE("columnar file corruption")
+	{
+	Field f_count("count", nullptr, TYPE_COUNT, TYPE_VOID, false);
+	const Field* fields[] = { &f_count };
+
+	RecordBatch b(1, fields);
+	b.AddRow();
+	b.Set(0).uint_val = 42;
+
+	std::string path = test_path("corrupt");
+	FileWriter w(0, 0);
+	REQUIRE(w.Open(path, 1, fields));
+	w.Add(b, 0);
+	CHECK(w.Close());
+
+	FileReader r;
+	CHECK(r.Open(path));
+
+	// Truncate the footer.
+	CHECK(truncate(path.c_str(), 10) == 0);
+	CHECK(! r.Open(path));
+	CHECK(! r.Error().empty());
+
+	unlink(path.c_str());
+	}
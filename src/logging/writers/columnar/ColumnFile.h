@@ -0,0 +1,352 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// A columnar file format for logs, in the spirit of Parquet, shared by the
+// Columnar log writer and the Columnar input reader.
+//
+// A file consists of row groups, each holding one chunk per column, followed
+// by a footer with the schema and the location and statistics of every
+// chunk:
+//
+//   "ZCL1" chunk* footer footer-length:uint32 "ZCL1"
+//
+// A column chunk holds the values of one column for all rows of a row group,
+// optionally compressed with zlib as a whole:
+//
+//   [row presence bitmap]        if the chunk has unset values
+//   [element count per row]      sets and vectors only, varints
+//   [element presence bitmap]    sets and vectors with unset elements
+//   [dictionary]                 dictionary-encoded chunks only
+//   values                       plain values, or varint dictionary indices
+//
+// Values of a set or vector column are its elements, so both share a
+// dictionary. Integers are stored as (zigzag) varints, times and intervals as
+// microseconds, and strings with a varint length prefix. The minimum and
+// maximum of each chunk are kept in the footer as keys that compare bytewise
+// in the order of the logical type.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "threading/SerialTypes.h"
+#include "threading/RecordBatch.h"
+
+namespace logging { namespace writer { namespace columnar {
+
+/**
+ * The logical type of a column, independent of the Zeek type that it was
+ * written from.
+ */
+enum LogicalType {
+	LT_NONE = 0,
+	LT_BOOL,
+	LT_INT64,
+	LT_UINT64,
+	LT_DOUBLE,
+	LT_TIMESTAMP_MICROS,	// time: microseconds since the epoch
+	LT_DURATION_MICROS,	// interval: microseconds
+	LT_STRING,		// string, file, func, pattern
+	LT_ENUM,		// enum, stored by name
+	LT_IP_ADDRESS,
+	LT_IP_SUBNET,
+	LT_PORT,		// port number and transport protocol
+	LT_SET,			// set of an atomic logical type
+	LT_LIST,		// vector of an atomic logical type
+};
+
+/**
+ * Returns the logical type used for a Zeek type, or LT_NONE if the type
+ * cannot be stored.
+ */
+LogicalType ToLogicalType(TypeTag type);
+
+/**
+ * Returns a readable name for a logical type.
+ */
+const char* LogicalTypeName(LogicalType lt);
+
+enum Encoding {
+	ENCODING_PLAIN = 0,
+	ENCODING_DICTIONARY = 1,
+};
+
+enum Codec {
+	CODEC_NONE = 0,
+	CODEC_ZLIB = 1,
+};
+
+/**
+ * Description of one column.
+ */
+struct ColumnSchema {
+	std::string name;
+	TypeTag type;		// Zeek type the column was written from
+	TypeTag subtype;	// element type for sets and vectors
+	LogicalType logical;
+	LogicalType element_logical;	// for LT_SET and LT_LIST
+
+	/**
+	 * Returns true if the column's values can be read into a field of
+	 * the given type.
+	 */
+	bool Feeds(TypeTag type, TypeTag subtype) const;
+};
+
+/**
+ * Location and statistics of one column chunk.
+ */
+struct ChunkMeta {
+	uint64_t offset = 0;
+	uint32_t compressed_size = 0;
+	uint32_t uncompressed_size = 0;
+	uint8_t encoding = ENCODING_PLAIN;
+	uint8_t codec = CODEC_NONE;
+	uint32_t num_values = 0;	// set values, including elements
+	uint32_t null_count = 0;	// unset rows
+	uint32_t element_null_count = 0;	// unset set/vector elements
+	uint32_t dictionary_size = 0;
+	bool has_min = false;
+	bool has_max = false;
+	std::string min;	// see StatsKey()
+	std::string max;
+};
+
+struct RowGroupMeta {
+	uint32_t num_rows = 0;
+	std::vector<ChunkMeta> chunks;
+};
+
+/**
+ * Accumulates the values of one column for a row group and encodes them
+ * into a chunk.
+ */
+class ColumnBuilder {
+public:
+	ColumnBuilder(const ColumnSchema& schema, size_t max_dictionary_size);
+
+	/**
+	 * Adds a column value from a batch.
+	 */
+	void Add(const threading::RecordBatch& batch, int row, int col);
+
+	/**
+	 * Returns the number of rows added since the last Finish().
+	 */
+	uint32_t NumRows() const	{ return num_rows; }
+
+	/**
+	 * Encodes the accumulated values into \a out, fills in the chunk's
+	 * metadata except for its offset, and resets the builder.
+	 *
+	 * @param compression_level zlib compression level, 0 to disable
+	 * compression.
+	 */
+	void Finish(int compression_level, std::string* out, ChunkMeta* meta);
+
+private:
+	// Encodes an atomic value and adds it to the values.
+	void AddAtom(const threading::RecordBatch& batch, LogicalType lt,
+	             const threading::RecordBatch::Cell& c);
+
+	ColumnSchema schema;
+	size_t max_dictionary_size;
+
+	uint32_t num_rows = 0;
+	std::vector<uint8_t> present;
+	std::vector<uint32_t> lengths;
+	std::vector<uint8_t> element_present;
+	uint32_t null_count = 0;
+	uint32_t element_null_count = 0;
+
+	uint32_t num_values = 0;
+	std::string plain;	// plain-encoded values
+	std::string atom;	// scratch for the value being added
+
+	// Dictionary, dropped once it grows beyond max_dictionary_size.
+	bool use_dictionary = true;
+	std::unordered_map<std::string, uint32_t> dictionary;
+	std::vector<const std::string*> dictionary_values;	// keys of dictionary, by index
+	std::vector<uint32_t> indices;
+
+	bool has_stats = false;
+	bool has_max = true;
+	std::string min;
+	std::string max;
+	std::string key;	// scratch for the key of the value being added
+};
+
+/**
+ * Writes a columnar file. All methods that return false set an error
+ * message that can be retrieved with Error().
+ */
+class FileWriter {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param compression_level zlib compression level for column
+	 * chunks, 0 to disable compression.
+	 *
+	 * @param max_dictionary_size The maximum number of distinct values
+	 * per column chunk for dictionary encoding.
+	 */
+	FileWriter(int compression_level, size_t max_dictionary_size);
+	~FileWriter();
+
+	FileWriter(const FileWriter&) = delete;
+	FileWriter& operator=(const FileWriter&) = delete;
+
+	/**
+	 * Creates a file for records with the given fields, truncating any
+	 * existing one.
+	 */
+	bool Open(const std::string& path, int num_fields, const threading::Field* const* fields);
+
+	bool IsOpen() const	{ return fd >= 0; }
+
+	/**
+	 * Buffers a row of a batch for the current row group. The batch's
+	 * columns must match the fields passed to Open().
+	 */
+	void Add(const threading::RecordBatch& batch, int row);
+
+	/**
+	 * Returns the number of rows buffered for the current row group.
+	 */
+	uint32_t BufferedRows() const	{ return buffered_rows; }
+
+	/**
+	 * Writes out the rows buffered so far as a row group, if there are
+	 * any.
+	 */
+	bool FinishRowGroup();
+
+	/**
+	 * Finishes the current row group, writes the footer and closes the
+	 * file.
+	 */
+	bool Close();
+
+	/**
+	 * Returns a description of the last error.
+	 */
+	const std::string& Error() const	{ return error; }
+
+private:
+	bool Write(const void* data, size_t len);
+
+	int compression_level;
+	size_t max_dictionary_size;
+
+	int fd = -1;
+	std::string path;
+	uint64_t offset = 0;
+	std::string error;
+
+	std::vector<ColumnSchema> schema;
+	std::vector<ColumnBuilder> builders;
+	std::vector<RowGroupMeta> row_groups;
+	uint32_t buffered_rows = 0;
+	std::string chunk;
+};
+
+/**
+ * The decoded values of one column chunk.
+ */
+class ColumnData {
+public:
+	/**
+	 * Returns a newly allocated Value for the next row, or null on a
+	 * malformed chunk. Rows must be retrieved in order.
+	 *
+	 * @param type The type of the Value, which must be one the column
+	 * feeds; see ColumnSchema::Feeds().
+	 *
+	 * @param subtype The element type of a set or vector Value.
+	 */
+	threading::Value* NextValue(TypeTag type, TypeTag subtype);
+
+private:
+	friend class FileReader;
+
+	// Fills in a Value of an atomic type.
+	bool AtomToValue(size_t idx, threading::Value* val) const;
+
+	LogicalType logical = LT_NONE;	// of the values
+	bool container = false;
+
+	std::vector<uint8_t> present;
+	std::vector<uint32_t> lengths;
+	std::vector<uint8_t> element_present;
+	std::vector<threading::RecordBatch::Cell> cells;
+	std::string strings;
+
+	size_t next_row = 0;
+	size_t next_length = 0;
+	size_t next_element = 0;
+	size_t next_cell = 0;
+};
+
+/**
+ * Reads a columnar file. All methods that return false set an error
+ * message that can be retrieved with Error().
+ */
+class FileReader {
+public:
+	FileReader();
+	~FileReader();
+
+	FileReader(const FileReader&) = delete;
+	FileReader& operator=(const FileReader&) = delete;
+
+	/**
+	 * Opens a file and reads its footer.
+	 */
+	bool Open(const std::string& path);
+
+	void Close();
+
+	const std::vector<ColumnSchema>& Schema() const	{ return schema; }
+	const std::vector<RowGroupMeta>& RowGroups() const	{ return row_groups; }
+
+	/**
+	 * Returns the index of the column with the given name, or -1.
+	 */
+	int FindColumn(const std::string& name) const;
+
+	/**
+	 * Reads and decodes a column chunk.
+	 */
+	bool ReadColumn(size_t row_group, int col, ColumnData* data);
+
+	/**
+	 * Returns a description of the last error.
+	 */
+	const std::string& Error() const	{ return error; }
+
+private:
+	bool ReadAt(uint64_t offset, size_t len, std::string* out);
+	bool Fail(const std::string& msg);
+
+	int fd = -1;
+	uint64_t size = 0;
+	std::string error;
+
+	std::vector<ColumnSchema> schema;
+	std::vector<RowGroupMeta> row_groups;
+	std::string buffer;
+};
+
+/**
+ * Computes the key under which a value of the given logical type is
+ * recorded in a chunk's statistics. Keys compare bytewise in the order of
+ * the values. Leaves \a key empty for values without an order, i.e., NaN.
+ */
+void StatsKey(LogicalType lt, const threading::RecordBatch& batch,
+              const threading::RecordBatch::Cell& c, std::string* key);
+
+} } }
@@ -0,0 +1,213 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include <string>
+#include <errno.h>
+#include <stdio.h>
+
+#include "threading/SerialTypes.h"
+
+#include "Columnar.h"
+#include "columnar.bif.h"
+
+using namespace std;
+using namespace logging::writer;
+using threading::Value;
+using threading::Field;
+using threading::RecordBatch;
+
+Columnar::Columnar(WriterFrontend* frontend) : WriterBackend(frontend)
+	{
+	file = nullptr;
+	single = nullptr;
+
+	compression_level = BifConst::LogColumnar::compression_level;
+	row_group_size = BifConst::LogColumnar::row_group_size;
+	dictionary_size = BifConst::LogColumnar::dictionary_size;
+	}
+
+Columnar::~Columnar()
+	{
+	// In case of errors aborting the logging altogether, DoFinish() may
+	// not have been called.
+	CloseFile();
+
+	delete single;
+	}
+
+bool Columnar::InitFilterOptions()
+	{
+	const WriterInfo& info = Info();
+
+	// Set per-filter configuration options.
+	for ( WriterInfo::config_map::const_iterator i = info.config.begin();
+	      i != info.config.end(); ++i )
+		{
+		if ( strcmp(i->first, "compression_level") == 0 )
+			{
+			compression_level = atoi(i->second);
+
+			if ( compression_level < 0 || compression_level > 9 )
+				{
+				Error("invalid value for 'compression_level', must be a number between 0 and 9.");
+				return false;
+				}
+			}
+
+		else if ( strcmp(i->first, "row_group_size") == 0 )
+			{
+			row_group_size = strtoull(i->second, nullptr, 10);
+
+			if ( row_group_size == 0 )
+				{
+				Error("invalid value for 'row_group_size', must be a positive number.");
+				return false;
+				}
+			}
+		}
+
+	return true;
+	}
+
+bool Columnar::DoInit(const WriterInfo& info, int num_fields, const Field* const * fields)
+	{
+	if ( ! InitFilterOptions() )
+		return false;
+
+	if ( compression_level < 0 || compression_level > 9 )
+		{
+		Error("invalid value for 'LogColumnar::compression_level', must be a number between 0 and 9.");
+		return false;
+		}
+
+	if ( row_group_size == 0 || row_group_size > UINT32_MAX )
+		{
+		Error("invalid value for 'LogColumnar::row_group_size'");
+		return false;
+		}
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		const Field* f = fields[i];
+		columnar::LogicalType lt = columnar::ToLogicalType(f->type);
+		bool container = (lt == columnar::LT_SET || lt == columnar::LT_LIST);
+
+		if ( lt == columnar::LT_NONE ||
+		     (container && columnar::ToLogicalType(f->subtype) == columnar::LT_NONE) )
+			{
+			Error(Fmt("unsupported type for field %s: %s", f->name, type_name(f->type)));
+			return false;
+			}
+		}
+
+	fname = string(info.path) + "." + LogExt();
+
+	return OpenFile();
+	}
+
+bool Columnar::OpenFile()
+	{
+	file = new columnar::FileWriter(compression_level, dictionary_size);
+
+	if ( ! file->Open(fname, NumFields(), Fields()) )
+		{
+		Error(file->Error().c_str());
+		delete file;
+		file = nullptr;
+		return false;
+		}
+
+	return true;
+	}
+
+bool Columnar::CloseFile()
+	{
+	if ( ! file )
+		return true;
+
+	bool ok = file->Close();
+
+	if ( ! ok )
+		Error(file->Error().c_str());
+
+	delete file;
+	file = nullptr;
+	return ok;
+	}
+
+bool Columnar::DoFinish(double network_time)
+	{
+	return CloseFile();
+	}
+
+bool Columnar::DoWrite(int num_fields, const Field* const * fields,
+			     Value** vals)
+	{
+	if ( ! single )
+		single = new RecordBatch(NumFields(), Fields());
+
+	single->Clear();
+
+	if ( ! single->AddRow(num_fields, vals) )
+		{
+		Error("type mismatch writing record");
+		return false;
+		}
+
+	return DoWriteBatch(*single);
+	}
+
+bool Columnar::DoWriteBatch(const RecordBatch& batch)
+	{
+	// Reopen after a rotation.
+	if ( ! file && ! OpenFile() )
+		return false;
+
+	for ( int j = 0; j < batch.NumRows(); j++ )
+		{
+		file->Add(batch, j);
+
+		if ( file->BufferedRows() >= row_group_size && ! file->FinishRowGroup() )
+			{
+			Error(file->Error().c_str());
+			return false;
+			}
+		}
+
+	return true;
+	}
+
+bool Columnar::DoRotate(const char* rotated_path, double open, double close, bool terminating)
+	{
+	// Rotation ends the current row group along with the file.
+	if ( ! file )
+		{
+		FinishedRotation();
+		return true;
+		}
+
+	if ( ! CloseFile() )
+		{
+		FinishedRotation();
+		return false;
+		}
+
+	string nname = string(rotated_path) + "." + LogExt();
+
+	if ( rename(fname.c_str(), nname.c_str()) != 0 )
+		{
+		char buf[256];
+		bro_strerror_r(errno, buf, sizeof(buf));
+		Error(Fmt("failed to rename %s to %s: %s", fname.c_str(),
+		          nname.c_str(), buf));
+		FinishedRotation();
+		return false;
+		}
+
+	if ( ! FinishedRotation(nname.c_str(), fname.c_str(), open, close, terminating) )
+		{
+		Error(Fmt("error rotating %s to %s", fname.c_str(), nname.c_str()));
+		return false;
+		}
+
+	return true;
+	}
@@ -0,0 +1,55 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Log writer for columnar, Parquet-style log files; see ColumnFile.h for the
+// format.
+
+#pragma once
+
+#include "logging/WriterBackend.h"
+
+#include "ColumnFile.h"
+
+namespace logging { namespace writer {
+
+class Columnar : public WriterBackend {
+public:
+	explicit Columnar(WriterFrontend* frontend);
+	~Columnar() override;
+
+	static std::string LogExt()	{ return "zcol"; }
+
+	static WriterBackend* Instantiate(WriterFrontend* frontend)
+		{ return new Columnar(frontend); }
+
+protected:
+	bool DoInit(const WriterInfo& info, int num_fields,
+			    const threading::Field* const* fields) override;
+	bool DoWrite(int num_fields, const threading::Field* const* fields,
+			     threading::Value** vals) override;
+	bool DoWriteBatch(const threading::RecordBatch& batch) override;
+	bool DoSetBuf(bool enabled) override	{ return true; }
+	bool DoRotate(const char* rotated_path, double open,
+			      double close, bool terminating) override;
+	bool DoFlush(double network_time) override	{ return true; }
+	bool DoFinish(double network_time) override;
+	bool DoHeartbeat(double network_time, double current_time) override	{ return true; }
+
+private:
+	bool InitFilterOptions();
+	bool OpenFile();
+	bool CloseFile();
+
+	std::string fname;
+	columnar::FileWriter* file;
+
+	// Scratch batch for DoWrite().
+	threading::RecordBatch* single;
+
+	// Options set from the script-level.
+	int compression_level;
+	uint64_t row_group_size;
+	uint64_t dictionary_size;
+};
+
+}
+}
@@ -21,6 +21,7 @@ protected:
 			    const threading::Field* const * fields) override;
 	bool DoWrite(int num_fields, const threading::Field* const* fields,
 			     threading::Value** vals) override { return true; }
+	bool DoWriteBatch(const threading::RecordBatch& batch) override { return true; }
 	bool DoSetBuf(bool enabled) override { return true; }
 	bool DoRotate(const char* rotated_path, double open,
 			      double close, bool terminating) override;
@@ -469,6 +469,7 @@ Clear_Patricia (patricia_tree_t *patricia, data_fn_t func)
                 Xrn = (patricia_node_t *) 0;
             }
         }
+        patricia->head = NULL;
     }
     assert (patricia->num_active_node == 0);
     /* Delete (patricia); */
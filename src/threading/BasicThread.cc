@@ -47,6 +47,11 @@ void BasicThread::SetName(const char* arg_name)
 void BasicThread::SetOSName(const char* arg_name)
 	{
 	static_assert(std::is_same<std::thread::native_handle_type, pthread_t>::value, "libstdc++ doesn't use pthread_t");
+
+	// Without a thread of its own, see Launch(), there's nothing to name.
+	if ( ! thread.joinable() )
+		return;
+
 	zeek::set_thread_name(arg_name, thread.native_handle());
 	}
 
@@ -94,13 +99,18 @@ void BasicThread::Start()
 
 	started = true;
 
-	thread = std::thread(&BasicThread::launcher, this);
+	Launch();
 
 	DBG_LOG(DBG_THREADING, "Started thread %s", name);
 
 	OnStart();
 	}
 
+void BasicThread::Launch()
+	{
+	thread = std::thread(&BasicThread::launcher, this);
+	}
+
 void BasicThread::SignalStop()
 	{
 	if ( ! started )
@@ -131,11 +141,18 @@ void BasicThread::Join()
 	if ( ! started )
 		return;
 
+	assert(terminating);
+
+	WaitForExit();
+
+	DBG_LOG(DBG_THREADING, "Joined with thread %s", name);
+	}
+
+void BasicThread::WaitForExit()
+	{
 	if ( ! thread.joinable() )
 		return;
 
-	assert(terminating);
-
 	try
 		{
 		thread.join();
@@ -144,8 +161,6 @@ void BasicThread::Join()
 		{
 		reporter->FatalError("Failure joining thread %s with error %s", name, e.what());
 		}
-
-	DBG_LOG(DBG_THREADING, "Joined with thread %s", name);
 	}
 
 void BasicThread::Kill()
@@ -138,6 +138,20 @@ protected:
 	 */
 	virtual void Run() = 0;
 
+	/**
+	 * Executed with Start() to get Run() going. The default starts an
+	 * OS thread for it. A derived class that executes elsewhere must
+	 * call Done() once it has finished, and override WaitForExit() to
+	 * match.
+	 */
+	virtual void Launch();
+
+	/**
+	 * Executed with Join() to wait until what Launch() started has
+	 * finished. The default joins the OS thread.
+	 */
+	virtual void WaitForExit();
+
 	/**
 	 * Executed with Start(). This is a hook into starting the thread. It
 	 * will be called from Bro's main thread after the OS thread has been
@@ -4,9 +4,18 @@
 #include "Formatter.h"
 
 #include <errno.h>
+#include <math.h>
+
+#include <limits>
+#include <random>
 
 #include "MsgThread.h"
+#include "Desc.h"
 #include "bro_inet_ntop.h"
+#include "formatters/Ascii.h"
+#include "formatters/JSON.h"
+
+#include "3rdparty/doctest.h"
 
 using namespace threading;
 using namespace formatter;
@@ -22,26 +31,50 @@ Formatter::~Formatter()
 	{
 	}
 
+bool Formatter::Describe(ODesc* desc, int num_fields, const threading::Field* const * fields,
+                         const threading::RecordBatch& batch, int row) const
+	{
+	RecordBatchRow values(num_fields);
+	return Describe(desc, num_fields, fields, values.Fill(batch, row));
+	}
+
 std::string Formatter::Render(const threading::Value::addr_t& addr)
+	{
+	char s[INET6_ADDRSTRLEN];
+	size_t n = Render(addr, s);
+	return std::string(s, n);
+	}
+
+size_t Formatter::Render(const threading::Value::addr_t& addr, char* buf)
 	{
 	if ( addr.family == IPv4 )
 		{
-		char s[INET_ADDRSTRLEN];
+		// Dotted quad, as bro_inet_ntop() has it.
+		const u_char* b = reinterpret_cast<const u_char*>(&addr.in.in4);
+		char* p = buf;
 
-		if ( ! bro_inet_ntop(AF_INET, &addr.in.in4, s, INET_ADDRSTRLEN) )
-			return "<bad IPv4 address conversion>";
-		else
-			return s;
-		}
-	else
-		{
-		char s[INET6_ADDRSTRLEN];
+		for ( int i = 0; i < 4; ++i )
+			{
+			if ( i > 0 )
+				*p++ = '.';
 
-		if ( ! bro_inet_ntop(AF_INET6, &addr.in.in6, s, INET6_ADDRSTRLEN) )
-			return "<bad IPv6 address conversion>";
-		else
-			return s;
+			if ( b[i] >= 100 )
+				*p++ = '0' + b[i] / 100;
+
+			if ( b[i] >= 10 )
+				*p++ = '0' + b[i] / 10 % 10;
+
+			*p++ = '0' + b[i] % 10;
+			}
+
+		*p = '\0';
+		return p - buf;
 		}
+
+	if ( ! bro_inet_ntop(AF_INET6, &addr.in.in6, buf, INET6_ADDRSTRLEN) )
+		strcpy(buf, "<bad IPv6 address conversion>");
+
+	return strlen(buf);
 	}
 
 TransportProto Formatter::ParseProto(const std::string &proto) const
@@ -106,9 +139,15 @@ std::string Formatter::Render(const threading::Value::subnet_t& subnet)
 
 std::string Formatter::Render(double d)
 	{
-	char buf[256];
+	char buf[32];
+	size_t n = Render(d, buf);
+	return std::string(buf, n);
+	}
+
+size_t Formatter::Render(double d, char* buf)
+	{
 	modp_dtoa(d, buf, 6);
-	return buf;
+	return strlen(buf);
 	}
 
 std::string Formatter::Render(TransportProto proto)
@@ -122,3 +161,219 @@ std::string Formatter::Render(TransportProto proto)
 	else
 		return "unknown";
 	}
+
+namespace {
+
+// A random value of an atomic type, with some of the odd ones thrown in.
+RecordBatch::Cell random_cell(std::mt19937& rng, RecordBatch* b, TypeTag type)
+	{
+	static const double doubles[] = {
+		0.0, -0.5, 1e-7, 123456.0, 1e300, -1e300,
+		std::numeric_limits<double>::quiet_NaN(),
+		std::numeric_limits<double>::infinity(),
+		-std::numeric_limits<double>::infinity(),
+	};
+
+	static const char* strings[] = { "-", "(empty)", "" };
+
+	// Separators, reserved strings, quotes, backslashes, control
+	// characters, valid and invalid UTF-8.
+	static const char alphabet[] = "abc -(empty),|\t\n\\\"\x01\x7f\x80\xc3\xa9\xff";
+
+	RecordBatch::Cell c;
+	memset(&c, 0, sizeof(c));
+
+	switch ( type ) {
+	case TYPE_BOOL:
+		c.int_val = rng() % 2;
+		break;
+
+	case TYPE_INT:
+		if ( rng() % 4 == 0 )
+			c.int_val = std::numeric_limits<bro_int_t>::min();
+		else
+			c.int_val = (bro_int_t)(((uint64_t)rng() << 32) | rng()) >> (rng() % 64);
+		break;
+
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+		c.uint_val = (((uint64_t)rng() << 32) | rng()) >> (rng() % 64);
+		break;
+
+	case TYPE_PORT:
+		c.port_val.port = rng() % 65536;
+		c.port_val.proto = TRANSPORT_TCP;
+		break;
+
+	case TYPE_ADDR:
+	case TYPE_SUBNET:
+		{
+		Value::addr_t* a = (type == TYPE_ADDR ? &c.addr_val : &c.subnet_val.prefix);
+		a->family = (rng() % 2 ? IPv4 : IPv6);
+
+		u_char* bytes = reinterpret_cast<u_char*>(&a->in);
+		size_t n = (a->family == IPv4 ? 4 : 16);
+
+		// Lots of zeros, for the IPv6 compression.
+		for ( size_t i = 0; i < n; ++i )
+			bytes[i] = rng() % 3 ? 0 : rng();
+
+		if ( type == TYPE_SUBNET )
+			c.subnet_val.length = (a->family == IPv4 ? 96 + rng() % 33 : rng() % 129);
+
+		break;
+		}
+
+	case TYPE_DOUBLE:
+	case TYPE_INTERVAL:
+		if ( rng() % 2 )
+			c.double_val = doubles[rng() % (sizeof(doubles) / sizeof(doubles[0]))];
+		else
+			c.double_val = (double)(int32_t)rng() / (1 + rng() % 10000);
+		break;
+
+	case TYPE_TIME:
+		// Within what all the time formats can represent.
+		c.double_val = 1.5e9 + (double)(int32_t)rng() / (1 + rng() % 1000000);
+		break;
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+		{
+		std::string str;
+
+		if ( rng() % 4 == 0 )
+			str = strings[rng() % 3];
+		else
+			{
+			size_t len = rng() % 20;
+
+			for ( size_t i = 0; i < len; ++i )
+				str += alphabet[rng() % (sizeof(alphabet) - 1)];
+			}
+
+		c.ref = b->AddString(str.data(), str.size());
+		break;
+		}
+
+	default:
+		break;
+	}
+
+	return c;
+	}
+
+// Checks that rendering the rows of a batch with and without the fields
+// compiled gives the same.
+void check_compiled(formatter::Formatter* generic, formatter::Formatter* compiled,
+                    int num_fields, const Field* const* fields, const RecordBatch& b)
+	{
+	compiled->Compile(num_fields, fields);
+
+	for ( int utf8 = 0; utf8 < 2; ++utf8 )
+		{
+		for ( int row = 0; row < b.NumRows(); ++row )
+			{
+			ODesc d1;
+			ODesc d2;
+
+			for ( ODesc* d : { &d1, &d2 } )
+				{
+				d->EnableEscaping();
+				d->AddEscapeSequence("\t");
+
+				if ( utf8 )
+					d->EnableUTF8();
+				}
+
+			CHECK(generic->Describe(&d1, num_fields, fields, b, row));
+			CHECK(compiled->Describe(&d2, num_fields, fields, b, row));
+			CHECK(std::string(d1.Description(), d1.Len()) == std::string(d2.Description(), d2.Len()));
+			}
+		}
+	}
+
+}
+
+TEST_CASE("formatter compiled columns")
+	{
+	std::vector<Field> fields = {
+		Field("b", nullptr, TYPE_BOOL, TYPE_VOID, false),
+		Field("i", nullptr, TYPE_INT, TYPE_VOID, false),
+		Field("c", nullptr, TYPE_COUNT, TYPE_VOID, false),
+		Field("p", nullptr, TYPE_PORT, TYPE_VOID, false),
+		Field("a", nullptr, TYPE_ADDR, TYPE_VOID, false),
+		Field("n", nullptr, TYPE_SUBNET, TYPE_VOID, false),
+		Field("d", nullptr, TYPE_DOUBLE, TYPE_VOID, false),
+		Field("iv", nullptr, TYPE_INTERVAL, TYPE_VOID, false),
+		Field("ts", nullptr, TYPE_TIME, TYPE_VOID, false),
+		Field("e", nullptr, TYPE_ENUM, TYPE_VOID, false),
+		Field("s\"\t\x01", nullptr, TYPE_STRING, TYPE_VOID, false),
+		Field("ss", nullptr, TYPE_TABLE, TYPE_STRING, false),
+		Field("vc", nullptr, TYPE_VECTOR, TYPE_COUNT, false),
+		Field("va", nullptr, TYPE_VECTOR, TYPE_ADDR, false),
+		Field("vd", nullptr, TYPE_VECTOR, TYPE_DOUBLE, false),
+	};
+
+	std::vector<const Field*> fptrs;
+
+	for ( const auto& f : fields )
+		fptrs.push_back(&f);
+
+	int num_fields = fptrs.size();
+	RecordBatch b(num_fields, fptrs.data());
+	std::mt19937 rng(42);
+
+	for ( int row = 0; row < 2000; ++row )
+		{
+		b.AddRow();
+
+		for ( int i = 0; i < num_fields; ++i )
+			{
+			// Some unset.
+			if ( rng() % 8 == 0 )
+				continue;
+
+			if ( fields[i].type != TYPE_TABLE && fields[i].type != TYPE_VECTOR )
+				{
+				RecordBatch::Cell c = random_cell(rng, &b, fields[i].type);
+				b.Set(i) = c;
+				continue;
+				}
+
+			b.StartContainer(i);
+			int n = rng() % 4;
+
+			for ( int j = 0; j < n; ++j )
+				{
+				if ( rng() % 8 == 0 )
+					{
+					b.AddUnsetElement(i);
+					continue;
+					}
+
+				RecordBatch::Cell c = random_cell(rng, &b, fields[i].subtype);
+				b.AddElement(i) = c;
+				}
+			}
+		}
+
+	SUBCASE("ascii")
+		{
+		formatter::Ascii::SeparatorInfo sep("\t", ",", "-", "(empty)");
+		formatter::Ascii generic(nullptr, sep);
+		formatter::Ascii compiled(nullptr, sep);
+		check_compiled(&generic, &compiled, num_fields, fptrs.data(), b);
+		}
+
+	SUBCASE("json")
+		{
+		for ( auto tf : { formatter::JSON::TS_EPOCH, formatter::JSON::TS_ISO8601,
+		                  formatter::JSON::TS_MILLIS } )
+			{
+			formatter::JSON generic(nullptr, tf);
+			formatter::JSON compiled(nullptr, tf);
+			check_compiled(&generic, &compiled, num_fields, fptrs.data(), b);
+			}
+		}
+	}
@@ -6,6 +6,7 @@
 
 #include "Type.h"
 #include "SerialTypes.h"
+#include "RecordBatch.h"
 
 namespace threading {
 
@@ -54,6 +55,47 @@ public:
 	virtual bool Describe(ODesc* desc, int num_fields, const threading::Field* const * fields,
 			      threading::Value** vals) const = 0;
 
+	/**
+	 * Convert a row of a batch of log records into an implementation
+	 * specific textual representation, as the other Describe() does for
+	 * a list of threading values.
+	 *
+	 * The default implementation presents the row as a list of
+	 * threading values. Derived classes should override this to work on
+	 * the batch directly.
+	 *
+	 * @param desc The ODesc object to write to.
+	 *
+	 * @param num_fields The number of fields in the logging record.
+	 *
+	 * @param fields Information about the fields for each of the given
+	 * log values.
+	 *
+	 * @param batch The batch holding the record.
+	 *
+	 * @param row The record's row in the batch.
+	 *
+	 * @return Returns true on success, false on error. Errors must also
+	 * be flagged via the thread.
+	 */
+	virtual bool Describe(ODesc* desc, int num_fields, const threading::Field* const * fields,
+			      const threading::RecordBatch& batch, int row) const;
+
+	/**
+	 * Prepares rendering rows of batches with the given fields by
+	 * deciding once how to render each of the columns, rather than for
+	 * every value. The batch-based Describe() then uses that for
+	 * records with these fields, with the same output as without.
+	 *
+	 * The default implementation does nothing.
+	 *
+	 * @param num_fields The number of fields in the logging record.
+	 *
+	 * @param fields Information about the fields. These must remain
+	 * valid as long as the formatter is used with them.
+	 */
+	virtual void Compile(int num_fields, const threading::Field* const * fields)	{ }
+
 	/**
 	 * Convert a single threading value into an implementation-specific
 	 * representation.
@@ -94,6 +136,21 @@ public:
 	 */
 	static std::string Render(const threading::Value::addr_t& addr);
 
+	/**
+	 * Convert an IP address into a string in a buffer provided by the
+	 * caller, the same as the other Render() does.
+	 *
+	 * This is a helper function that formatter implementations may use.
+	 *
+	 * @param addr The address.
+	 *
+	 * @param buf The buffer, with room for at least INET6_ADDRSTRLEN
+	 * bytes.
+	 *
+	 * @return The length of the NUL-terminated representation.
+	 */
+	static size_t Render(const threading::Value::addr_t& addr, char* buf);
+
 	/**
 	 * Convert an subnet value into a string.
 	 *
@@ -117,6 +174,20 @@ public:
 	 */
 	static std::string Render(double d);
 
+	/**
+	 * Convert a double into a string in a buffer provided by the
+	 * caller, the same as the other Render() does.
+	 *
+	 * This is a helper function that formatter implementations may use.
+	 *
+	 * @param d The double.
+	 *
+	 * @param buf The buffer, with room for at least 32 bytes.
+	 *
+	 * @return The length of the NUL-terminated representation.
+	 */
+	static size_t Render(double d, char* buf);
+
 	/**
 	 * Convert a transport protocol into a string.
 	 *
@@ -58,9 +58,25 @@ void Manager::Terminate()
 
 	all_threads.clear();
 	msg_threads.clear();
+
+	// All its tasks are gone now.
+	pool.reset();
+
 	terminating = false;
 	}
 
+ThreadPool* Manager::Pool()
+	{
+	if ( ! pool && BifConst::Threading::pool_size > 0 )
+		{
+		DBG_LOG(DBG_THREADING, "Starting thread pool with %" PRIu64 " workers ...",
+		        BifConst::Threading::pool_size);
+		pool = std::make_unique<ThreadPool>(BifConst::Threading::pool_size);
+		}
+
+	return pool.get();
+	}
+
 void Manager::AddThread(BasicThread* thread)
 	{
 	DBG_LOG(DBG_THREADING, "Adding thread %s ...", thread->Name());
@@ -5,6 +5,7 @@
 #include "Timer.h"
 
 #include <list>
+#include <memory>
 #include <utility>
 
 namespace threading {
@@ -100,6 +101,13 @@ public:
 	 */
 	bool SendEvent(MsgThread* thread, const std::string& name, const int num_vals, threading::Value* *vals) const;
 
+	/**
+	 * Returns the pool that MsgThreads run on when Threading::pool_size
+	 * is set, starting it with the first call. Returns null if each
+	 * MsgThread gets an OS thread of its own.
+	 */
+	ThreadPool* Pool();
+
 protected:
 	friend class BasicThread;
 	friend class MsgThread;
@@ -149,6 +157,8 @@ private:
 	msg_stats_list stats;
 
 	bool heartbeat_timer_running = false;
+
+	std::unique_ptr<ThreadPool> pool;
 };
 
 }
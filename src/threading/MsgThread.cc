@@ -204,6 +204,10 @@ MsgThread::MsgThread() : BasicThread(), queue_in(this, nullptr), queue_out(nullp
 	child_finished = false;
 	child_sent_finish = false;
 	failed = false;
+	pool = thread_mgr->Pool();
+	launched = false;
+	scheduled = false;
+	retired = false;
 	thread_mgr->AddMsgThread(this);
 
 	if ( ! iosource_mgr->RegisterFd(flare.FD(), this) )
@@ -296,6 +300,85 @@ void MsgThread::OnKill()
 	// input. This is just an optimization to make it terminate more
 	// quickly, even without the message it will eventually time out.
 	queue_in.WakeUp();
+
+	// On the pool, it needs to run once more to notice.
+	Wake();
+	}
+
+void MsgThread::Launch()
+	{
+	if ( ! pool )
+		{
+		BasicThread::Launch();
+		return;
+		}
+
+	launched = true;
+
+	// There may be messages already.
+	Wake();
+	}
+
+void MsgThread::WaitForExit()
+	{
+	if ( ! pool )
+		{
+		BasicThread::WaitForExit();
+		return;
+		}
+
+	if ( ! launched )
+		return;
+
+	while ( ! retired.load(std::memory_order_acquire) )
+		{
+		Wake();
+		usleep(1000);
+		}
+	}
+
+void MsgThread::Wake()
+	{
+	if ( pool && launched && ! scheduled.exchange(true, std::memory_order_seq_cst) )
+		pool->Schedule(this);
+	}
+
+bool MsgThread::RunSlice()
+	{
+	// Enough to make up for the scheduling, few enough for other
+	// threads to get their turn soon.
+	const int max_messages = 64;
+
+	for ( int i = 0; i < max_messages && ! (child_finished || Killed()); ++i )
+		{
+		BasicInputMessage* msg = RetrieveIn(false);
+
+		if ( ! msg )
+			break;
+
+		ProcessIn(msg);
+		}
+
+	if ( child_finished || Killed() )
+		{
+		BasicThread::Done();
+
+		// Leaves scheduled set, so that we don't get queued anymore.
+		// The main thread may delete us as soon as it sees this.
+		retired.store(true, std::memory_order_release);
+		return false;
+		}
+
+	if ( HasIn() )
+		return true;
+
+	scheduled.store(false, std::memory_order_seq_cst);
+
+	// Either we see a message that came in just now, or the main
+	// thread sees scheduled cleared and queues us again.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	return HasIn() && ! scheduled.exchange(true, std::memory_order_seq_cst);
 	}
 
 void MsgThread::Heartbeat()
@@ -370,6 +453,8 @@ void MsgThread::SendIn(BasicInputMessage* msg, bool force)
 
 	queue_in.Put(msg);
 	++cnt_sent_in;
+
+	Wake();
 	}
 
 
@@ -404,9 +489,9 @@ BasicOutputMessage* MsgThread::RetrieveOut()
 	return msg;
 	}
 
-BasicInputMessage* MsgThread::RetrieveIn()
+BasicInputMessage* MsgThread::RetrieveIn(bool wait)
 	{
-	BasicInputMessage* msg = queue_in.Get();
+	BasicInputMessage* msg = wait ? queue_in.Get() : queue_in.TryGet();
 
 	if ( ! msg )
 		return nullptr;
@@ -428,21 +513,7 @@ void MsgThread::Run()
 		if ( ! msg )
 			continue;
 
-		bool result = msg->Process();
-
-		delete msg;
-
-		if ( ! result )
-			{
-			Error("terminating thread");
-
-			// This will eventually kill this thread, but only
-			// after all other outgoing messages (in particular
-			// error messages have been processed by then main
-			// thread).
-			SendOut(new KillMeMessage(this));
-			failed = true;
-			}
+		ProcessIn(msg);
 		}
 
 	// In case we haven't sent the finish method yet, do it now. Reading
@@ -455,12 +526,32 @@ void MsgThread::Run()
 		}
 	}
 
+void MsgThread::ProcessIn(BasicInputMessage* msg)
+	{
+	bool result = msg->Process();
+
+	delete msg;
+
+	if ( ! result )
+		{
+		Error("terminating thread");
+
+		// This will eventually kill this thread, but only
+		// after all other outgoing messages (in particular
+		// error messages have been processed by then main
+		// thread).
+		SendOut(new KillMeMessage(this));
+		failed = true;
+		}
+	}
+
 void MsgThread::GetStats(Stats* stats)
 	{
 	stats->sent_in = cnt_sent_in;
 	stats->sent_out = cnt_sent_out;
 	stats->pending_in = queue_in.Size();
 	stats->pending_out = queue_out.Size();
+	stats->backlog = Backlog();
 	queue_in.GetStats(&stats->queue_in_stats);
 	queue_out.GetStats(&stats->queue_out_stats);
 	}
@@ -5,6 +5,7 @@
 
 #include "BasicThread.h"
 #include "Queue.h"
+#include "ThreadPool.h"
 #include "iosource/IOSource.h"
 #include "Flare.h"
 
@@ -24,8 +25,14 @@ class HeartbeatMessage;
  * messages until Terminating() indicates that execution should stop. Once
  * that happens, the thread stops accepting any new messages, finishes
  * processes all remaining ones still in the queue, and then exits.
+ *
+ * If Threading::pool_size is set, a MsgThread doesn't get an OS thread of
+ * its own. It runs as a task on the threading::Manager's ThreadPool
+ * instead, which processes its messages in slices whenever there are
+ * some, still in order and one at a time.
  */
-class MsgThread : public BasicThread, public iosource::IOSource
+class MsgThread : public BasicThread, public iosource::IOSource,
+                  private ThreadPool::Task
 {
 public:
 	/**
@@ -180,6 +187,7 @@ public:
 		uint64_t sent_out;	//! Number of messages sent from the child thread to the main thread
 		uint64_t pending_in;	//! Number of messages sent to the child but not yet processed.
 		uint64_t pending_out;	//! Number of messages sent from the child but not yet processed by the main thread.
+		uint64_t backlog;	//! Work the child accepted but hasn't completed yet, in units specific to the thread; see Backlog().
 
 		/// Statistics from our queues.
 		Queue<BasicInputMessage *>::Stats  queue_in_stats;
@@ -231,6 +239,14 @@ protected:
 	 */
 	virtual void Heartbeat();
 
+	/**
+	 * Returns the amount of work that the child thread has accepted but
+	 * not completed yet, such as data waiting for compression. What's
+	 * counted depends on the thread, the default returns zero. This is
+	 * called by the main thread, so implementations must be thread-safe.
+	 */
+	virtual uint64_t Backlog()	{ return 0; }
+
 	/** Returns true if a child command has reported a failure. In that case, we'll
 	  * be in the process of killing this thread and no further activity
 	  * should carried out. To be called only from this child thread.
@@ -257,21 +273,44 @@ protected:
 	 * Overriden from BasicThread.
 	 */
 	void Run() override;
+	void Launch() override;
+	void WaitForExit() override;
 	void OnWaitForStop() override;
 	void OnSignalStop() override;
 	void OnKill() override;
 
 private:
+	/**
+	 * Overridden from ThreadPool::Task, runs the thread on the pool.
+	 */
+	bool RunSlice() override;
+
+	/**
+	 * Schedules the thread on the pool unless it's scheduled already.
+	 * Must only be called by the main thread.
+	 */
+	void Wake();
+
 	/**
 	 * Pops a message sent by the main thread from the main-to-chold
 	 * queue.
 	 *
 	 * Must only be called by the child thread.
 	 *
+	 * @param wait If true, waits a little while for a message if there
+	 * isn't one yet.
+	 *
 	 * @return The message, wth ownership passed to caller. Returns null
 	 * if the queue is empty.
 	 */
-	BasicInputMessage* RetrieveIn();
+	BasicInputMessage* RetrieveIn(bool wait = true);
+
+	/**
+	 * Processes and deletes a message from the main thread.
+	 *
+	 * Must only be called by the child thread.
+	 */
+	void ProcessIn(BasicInputMessage* msg);
 
 	/**
 	 * Queues a message for the child.
@@ -335,6 +374,12 @@ private:
 	bool failed;	// Set to true when a command failed.
 
 	bro::Flare flare;
+
+	// For running on the pool, null with a thread of our own.
+	ThreadPool* pool;
+	bool launched;	// Set once Launch() has scheduled us.
+	std::atomic<bool> scheduled;	// Queued or running on the pool.
+	std::atomic<bool> retired;	// Done running on the pool for good.
 };
 
 /**
@@ -0,0 +1,92 @@
+#include "Queue.h"
+
+#include <thread>
+
+#include "3rdparty/doctest.h"
+
+using namespace threading;
+
+static int* to_ptr(uintptr_t i)	{ return reinterpret_cast<int*>(i); }
+
+TEST_CASE("queue operation")
+	{
+	Queue<int*> q(nullptr, nullptr);
+	CHECK(q.Size() == 0);
+	CHECK(! q.Ready());
+
+	q.Put(to_ptr(1));
+	q.Put(to_ptr(2));
+	CHECK(q.Size() == 2);
+	CHECK(q.Ready());
+
+	CHECK(q.Get() == to_ptr(1));
+	CHECK(q.Get() == to_ptr(2));
+	CHECK(q.Size() == 0);
+
+	// Doesn't wait for input.
+	CHECK(q.TryGet() == nullptr);
+	q.Put(to_ptr(3));
+	CHECK(q.TryGet() == to_ptr(3));
+	CHECK(q.TryGet() == nullptr);
+
+	// Crosses a few chunk boundaries.
+	std::vector<int*> in;
+
+	for ( uintptr_t i = 1; i <= 1000; ++i )
+		in.push_back(to_ptr(i));
+
+	q.PutBatch(in.data(), in.size());
+	CHECK(q.Size() == 1000);
+
+	std::vector<int*> out(1000);
+	size_t n = 0;
+
+	while ( n < out.size() )
+		n += q.GetBatch(out.data() + n, 300);
+
+	CHECK(out == in);
+
+	Queue<int*>::Stats stats;
+	q.GetStats(&stats);
+	CHECK(stats.num_reads == 1002);
+	CHECK(stats.num_writes == 1002);
+	}
+
+TEST_CASE("queue threads")
+	{
+	Queue<int*> q(nullptr, nullptr);
+	const uintptr_t n = 100000;
+
+	std::thread writer([&q, n]
+		{
+		for ( uintptr_t i = 1; i <= n; )
+			{
+			// Mix single and batched puts.
+			if ( i % 7 == 0 && i + 3 <= n )
+				{
+				int* batch[3] = { to_ptr(i), to_ptr(i + 1), to_ptr(i + 2) };
+				q.PutBatch(batch, 3);
+				i += 3;
+				}
+			else
+				q.Put(to_ptr(i++));
+			}
+		});
+
+	uintptr_t expected = 1;
+	bool in_order = true;
+
+	while ( expected <= n )
+		{
+		int* batch[16];
+		size_t got = q.GetBatch(batch, 16);
+
+		for ( size_t i = 0; i < got; ++i )
+			in_order = in_order && batch[i] == to_ptr(expected++);
+		}
+
+	writer.join();
+
+	CHECK(in_order);
+	CHECK(q.Size() == 0);
+	}
@@ -2,10 +2,11 @@
 
 #include <mutex>
 #include <condition_variable>
-#include <queue>
-#include <deque>
+#include <atomic>
+#include <chrono>
+#include <vector>
 #include <stdint.h>
-#include <sys/time.h>
+#include <stddef.h>
 
 #include "Reporter.h"
 #include "BasicThread.h"
@@ -17,13 +18,21 @@ namespace threading {
 /**
  * A thread-safe single-reader single-writer queue.
  *
- * The implementation uses multiple queues and reads/writes in rotary fashion
- * in an attempt to limit contention.
+ * The implementation is a lock-free ring of fixed-size chunks.  The writer
+ * appends to the last chunk and links in a new one once that's full, the
+ * reader consumes from the first chunk and recycles it once it's
+ * exhausted, so the queue is unbounded and Put() never blocks.  Elements
+ * get published through a release store of the write counter, which the
+ * reader picks up with an acquire load; neither side takes a lock as long
+ * as there's data.  The only lock is the one the reader sleeps on while
+ * waiting for input, and the writer only touches it when it adds the first
+ * element to an empty queue while the reader is waiting.
  *
- * All Queue instances must be instantiated by Bro's main thread.
+ * There must be exactly one thread calling Put()/PutBatch() and exactly
+ * one thread calling Get()/GetBatch() over the lifetime of the queue. All
+ * other methods can be called from any thread.
  *
- * TODO: Unclear how critical performance is for this qeueue. We could likely
- * optimize it further if helpful.
+ * All Queue instances must be instantiated by Bro's main thread.
  */
 template<typename T>
 class Queue
@@ -50,26 +59,47 @@ public:
 	 */
 	T Get();
 
+	/**
+	 * Retrieves up to \a max elements at once. Blocks like Get() if no
+	 * input is available.
+	 *
+	 * @param data Array of at least \a max elements to fill in.
+	 *
+	 * @param max The maximum number of elements to retrieve.
+	 *
+	 * @return The number of elements retrieved, zero if nothing showed up.
+	 */
+	size_t GetBatch(T* data, size_t max);
+
+	/**
+	 * Retrieves one element if there is one, without blocking.
+	 *
+	 * @return The element, or null if the queue is empty.
+	 */
+	T TryGet();
+
 	/**
 	 * Queues one element.
 	 */
 	void Put(T data);
 
+	/**
+	 * Queues a number of elements at once, making them visible to the
+	 * reader together.
+	 */
+	void PutBatch(const T* data, size_t n);
+
 	/**
 	 * Returns true if the next Get() operation will succeed.
 	 */
-	bool Ready();
+	bool Ready()	{ return Size() > 0; }
 
 	/**
-	 * Returns true if the next Get() operation might succeed. This
-	 * function may occasionally return a value not indicating the actual
-	 * state, but won't do so very often. Note that this means that it can
-	 * consistently return false even if there is something in the Queue.
-	 * You have to check real queue status from time to time to be sure that
-	 * it is empty. In other words, this method helps to avoid locking the queue
-	 * frequently, but doesn't allow you to forgo it completely.
+	 * Returns true if the next Get() operation might succeed. Kept for
+	 * compatibility with the previous, lock-based implementation; this
+	 * is now the same as Ready().
 	 */
-	bool MaybeReady() { return (num_reads != num_writes); }
+	bool MaybeReady()	{ return Ready(); }
 
 	/**
 	 * Wake up the reader if it's currently blocked for input. This is
@@ -80,7 +110,12 @@ public:
 	/**
 	 * Returns the number of queued items not yet retrieved.
 	 */
-	uint64_t Size();
+	uint64_t Size()
+		{
+		// Load the reads first so that the difference can't underflow.
+		uint64_t r = num_reads.load(std::memory_order_acquire);
+		return num_writes.load(std::memory_order_acquire) - r;
+		}
 
 	/**
 	 * Statistics about inter-thread communication.
@@ -100,23 +135,53 @@ public:
 	void GetStats(Stats* stats);
 
 private:
-	static const int NUM_QUEUES = 8;
+	// Elements per chunk; chunks are recycled, so this mostly
+	// determines how often the writer has to link in a new one.
+	static const size_t CHUNK_SIZE = 256;
+	static const size_t CACHE_LINE = 64;
+
+	struct Chunk {
+		T items[CHUNK_SIZE];
+		std::atomic<Chunk*> next;
 
-	std::vector<std::unique_lock<std::mutex>> LocksForAllQueues();
+		Chunk() : next(nullptr)	{ }
+		};
+
+	// Blocks until there's input, the timeout passes, or the reader
+	// gets woken up. Returns the number of elements available.
+	uint64_t WaitForData(uint64_t reads);
+
+	// Moves up to max of the avail elements after the first reads ones
+	// into data. Returns the number moved.
+	size_t Take(T* data, size_t max, uint64_t reads, uint64_t avail);
 
-	std::mutex mutex[NUM_QUEUES];	// Mutex protected shared accesses.
-	std::condition_variable has_data[NUM_QUEUES];	// Signals when data becomes available
-	std::queue<T> messages[NUM_QUEUES];	// Actually holds the queued messages
+	// Returns a chunk to the writer's free list (reader side).
+	void RecycleChunk(Chunk* c);
 
-	int read_ptr;	// Where the next operation will read from
-	int write_ptr;	// Where the next operation will write to
+	// Takes a chunk from the free list, or allocates one (writer side).
+	Chunk* NewChunk();
 
 	BasicThread* reader;
 	BasicThread* writer;
 
-	// Statistics.
-	uint64_t num_reads;
-	uint64_t num_writes;
+	// Writer side.
+	alignas(CACHE_LINE) Chunk* write_chunk;
+	size_t write_pos;	// Next slot to fill in write_chunk
+	std::atomic<uint64_t> num_writes;
+
+	// Reader side.
+	alignas(CACHE_LINE) Chunk* read_chunk;
+	size_t read_pos;	// Next slot to consume in read_chunk
+	std::atomic<uint64_t> num_reads;
+
+	// One spare chunk handed back from the reader to the writer, so
+	// that a steady flow of messages doesn't allocate.
+	alignas(CACHE_LINE) std::atomic<Chunk*> spare;
+
+	// For a reader waiting on an empty queue.
+	std::atomic<bool> reader_waiting;
+	std::mutex mutex;
+	std::condition_variable has_data;
 };
 
 inline static std::unique_lock<std::mutex> acquire_lock(std::mutex& m)
@@ -135,130 +200,195 @@ inline static std::unique_lock<std::mutex> acquire_lock(std::mutex& m)
 
 template<typename T>
 inline Queue<T>::Queue(BasicThread* arg_reader, BasicThread* arg_writer)
+	: num_writes(0), num_reads(0), spare(nullptr), reader_waiting(false)
 	{
-	read_ptr = 0;
-	write_ptr = 0;
-	num_reads = num_writes = 0;
 	reader = arg_reader;
 	writer = arg_writer;
+
+	write_chunk = read_chunk = new Chunk();
+	write_pos = read_pos = 0;
 	}
 
 template<typename T>
 inline Queue<T>::~Queue()
 	{
+	// Chunks from the one being read up to the one being written are
+	// linked together.
+	Chunk* c = read_chunk;
+
+	while ( c )
+		{
+		Chunk* next = c->next.load(std::memory_order_relaxed);
+		delete c;
+		c = next;
+		}
+
+	delete spare.load(std::memory_order_relaxed);
 	}
 
 template<typename T>
-inline T Queue<T>::Get()
+inline typename Queue<T>::Chunk* Queue<T>::NewChunk()
 	{
-	auto lock = acquire_lock(mutex[read_ptr]);
+	Chunk* c = spare.exchange(nullptr, std::memory_order_acquire);
 
-	int old_read_ptr = read_ptr;
-
-	if ( messages[read_ptr].empty() && ! ((reader && reader->Killed()) || (writer && writer->Killed())) )
+	if ( c )
 		{
-		if ( has_data[read_ptr].wait_for(lock, std::chrono::seconds(5)) == std::cv_status::timeout )
-			return nullptr;
+		c->next.store(nullptr, std::memory_order_relaxed);
+		return c;
 		}
 
-	if ( messages[read_ptr].empty() )
-		return nullptr;
+	return new Chunk();
+	}
 
-	T data = messages[read_ptr].front();
-	messages[read_ptr].pop();
+template<typename T>
+inline void Queue<T>::RecycleChunk(Chunk* c)
+	{
+	Chunk* old = spare.exchange(c, std::memory_order_release);
+	delete old;
+	}
 
-	read_ptr = (read_ptr + 1) % NUM_QUEUES;
-	++num_reads;
+template<typename T>
+inline void Queue<T>::PutBatch(const T* data, size_t n)
+	{
+	if ( n == 0 )
+		return;
 
-	return data;
+	uint64_t writes = num_writes.load(std::memory_order_relaxed);
+
+	for ( size_t i = 0; i < n; ++i )
+		{
+		if ( write_pos == CHUNK_SIZE )
+			{
+			// The reader follows the link only after seeing the
+			// write counter covering the new chunk's first element,
+			// so a relaxed store is sufficient here.
+			Chunk* c = NewChunk();
+			write_chunk->next.store(c, std::memory_order_relaxed);
+			write_chunk = c;
+			write_pos = 0;
+			}
+
+		write_chunk->items[write_pos++] = data[i];
+		}
+
+	// Publishes the elements. This must be ordered before the load of
+	// reader_waiting below; see WaitForData() for the other half.
+	num_writes.store(writes + n, std::memory_order_seq_cst);
+
+	bool was_empty = (num_reads.load(std::memory_order_seq_cst) == writes);
+
+	if ( was_empty && reader_waiting.load(std::memory_order_seq_cst) )
+		{
+		// Taking the lock makes sure the reader has either entered
+		// wait_for() already or is done waiting.
+		acquire_lock(mutex).unlock();
+		has_data.notify_one();
+		}
 	}
 
 template<typename T>
 inline void Queue<T>::Put(T data)
 	{
-	auto lock = acquire_lock(mutex[write_ptr]);
+	PutBatch(&data, 1);
+	}
 
-	int old_write_ptr = write_ptr;
+template<typename T>
+inline uint64_t Queue<T>::WaitForData(uint64_t reads)
+	{
+	uint64_t avail = num_writes.load(std::memory_order_acquire) - reads;
 
-	bool need_signal = messages[write_ptr].empty();
+	if ( avail )
+		return avail;
 
-	messages[write_ptr].push(data);
+	if ( (reader && reader->Killed()) || (writer && writer->Killed()) )
+		return 0;
 
-	write_ptr = (write_ptr + 1) % NUM_QUEUES;
-	++num_writes;
+	auto lock = acquire_lock(mutex);
 
-	if ( need_signal )
+	// Announce that we're going to sleep, then check once more. Either
+	// we see the writer's update of num_writes, or the writer sees our
+	// flag and wakes us up.
+	reader_waiting.store(true, std::memory_order_seq_cst);
+	avail = num_writes.load(std::memory_order_seq_cst) - reads;
+
+	if ( ! avail )
 		{
-		lock.unlock();
-		has_data[old_write_ptr].notify_one();
+		has_data.wait_for(lock, std::chrono::seconds(5));
+		avail = num_writes.load(std::memory_order_acquire) - reads;
 		}
+
+	reader_waiting.store(false, std::memory_order_relaxed);
+
+	return avail;
 	}
 
+template<typename T>
+inline size_t Queue<T>::GetBatch(T* data, size_t max)
+	{
+	uint64_t reads = num_reads.load(std::memory_order_relaxed);
+	return Take(data, max, reads, WaitForData(reads));
+	}
 
 template<typename T>
-inline bool Queue<T>::Ready()
+inline T Queue<T>::TryGet()
 	{
-	auto lock = acquire_lock(mutex[read_ptr]);
+	uint64_t reads = num_reads.load(std::memory_order_relaxed);
+	uint64_t avail = num_writes.load(std::memory_order_acquire) - reads;
+	T data;
 
-	bool ret = (messages[read_ptr].size());
+	if ( Take(&data, 1, reads, avail) == 0 )
+		return nullptr;
 
-	return ret;
+	return data;
 	}
 
 template<typename T>
-inline std::vector<std::unique_lock<std::mutex>> Queue<T>::LocksForAllQueues()
+inline size_t Queue<T>::Take(T* data, size_t max, uint64_t reads, uint64_t avail)
 	{
-	std::vector<std::unique_lock<std::mutex>> locks;
+	size_t n = avail < max ? avail : max;
 
-	try
+	for ( size_t i = 0; i < n; ++i )
 		{
-		for ( int i = 0; i < NUM_QUEUES; i++ )
-			locks.emplace_back(std::unique_lock<std::mutex>(mutex[i]));
+		if ( read_pos == CHUNK_SIZE )
+			{
+			Chunk* c = read_chunk->next.load(std::memory_order_relaxed);
+			RecycleChunk(read_chunk);
+			read_chunk = c;
+			read_pos = 0;
+			}
+
+		data[i] = read_chunk->items[read_pos++];
 		}
 
-	catch ( const std::system_error& e )
-		{
-		reporter->FatalErrorWithCore("cannot lock all mutexes: %s", e.what());
-		// Never gets here.
-		throw std::exception();
-		}
+	if ( n )
+		num_reads.store(reads + n, std::memory_order_release);
 
-	return locks;
+	return n;
 	}
 
 template<typename T>
-inline uint64_t Queue<T>::Size()
+inline T Queue<T>::Get()
 	{
-	// Need to lock all queues.
-	auto locks = LocksForAllQueues();
+	T data;
 
-	uint64_t size = 0;
-
-	for ( int i = 0; i < NUM_QUEUES; i++ )
-		size += messages[i].size();
+	if ( GetBatch(&data, 1) == 0 )
+		return nullptr;
 
-	return size;
+	return data;
 	}
 
 template<typename T>
 inline void Queue<T>::GetStats(Stats* stats)
 	{
-	// To be safe, we look all queues. That's probably unneccessary, but
-	// doesn't really hurt.
-	auto locks = LocksForAllQueues();
-
-	stats->num_reads = num_reads;
-	stats->num_writes = num_writes;
+	stats->num_reads = num_reads.load(std::memory_order_relaxed);
+	stats->num_writes = num_writes.load(std::memory_order_relaxed);
 	}
 
 template<typename T>
 inline void Queue<T>::WakeUp()
 	{
-	for ( int i = 0; i < NUM_QUEUES; i++ )
-		{
-		auto lock = acquire_lock(mutex[i]);
-		has_data[i].notify_all();
-		}
+	auto lock = acquire_lock(mutex);
+	has_data.notify_all();
 	}
 
 }
@@ -0,0 +1,413 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "RecordBatch.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <utility>
+
+#include "3rdparty/doctest.h"
+
+#include "util.h"
+
+using namespace threading;
+
+RecordBatch::RecordBatch(int num_fields, const Field* const* fields)
+	: columns(num_fields), num_rows(0)
+	{
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		columns[i].type = fields[i]->type;
+		columns[i].subtype = fields[i]->subtype;
+		}
+	}
+
+void RecordBatch::AddRow()
+	{
+	for ( auto& c : columns )
+		{
+		c.cells.emplace_back();
+		c.present.push_back(0);
+		}
+
+	++num_rows;
+	}
+
+RecordBatch::Ref RecordBatch::AddString(const char* data, size_t len)
+	{
+	Ref r;
+	r.offset = strings.size();
+	r.length = len;
+
+	strings.insert(strings.end(), data, data + len);
+	strings.push_back('\0');
+
+	return r;
+	}
+
+void RecordBatch::StartContainer(int col)
+	{
+	Cell& c = Set(col);
+	c.ref.offset = elements.size();
+	c.ref.length = 0;
+	}
+
+RecordBatch::Cell& RecordBatch::AddElement(int col)
+	{
+	Ref& r = columns[col].cells.back().ref;
+	assert(r.offset + r.length == elements.size());
+	++r.length;
+
+	elements.emplace_back();
+	element_present.push_back(1);
+	return elements.back();
+	}
+
+void RecordBatch::AddUnsetElement(int col)
+	{
+	AddElement(col);
+	element_present.back() = 0;
+	}
+
+void RecordBatch::ValueToCell(const Value* val, Cell* c)
+	{
+	switch ( val->type ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+		c->int_val = val->val.int_val;
+		break;
+
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+		c->uint_val = val->val.uint_val;
+		break;
+
+	case TYPE_PORT:
+		c->port_val = val->val.port_val;
+		break;
+
+	case TYPE_SUBNET:
+		c->subnet_val = val->val.subnet_val;
+		break;
+
+	case TYPE_ADDR:
+		c->addr_val = val->val.addr_val;
+		break;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		c->double_val = val->val.double_val;
+		break;
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		c->ref = AddString(val->val.string_val.data, val->val.string_val.length);
+		break;
+
+	case TYPE_PATTERN:
+		c->ref = AddString(val->val.pattern_text_val, strlen(val->val.pattern_text_val));
+		break;
+
+	default:
+		// Containers are handled by the caller, nothing else is
+		// loggable.
+		break;
+	}
+	}
+
+bool RecordBatch::AddRow(int num_fields, Value** vals)
+	{
+	if ( num_fields != NumFields() )
+		return false;
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		if ( vals[i]->type != columns[i].type )
+			return false;
+		}
+
+	AddRow();
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		const Value* val = vals[i];
+
+		if ( ! val->present )
+			continue;
+
+		if ( val->type == TYPE_TABLE || val->type == TYPE_VECTOR )
+			{
+			// Sets and vectors share the layout of their values.
+			StartContainer(i);
+
+			for ( bro_int_t j = 0; j < val->val.set_val.size; ++j )
+				{
+				const Value* e = val->val.set_val.vals[j];
+
+				if ( e->present )
+					ValueToCell(e, &AddElement(i));
+				else
+					AddUnsetElement(i);
+				}
+
+			continue;
+			}
+
+		ValueToCell(val, &Set(i));
+		}
+
+	return true;
+	}
+
+void RecordBatch::Clear()
+	{
+	for ( auto& c : columns )
+		{
+		c.cells.clear();
+		c.present.clear();
+		}
+
+	strings.clear();
+	elements.clear();
+	element_present.clear();
+	num_rows = 0;
+	}
+
+size_t RecordBatch::MemoryAllocation() const
+	{
+	size_t size = padded_sizeof(*this)
+		+ pad_size(columns.capacity() * sizeof(Column))
+		+ pad_size(strings.capacity())
+		+ pad_size(elements.capacity() * sizeof(Cell))
+		+ pad_size(element_present.capacity());
+
+	for ( const auto& c : columns )
+		size += pad_size(c.cells.capacity() * sizeof(Cell))
+			+ pad_size(c.present.capacity());
+
+	return size;
+	}
+
+RecordBatchRow::RecordBatchRow(int num_fields)
+	: elements(num_fields), element_ptrs(num_fields)
+	{
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		values.emplace_back(new Value());
+		ptrs.push_back(values.back().get());
+		}
+	}
+
+RecordBatchRow::~RecordBatchRow()
+	{
+	// The values point into a batch's storage, so keep their destructor
+	// from releasing anything.
+	for ( auto& v : values )
+		v->present = false;
+
+	for ( auto& e : elements )
+		for ( auto& v : e )
+			v->present = false;
+	}
+
+void RecordBatchRow::CellToValue(const RecordBatch& batch, TypeTag type,
+                                 const RecordBatch::Cell& c, Value* val)
+	{
+	switch ( type ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+		val->val.int_val = c.int_val;
+		break;
+
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+		val->val.uint_val = c.uint_val;
+		break;
+
+	case TYPE_PORT:
+		val->val.port_val = c.port_val;
+		break;
+
+	case TYPE_SUBNET:
+		val->val.subnet_val = c.subnet_val;
+		break;
+
+	case TYPE_ADDR:
+		val->val.addr_val = c.addr_val;
+		break;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		val->val.double_val = c.double_val;
+		break;
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		val->val.string_val.data = const_cast<char*>(batch.String(c));
+		val->val.string_val.length = c.ref.length;
+		break;
+
+	case TYPE_PATTERN:
+		val->val.pattern_text_val = batch.String(c);
+		break;
+
+	default:
+		break;
+	}
+	}
+
+Value** RecordBatchRow::Fill(const RecordBatch& batch, int row)
+	{
+	for ( int i = 0; i < batch.NumFields(); ++i )
+		{
+		Value* val = ptrs[i];
+		val->type = batch.Type(i);
+		val->subtype = batch.SubType(i);
+		val->present = batch.Present(row, i);
+
+		if ( ! val->present )
+			continue;
+
+		const RecordBatch::Cell& c = batch.Get(row, i);
+
+		if ( val->type != TYPE_TABLE && val->type != TYPE_VECTOR )
+			{
+			CellToValue(batch, val->type, c, val);
+			continue;
+			}
+
+		int n = batch.NumElements(c);
+		auto& evals = elements[i];
+		auto& eptrs = element_ptrs[i];
+
+		while ( evals.size() < size_t(n) )
+			{
+			evals.emplace_back(new Value());
+			eptrs.push_back(evals.back().get());
+			}
+
+		for ( int j = 0; j < n; ++j )
+			{
+			Value* e = eptrs[j];
+			e->type = val->subtype;
+			e->present = batch.ElementPresent(c, j);
+
+			if ( e->present )
+				CellToValue(batch, e->type, batch.Element(c, j), e);
+			}
+
+		// Sets and vectors share the layout of their values.
+		val->val.set_val.size = n;
+		val->val.set_val.vals = eptrs.data();
+		}
+
+	return ptrs.data();
+	}
+
+TEST_CASE("record batch")
+	{
+	Field f_count("count", nullptr, TYPE_COUNT, TYPE_VOID, false);
+	Field f_str("str", nullptr, TYPE_STRING, TYPE_VOID, false);
+	Field f_vec("vec", nullptr, TYPE_VECTOR, TYPE_STRING, false);
+	const Field* fields[] = { &f_count, &f_str, &f_vec };
+
+	RecordBatch b(3, fields);
+	CHECK(b.Empty());
+
+	b.AddRow();
+	b.Set(0).uint_val = 42;
+	b.Set(1).ref = b.AddString("foo", 3);
+	b.StartContainer(2);
+	b.AddElement(2).ref = b.AddString("a", 1);
+	b.AddUnsetElement(2);
+	b.AddElement(2).ref = b.AddString("bc", 2);
+
+	b.AddRow();
+	b.StartContainer(2);
+
+	CHECK(b.NumRows() == 2);
+	CHECK(b.Present(0, 0));
+	CHECK(b.Get(0, 0).uint_val == 42);
+	CHECK(b.Get(0, 1).ref.length == 3);
+	CHECK(strcmp(b.String(b.Get(0, 1)), "foo") == 0);
+
+	const RecordBatch::Cell& v = b.Get(0, 2);
+	CHECK(b.NumElements(v) == 3);
+	CHECK(b.ElementPresent(v, 0));
+	CHECK(! b.ElementPresent(v, 1));
+	CHECK(strcmp(b.String(b.Element(v, 2)), "bc") == 0);
+
+	CHECK(! b.Present(1, 0));
+	CHECK(! b.Present(1, 1));
+	CHECK(b.Present(1, 2));
+	CHECK(b.NumElements(b.Get(1, 2)) == 0);
+
+	b.Clear();
+	CHECK(b.Empty());
+	}
+
+TEST_CASE("record batch values")
+	{
+	Field f_addr("addr", nullptr, TYPE_ADDR, TYPE_VOID, false);
+	Field f_enum("enum", nullptr, TYPE_ENUM, TYPE_VOID, false);
+	Field f_set("set", nullptr, TYPE_TABLE, TYPE_COUNT, false);
+	const Field* fields[] = { &f_addr, &f_enum, &f_set };
+
+	Value** vals = new Value*[3];
+	vals[0] = new Value(TYPE_ADDR);
+	vals[0]->val.addr_val.family = IPv4;
+	vals[0]->val.addr_val.in.in4.s_addr = htonl(0x01020304);
+	vals[1] = new Value(TYPE_ENUM);
+	vals[1]->val.string_val.data = copy_string("Conn::LOG");
+	vals[1]->val.string_val.length = 9;
+	vals[2] = new Value(TYPE_TABLE, TYPE_COUNT);
+	vals[2]->val.set_val.size = 2;
+	vals[2]->val.set_val.vals = new Value*[2];
+
+	for ( int i = 0; i < 2; ++i )
+		{
+		vals[2]->val.set_val.vals[i] = new Value(TYPE_COUNT);
+		vals[2]->val.set_val.vals[i]->val.uint_val = i + 10;
+		}
+
+	RecordBatch b(3, fields);
+	CHECK(b.AddRow(3, vals));
+
+	vals[1]->present = false;
+	delete [] vals[1]->val.string_val.data;
+	CHECK(b.AddRow(3, vals));
+
+	// Type mismatch.
+	std::swap(vals[0], vals[2]);
+	CHECK(! b.AddRow(3, vals));
+	std::swap(vals[0], vals[2]);
+	CHECK(b.NumRows() == 2);
+
+	Value::delete_value_ptr_array(vals, 3);
+
+	RecordBatchRow row(3);
+
+	Value** r = row.Fill(b, 0);
+	CHECK(r[0]->present);
+	CHECK(r[0]->val.addr_val.family == IPv4);
+	CHECK(r[0]->val.addr_val.in.in4.s_addr == htonl(0x01020304));
+	CHECK(r[1]->present);
+	CHECK(r[1]->val.string_val.length == 9);
+	CHECK(strcmp(r[1]->val.string_val.data, "Conn::LOG") == 0);
+	CHECK(r[2]->val.set_val.size == 2);
+	CHECK(r[2]->val.set_val.vals[1]->type == TYPE_COUNT);
+	CHECK(r[2]->val.set_val.vals[1]->val.uint_val == 11);
+
+	r = row.Fill(b, 1);
+	CHECK(! r[1]->present);
+	CHECK(r[2]->val.set_val.vals[0]->val.uint_val == 10);
+	}
@@ -0,0 +1,241 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "SerialTypes.h"
+
+namespace threading {
+
+/**
+ * A batch of log records stored column by column.
+ *
+ * Each column keeps its cells in one contiguous array along with a parallel
+ * array of presence flags. Strings of all columns share a single pool, and
+ * the elements of sets and vectors share a single element array, with cells
+ * referring into them by offset and length. Compared to an array of
+ * individually allocated threading::Value objects per record, a batch needs
+ * a handful of allocations no matter how many records it holds, and it's
+ * released in one go once the receiving thread is done with it.
+ *
+ * Rows are appended one at a time: AddRow() starts a new row with all
+ * columns unset, then Set() and the container methods fill in the columns
+ * of that row. A batch is filled by one thread and then handed over to
+ * another one, which only reads it.
+ */
+class RecordBatch {
+public:
+	/**
+	 * Location of a string in the batch's string pool, or of a
+	 * container's elements in the batch's element array.
+	 */
+	struct Ref {
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	/**
+	 * The value of one column in one row. Which member is valid depends
+	 * on the column's type, following the conventions of
+	 * threading::Value, except that strings, enums, files, functions and
+	 * patterns as well as sets and vectors use \a ref.
+	 */
+	union Cell {
+		bro_int_t int_val;
+		bro_uint_t uint_val;
+		double double_val;
+		Value::port_t port_val;
+		Value::addr_t addr_val;
+		Value::subnet_t subnet_val;
+		Ref ref;
+	};
+
+	/**
+	 * Constructor.
+	 *
+	 * @param num_fields The number of columns.
+	 *
+	 * @param fields The log fields, which define the columns' types.
+	 * The batch does not keep a reference to them.
+	 */
+	RecordBatch(int num_fields, const Field* const* fields);
+
+	RecordBatch(const RecordBatch&) = delete;
+	RecordBatch& operator=(const RecordBatch&) = delete;
+
+	int NumFields() const	{ return columns.size(); }
+	int NumRows() const	{ return num_rows; }
+	bool Empty() const	{ return num_rows == 0; }
+
+	/**
+	 * Returns the type of a column.
+	 */
+	TypeTag Type(int col) const	{ return columns[col].type; }
+
+	/**
+	 * Returns the element type of a set or vector column.
+	 */
+	TypeTag SubType(int col) const	{ return columns[col].subtype; }
+
+	/**
+	 * Returns true if a column is set in the given row.
+	 */
+	bool Present(int row, int col) const
+		{ return columns[col].present[row]; }
+
+	/**
+	 * Returns the cell of a column in the given row. Only meaningful
+	 * if the column is present.
+	 */
+	const Cell& Get(int row, int col) const
+		{ return columns[col].cells[row]; }
+
+	/**
+	 * Returns the start of a string-valued cell's data. The cell's \a
+	 * ref.length has its size; the data is followed by a null byte so
+	 * that it can also be used as a C string if it doesn't contain any
+	 * itself.
+	 */
+	const char* String(const Cell& c) const
+		{ return strings.data() + c.ref.offset; }
+
+	/**
+	 * Returns the number of elements of a set- or vector-valued cell.
+	 */
+	int NumElements(const Cell& c) const	{ return c.ref.length; }
+
+	/**
+	 * Returns true if the given element of a container cell is set.
+	 */
+	bool ElementPresent(const Cell& c, int i) const
+		{ return element_present[c.ref.offset + i]; }
+
+	/**
+	 * Returns the given element of a container cell, which is of the
+	 * column's SubType().
+	 */
+	const Cell& Element(const Cell& c, int i) const
+		{ return elements[c.ref.offset + i]; }
+
+	/**
+	 * Starts a new row, with all columns unset.
+	 */
+	void AddRow();
+
+	/**
+	 * Marks a column of the current row as set and returns its cell
+	 * for filling in.
+	 */
+	Cell& Set(int col)
+		{
+		Column& c = columns[col];
+		c.present.back() = 1;
+		return c.cells.back();
+		}
+
+	/**
+	 * Copies a string into the batch's pool.
+	 *
+	 * @return A reference to store in a cell's \a ref.
+	 */
+	Ref AddString(const char* data, size_t len);
+
+	/**
+	 * Marks a set or vector column of the current row as set, with no
+	 * elements so far. Elements get added with AddElement() or
+	 * AddUnsetElement(); all elements of one container must be added
+	 * before starting the next one.
+	 */
+	void StartContainer(int col);
+
+	/**
+	 * Adds an element to the container started last for the given
+	 * column and returns its cell for filling in.
+	 */
+	Cell& AddElement(int col);
+
+	/**
+	 * Adds an unset element to the container started last for the
+	 * given column.
+	 */
+	void AddUnsetElement(int col);
+
+	/**
+	 * Appends a row given as threading::Value objects, copying their
+	 * contents. Does not take ownership of the values.
+	 *
+	 * @return False if the values' types don't match those of the
+	 * columns, in which case the batch is left unchanged.
+	 */
+	bool AddRow(int num_fields, Value** vals);
+
+	/**
+	 * Removes all rows, keeping the memory allocated for reuse.
+	 */
+	void Clear();
+
+	/**
+	 * Returns an estimate of the memory the batch currently uses.
+	 */
+	size_t MemoryAllocation() const;
+
+private:
+	struct Column {
+		TypeTag type;
+		TypeTag subtype;
+		std::vector<Cell> cells;
+		std::vector<uint8_t> present;
+	};
+
+	// Copies a Value of an atomic type into a cell.
+	void ValueToCell(const Value* val, Cell* c);
+
+	std::vector<Column> columns;
+	std::vector<char> strings;
+	std::vector<Cell> elements;
+	std::vector<uint8_t> element_present;
+	int num_rows;
+};
+
+/**
+ * Presents rows of a RecordBatch as arrays of threading::Value, for code
+ * that hasn't been adapted to working on batches.
+ *
+ * The values are reused from row to row and point into the batch's storage
+ * instead of owning copies. They remain valid only until the next call to
+ * Fill(), as long as the batch isn't changed, and they must not be modified
+ * or deleted.
+ */
+class RecordBatchRow {
+public:
+	explicit RecordBatchRow(int num_fields);
+	~RecordBatchRow();
+
+	RecordBatchRow(const RecordBatchRow&) = delete;
+	RecordBatchRow& operator=(const RecordBatchRow&) = delete;
+
+	/**
+	 * Fills in the values for a row of a batch.
+	 *
+	 * @return An array of values, one per field.
+	 */
+	Value** Fill(const RecordBatch& batch, int row);
+
+private:
+	// Fills in a value of an atomic type.
+	static void CellToValue(const RecordBatch& batch, TypeTag type,
+	                        const RecordBatch::Cell& c, Value* val);
+
+	std::vector<std::unique_ptr<Value>> values;
+	std::vector<Value*> ptrs;
+
+	// Element values for set and vector fields, indexed by field.
+	std::vector<std::vector<std::unique_ptr<Value>>> elements;
+	std::vector<std::vector<Value*>> element_ptrs;
+};
+
+}
@@ -0,0 +1,256 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "ThreadPool.h"
+
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "util.h"
+
+#include "3rdparty/doctest.h"
+
+using namespace threading;
+
+ThreadPool::ThreadPool(int num_workers)
+	: pending(0), next_worker(0), sleeping(0), stopping(false),
+	  num_slices(0), num_steals(0), num_sleeps(0)
+	{
+	if ( num_workers < 1 )
+		num_workers = 1;
+
+	for ( int i = 0; i < num_workers; ++i )
+		workers.emplace_back(new Worker());
+
+	// Only start them once they can all be found.
+	for ( int i = 0; i < num_workers; ++i )
+		workers[i]->thread = std::thread(&ThreadPool::Run, this, i);
+	}
+
+ThreadPool::~ThreadPool()
+	{
+		{
+		std::lock_guard<std::mutex> lock(idle_mutex);
+		stopping = true;
+		}
+
+	has_work.notify_all();
+
+	for ( auto& w : workers )
+		w->thread.join();
+	}
+
+void ThreadPool::Schedule(Task* task)
+	{
+	uint64_t i = next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+	Worker& w = *workers[i];
+
+		{
+		std::lock_guard<std::mutex> lock(w.mutex);
+		w.tasks.push_back(task);
+		}
+
+	// This must be ordered before the load of sleeping, see Run() for
+	// the other half.
+	pending.fetch_add(1, std::memory_order_seq_cst);
+
+	if ( sleeping.load(std::memory_order_seq_cst) > 0 )
+		{
+		// Taking the lock makes sure a worker that's going to
+		// sleep has either started waiting already or will see
+		// the task.
+		std::lock_guard<std::mutex> lock(idle_mutex);
+		has_work.notify_one();
+		}
+	}
+
+ThreadPool::Task* ThreadPool::Next(int id)
+	{
+	int n = workers.size();
+
+	// Own tasks from the front, in the order they were queued, ...
+		{
+		Worker& w = *workers[id];
+		std::lock_guard<std::mutex> lock(w.mutex);
+
+		if ( ! w.tasks.empty() )
+			{
+			Task* t = w.tasks.front();
+			w.tasks.pop_front();
+			pending.fetch_sub(1, std::memory_order_relaxed);
+			return t;
+			}
+		}
+
+	// ... and other workers' from the back.
+	for ( int k = 1; k < n; ++k )
+		{
+		Worker& w = *workers[(id + k) % n];
+		std::lock_guard<std::mutex> lock(w.mutex);
+
+		if ( ! w.tasks.empty() )
+			{
+			Task* t = w.tasks.back();
+			w.tasks.pop_back();
+			pending.fetch_sub(1, std::memory_order_relaxed);
+			num_steals.fetch_add(1, std::memory_order_relaxed);
+			return t;
+			}
+		}
+
+	return nullptr;
+	}
+
+void ThreadPool::Run(int id)
+	{
+	// Block signals like BasicThread does, they're handled by the main
+	// thread only.
+	sigset_t mask_set;
+	sigfillset(&mask_set);
+	sigdelset(&mask_set, SIGFPE);
+	sigdelset(&mask_set, SIGILL);
+	sigdelset(&mask_set, SIGSEGV);
+	sigdelset(&mask_set, SIGBUS);
+	pthread_sigmask(SIG_BLOCK, &mask_set, nullptr);
+
+	char name[16];
+	snprintf(name, sizeof(name), "zk.pool-%d", id);
+	zeek::set_thread_name(name);
+
+	Worker& self = *workers[id];
+
+	while ( true )
+		{
+		Task* t = Next(id);
+
+		if ( t )
+			{
+			num_slices.fetch_add(1, std::memory_order_relaxed);
+
+			if ( t->RunSlice() )
+				{
+				// Back to the end of our own queue, where
+				// idle workers can pick it up as well.
+					{
+					std::lock_guard<std::mutex> lock(self.mutex);
+					self.tasks.push_back(t);
+					}
+
+				pending.fetch_add(1, std::memory_order_seq_cst);
+
+				if ( sleeping.load(std::memory_order_seq_cst) > 0 )
+					{
+					std::lock_guard<std::mutex> lock(idle_mutex);
+					has_work.notify_one();
+					}
+				}
+
+			continue;
+			}
+
+		std::unique_lock<std::mutex> lock(idle_mutex);
+
+		// Announce that we're going to sleep, then check once more.
+		// Either we see the update of pending, or Schedule() sees us.
+		sleeping.fetch_add(1, std::memory_order_seq_cst);
+
+		while ( pending.load(std::memory_order_seq_cst) <= 0 && ! stopping )
+			{
+			num_sleeps.fetch_add(1, std::memory_order_relaxed);
+			has_work.wait(lock);
+			}
+
+		sleeping.fetch_sub(1, std::memory_order_relaxed);
+
+		if ( stopping && pending.load(std::memory_order_seq_cst) <= 0 )
+			return;
+		}
+	}
+
+void ThreadPool::GetStats(Stats* stats) const
+	{
+	stats->slices = num_slices.load(std::memory_order_relaxed);
+	stats->steals = num_steals.load(std::memory_order_relaxed);
+	stats->sleeps = num_sleeps.load(std::memory_order_relaxed);
+	}
+
+namespace {
+
+// Counts the messages sent to it in slices, checking that it never runs
+// on two workers at once.
+class OrderedTask : public ThreadPool::Task {
+public:
+	explicit OrderedTask(ThreadPool* arg_pool) : pool(arg_pool)	{}
+
+	// Adds a message, scheduling the task if it isn't already.
+	void Send()
+		{
+		sent.fetch_add(1, std::memory_order_seq_cst);
+
+		if ( ! scheduled.exchange(true, std::memory_order_seq_cst) )
+			pool->Schedule(this);
+		}
+
+	bool RunSlice() override
+		{
+		if ( running.exchange(true) )
+			overlaps.fetch_add(1);
+
+		// At most 10 messages per slice.
+		for ( int i = 0; i < 10 && processed < sent.load(); ++i )
+			processed.fetch_add(1);
+
+		running.store(false);
+
+		if ( processed < sent.load() )
+			return true;
+
+		scheduled.store(false, std::memory_order_seq_cst);
+
+		if ( processed < sent.load(std::memory_order_seq_cst) &&
+		     ! scheduled.exchange(true, std::memory_order_seq_cst) )
+			return true;
+
+		return false;
+		}
+
+	std::atomic<uint64_t> sent{0};
+	std::atomic<uint64_t> processed{0};
+	std::atomic<int> overlaps{0};
+
+private:
+	ThreadPool* pool;
+	std::atomic<bool> scheduled{false};
+	std::atomic<bool> running{false};
+};
+
+}
+
+TEST_CASE("thread pool")
+	{
+	// The pool goes first, a task may still be finishing its slice.
+	std::vector<std::unique_ptr<OrderedTask>> tasks;
+	ThreadPool pool(3);
+
+	for ( int i = 0; i < 8; ++i )
+		tasks.emplace_back(new OrderedTask(&pool));
+
+	for ( int n = 0; n < 1000; ++n )
+		for ( auto& t : tasks )
+			t->Send();
+
+	for ( auto& t : tasks )
+		{
+		int waited = 0;
+
+		while ( t->processed.load() < 1000 && waited++ < 10000 )
+			usleep(1000);
+
+		CHECK(t->processed.load() == 1000);
+		CHECK(t->overlaps.load() == 0);
+		}
+
+	ThreadPool::Stats stats;
+	pool.GetStats(&stats);
+	CHECK(stats.slices >= 8);
+	}
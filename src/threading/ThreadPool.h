@@ -0,0 +1,129 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace threading {
+
+/**
+ * A fixed set of worker threads that runs tasks multiplexed onto them,
+ * used to run MsgThreads without a thread of their own (see
+ * Threading::pool_size).
+ *
+ * Each worker has a queue of tasks that are ready to run. A task gets
+ * queued when there's work for it, and runs for a slice, after which it
+ * either goes to the back of the queue of the worker that ran it, or
+ * waits to be scheduled again. A worker that runs out of tasks steals
+ * from the other end of another worker's queue before going to sleep.
+ *
+ * A task is never queued more than once, so it only ever runs on one
+ * worker at a time; the task makes sure of that itself, see Schedule().
+ */
+class ThreadPool {
+public:
+	/**
+	 * Something to run on the pool.
+	 */
+	class Task {
+	public:
+		virtual ~Task()	{}
+
+		/**
+		 * Does some of the task's work on a worker. This should
+		 * return after a limited amount of work even if there's
+		 * more to do, to give the other tasks their turn.
+		 *
+		 * @return True if the task needs to run again right away.
+		 * If false, the task won't run again until scheduled again.
+		 */
+		virtual bool RunSlice() = 0;
+	};
+
+	/**
+	 * Statistics about the pool's work.
+	 */
+	struct Stats {
+		uint64_t slices;	//! Number of task slices run.
+		uint64_t steals;	//! Number of tasks taken from another worker.
+		uint64_t sleeps;	//! Number of times a worker went idle.
+	};
+
+	/**
+	 * Constructor. Starts the workers.
+	 *
+	 * @param num_workers The number of worker threads, at least one.
+	 */
+	explicit ThreadPool(int num_workers);
+
+	/**
+	 * Destructor. Stops and joins the workers. No task may be scheduled
+	 * or running anymore at this point.
+	 */
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/**
+	 * Queues a task to run. The caller must make sure that the task
+	 * isn't queued or running already, and that it stays around until
+	 * it has finished running. Can be called from any thread.
+	 *
+	 * @param task The task.
+	 */
+	void Schedule(Task* task);
+
+	/**
+	 * Returns the number of worker threads.
+	 */
+	int NumWorkers() const	{ return workers.size(); }
+
+	/**
+	 * Returns statistics about the pool's work.
+	 */
+	void GetStats(Stats* stats) const;
+
+private:
+	struct Worker {
+		std::mutex mutex;	// protects tasks
+		std::deque<Task*> tasks;
+		std::thread thread;
+	};
+
+	void Run(int id);
+
+	// Takes the next task for a worker, from its own queue or stolen
+	// from another one. Returns null if there's none.
+	Task* Next(int id);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	// Number of tasks queued on all workers together. This can go below
+	// zero for a moment, when a worker takes a task right after it has
+	// been queued, before it has been counted.
+	std::atomic<int64_t> pending;
+
+	// Spreads tasks scheduled from outside over the workers.
+	std::atomic<uint64_t> next_worker;
+
+	// For idle workers.
+	std::mutex idle_mutex;
+	std::condition_variable has_work;
+	std::atomic<int> sleeping;
+	bool stopping;	// protected by idle_mutex
+
+	std::atomic<uint64_t> num_slices;
+	std::atomic<uint64_t> num_steals;
+	std::atomic<uint64_t> num_sleeps;
+};
+
+}
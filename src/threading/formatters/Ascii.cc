@@ -50,6 +50,7 @@ Ascii::SeparatorInfo::SeparatorInfo(const string& arg_separator,
 Ascii::Ascii(threading::MsgThread* t, const SeparatorInfo& info) : Formatter(t)
 	{
 	separators = info;
+	compiled_fields = nullptr;
 	}
 
 Ascii::~Ascii()
@@ -125,25 +126,8 @@ bool Ascii::Describe(ODesc* desc, threading::Value* val, const string& name) con
 	case TYPE_STRING:
 	case TYPE_FILE:
 	case TYPE_FUNC:
-		{
-		int size = val->val.string_val.length;
-		const char* data = val->val.string_val.data;
-
-		if ( ! size )
-			{
-			desc->Add(separators.empty_field);
-			break;
-			}
-
-		if ( escapeReservedContent(desc, separators.unset_field, data, size) )
-			break;
-
-		if ( escapeReservedContent(desc, separators.empty_field, data, size) )
-			break;
-
-		desc->AddN(data, size);
+		DescribeString(desc, val->val.string_val.data, val->val.string_val.length);
 		break;
-		}
 
 	case TYPE_TABLE:
 		{
@@ -207,6 +191,313 @@ bool Ascii::Describe(ODesc* desc, threading::Value* val, const string& name) con
 	return true;
 	}
 
+bool Ascii::Describe(ODesc* desc, int num_fields, const threading::Field* const * fields,
+                     const threading::RecordBatch& batch, int row) const
+	{
+	if ( fields == compiled_fields && num_fields == (int)compiled.size() &&
+	     num_fields > 0 && ! desc->IsBinary() )
+		{
+		DescribeCompiled(desc, batch, row);
+		return true;
+		}
+
+	for ( int i = 0; i < num_fields; i++ )
+		{
+		if ( i > 0 )
+			desc->AddRaw(separators.separator);
+
+		if ( ! batch.Present(row, i) )
+			{
+			desc->Add(separators.unset_field);
+			continue;
+			}
+
+		TypeTag type = batch.Type(i);
+		const threading::RecordBatch::Cell& c = batch.Get(row, i);
+
+		if ( type != TYPE_TABLE && type != TYPE_VECTOR )
+			{
+			if ( ! DescribeCell(desc, batch, type, c) )
+				return false;
+
+			continue;
+			}
+
+		int n = batch.NumElements(c);
+
+		if ( ! n )
+			{
+			desc->Add(separators.empty_field);
+			continue;
+			}
+
+		desc->AddEscapeSequence(separators.set_separator);
+
+		for ( int j = 0; j < n; j++ )
+			{
+			if ( j > 0 )
+				desc->AddRaw(separators.set_separator);
+
+			if ( ! batch.ElementPresent(c, j) )
+				{
+				desc->Add(separators.unset_field);
+				continue;
+				}
+
+			if ( ! DescribeCell(desc, batch, batch.SubType(i), batch.Element(c, j)) )
+				{
+				desc->RemoveEscapeSequence(separators.set_separator);
+				return false;
+				}
+			}
+
+		desc->RemoveEscapeSequence(separators.set_separator);
+		}
+
+	return true;
+	}
+
+bool Ascii::DescribeCell(ODesc* desc, const threading::RecordBatch& batch, TypeTag type,
+                         const threading::RecordBatch::Cell& c) const
+	{
+	// Keep this in sync with the value-based Describe() above.
+	switch ( type ) {
+
+	case TYPE_BOOL:
+		desc->Add(c.int_val ? "T" : "F");
+		break;
+
+	case TYPE_INT:
+		desc->Add(c.int_val);
+		break;
+
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+		desc->Add(c.uint_val);
+		break;
+
+	case TYPE_PORT:
+		desc->Add(c.port_val.port);
+		break;
+
+	case TYPE_SUBNET:
+		desc->Add(Render(c.subnet_val));
+		break;
+
+	case TYPE_ADDR:
+		desc->Add(Render(c.addr_val));
+		break;
+
+	case TYPE_DOUBLE:
+		desc->Add(c.double_val, true);
+		break;
+
+	case TYPE_INTERVAL:
+	case TYPE_TIME:
+		desc->Add(Render(c.double_val));
+		break;
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		DescribeString(desc, batch.String(c), c.ref.length);
+		break;
+
+	default:
+		GetThread()->Warning(GetThread()->Fmt("Ascii writer unsupported field format %d", type));
+		return false;
+	}
+
+	return true;
+	}
+
+void Ascii::DescribeString(ODesc* desc, const char* data, int size) const
+	{
+	if ( ! size )
+		{
+		desc->Add(separators.empty_field);
+		return;
+		}
+
+	if ( escapeReservedContent(desc, separators.unset_field, data, size) )
+		return;
+
+	if ( escapeReservedContent(desc, separators.empty_field, data, size) )
+		return;
+
+	desc->AddN(data, size);
+	}
+
+void Ascii::Compile(int num_fields, const threading::Field* const * fields)
+	{
+	compiled_fields = nullptr;
+	compiled.clear();
+
+	std::vector<CompiledColumn> columns;
+
+	for ( int i = 0; i < num_fields; i++ )
+		{
+		CompiledColumn col;
+		col.container = (fields[i]->type == TYPE_TABLE || fields[i]->type == TYPE_VECTOR);
+		col.render = CompileType(col.container ? fields[i]->subtype : fields[i]->type);
+
+		// Leave anything unusual to the generic code, which also
+		// reports what it doesn't support.
+		if ( ! col.render )
+			return;
+
+		columns.push_back(col);
+		}
+
+	compiled_fields = fields;
+	compiled = std::move(columns);
+	}
+
+Ascii::CellRenderer Ascii::CompileType(TypeTag type)
+	{
+	// Keep this in sync with DescribeCell().
+	switch ( type ) {
+	case TYPE_BOOL:
+		return &Ascii::RenderBool;
+
+	case TYPE_INT:
+		return &Ascii::RenderInt;
+
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+		return &Ascii::RenderCount;
+
+	case TYPE_PORT:
+		return &Ascii::RenderPort;
+
+	case TYPE_SUBNET:
+		return &Ascii::RenderSubnet;
+
+	case TYPE_ADDR:
+		return &Ascii::RenderAddr;
+
+	case TYPE_DOUBLE:
+		return &Ascii::RenderDouble;
+
+	case TYPE_INTERVAL:
+	case TYPE_TIME:
+		return &Ascii::RenderTime;
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		return &Ascii::RenderString;
+
+	default:
+		return nullptr;
+	}
+	}
+
+void Ascii::DescribeCompiled(ODesc* desc, const threading::RecordBatch& batch, int row) const
+	{
+	// The same as the generic Describe(), minus looking at the types.
+	for ( size_t i = 0; i < compiled.size(); i++ )
+		{
+		if ( i > 0 )
+			desc->AddRaw(separators.separator);
+
+		if ( ! batch.Present(row, i) )
+			{
+			desc->Add(separators.unset_field);
+			continue;
+			}
+
+		const CompiledColumn& col = compiled[i];
+		const threading::RecordBatch::Cell& c = batch.Get(row, i);
+
+		if ( ! col.container )
+			{
+			(this->*col.render)(desc, batch, c);
+			continue;
+			}
+
+		int n = batch.NumElements(c);
+
+		if ( ! n )
+			{
+			desc->Add(separators.empty_field);
+			continue;
+			}
+
+		desc->AddEscapeSequence(separators.set_separator);
+
+		for ( int j = 0; j < n; j++ )
+			{
+			if ( j > 0 )
+				desc->AddRaw(separators.set_separator);
+
+			if ( batch.ElementPresent(c, j) )
+				(this->*col.render)(desc, batch, batch.Element(c, j));
+			else
+				desc->Add(separators.unset_field);
+			}
+
+		desc->RemoveEscapeSequence(separators.set_separator);
+		}
+	}
+
+void Ascii::RenderBool(ODesc* desc, const threading::RecordBatch& batch,
+                       const threading::RecordBatch::Cell& c) const
+	{
+	desc->Add(c.int_val ? "T" : "F");
+	}
+
+void Ascii::RenderInt(ODesc* desc, const threading::RecordBatch& batch,
+                      const threading::RecordBatch::Cell& c) const
+	{
+	desc->Add(c.int_val);
+	}
+
+void Ascii::RenderCount(ODesc* desc, const threading::RecordBatch& batch,
+                        const threading::RecordBatch::Cell& c) const
+	{
+	desc->Add(c.uint_val);
+	}
+
+void Ascii::RenderPort(ODesc* desc, const threading::RecordBatch& batch,
+                       const threading::RecordBatch::Cell& c) const
+	{
+	desc->Add(c.port_val.port);
+	}
+
+void Ascii::RenderSubnet(ODesc* desc, const threading::RecordBatch& batch,
+                         const threading::RecordBatch::Cell& c) const
+	{
+	desc->Add(Render(c.subnet_val));
+	}
+
+void Ascii::RenderAddr(ODesc* desc, const threading::RecordBatch& batch,
+                       const threading::RecordBatch::Cell& c) const
+	{
+	char buf[INET6_ADDRSTRLEN];
+	desc->AddN(buf, Render(c.addr_val, buf));
+	}
+
+void Ascii::RenderDouble(ODesc* desc, const threading::RecordBatch& batch,
+                         const threading::RecordBatch::Cell& c) const
+	{
+	desc->Add(c.double_val, true);
+	}
+
+void Ascii::RenderTime(ODesc* desc, const threading::RecordBatch& batch,
+                       const threading::RecordBatch::Cell& c) const
+	{
+	char buf[32];
+	desc->AddN(buf, Render(c.double_val, buf));
+	}
+
+void Ascii::RenderString(ODesc* desc, const threading::RecordBatch& batch,
+                         const threading::RecordBatch::Cell& c) const
+	{
+	DescribeString(desc, batch.String(c), c.ref.length);
+	}
 
 threading::Value* Ascii::ParseValue(const string& s, const string& name, TypeTag type, TypeTag subtype) const
 	{
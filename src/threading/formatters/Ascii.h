@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include "../Formatter.h"
 
 namespace threading { namespace formatter {
@@ -50,13 +52,62 @@ public:
 	virtual bool Describe(ODesc* desc, threading::Value* val, const std::string& name = "") const;
 	virtual bool Describe(ODesc* desc, int num_fields, const threading::Field* const * fields,
 	                      threading::Value** vals) const;
+	virtual bool Describe(ODesc* desc, int num_fields, const threading::Field* const * fields,
+	                      const threading::RecordBatch& batch, int row) const;
 	virtual threading::Value* ParseValue(const std::string& s, const std::string& name,
 	                                     TypeTag type, TypeTag subtype = TYPE_ERROR) const;
 
+	void Compile(int num_fields, const threading::Field* const * fields) override;
+
 private:
+	// Renders a single value of a column compiled with Compile().
+	typedef void (Ascii::*CellRenderer)(ODesc* desc, const threading::RecordBatch& batch,
+	                                    const threading::RecordBatch::Cell& c) const;
+
+	struct CompiledColumn {
+		CellRenderer render;	// For the value, or a container's elements.
+		bool container;
+	};
+
+	// Returns the renderer for a type, or null if there's none.
+	static CellRenderer CompileType(TypeTag type);
+
+	// Describe() for a batch with the columns compiled.
+	void DescribeCompiled(ODesc* desc, const threading::RecordBatch& batch, int row) const;
+
+	void RenderBool(ODesc* desc, const threading::RecordBatch& batch,
+	                const threading::RecordBatch::Cell& c) const;
+	void RenderInt(ODesc* desc, const threading::RecordBatch& batch,
+	               const threading::RecordBatch::Cell& c) const;
+	void RenderCount(ODesc* desc, const threading::RecordBatch& batch,
+	                 const threading::RecordBatch::Cell& c) const;
+	void RenderPort(ODesc* desc, const threading::RecordBatch& batch,
+	                const threading::RecordBatch::Cell& c) const;
+	void RenderSubnet(ODesc* desc, const threading::RecordBatch& batch,
+	                  const threading::RecordBatch::Cell& c) const;
+	void RenderAddr(ODesc* desc, const threading::RecordBatch& batch,
+	                const threading::RecordBatch::Cell& c) const;
+	void RenderDouble(ODesc* desc, const threading::RecordBatch& batch,
+	                  const threading::RecordBatch::Cell& c) const;
+	void RenderTime(ODesc* desc, const threading::RecordBatch& batch,
+	                const threading::RecordBatch::Cell& c) const;
+	void RenderString(ODesc* desc, const threading::RecordBatch& batch,
+	                  const threading::RecordBatch::Cell& c) const;
+
 	bool CheckNumberError(const char* start, const char* end) const;
 
+	// Renders an atomic value stored in a batch.
+	bool DescribeCell(ODesc* desc, const threading::RecordBatch& batch, TypeTag type,
+	                  const threading::RecordBatch::Cell& c) const;
+
+	// Renders string data, escaping it as necessary.
+	void DescribeString(ODesc* desc, const char* data, int size) const;
+
 	SeparatorInfo separators;
+
+	// Set by Compile(), empty if the fields can't be compiled.
+	const threading::Field* const * compiled_fields;
+	std::vector<CompiledColumn> compiled;
 };
 
 }}
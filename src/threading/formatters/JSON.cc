@@ -29,6 +29,7 @@ bool JSON::NullDoubleWriter::Double(double d)
 JSON::JSON(MsgThread* t, TimeFormat tf) : Formatter(t), surrounding_braces(true)
 	{
 	timestamps = tf;
+	compiled_fields = nullptr;
 	}
 
 JSON::~JSON()
@@ -55,6 +56,55 @@ bool JSON::Describe(ODesc* desc, int num_fields, const Field* const * fields,
 	return true;
 	}
 
+bool JSON::Describe(ODesc* desc, int num_fields, const Field* const * fields,
+                    const RecordBatch& batch, int row) const
+	{
+	if ( fields == compiled_fields && num_fields == (int)compiled.size() && num_fields > 0 )
+		{
+		DescribeCompiled(desc, batch, row);
+		return true;
+		}
+
+	rapidjson::StringBuffer buffer;
+	NullDoubleWriter writer(buffer);
+
+	writer.StartObject();
+
+	for ( int i = 0; i < num_fields; i++ )
+		{
+		if ( ! batch.Present(row, i) )
+			continue;
+
+		TypeTag type = batch.Type(i);
+		const RecordBatch::Cell& c = batch.Get(row, i);
+
+		writer.Key(fields[i]->name);
+
+		if ( type != TYPE_TABLE && type != TYPE_VECTOR )
+			{
+			BuildJSON(writer, batch, type, c);
+			continue;
+			}
+
+		writer.StartArray();
+
+		for ( int j = 0; j < batch.NumElements(c); j++ )
+			{
+			if ( batch.ElementPresent(c, j) )
+				BuildJSON(writer, batch, batch.SubType(i), batch.Element(c, j));
+			else
+				writer.Null();
+			}
+
+		writer.EndArray();
+		}
+
+	writer.EndObject();
+	desc->Add(buffer.GetString());
+
+	return true;
+	}
+
 bool JSON::Describe(ODesc* desc, Value* val, const std::string& name) const
 	{
 	if ( desc->IsBinary() )
@@ -128,46 +178,8 @@ void JSON::BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& na
 			break;
 
 		case TYPE_TIME:
-			{
-			if ( timestamps == TS_ISO8601 )
-				{
-				char buffer[40];
-				char buffer2[40];
-				time_t the_time = time_t(floor(val->val.double_val));
-				struct tm t;
-
-				if ( ! gmtime_r(&the_time, &t) ||
-				     ! strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &t) )
-					{
-					GetThread()->Error(GetThread()->Fmt("json formatter: failure getting time: (%lf)", val->val.double_val));
-					// This was a failure, doesn't really matter what gets put here
-					// but it should probably stand out...
-					writer.String("2000-01-01T00:00:00.000000");
-					}
-				else
-					{
-					double integ;
-					double frac = modf(val->val.double_val, &integ);
-
-					if ( frac < 0 )
-						frac += 1;
-
-					snprintf(buffer2, sizeof(buffer2), "%s.%06.0fZ", buffer, fabs(frac) * 1000000);
-					writer.String(buffer2, strlen(buffer2));
-					}
-				}
-
-			else if ( timestamps == TS_EPOCH )
-				writer.Double(val->val.double_val);
-
-			else if ( timestamps == TS_MILLIS )
-				{
-				// ElasticSearch uses milliseconds for timestamps
-				writer.Uint64((uint64_t) (val->val.double_val * 1000));
-				}
-
+			BuildTime(writer, val->val.double_val);
 			break;
-			}
 
 		case TYPE_ENUM:
 		case TYPE_STRING:
@@ -205,3 +217,358 @@ void JSON::BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& na
 			break;
 		}
 	}
+
+void JSON::BuildJSON(NullDoubleWriter& writer, const RecordBatch& batch, TypeTag type,
+                     const RecordBatch::Cell& c) const
+	{
+	// Keep this in sync with the value-based BuildJSON() above.
+	switch ( type )
+		{
+		case TYPE_BOOL:
+			writer.Bool(c.int_val != 0);
+			break;
+
+		case TYPE_INT:
+			writer.Int64(c.int_val);
+			break;
+
+		case TYPE_COUNT:
+		case TYPE_COUNTER:
+			writer.Uint64(c.uint_val);
+			break;
+
+		case TYPE_PORT:
+			writer.Uint64(c.port_val.port);
+			break;
+
+		case TYPE_SUBNET:
+			writer.String(Formatter::Render(c.subnet_val));
+			break;
+
+		case TYPE_ADDR:
+			writer.String(Formatter::Render(c.addr_val));
+			break;
+
+		case TYPE_DOUBLE:
+		case TYPE_INTERVAL:
+			writer.Double(c.double_val);
+			break;
+
+		case TYPE_TIME:
+			BuildTime(writer, c.double_val);
+			break;
+
+		case TYPE_ENUM:
+		case TYPE_STRING:
+		case TYPE_FILE:
+		case TYPE_FUNC:
+			writer.String(json_escape_utf8(std::string(batch.String(c), c.ref.length)));
+			break;
+
+		default:
+			reporter->Warning("Unhandled type in JSON::BuildJSON");
+			break;
+		}
+	}
+
+// Renders an ISO 8601 timestamp into a buffer of 40 bytes, returning false
+// on failure.
+static bool format_iso8601(double ts, char* buffer2)
+	{
+	char buffer[40];
+	time_t the_time = time_t(floor(ts));
+	struct tm t;
+
+	if ( ! gmtime_r(&the_time, &t) ||
+	     ! strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &t) )
+		return false;
+
+	double integ;
+	double frac = modf(ts, &integ);
+
+	if ( frac < 0 )
+		frac += 1;
+
+	snprintf(buffer2, 40, "%s.%06.0fZ", buffer, fabs(frac) * 1000000);
+	return true;
+	}
+
+void JSON::BuildTime(NullDoubleWriter& writer, double ts) const
+	{
+	if ( timestamps == TS_ISO8601 )
+		{
+		char buffer2[40];
+
+		if ( ! format_iso8601(ts, buffer2) )
+			{
+			GetThread()->Error(GetThread()->Fmt("json formatter: failure getting time: (%lf)", ts));
+			// This was a failure, doesn't really matter what gets put here
+			// but it should probably stand out...
+			writer.String("2000-01-01T00:00:00.000000");
+			}
+		else
+			writer.String(buffer2, strlen(buffer2));
+		}
+
+	else if ( timestamps == TS_EPOCH )
+		writer.Double(ts);
+
+	else if ( timestamps == TS_MILLIS )
+		{
+		// ElasticSearch uses milliseconds for timestamps
+		writer.Uint64((uint64_t) (ts * 1000));
+		}
+	}
+
+// Appends a string the way rapidjson's Writer::String() writes it.
+static void append_json_string(std::string* out, const char* s, size_t n)
+	{
+	static const char hex[] = "0123456789ABCDEF";
+
+	out->push_back('"');
+	size_t start = 0;
+
+	for ( size_t i = 0; i < n; ++i )
+		{
+		unsigned char c = s[i];
+
+		if ( c >= 0x20 && c != '"' && c != '\\' )
+			continue;
+
+		out->append(s + start, i - start);
+		start = i + 1;
+		out->push_back('\\');
+
+		switch ( c ) {
+		case '\b': out->push_back('b'); break;
+		case '\t': out->push_back('t'); break;
+		case '\n': out->push_back('n'); break;
+		case '\f': out->push_back('f'); break;
+		case '\r': out->push_back('r'); break;
+		case '"': out->push_back('"'); break;
+		case '\\': out->push_back('\\'); break;
+
+		default:
+			out->append("u00");
+			out->push_back(hex[c >> 4]);
+			out->push_back(hex[c & 0xf]);
+			break;
+		}
+		}
+
+	out->append(s + start, n - start);
+	out->push_back('"');
+	}
+
+// Appends a log string the way BuildJSON() does, leaving out the
+// json_escape_utf8() pass for strings it wouldn't change.
+static void append_json_value_string(std::string* out, const char* s, size_t n)
+	{
+	for ( size_t i = 0; i < n; ++i )
+		{
+		unsigned char c = s[i];
+
+		if ( (c >= 0x20 && c <= 0x7f) ||
+		     c == '\b' || c == '\f' || c == '\n' || c == '\r' || c == '\t' )
+			continue;
+
+		std::string escaped = json_escape_utf8(std::string(s, n));
+		append_json_string(out, escaped.data(), escaped.size());
+		return;
+		}
+
+	append_json_string(out, s, n);
+	}
+
+void JSON::Compile(int num_fields, const Field* const * fields)
+	{
+	compiled_fields = nullptr;
+	compiled.clear();
+
+	std::vector<CompiledColumn> columns;
+
+	for ( int i = 0; i < num_fields; i++ )
+		{
+		CompiledColumn col;
+		col.container = (fields[i]->type == TYPE_TABLE || fields[i]->type == TYPE_VECTOR);
+		col.render = CompileType(col.container ? fields[i]->subtype : fields[i]->type);
+
+		// Leave anything unusual to the generic code.
+		if ( ! col.render )
+			return;
+
+		append_json_string(&col.key, fields[i]->name, strlen(fields[i]->name));
+		col.key.push_back(':');
+		columns.push_back(std::move(col));
+		}
+
+	compiled_fields = fields;
+	compiled = std::move(columns);
+	}
+
+JSON::CellRenderer JSON::CompileType(TypeTag type)
+	{
+	// Keep this in sync with the batch-based BuildJSON().
+	switch ( type )
+		{
+		case TYPE_BOOL:
+			return &JSON::RenderBool;
+
+		case TYPE_INT:
+			return &JSON::RenderInt;
+
+		case TYPE_COUNT:
+		case TYPE_COUNTER:
+			return &JSON::RenderCount;
+
+		case TYPE_PORT:
+			return &JSON::RenderPort;
+
+		case TYPE_SUBNET:
+			return &JSON::RenderSubnet;
+
+		case TYPE_ADDR:
+			return &JSON::RenderAddr;
+
+		case TYPE_DOUBLE:
+		case TYPE_INTERVAL:
+			return &JSON::RenderDouble;
+
+		case TYPE_TIME:
+			return &JSON::RenderTime;
+
+		case TYPE_ENUM:
+		case TYPE_STRING:
+		case TYPE_FILE:
+		case TYPE_FUNC:
+			return &JSON::RenderString;
+
+		default:
+			return nullptr;
+		}
+	}
+
+void JSON::DescribeCompiled(ODesc* desc, const RecordBatch& batch, int row) const
+	{
+	std::string out;
+	out.reserve(256);
+	out.push_back('{');
+
+	for ( size_t i = 0; i < compiled.size(); i++ )
+		{
+		if ( ! batch.Present(row, i) )
+			continue;
+
+		const CompiledColumn& col = compiled[i];
+		const RecordBatch::Cell& c = batch.Get(row, i);
+
+		if ( out.size() > 1 )
+			out.push_back(',');
+
+		out.append(col.key);
+
+		if ( ! col.container )
+			{
+			(this->*col.render)(&out, batch, c);
+			continue;
+			}
+
+		out.push_back('[');
+
+		for ( int j = 0; j < batch.NumElements(c); j++ )
+			{
+			if ( j > 0 )
+				out.push_back(',');
+
+			if ( batch.ElementPresent(c, j) )
+				(this->*col.render)(&out, batch, batch.Element(c, j));
+			else
+				out.append("null");
+			}
+
+		out.push_back(']');
+		}
+
+	out.push_back('}');
+	desc->Add(out.c_str());
+	}
+
+void JSON::RenderBool(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const
+	{
+	out->append(c.int_val != 0 ? "true" : "false");
+	}
+
+void JSON::RenderInt(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const
+	{
+	char buf[32];
+	out->append(buf, rapidjson::internal::i64toa(c.int_val, buf) - buf);
+	}
+
+void JSON::RenderCount(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const
+	{
+	char buf[32];
+	out->append(buf, rapidjson::internal::u64toa(c.uint_val, buf) - buf);
+	}
+
+void JSON::RenderPort(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const
+	{
+	char buf[32];
+	out->append(buf, rapidjson::internal::u64toa(c.port_val.port, buf) - buf);
+	}
+
+void JSON::RenderSubnet(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const
+	{
+	std::string s = Formatter::Render(c.subnet_val);
+	append_json_string(out, s.data(), s.size());
+	}
+
+void JSON::RenderAddr(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const
+	{
+	char buf[INET6_ADDRSTRLEN];
+	size_t n = Formatter::Render(c.addr_val, buf);
+	append_json_string(out, buf, n);
+	}
+
+void JSON::RenderDouble(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const
+	{
+	// As NullDoubleWriter::Double().
+	if ( rapidjson::internal::Double(c.double_val).IsNanOrInf() )
+		{
+		out->append("null");
+		return;
+		}
+
+	char buf[25];
+	out->append(buf, rapidjson::internal::dtoa(c.double_val, buf) - buf);
+	}
+
+void JSON::RenderTime(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const
+	{
+	// As BuildTime().
+	if ( timestamps == TS_ISO8601 )
+		{
+		char buffer2[40];
+
+		if ( ! format_iso8601(c.double_val, buffer2) )
+			{
+			GetThread()->Error(GetThread()->Fmt("json formatter: failure getting time: (%lf)", c.double_val));
+			strcpy(buffer2, "2000-01-01T00:00:00.000000");
+			}
+
+		append_json_string(out, buffer2, strlen(buffer2));
+		}
+
+	else if ( timestamps == TS_EPOCH )
+		RenderDouble(out, batch, c);
+
+	else if ( timestamps == TS_MILLIS )
+		{
+		char buf[32];
+		out->append(buf, rapidjson::internal::u64toa((uint64_t) (c.double_val * 1000), buf) - buf);
+		}
+	}
+
+void JSON::RenderString(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const
+	{
+	append_json_value_string(out, batch.String(c), c.ref.length);
+	}
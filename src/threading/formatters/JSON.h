@@ -6,6 +6,8 @@
 #include "rapidjson/document.h"
 #include "rapidjson/writer.h"
 
+#include <vector>
+
 #include "../Formatter.h"
 
 namespace threading { namespace formatter {
@@ -28,8 +30,12 @@ public:
 	bool Describe(ODesc* desc, threading::Value* val, const std::string& name = "") const override;
 	bool Describe(ODesc* desc, int num_fields, const threading::Field* const * fields,
 	                      threading::Value** vals) const override;
+	bool Describe(ODesc* desc, int num_fields, const threading::Field* const * fields,
+	              const threading::RecordBatch& batch, int row) const override;
 	threading::Value* ParseValue(const std::string& s, const std::string& name, TypeTag type, TypeTag subtype = TYPE_ERROR) const override;
 
+	void Compile(int num_fields, const threading::Field* const * fields) override;
+
 	class NullDoubleWriter : public rapidjson::Writer<rapidjson::StringBuffer> {
 	public:
 		NullDoubleWriter(rapidjson::StringBuffer& stream) : rapidjson::Writer<rapidjson::StringBuffer>(stream) {}
@@ -38,9 +44,44 @@ public:
 
 private:
 	void BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& name = "") const;
+	void BuildJSON(NullDoubleWriter& writer, const RecordBatch& batch, TypeTag type,
+	               const RecordBatch::Cell& c) const;
+	void BuildTime(NullDoubleWriter& writer, double t) const;
+
+	// Appends the JSON for a single value of a column compiled with
+	// Compile().
+	typedef void (JSON::*CellRenderer)(std::string* out, const RecordBatch& batch,
+	                                   const RecordBatch::Cell& c) const;
+
+	struct CompiledColumn {
+		std::string key;	// The field name as a key, with quotes and colon.
+		CellRenderer render;	// For the value, or a container's elements.
+		bool container;
+	};
+
+	// Returns the renderer for a type, or null if there's none.
+	static CellRenderer CompileType(TypeTag type);
+
+	// Describe() for a batch with the columns compiled. This writes the
+	// JSON directly, the same as rapidjson would.
+	void DescribeCompiled(ODesc* desc, const RecordBatch& batch, int row) const;
+
+	void RenderBool(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const;
+	void RenderInt(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const;
+	void RenderCount(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const;
+	void RenderPort(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const;
+	void RenderSubnet(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const;
+	void RenderAddr(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const;
+	void RenderDouble(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const;
+	void RenderTime(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const;
+	void RenderString(std::string* out, const RecordBatch& batch, const RecordBatch::Cell& c) const;
 
 	TimeFormat timestamps;
 	bool surrounding_braces;
+
+	// Set by Compile(), empty if the fields can't be compiled.
+	const threading::Field* const * compiled_fields;
+	std::vector<CompiledColumn> compiled;
 };
 
 }}
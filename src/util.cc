@@ -954,6 +954,125 @@ bool is_file(const std::string& path)
 	return S_ISREG(st.st_mode);
 	}
 
+// Copies the content of one open file to another.
+static bool copy_fd(int in, int out)
+	{
+	char buf[65536];
+
+	while ( true )
+		{
+		ssize_t n = read(in, buf, sizeof(buf));
+
+		if ( n < 0 && errno == EINTR )
+			continue;
+
+		if ( n <= 0 )
+			return n == 0;
+
+		for ( ssize_t done = 0; done < n; )
+			{
+			ssize_t w = write(out, buf + done, n - done);
+
+			if ( w < 0 && errno == EINTR )
+				continue;
+
+			if ( w < 0 )
+				return false;
+
+			done += w;
+			}
+		}
+	}
+
+TEST_CASE("util move_file")
+	{
+	const char* tmp = getenv("TMPDIR");
+	string dir = tmp ? tmp : "/tmp";
+	string src = fmt("%s/zeek-move-file-%d", dir.c_str(), int(getpid()));
+	string dst = src + ".moved";
+
+	FILE* f = fopen(src.c_str(), "w");
+	REQUIRE(f);
+	fputs("some content\n", f);
+	fclose(f);
+
+	CHECK(move_file(src.c_str(), dst.c_str()));
+	CHECK(access(src.c_str(), F_OK) != 0);
+	CHECK(access(dst.c_str(), F_OK) == 0);
+
+	// Across file systems, if there's a second one at hand.
+	struct stat st_dir, st_shm;
+	string shm = fmt("/dev/shm/zeek-move-file-%d", int(getpid()));
+
+	if ( stat(dir.c_str(), &st_dir) == 0 && stat("/dev/shm", &st_shm) == 0 &&
+	     st_dir.st_dev != st_shm.st_dev )
+		{
+		CHECK(move_file(dst.c_str(), shm.c_str()));
+		CHECK(access(dst.c_str(), F_OK) != 0);
+
+		char buf[32] = {0};
+		f = fopen(shm.c_str(), "r");
+		REQUIRE(f);
+		CHECK(fgets(buf, sizeof(buf), f));
+		fclose(f);
+		CHECK(string(buf) == "some content\n");
+		unlink(shm.c_str());
+		}
+	else
+		unlink(dst.c_str());
+
+	CHECK(! move_file(src.c_str(), dst.c_str()));
+	CHECK(errno == ENOENT);
+	}
+
+bool move_file(const char* src, const char* dst)
+	{
+	if ( rename(src, dst) == 0 )
+		return true;
+
+	if ( errno != EXDEV )
+		return false;
+
+	int in = open(src, O_RDONLY);
+
+	if ( in < 0 )
+		return false;
+
+	struct stat st;
+	int out = -1;
+
+	if ( fstat(in, &st) == 0 )
+		out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 07777);
+
+	bool ok = out >= 0 && copy_fd(in, out);
+	int err = errno;
+
+	if ( out >= 0 && close(out) < 0 && ok )
+		{
+		// Some file systems only report write errors on close.
+		ok = false;
+		err = errno;
+		}
+
+	close(in);
+
+	if ( ok && unlink(src) < 0 )
+		{
+		ok = false;
+		err = errno;
+		}
+
+	if ( ! ok )
+		{
+		if ( out >= 0 )
+			unlink(dst);
+
+		errno = err;
+		}
+
+	return ok;
+	}
+
 TEST_CASE("util strreplace")
 	{
 	string s = "this is not a string";
@@ -193,6 +193,12 @@ bool is_dir(const std::string& path);
 // Returns true if path exists and is a file.
 bool is_file(const std::string& path);
 
+// Like rename(2), but if src and dst are on different file systems,
+// copies src over to dst and removes src afterwards, as mv(1) does.
+// Returns false and sets errno if that fails. This function is
+// thread-safe.
+extern bool move_file(const char* src, const char* dst);
+
 // Replaces all occurences of *o* in *s* with *n*.
 extern std::string strreplace(const std::string& s, const std::string& o, const std::string& n);
 
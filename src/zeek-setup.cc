@@ -37,14 +37,17 @@ extern "C" {
 #include "Desc.h"
 #include "Debug.h"
 #include "DFA.h"
+#include "DFACache.h"
 #include "RuleMatcher.h"
 #include "Anon.h"
 #include "EventRegistry.h"
 #include "Stats.h"
 #include "Brofiler.h"
+#include "ScriptProfiler.h"
 #include "Traverse.h"
 #include "Trigger.h"
 #include "Hash.h"
+#include "FlowShards.h"
 
 #include "supervisor/Supervisor.h"
 #include "threading/Manager.h"
@@ -276,6 +279,11 @@ void terminate_bro()
 	timer_mgr->Expire();
 	mgr.Drain();
 
+	if ( zeek::detail::script_profiler_running() )
+		zeek::detail::stop_script_profiler();
+
+	zeek::detail::save_dfa_cache();
+
 	if ( profiling_logger )
 		{
 		// FIXME: There are some occasional crashes in the memory
@@ -524,7 +532,17 @@ zeek::detail::SetupResult zeek::detail::setup(int argc, char** argv,
 	createCurrentDoc("1.0");		// Set a global XML document
 #endif
 
-	timer_mgr = new PQ_TimerMgr();
+	const char* timer_mgr_type = zeekenv("ZEEK_TIMER_MGR");
+
+	if ( timer_mgr_type && streq(timer_mgr_type, "wheel") )
+		timer_mgr = new Wheel_TimerMgr();
+	else
+		{
+		if ( timer_mgr_type && ! streq(timer_mgr_type, "pq") )
+			reporter->Warning("unknown ZEEK_TIMER_MGR '%s', using 'pq'", timer_mgr_type);
+
+		timer_mgr = new PQ_TimerMgr();
+		}
 
 	auto zeekygen_cfg = options.zeekygen_config_file.value_or("");
 	zeekygen_mgr = new zeekygen::Manager(zeekygen_cfg, bro_argv[0]);
@@ -643,6 +661,45 @@ zeek::detail::SetupResult zeek::detail::setup(int argc, char** argv,
 	if ( reporter->Errors() > 0 )
 		exit(1);
 
+	if ( ! options.parse_only && ! options.print_plugins )
+		{
+		auto all_signature_files = options.signature_files;
+
+		// Append signature files defined in "signature_files" script option
+		for ( auto&& sf : get_script_signature_files() )
+			all_signature_files.emplace_back(std::move(sf));
+
+		// Append signature files defined in @load-sigs
+		for ( const auto& sf : sig_files )
+			all_signature_files.emplace_back(sf);
+
+		if ( ! all_signature_files.empty() )
+			{
+			rule_matcher = new RuleMatcher(options.signature_re_level);
+			if ( ! rule_matcher->ReadFiles(all_signature_files) )
+				{
+				delete dns_mgr;
+				exit(1);
+				}
+
+			if ( options.print_signature_debug_info )
+				rule_matcher->PrintDebug();
+
+			file_mgr->InitMagic();
+			}
+
+		// All patterns have been compiled at this point.
+		zeek::detail::init_dfa_cache(dfa_cache_file->CheckString(),
+		                             dfa_cache_expand_states);
+		}
+
+	// Split into flow shards now that the scripts are parsed and the
+	// signatures compiled, so that all shards share that state, but
+	// before any threads get started.
+	if ( options.flow_shards && ! options.parse_only && ! options.print_plugins &&
+	     ! options.identifier_to_print )
+		zeek::fork_flow_shards(options.flow_shards);
+
 	iosource_mgr->InitPostScript();
 	plugin_mgr->InitPostScript();
 	zeekygen_mgr->InitPostScript();
@@ -693,31 +750,6 @@ zeek::detail::SetupResult zeek::detail::setup(int argc, char** argv,
 		id->SetVal(make_intrusive<StringVal>(*options.pcap_filter));
 		}
 
-	auto all_signature_files = options.signature_files;
-
-	// Append signature files defined in "signature_files" script option
-	for ( auto&& sf : get_script_signature_files() )
-		all_signature_files.emplace_back(std::move(sf));
-
-	// Append signature files defined in @load-sigs
-	for ( const auto& sf : sig_files )
-		all_signature_files.emplace_back(sf);
-
-	if ( ! all_signature_files.empty() )
-		{
-		rule_matcher = new RuleMatcher(options.signature_re_level);
-		if ( ! rule_matcher->ReadFiles(all_signature_files) )
-			{
-			delete dns_mgr;
-			exit(1);
-			}
-
-		if ( options.print_signature_debug_info )
-			rule_matcher->PrintDebug();
-
-		file_mgr->InitMagic();
-		}
-
 	if ( g_policy_debug )
 		// ### Add support for debug command file.
 		dbg_init_debugger(nullptr);
@@ -737,6 +769,8 @@ zeek::detail::SetupResult zeek::detail::setup(int argc, char** argv,
 			}
 		}
 
+	zeek::enter_flow_shard_dir(&options.pcap_file);
+
 	if ( dns_type != DNS_PRIME )
 		net_init(options.interface, options.pcap_file, options.pcap_output_file, options.use_watchdog);
 